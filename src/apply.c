@@ -35,27 +35,41 @@
 #include "lex.h"
 #include "grammar.h"
 #include "moves.h"
+#include "lists.h"
 #include "eco.h"
 #include "decode.h"
 #include "hashing.h"
 #include "fenmatcher.h"
 #include "zobrist.h"
+#include "prefixcache.h"
+#include "reachability.h"
+#include "posindex.h"
 
 /* Define a positional search depth that should look at the
  * full length of a game.  This is used in play_moves().
  */
 #define DEFAULT_POSITIONAL_DEPTH 300
+/* The least number of plies between checks of whether the
+ * positions of interest have become unreachable.
+ * A check costs time proportional to the number of positions,
+ * and a later check only delays giving up on a game.
+ */
+#ifndef REACHABILITY_CHECK_PLIES
+#define REACHABILITY_CHECK_PLIES 16
+#endif
 
 /* Prototypes of functions limited to this file. */
 static const char *position_matches(const Board *board);
+static Boolean material_may_match(const Board *board);
 static Boolean play_moves(Game *game_details, Board *board, Move *moves,
         unsigned max_depth, Boolean check_move_validity,
-        Boolean mainline);
+        Boolean mainline, PrefixNode *prefix, Boolean settle_ECO);
 static Boolean apply_variations(const Game *game_details, const Board *board,
         Variation *variation, Boolean check_move_validity);
 static Boolean rewrite_variations(const Board *board, Variation *variation);
 static Boolean rewrite_moves(Game *game, Board *board, Move *move_details);
 static void build_FEN_components(const Board *board, char *epd, char *fen_suffix);
+static void add_FEN_components(Move *move_details, const Board *board);
 static unsigned plies_in_move_sequence(Move *moves);
 static Boolean drop_plies_from_start(Game *game, Move *moves, int plies_to_drop);
 #if 0
@@ -616,6 +630,10 @@ new_fen_board(const char *fen)
         report_details(GlobalState.logfile);
 	print_error_context(GlobalState.logfile);
     }
+    if (new_board != NULL) {
+        set_board_bitboards(new_board);
+        set_zobrist_hash(new_board);
+    }
     return new_board;
 }
 
@@ -678,6 +696,8 @@ new_game_board(const char *fen)
         /* Use the initial board setup. */
         new_board = allocate_new_board();
         *new_board = initial_board;
+        set_board_bitboards(new_board);
+        set_zobrist_hash(new_board);
     }
 
     /* Generate the hash value for the initial position. */
@@ -872,13 +892,7 @@ apply_move(Move *move_details, Board *board)
             if (board->to_move == WHITE) {
                 board->move_number++;
             }
-            if (GlobalState.output_format == EPD || GlobalState.add_FEN_comments) {
-                char epd[FEN_SPACE], fen_suffix[FEN_SPACE];
-                build_FEN_components(board, epd, fen_suffix);
-                move_details->epd = copy_string(epd);
-                move_details->fen_suffix = copy_string(fen_suffix);
-            }
-
+            add_FEN_components(move_details, board);
         }
     }
     else {
@@ -887,18 +901,37 @@ apply_move(Move *move_details, Board *board)
     return Ok;
 }
 
+/* Keep the EPD and FEN suffix of board with move_details,
+ * if they will be needed for output.
+ */
+static void
+add_FEN_components(Move *move_details, const Board *board)
+{
+    if (GlobalState.output_format == EPD || GlobalState.add_FEN_comments) {
+        char epd[FEN_SPACE], fen_suffix[FEN_SPACE];
+        build_FEN_components(board, epd, fen_suffix);
+        move_details->epd = copy_string(epd);
+        move_details->fen_suffix = copy_string(fen_suffix);
+    }
+}
+
 /* Play out the moves on the given board.
  * These could be either the main line or a variation.
  * game_details is updated with the final_ and cumulative_ hash values.
  * Check move validity unless a NULL_MOVE has been found in this
  * variation.
+ * If prefix is not NULL then board is the standard starting position
+ * and moves found in the opening prefix cache are not played on board
+ * but taken from the cache, until the first move that is not found.
+ * If settle_ECO then the moves of the main line are only played until
+ * the ECO classification is settled, if it fails the ECO tag criteria.
  * Return TRUE if the game is valid and matches all matching criteria,
  * FALSE otherwise.
  */
 static Boolean
 play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
         Boolean check_move_validity,
-        Boolean mainline)
+        Boolean mainline, PrefixNode *prefix, Boolean settle_ECO)
 {
     Boolean game_ok = TRUE;
     /* Ply number at which any error was found. */
@@ -915,6 +948,33 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
     unsigned plies = board->move_number * 2 - (board->to_move == WHITE ? 1 : 0);
     /* Whether there has been an underpromotion. */
     Boolean underpromotion = FALSE;
+    /* The current position: either board or one in the prefix cache. */
+    const Board *position = board;
+    /* The deepest node of the prefix cache reached. */
+    PrefixNode *last_prefix = prefix;
+    /* Whether the game has been rejected before the end of its moves. */
+    Boolean rejected = FALSE;
+    /* Whether to stop looking for a positional match once
+     * captures and pawn moves make every position of interest unreachable.
+     * This is only done with --skiprejected, when a game that does
+     * not match is neither output nor matched in another way by
+     * play_moves, and errors in every game are not being checked for (-r).
+     */
+    Boolean settle_reachability = mainline && !game_matches &&
+            GlobalState.non_matching_file == NULL &&
+            !GlobalState.check_for_fifty_move_rule &&
+            GlobalState.skip_rejected_moves &&
+            !GlobalState.check_only;
+    /* The material and pawns when reachability was last checked. */
+    MaterialKey checked_material = board->material;
+    Bitboard checked_pawns = board->pieces[WHITE][PAWN] | board->pieces[BLACK][PAWN];
+    unsigned checked_plies = plies;
+    /* Whether the positions of interest can no longer be reached. */
+    Boolean unreachable = FALSE;
+    if (settle_reachability) {
+        reset_reachable_targets();
+        unreachable = !targets_remain_reachable(board);
+    }
     
     const char *match_label = NULL;
     
@@ -933,20 +993,32 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
             game_details->prefix_comment = comment;
         }
     }
+    /* The ECO classification can only be used to reject a game before
+     * the end of its moves with --skiprejected, when a broken game could
+     * not be wanted anyway, games that are not wanted are not output
+     * and errors in every game are not being checked for (-r).
+     */
+    settle_ECO = settle_ECO && mainline &&
+            GlobalState.add_ECO && !GlobalState.parsing_ECO_file &&
+            !GlobalState.keep_broken_games &&
+            GlobalState.non_matching_file == NULL &&
+            GlobalState.skip_rejected_moves &&
+            !GlobalState.check_only && ECO_tag_is_checked();
     /* Keep going while the game is ok, and we have some more
      * moves and we haven't exceeded the search depth without finding
      * a match.
      */
     while (game_ok &&
               (next_move != NULL) &&
-              (game_matches || (plies <= max_depth))) {
+              (game_matches || (plies <= max_depth && !unreachable)) &&
+              !rejected) {
         if (*(next_move->move) != '\0') {
             /* There might be a restriction on when to start checking for a match. */
             Boolean check_for_match = plies >= GlobalState.startply;
 
             /* See if there are any variations associated with this move. */
             if ((next_move->Variants != NULL) && GlobalState.keep_variations) {
-                game_matches |= apply_variations(game_details, board,
+                game_matches |= apply_variations(game_details, position,
                         next_move->Variants,
                         check_move_validity);
             }
@@ -961,40 +1033,82 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
 #endif
             }
             if (check_move_validity) {
-                if (apply_move(next_move, board)) {
+                Boolean move_ok;
+                PrefixNode *cached = NULL;
+
+                if (prefix != NULL) {
+                    cached = prefix_cache_find(prefix, next_move);
+                }
+                if (cached != NULL) {
+                    prefix_cache_resolve(cached, next_move);
+                    position = prefix_cache_position(cached);
+                    add_FEN_components(next_move, position);
+                    prefix = last_prefix = cached;
+                    move_ok = TRUE;
+                }
+                else {
+                    if (position != board) {
+                        /* Resume play from the cached position. */
+                        *board = *position;
+                        position = board;
+                    }
+                    move_ok = apply_move(next_move, board);
+                    if (move_ok && prefix != NULL) {
+                        /* Extend the cached line by this move only. */
+                        PrefixNode *added = prefix_cache_add(prefix, next_move, board);
+                        if (added != NULL) {
+                            last_prefix = added;
+                        }
+                    }
+                    prefix = NULL;
+                }
+                if (move_ok) {
+                    /* Captures, promotions and pawn moves might have put
+                     * the positions of interest out of reach.
+                     */
+                    if (settle_reachability && !game_matches &&
+                            plies >= checked_plies + REACHABILITY_CHECK_PLIES &&
+                            (position->material != checked_material ||
+                             (position->pieces[WHITE][PAWN] | position->pieces[BLACK][PAWN]) !=
+                                    checked_pawns)) {
+                        checked_material = position->material;
+                        checked_pawns = position->pieces[WHITE][PAWN] | position->pieces[BLACK][PAWN];
+                        checked_plies = plies;
+                        unreachable = !targets_remain_reachable(position);
+                    }
                     /* Don't try for a positional match if we already have one. */
-                    if (check_for_match && !game_matches && (match_label = position_matches(board)) != NULL) {
+                    if (check_for_match && !game_matches && (match_label = position_matches(position)) != NULL) {
                         game_matches = TRUE;
                         if (GlobalState.add_position_match_comments) {
-                            CommentList *comment = create_match_comment(board);
+                            CommentList *comment = create_match_comment(position);
                             append_comments_to_move(next_move, comment);
                         }
                     }
                     /* Combine this hash value with the cumulative one. */
-                    game_details->cumulative_hash_value += board->weak_hash_value;
+                    game_details->cumulative_hash_value += position->weak_hash_value;
                     if (check_for_match && GlobalState.fuzzy_match_duplicates) {
                         /* Consider remembering this hash value for fuzzy matches. */
                         if (GlobalState.fuzzy_match_depth == plies) {
                             /* Remember it. */
-                            game_details->fuzzy_duplicate_hash = board->weak_hash_value;
+                            game_details->fuzzy_duplicate_hash = position->weak_hash_value;
                         }
                     }
 
                     if (check_for_match && GlobalState.check_for_repetition) {
                         Boolean repetition =
-                            update_position_counts(game_details->position_counts, board);
+                            update_position_counts(game_details->position_counts, position);
                         if (repetition && GlobalState.add_position_match_comments) {
-                            CommentList *comment = create_match_comment(board);
+                            CommentList *comment = create_match_comment(position);
                             append_comments_to_move(next_move, comment);
                         }
                     }
 
                     if (check_for_match && GlobalState.check_for_fifty_move_rule && mainline) {
-                        if (board->halfmove_clock >= 100) {
+                        if (position->halfmove_clock >= 100) {
                             /* Fifty moves by both players with no pawn move or capture. */
                             fifty_move_rule_applies = TRUE;
                             if (GlobalState.add_position_match_comments) {
-                                CommentList *comment = create_match_comment(board);
+                                CommentList *comment = create_match_comment(position);
                                 append_comments_to_move(next_move, comment);
                             }
                         }
@@ -1011,7 +1125,7 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                         /* End of the game. */
                         if (check_for_match && GlobalState.fuzzy_match_duplicates &&
                                 GlobalState.fuzzy_match_depth == 0) {
-                            game_details->fuzzy_duplicate_hash = board->weak_hash_value;
+                            game_details->fuzzy_duplicate_hash = position->weak_hash_value;
                         }
                         /* Ensure that the result tag is consistent with the
                          * final status of the game.
@@ -1020,7 +1134,7 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                         const char *corrected_result = NULL;
                         if (result != NULL) {
                             if (next_move->check_status == CHECKMATE) {
-                                if (board->to_move == BLACK) {
+                                if (position->to_move == BLACK) {
                                     if (strncmp(result, "1-0", 3) != 0) {
                                         if (GlobalState.fix_result_tags) {
                                             corrected_result = "1-0";
@@ -1050,7 +1164,7 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                                 }
                             }
                             else {
-                                if (is_stalemate(board, NULL)) {
+                                if (is_stalemate(position, NULL)) {
                                     if (strncmp(result, "1/2", 3) != 0) {
                                         if (GlobalState.fix_result_tags) {
                                             corrected_result = "1/2-1/2";
@@ -1066,10 +1180,10 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                                 }
                             }
                             if (corrected_result != NULL) {
-                                free((void *) result);
+                                game_free((void *) result);
                                 game_details->tags[RESULT_TAG] = copy_string(corrected_result);
                                 if(next_move->terminating_result != NULL) {
-                                    free((void *) next_move->terminating_result);
+                                    game_free((void *) next_move->terminating_result);
                                     next_move->terminating_result = NULL;
                                 }
                                 next_move->terminating_result = copy_string(corrected_result);
@@ -1089,7 +1203,7 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                                 if(strcmp(move_result, "*") == 0 || 
                                         strcmp(result_tag, "*") == 0) {
                                     /* Prefer the move result. */
-                                    free((void *) result_tag);
+                                    game_free((void *) result_tag);
                                     game_details->tags[RESULT_TAG] = copy_string(move_result);
                                     report = FALSE;
                                 }
@@ -1115,9 +1229,9 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                     }
 
                     if (GlobalState.add_ECO && !GlobalState.parsing_ECO_file) {
-                        int half_moves = half_moves_played(board);
+                        int half_moves = half_moves_played(position);
                         EcoLog *entry = eco_matches(
-                                board->weak_hash_value,
+                                position->weak_hash_value,
                                 game_details->cumulative_hash_value,
                                 half_moves);
                         if (entry != NULL) {
@@ -1145,6 +1259,14 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                                 eco_match = entry;
                             }
                         }
+                        if (settle_ECO &&
+                                (unsigned) half_moves >= eco_half_move_limit()) {
+                            /* No later position can change the classification. */
+                            const char *eco = eco_match != NULL ?
+                                    eco_match->ECO_tag : game_details->tags[ECO_TAG];
+                            rejected = !check_ECO_value(eco);
+                            settle_ECO = FALSE;
+                        }
                     }
                     next_move = next_move->next;
                 }
@@ -1191,6 +1313,12 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
         }
         plies++;
     }
+    if (position != board) {
+        *board = *position;
+    }
+    if (last_prefix != NULL) {
+        prefix_cache_touch(last_prefix);
+    }
     /* Record whether the full game was checked or not. */
     game_details->moves_checked = next_move == NULL;
 
@@ -1204,19 +1332,19 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
         if (eco_match != NULL) {
             /* Free any details of the old one. */
             if (game_details->tags[ECO_TAG] != NULL) {
-                (void) free((void *) game_details->tags[ECO_TAG]);
+                game_free((void *) game_details->tags[ECO_TAG]);
                 game_details->tags[ECO_TAG] = NULL;
             }
             if (game_details->tags[OPENING_TAG] != NULL) {
-                (void) free((void *) game_details->tags[OPENING_TAG]);
+                game_free((void *) game_details->tags[OPENING_TAG]);
                 game_details->tags[OPENING_TAG] = NULL;
             }
             if (game_details->tags[VARIATION_TAG] != NULL) {
-                (void) free((void *) game_details->tags[VARIATION_TAG]);
+                game_free((void *) game_details->tags[VARIATION_TAG]);
                 game_details->tags[VARIATION_TAG] = NULL;
             }
             if (game_details->tags[SUB_VARIATION_TAG] != NULL) {
-                (void) free((void *) game_details->tags[SUB_VARIATION_TAG]);
+                game_free((void *) game_details->tags[SUB_VARIATION_TAG]);
                 game_details->tags[SUB_VARIATION_TAG] = NULL;
             }
 
@@ -1243,6 +1371,9 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
         if(GlobalState.match_underpromotion && !underpromotion) {
             game_matches = FALSE;
         }
+        if (rejected) {
+            game_matches = FALSE;
+        }
         
         /* Add a tag containing the matching FENPattern  label
          * if appropriate.
@@ -1384,7 +1515,7 @@ apply_variations(const Game *game_details, const Board *board, Variation *variat
          */
         variation_matches |= play_moves(copy_game, copy_board, variation->moves,
                 DEFAULT_POSITIONAL_DEPTH,
-                check_move_validity, FALSE);
+                check_move_validity, FALSE, NULL, FALSE);
         variation = variation->next;
     }
     (void) free((void *) copy_game);
@@ -1413,15 +1544,36 @@ apply_move_list(Game *game_details, unsigned *plycount, unsigned max_depth)
 
     /* Start off the cumulative hash value. */
     game_details->cumulative_hash_value = 0;
+    /* Not yet reached the fuzzy match depth. */
+    game_details->fuzzy_duplicate_hash = 0;
 
-    if (GlobalState.check_for_repetition && game_details->position_counts == NULL) {
-        game_details->position_counts = new_position_count_list(board);
+    if (GlobalState.check_for_repetition) {
+        if (game_details->position_counts == NULL) {
+            game_details->position_counts = new_position_count_list(board);
+        }
+        else {
+            /* The moves are being played again. */
+            reset_position_counts(game_details->position_counts, board);
+        }
     }
 
     /* Play through the moves and see if we have a match.
      * Check move validity.
+     * Games from the standard starting position may use the
+     * opening prefix cache.
      */
-    game_matches = play_moves(game_details, board, moves, max_depth, TRUE, TRUE);
+    game_matches = play_moves(game_details, board, moves, max_depth, TRUE, TRUE,
+            game_details->tags[FEN_TAG] == NULL ? prefix_cache_root() : NULL,
+            TRUE);
+
+    if (GlobalState.fuzzy_match_duplicates &&
+            game_details->fuzzy_duplicate_hash == 0) {
+        /* The game did not pass through the fuzzy match depth,
+         * because it is shorter or was set up beyond it,
+         * so match on its final position.
+         */
+        game_details->fuzzy_duplicate_hash = game_details->final_hash_value;
+    }
 
     /* Record how long the game was. */
     if (board->to_move == BLACK) {
@@ -1497,62 +1649,69 @@ rewrite_SAN_string(Colour colour, Move *move_details, Board *board)
     else {
         const unsigned char *move = move_details->move;
         MoveClass class = move_details->class;
-        MovePair *move_list = NULL;
+        MoveList move_list;
         Col to_col = move_details->to_col;
         Rank to_rank = move_details->to_rank;
         unsigned char new_move_str[MAX_MOVE_LEN + 1] = "";
 
-        switch (class) {
-            case PAWN_MOVE:
-            case ENPASSANT_PAWN_MOVE:
-            case PAWN_MOVE_WITH_PROMOTION:
-                move_list = find_pawn_moves(move_details->from_col,
-                        '0', to_col, to_rank,
-                        colour, board);
-                break;
-            case PIECE_MOVE:
-                switch (move_details->piece_to_move) {
-                    case KING:
-                        move_list = find_king_moves(to_col, to_rank, colour, board);
-                        break;
-                    case QUEEN:
-                        move_list = find_queen_moves(to_col, to_rank, colour, board);
-                        break;
-                    case ROOK:
-                        move_list = find_rook_moves(to_col, to_rank, colour, board);
-                        break;
-                    case KNIGHT:
-                        move_list = find_knight_moves(to_col, to_rank, colour, board);
-                        break;
-                    case BISHOP:
-                        move_list = find_bishop_moves(to_col, to_rank, colour, board);
-                        break;
-                    default:
-                        fprintf(GlobalState.logfile, "Unknown piece move %s\n", move);
-                        Ok = FALSE;
-                        break;
-                }
-                break;
-            case KINGSIDE_CASTLE:
-            case QUEENSIDE_CASTLE:
-                /* No move list to prepare. */
-                break;
-            case NULL_MOVE:
-                /* No move list to prepare. */
-                break;
-            case UNKNOWN_MOVE:
-            default:
-                fprintf(GlobalState.logfile,
-                        "Unknown move class in rewrite_SAN_string(%d).\n",
-                        move_details->class);
-                Ok = FALSE;
-                break;
+        move_list.num_moves = 0;
+        if (move_details->unambiguous) {
+            /* determine_move_details found this to be the only candidate,
+             * so there is no need to generate the alternatives again.
+             * The list's contents are not needed.
+             */
+            move_list.num_moves = 1;
         }
-        if (move_list != NULL) {
-            move_list = exclude_checks(move_details->piece_to_move, colour,
-                    move_list, board);
+        else {
+            switch (class) {
+                case PAWN_MOVE:
+                case ENPASSANT_PAWN_MOVE:
+                case PAWN_MOVE_WITH_PROMOTION:
+                    find_pawn_moves(move_details->from_col,
+                            '0', to_col, to_rank,
+                            colour, board, &move_list);
+                    break;
+                case PIECE_MOVE:
+                    switch (move_details->piece_to_move) {
+                        case KING:
+                            find_king_moves(to_col, to_rank, colour, board, &move_list);
+                            break;
+                        case QUEEN:
+                            find_queen_moves(to_col, to_rank, colour, board, &move_list);
+                            break;
+                        case ROOK:
+                            find_rook_moves(to_col, to_rank, colour, board, &move_list);
+                            break;
+                        case KNIGHT:
+                            find_knight_moves(to_col, to_rank, colour, board, &move_list);
+                            break;
+                        case BISHOP:
+                            find_bishop_moves(to_col, to_rank, colour, board, &move_list);
+                            break;
+                        default:
+                            fprintf(GlobalState.logfile, "Unknown piece move %s\n", move);
+                            Ok = FALSE;
+                            break;
+                    }
+                    break;
+                case KINGSIDE_CASTLE:
+                case QUEENSIDE_CASTLE:
+                    /* No move list to prepare. */
+                    break;
+                case NULL_MOVE:
+                    /* No move list to prepare. */
+                    break;
+                case UNKNOWN_MOVE:
+                default:
+                    fprintf(GlobalState.logfile,
+                            "Unknown move class in rewrite_SAN_string(%d).\n",
+                            move_details->class);
+                    Ok = FALSE;
+                    break;
+            }
+            exclude_checks(move_details->piece_to_move, colour, &move_list, board);
         }
-        if ((move_list == NULL) && (class != KINGSIDE_CASTLE) &&
+        if ((move_list.num_moves == 0) && (class != KINGSIDE_CASTLE) &&
                 (class != QUEENSIDE_CASTLE) && (class != NULL_MOVE)) {
             Ok = FALSE;
         }
@@ -1573,7 +1732,7 @@ rewrite_SAN_string(Colour colour, Move *move_details, Board *board)
                         new_move_str[new_move_index] = 'x';
                         new_move_index++;
                     }
-                    else if (move_list->next != NULL) {
+                    else if (move_list.num_moves > 1) {
                         new_move_str[new_move_index] = move_details->from_col;
                         new_move_index++;
                     }
@@ -1599,19 +1758,19 @@ rewrite_SAN_string(Colour colour, Move *move_details, Board *board)
                     strcpy((char *) &new_move_str[0], piece);
                     new_move_index += strlen(piece);
                     /* Check for the need to disambiguate. */
-                    if (move_list->next != NULL) {
+                    if (move_list.num_moves > 1) {
                         /* It is necessary.  Count how many times
                          * the from_ col and rank occur in the list
                          * of possibles in order to determine which to use
                          * for this purpose.
                          */
                         int col_times = 0, rank_times = 0;
-                        MovePair *possible;
                         Col from_col = move_details->from_col;
                         Rank from_rank = move_details->from_rank;
 
-                        for (possible = move_list; possible != NULL;
-                                possible = possible->next) {
+                        for (unsigned ix = 0; ix < move_list.num_moves; ix++) {
+                            const MovePair *possible = &move_list.moves[ix];
+
                             if (possible->from_col == from_col) {
                                 col_times++;
                             }
@@ -1684,9 +1843,6 @@ rewrite_SAN_string(Colour colour, Move *move_details, Board *board)
             strcpy((char *) move_details->move,
                     (const char *) new_move_str);
         }
-        if (move_list != NULL) {
-            free_move_pair_list(move_list);
-        }
     }
     return Ok;
 }
@@ -1828,7 +1984,7 @@ rewrite_moves(Game *game, Board *board, Move *moves)
                                               move_details->comment_list);
                     if(comment_to_replace != NULL) {
                         /* Replace it. */
-                        (void) free((void *) comment_to_replace->str);
+                        game_free((void *) comment_to_replace->str);
                         comment_to_replace->str = get_FEN_string(board);
                     }
                 }
@@ -2024,7 +2180,7 @@ drop_plies_from_start(Game *game, Move *moves, int plies_to_drop)
     }
     if(plies == plies_to_drop && game_ok) {
         if(fen != NULL) {
-            (void) free((void *) fen);
+            game_free((void *) fen);
         }
 #if 0
         /* Reset the move number. */
@@ -2059,6 +2215,66 @@ drop_plies_from_start(Game *game, Move *moves, int plies_to_drop)
     return game_ok;
 }
 
+/* The least and greatest material of the positions of interest,
+ * field by field, when material_targets_known.
+ */
+static Boolean material_targets_known = FALSE;
+static MaterialKey least_target_material, greatest_target_material;
+/* The greatest count in every field. */
+#define MATERIAL_ANY_COUNTS (MATERIAL_GUARD_BITS - (MATERIAL_GUARD_BITS >> (MATERIAL_FIELD_BITS - 1)))
+
+/* Widen the range of material of the positions of interest to
+ * include a position or pattern whose material lies between
+ * least and greatest, and that needs pawns on the squares of
+ * required_pawns (indexed by Colour, or NULL if none).
+ */
+void
+add_material_target(MaterialKey least, MaterialKey greatest, const Bitboard *required_pawns)
+{
+    add_reachability_target(least, required_pawns);
+    if (!material_targets_known) {
+        least_target_material = least;
+        greatest_target_material = greatest;
+        material_targets_known = TRUE;
+    }
+    else {
+        MaterialKey new_least = 0, new_greatest = 0;
+        for (Colour colour = BLACK; colour <= WHITE; colour++) {
+            for (Piece piece = PAWN; piece <= QUEEN; piece++) {
+                unsigned old_count = MATERIAL_COUNT(least_target_material, colour, piece);
+                unsigned count = MATERIAL_COUNT(least, colour, piece);
+                new_least += (count < old_count ? count : old_count) * MATERIAL_UNIT(colour, piece);
+
+                old_count = MATERIAL_COUNT(greatest_target_material, colour, piece);
+                count = MATERIAL_COUNT(greatest, colour, piece);
+                new_greatest += (count > old_count ? count : old_count) * MATERIAL_UNIT(colour, piece);
+            }
+        }
+        least_target_material = new_least;
+        greatest_target_material = new_greatest;
+    }
+}
+
+/* Return TRUE if the material on board lies within the range of
+ * the positions of interest, or the range is not known.
+ * Each field is compared at once by subtraction, with the guard bit
+ * of a field being left set if there is no borrow from it.
+ */
+static Boolean
+material_may_match(const Board *board)
+{
+    MaterialKey material = board->material;
+    if (!material_targets_known || material == MATERIAL_UNKNOWN) {
+        return TRUE;
+    }
+    else {
+        return ((((material | MATERIAL_GUARD_BITS) - least_target_material) &
+                        MATERIAL_GUARD_BITS) == MATERIAL_GUARD_BITS) &&
+               ((((greatest_target_material | MATERIAL_GUARD_BITS) - material) &
+                        MATERIAL_GUARD_BITS) == MATERIAL_GUARD_BITS);
+    }
+}
+
 /* Define a table to hold the positional hash codes of interest.
  * Size should be a prime number for collision avoidance.
  */
@@ -2112,6 +2328,16 @@ store_hash_value(Move *move_details, const char *fen)
         entry->next = non_polyglot_codes_of_interest[ix];
         non_polyglot_codes_of_interest[ix] = entry;
         using_non_polyglot = TRUE;
+        add_position_index_board(board);
+        if (board->material != MATERIAL_UNKNOWN) {
+            Bitboard pawns[2];
+            pawns[BLACK] = board->pieces[BLACK][PAWN];
+            pawns[WHITE] = board->pieces[WHITE][PAWN];
+            add_material_target(board->material, board->material, pawns);
+        }
+        else {
+            add_material_target(0, MATERIAL_ANY_COUNTS, NULL);
+        }
     }
     else {
         exit(1);
@@ -2178,6 +2404,9 @@ Boolean save_polyglot_hashcode(const char *value)
                 entry->next = polyglot_codes_of_interest[ix];
                 polyglot_codes_of_interest[ix] = entry;
                 using_polyglot = TRUE;
+                add_position_index_hash(hash);
+                /* The material of the position is not known. */
+                add_material_target(0, MATERIAL_ANY_COUNTS, NULL);
             }
             else {
                 fprintf(GlobalState.logfile, "Unrecognised hash value %s\n", value);
@@ -2204,6 +2433,10 @@ position_matches(const Board *board)
 {
     Boolean found = FALSE;
     
+    if(!material_may_match(board)) {
+        return NULL;
+    }
+    
     if(using_non_polyglot) {
         HashCode current_hash_value = board->weak_hash_value;
         unsigned ix = current_hash_value % MAX_NON_POLYGLOT_CODE;
@@ -2641,8 +2874,8 @@ evaluate(const Board *board)
 static double
 shannonEvaluation(const Board *board)
 {
-    MovePair *white_moves, *black_moves;
-    int whiteMoveCount = 0, blackMoveCount = 0;
+    MoveList moves;
+    int whiteMoveCount, blackMoveCount;
     int whitePieceCount = 0, blackPieceCount = 0;
     double shannonValue = 0.0;
 
@@ -2650,23 +2883,11 @@ shannonEvaluation(const Board *board)
     Col col;
 
     /* Determine the mobilities. */
-    white_moves = find_all_moves(board, WHITE);
-    if (white_moves != NULL) {
-        MovePair *m;
-        for (m = white_moves; m != NULL; m = m->next) {
-            whiteMoveCount++;
-        }
-        free_move_pair_list(white_moves);
-    }
+    find_all_moves(board, WHITE, &moves);
+    whiteMoveCount = moves.num_moves;
 
-    black_moves = find_all_moves(board, BLACK);
-    if (black_moves != NULL) {
-        MovePair *m;
-        for (m = black_moves; m != NULL; m = m->next) {
-            blackMoveCount++;
-        }
-        free_move_pair_list(black_moves);
-    }
+    find_all_moves(board, BLACK, &moves);
+    blackMoveCount = moves.num_moves;
 
 
     /* Pick up each piece of the required colour. */
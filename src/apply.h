@@ -24,6 +24,7 @@
 
 void store_hash_value(Move *move_details,const char *fen);
 Boolean save_polyglot_hashcode(const char *value);
+void add_material_target(MaterialKey least, MaterialKey greatest, const Bitboard *required_pawns);
 Boolean apply_move_list(Game *game_details,unsigned *plycount, unsigned max_depth);
 Boolean apply_move(Move *move_details, Board *board);
 Boolean apply_eco_move_list(Game *game_details,unsigned *number_of_half_moves);
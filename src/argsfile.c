@@ -157,7 +157,8 @@ usage_and_exit(void)
         "       otherwise num (or enum) means equal-to 'num' ply.",
         "-P -- don't match permutations of the textual variations (-v).",
         "-Rtagorder -- Use the tag ordering specified in the file tagorder.",
-        "-r -- report any errors but don't extract.",
+        "-r -- report any errors but don't extract. The moves of games that fail",
+        "      the -b, -p, ECO or positional criteria are still checked for errors.",
         "-S -- Use a simple soundex algorithm for some tag matches. If used",
         "      this option must precede the -t or -T options.",
         "-s -- silent mode: don't report each game as it is extracted.",
@@ -183,7 +184,7 @@ usage_and_exit(void)
         "                positions of interest.",
         "-yfile -- file contains a material balance of interest.",
         "-zfile -- file contains a material balance of interest.",
-        "-Z -- use the file virtual.tmp as an external hash table for duplicates.",
+        "-Z -- use a temporary file as an external hash table for duplicates.",
         "      Use when MallocOrDie messages occur with big datasets.",
 
         "",
@@ -194,12 +195,15 @@ usage_and_exit(void)
         "--allownullmoves - allow NULL moves in the main line",
         "--append - see -a",
 	"--btm - match position only if Black is to move (see -t)",
+        "--buildposindex file - write an index of the positions reached by the games to file.",
         "--checkfile - see -c",
         "--checkmate - see -M",
         "--commentlines - output each comment on a separate line",
         "--dropbefore - drop opening ply before a matching comment string",
         "--dropply - drop the given number of ply from the beginning of the game",
+        "--dupdb file - keep the hash values for duplicate detection in file between runs.",
         "--duplicates - see -d",
+        "--ecocache file - keep the table built from the ECO file in file between runs (see -e)",
         "--evaluation - include a position evaluation after each move",
         "--fencomments - include a FEN string after each move",
         "--fenpattern pattern - match games reaching a position matching the given FEN pattern",
@@ -208,6 +212,7 @@ usage_and_exit(void)
         "--fixresulttags - correct Result tags that conflict with the game outcome or terminating result.",
         "--fixtagstrings - attempt to correct tag strings that are not properly terminated.",
         "--fuzzydepth plies - positional duplicates match",
+        "--gameindex file - keep an index of where the games start in file, to read only the games selected by number.",
         "--hashcomments - include a hashcode string after each move",
         "--help - see -h",
         "--json - output the game in JSON format",
@@ -235,19 +240,24 @@ usage_and_exit(void)
         "--output - see -o",
         "--plycount - include a PlyCount tag.",
         "--plylimit - limit the number of plies output.",
+        "--prefixcache N - hold N positions in the cache of opening lines (default 8192, 0 for none).",
+        "--prefixstats - report how well the cache of opening lines worked.",
         "--quiescent N - position quiescence length (default 0)",
         "--quiet - No status processing output (see, also, -s).",
         "--repetition - only output games that include 3-fold repetition.",
         "--selectonly range[,range ...] - only output the selected matched game(s)",
         "--seven - see -7",
         "--skipmatching range[,range ...] - don't output the selected matched game(s)",
+        "--skiprejected - don't check the remaining moves of a game once it has been rejected",
         "--splitvariants [depth] - output each variation (to the given depth) as a separate game.",
         "--stalemate - only output games that end in stalemate.",
         "--startply N - only start matching after N ply (N >= 1).",
         "--stopafter N - stop after matching N games (N > 0)",
         "--tagsubstr - match in any part of a tag (see -T and -t).",
+        "--threads N - process games using N worker processes.",
         "--totalplycount - include a tag with the total number of plies in a game.",
         "--underpromotion - match only games that contain an underpromotion.",
+        "--useposindex file - read only the games that the index in file shows to reach a position of -H, -t or -x.",
         "--version - print the current version number and exit.",
 	"--wtm - match position only if White is to move (see -t)",
         "--xroster - don't output tags not included with the -R option (see -R).",
@@ -1036,6 +1046,17 @@ process_long_form_argument(const char *argument, const char *associated_value)
 	}
 	return 1;
     }
+    else if (stringcompare(argument, "buildposindex") == 0) {
+        if (associated_value != NULL) {
+            GlobalState.build_position_index = copy_string(associated_value);
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a file name following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "checkfile") == 0) {
         process_argument(CHECK_FILE_ARGUMENT, associated_value);
         return 2;
@@ -1074,10 +1095,32 @@ process_long_form_argument(const char *argument, const char *associated_value)
         }
         return 2;
     }
+    else if (stringcompare(argument, "dupdb") == 0) {
+        if (associated_value != NULL) {
+            GlobalState.duplicate_database = copy_string(associated_value);
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a file name following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "duplicates") == 0) {
         process_argument(DUPLICATES_FILE_ARGUMENT, associated_value);
         return 2;
     }
+    else if (stringcompare(argument, "ecocache") == 0) {
+        if (associated_value != NULL) {
+            GlobalState.eco_cache_file = copy_string(associated_value);
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a file name following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "evaluation") == 0) {
         /* Output an evaluation is required with each move. */
         GlobalState.output_evaluation = TRUE;
@@ -1147,6 +1190,17 @@ process_long_form_argument(const char *argument, const char *associated_value)
         }
         return 2;
     }
+    else if (stringcompare(argument, "gameindex") == 0) {
+        if (associated_value != NULL) {
+            GlobalState.game_index = copy_string(associated_value);
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a file name following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "hashcomments") == 0) {
         /* Output a hashcode comment after each move. */
         GlobalState.add_hashcode_comments = TRUE;
@@ -1347,6 +1401,31 @@ process_long_form_argument(const char *argument, const char *associated_value)
         }
         return 2;
     }
+    else if (stringcompare(argument, "prefixcache") == 0) {
+        int size = 0;
+
+        /* Extract the number of positions. */
+        if (sscanf(associated_value, "%d", &size) == 1) {
+            if (size >= 0) {
+                GlobalState.prefix_cache_size = size;
+            }
+            else {
+                fprintf(GlobalState.logfile,
+                        "--%s requires a number greater than or equal to zero.\n", argument);
+                exit(1);
+            }
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a number following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
+    else if (stringcompare(argument, "prefixstats") == 0) {
+        GlobalState.report_prefix_cache = TRUE;
+        return 1;
+    }
     else if (stringcompare(argument, "quiescent") == 0) {
         int threshold = 0;
 
@@ -1405,6 +1484,10 @@ process_long_form_argument(const char *argument, const char *associated_value)
         }
         return 2;
     }
+    else if (stringcompare(argument, "skiprejected") == 0) {
+        GlobalState.skip_rejected_moves = TRUE;
+        return 1;
+    }
     else if (stringcompare(argument, "splitvariants") == 0) {
         if(GlobalState.keep_variations) {
             GlobalState.split_variants = TRUE;
@@ -1485,6 +1568,20 @@ process_long_form_argument(const char *argument, const char *associated_value)
         GlobalState.tag_match_anywhere = TRUE;
         return 1;
     }
+    else if (stringcompare(argument, "threads") == 0) {
+        int threads = 0;
+
+        /* Extract the number of workers. */
+        if (sscanf(associated_value, "%d", &threads) == 1 && threads > 0) {
+            GlobalState.num_threads = threads;
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a number greater than zero to follow it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "totalplycount") == 0) {
         GlobalState.output_total_plycount = TRUE;
         return 1;
@@ -1493,6 +1590,17 @@ process_long_form_argument(const char *argument, const char *associated_value)
         GlobalState.match_underpromotion = TRUE;
         return 1;
     }
+    else if (stringcompare(argument, "useposindex") == 0) {
+        if (associated_value != NULL) {
+            GlobalState.use_position_index = copy_string(associated_value);
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a file name following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "version") == 0) {
         fprintf(GlobalState.logfile, "pgn-extract %s\n", CURRENT_VERSION);
         exit(0);
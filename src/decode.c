@@ -41,6 +41,33 @@
 #include "taglist.h"
 #include "lex.h"
 
+/* The number of entries in the cache of decoded moves.
+ * Must be a power of 2.
+ */
+#define DECODED_MOVES 4096
+
+/* The details that decode_move gleans from the text of a move. */
+typedef struct {
+    unsigned char move[MAX_MOVE_LEN + 1];
+    MoveClass class;
+    Piece piece_to_move;
+    Col from_col;
+    Rank from_rank;
+    Col to_col;
+    Rank to_rank;
+} DecodedMove;
+
+/* A cache of the move texts decoded most recently.
+ * The same few thousand texts account for nearly all the moves
+ * of most games, so each text is decoded once and its details
+ * copied thereafter.
+ * The entry for a text is selected by its hash value and is
+ * replaced by that of any other text with the same selection.
+ */
+static DecodedMove decoded_moves[DECODED_MOVES];
+
+static Move *decode_move_text(const unsigned char *move_string);
+
 /* Does the character represent a column of the board? */
 Boolean
 is_col(char c)
@@ -132,13 +159,14 @@ is_check(char c)
 Move *
 new_move_structure(void)
 {
-    Move *move = (Move *) malloc_or_die(sizeof (Move));
+    Move *move = (Move *) game_alloc(sizeof (Move));
 
     move->terminating_result = NULL;
     move->piece_to_move = EMPTY;
     move->captured_piece = EMPTY;
     move->promoted_piece = EMPTY;
     move->check_status = NOCHECK;
+    move->unambiguous = FALSE;
     move->epd = NULL;
     move->fen_suffix = NULL;
     move->zobrist = ~0;
@@ -151,6 +179,49 @@ new_move_structure(void)
     return move;
 }
 
+/* Return a new move structure for move_string, with whatever
+ * can be gleaned from the text of the starting and ending points
+ * of the move.
+ * Only the texts of valid moves are cached, so that any
+ * errors are reported for every occurrence.
+ */
+Move *
+decode_move(const unsigned char *move_string)
+{
+    unsigned hash = 0;
+    const unsigned char *c;
+    DecodedMove *decoded;
+    Move *move_details;
+
+    for (c = move_string; *c != '\0'; c++) {
+        hash = (hash * 31) + *c;
+    }
+    decoded = &decoded_moves[hash & (DECODED_MOVES - 1)];
+    if (strcmp((const char *) decoded->move, (const char *) move_string) == 0) {
+        move_details = new_move_structure();
+        strcpy((char *) move_details->move, (const char *) move_string);
+        move_details->class = decoded->class;
+        move_details->piece_to_move = decoded->piece_to_move;
+        move_details->from_col = decoded->from_col;
+        move_details->from_rank = decoded->from_rank;
+        move_details->to_col = decoded->to_col;
+        move_details->to_rank = decoded->to_rank;
+    }
+    else {
+        move_details = decode_move_text(move_string);
+        if (move_details->class != UNKNOWN_MOVE) {
+            strcpy((char *) decoded->move, (const char *) move_string);
+            decoded->class = move_details->class;
+            decoded->piece_to_move = move_details->piece_to_move;
+            decoded->from_col = move_details->from_col;
+            decoded->from_rank = move_details->from_rank;
+            decoded->to_col = move_details->to_col;
+            decoded->to_rank = move_details->to_rank;
+        }
+    }
+    return move_details;
+}
+
 /* Work out whatever can be gleaned from move_string of
  * the starting and ending points of the given move.
  * The move may be any legal string.
@@ -158,8 +229,8 @@ new_move_structure(void)
  * illegal moves having already been filtered out by the process
  * of lexical analysis.
  */
-Move *
-decode_move(const unsigned char *move_string)
+static Move *
+decode_move_text(const unsigned char *move_string)
 { /* The four components of the co-ordinates when known. */
     Rank from_rank = 0, to_rank = 0;
     Col from_col = 0, to_col = 0;
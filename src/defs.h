@@ -85,6 +85,35 @@ typedef char Col;
  */
 typedef uint64_t HashCode;
 
+/* A set of squares, one bit per square, with a1 as the
+ * least significant bit, then b1, ..., h1, a2, ...
+ */
+typedef uint64_t Bitboard;
+
+/* The number of pieces of each kind, other than kings, of each colour,
+ * packed into fields of MATERIAL_FIELD_BITS bits so that all the
+ * counts can be compared at once.
+ * The top bit of each field is a guard bit that is always clear in a key.
+ * A position with more than MATERIAL_MAX_COUNT of any kind of piece
+ * has the key MATERIAL_UNKNOWN.
+ */
+typedef uint64_t MaterialKey;
+#define MATERIAL_FIELD_BITS 6
+#define MATERIAL_MAX_COUNT ((1 << (MATERIAL_FIELD_BITS - 1)) - 1)
+/* The number of kinds of piece counted for each colour: PAWN to QUEEN. */
+#define MATERIAL_KINDS (QUEEN - PAWN + 1)
+#define MATERIAL_SHIFT(colour, piece) \
+    ((((colour) * MATERIAL_KINDS) + ((piece) - PAWN)) * MATERIAL_FIELD_BITS)
+/* The key of a single piece. */
+#define MATERIAL_UNIT(colour, piece) \
+    ((piece) >= PAWN && (piece) <= QUEEN ? \
+        ((MaterialKey) 1) << MATERIAL_SHIFT(colour, piece) : (MaterialKey) 0)
+#define MATERIAL_COUNT(key, colour, piece) \
+    ((unsigned) (((key) >> MATERIAL_SHIFT(colour, piece)) & MATERIAL_MAX_COUNT))
+#define MATERIAL_UNKNOWN (((MaterialKey) 1) << 63)
+/* The guard bit of every field of a MaterialKey. */
+#define MATERIAL_GUARD_BITS ((MaterialKey) 0x0820820820820820ULL)
+
 typedef struct {
     Piece board[HEDGE+BOARDSIZE+HEDGE][HEDGE+BOARDSIZE+HEDGE];
     /* Who has the next move. */
@@ -112,25 +141,46 @@ typedef struct {
      * that really needs updating to properly use the Zobrist hash.
      */
     HashCode weak_hash_value;
-    /* Provision for storing a Zobrist hash value. However,
-     * this is only set if GlobalState.add_hashcode_comments.
+    /* The Zobrist hash of the piece placement and castling rights,
+     * kept up to date by make_move.  generate_zobrist_hash_from_board
+     * adds the side to move and en passant details to this.
      * At some point, it should supersede the weak_hash_value.
      */
     uint64_t zobrist;
     /* The half-move clock since the last pawn move or capture. */
     unsigned halfmove_clock;
+    /* The squares occupied by each piece of each colour, indexed
+     * by Colour and Piece, and by all the pieces of each colour.
+     * These mirror board: see set_board_bitboards and make_move.
+     */
+    Bitboard pieces[2][NUM_PIECE_VALUES];
+    Bitboard occupied[2];
+    /* The material on the board, kept up to date by make_move. */
+    MaterialKey material;
 } Board;
 
-/* Define a type that can be used to create a list of possible source
- * squares for a move.
+/* Define a type that can be used to hold the source and destination
+ * squares of a possible move.
  */
-typedef struct move_pair {
+typedef struct {
     Col from_col;
     Rank from_rank;
     Col to_col;
     Rank to_rank;
-    struct move_pair *next;
 } MovePair;
+
+/* The capacity of a MoveList.
+ * No legal position has more than 218 moves.
+ */
+#define MAX_MOVES 256
+
+/* A list of possible moves.  These are intended to be held on the
+ * stack, so that finding moves involves no dynamic allocation.
+ */
+typedef struct {
+    unsigned num_moves;
+    MovePair moves[MAX_MOVES];
+} MoveList;
     
 /* Conversion macros. */
 #define PIECE_SHIFT 3
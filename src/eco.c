@@ -25,6 +25,7 @@
 #include <ctype.h>
 #include "bool.h"
 #include "mymalloc.h"
+#include "lines.h"
 #include "defs.h"
 #include "typedef.h"
 #include "map.h"
@@ -33,6 +34,7 @@
 #include "lex.h"
 #include "eco.h"
 #include "apply.h"
+#include "outputcache.h"
 
 /* Place a limit on how distant a position may be from the ECO line
  * it purports to match. This is to try to stop collisions way past
@@ -47,10 +49,72 @@
 static unsigned maximum_half_moves = ECO_HALF_MOVE_LIMIT;
 
 /* Define a table to hold hash values of the ECO positions.
- * This is used to enable duplicate detection.
+ * This is an open-addressing table, with linear probing from the
+ * slot selected by the low bits of the required hash value.
+ * It is kept no more than half full, doubling in size when necessary,
+ * so its size suits the number of ECO lines.
+ * Entries with the same required hash value lie along the same
+ * probe sequence in the order in which they were added.
+ * The tags of each entry are held separately in EcoDetails.
  */
-#define ECO_TABLE_SIZE 4096
-static EcoLog **EcoTable;
+#define INITIAL_ECO_TABLE_SIZE 1024
+
+typedef struct {
+    HashCode required_hash_value;
+    /* cumulative_hash_value is used to disambiguate clashing
+     * final hash values in duplicate detection.
+     */
+    HashCode cumulative_hash_value;
+    /* How deep the line is, from the half_moves associated with
+     * the board when the line is played out.
+     */
+    uint32_t half_moves;
+    /* One more than the index of the entry's tags in EcoDetails.
+     * 0 => an empty slot.
+     */
+    uint32_t details;
+} EcoEntry;
+
+static EcoEntry *EcoTable = NULL;
+/* The number of slots in EcoTable: a power of two. */
+static unsigned eco_table_size = 0;
+/* Whether EcoTable is held in a mapped ECO cache. */
+static Boolean eco_table_cached = FALSE;
+/* The tags of the entries, in the order in which they were added. */
+static EcoLog *EcoDetails = NULL;
+static unsigned num_eco_entries = 0, max_eco_entries = 0;
+
+/* An ECO cache file (--ecocache) holds the contents of EcoTable,
+ * so that the ECO file need not be parsed on every run.
+ * The file starts with an EcoCacheHeader, which is followed by
+ * the slots of EcoTable, an EcoCacheDetails for each entry and then
+ * the nul-terminated tag strings, each of which is stored only once.
+ * The slots are used where they lie in the file.
+ * Values are stored in the byte order of the machine.
+ * The cache is rebuilt if it does not match the ECO file.
+ */
+#define ECO_CACHE_MAGIC "PGNXECO2"
+
+typedef struct {
+    char magic[8];
+    uint64_t byte_order;
+    /* The size and checksum of the ECO file. */
+    uint64_t source_size, source_checksum;
+    uint64_t table_size;
+    uint64_t num_entries;
+    uint64_t strings_length;
+} EcoCacheHeader;
+
+/* The indices of the tag strings of an EcoCacheDetails. */
+enum { CACHED_ECO, CACHED_OPENING, CACHED_VARIATION, CACHED_SUB_VARIATION,
+       NUM_CACHED_TAGS };
+
+typedef struct {
+    /* One more than the offset of each tag string.
+     * 0 => no string.
+     */
+    uint32_t tags[NUM_CACHED_TAGS];
+} EcoCacheDetails;
 
 #if INCLUDE_UNUSED_FUNCTIONS
 
@@ -58,15 +122,13 @@ static void
 dumpEcoTable(void)
 {
     unsigned ix;
-    for (ix = 0; ix < ECO_TABLE_SIZE; ix++) {
-        if (EcoTable[ix] != NULL) {
-            EcoLog *entry = NULL;
-            for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
-                fprintf(stderr, "%s %lu %lu ", entry->ECO_tag,
-                        entry->required_hash_value,
-                        entry->cumulative_hash_value);
-            }
-            fprintf(stderr, "\n");
+    for (ix = 0; ix < eco_table_size; ix++) {
+        const EcoEntry *entry = &EcoTable[ix];
+        if (entry->details != 0) {
+            fprintf(stderr, "%u %s %lu %lu\n", ix,
+                    EcoDetails[entry->details - 1].ECO_tag,
+                    entry->required_hash_value,
+                    entry->cumulative_hash_value);
         }
     }
 }
@@ -81,7 +143,7 @@ dumpEcoTable(void)
  * a game.
  */
 static int
-eco_match_level(EcoLog *entry, HashCode current_hash_value,
+eco_match_level(const EcoEntry *entry, HashCode current_hash_value,
         HashCode cumulative_hash_value, unsigned half_moves_played)
 {
     int level = 0;
@@ -109,7 +171,7 @@ static int ECO_CUMULATIVE_HASH_VALUE = 0;
 /* Rate the quality of the given match.
  * Currently unused.
  */
-static int eco_match_quality(EcoLog* entry,
+static int eco_match_quality(const EcoEntry* entry,
         HashCode current_hash_value,
         HashCode cumulative_hash_value,
         int half_moves_played)
@@ -117,7 +179,7 @@ static int eco_match_quality(EcoLog* entry,
     int quality = 0;
     if (entry->required_hash_value == current_hash_value) {
         quality += ECO_REQUIRED_HASH_VALUE;
-        if (abs(half_moves_played - entry->half_moves) <= ECO_HALF_MOVE_LIMIT) {
+        if (abs(half_moves_played - (int) entry->half_moves) <= ECO_HALF_MOVE_LIMIT) {
             quality += ECO_HALF_MOVE_VALUE;
         }
         if (entry->cumulative_hash_value == cumulative_hash_value) {
@@ -128,17 +190,67 @@ static int eco_match_quality(EcoLog* entry,
 }
 #endif
 
+/* Give EcoTable size empty slots. */
+static void
+allocate_eco_table(unsigned size)
+{
+    unsigned ix;
+
+    EcoTable = (EcoEntry *) malloc_or_die(size * sizeof (*EcoTable));
+    for (ix = 0; ix < size; ix++) {
+        EcoTable[ix].details = 0;
+    }
+    eco_table_size = size;
+}
+
 void initEcoTable(void)
 {
     /* Avoid multiple calls. */
     if (EcoTable == NULL) {
-        int i;
-        EcoTable = (EcoLog **) malloc_or_die(ECO_TABLE_SIZE * sizeof (EcoLog *));
+        allocate_eco_table(INITIAL_ECO_TABLE_SIZE);
+    }
+}
 
-        for (i = 0; i < ECO_TABLE_SIZE; i++) {
-            EcoTable[i] = NULL;
+/* Place entry in the first free slot of its probe sequence. */
+static void
+place_eco_entry(const EcoEntry *entry)
+{
+    unsigned mask = eco_table_size - 1;
+    unsigned ix = (unsigned) entry->required_hash_value & mask;
+
+    while (EcoTable[ix].details != 0) {
+        ix = (ix + 1) & mask;
+    }
+    EcoTable[ix] = *entry;
+    /* Check for a new greater depth. */
+    if (entry->half_moves + ECO_HALF_MOVE_LIMIT > maximum_half_moves) {
+        maximum_half_moves = entry->half_moves + ECO_HALF_MOVE_LIMIT;
+    }
+}
+
+/* Double the size of EcoTable.
+ * The entries are placed again in the order in which they were added
+ * to keep the order of those with the same required hash value.
+ */
+static void
+grow_eco_table(void)
+{
+    EcoEntry *old_table = EcoTable;
+    unsigned old_size = eco_table_size;
+    EcoEntry *entries = (EcoEntry *) malloc_or_die(num_eco_entries * sizeof (*entries));
+    unsigned ix;
+
+    for (ix = 0; ix < old_size; ix++) {
+        if (old_table[ix].details != 0) {
+            entries[old_table[ix].details - 1] = old_table[ix];
         }
     }
+    allocate_eco_table(2 * old_size);
+    for (ix = 0; ix < num_eco_entries; ix++) {
+        place_eco_entry(&entries[ix]);
+    }
+    (void) free((void *) entries);
+    (void) free((void *) old_table);
 }
 
 /* Enter the ECO details of game into EcoTable.
@@ -146,24 +258,25 @@ void initEcoTable(void)
 void
 save_eco_details(Game game_details, unsigned number_of_half_moves)
 {
-    unsigned ix = game_details.final_hash_value % ECO_TABLE_SIZE;
-    EcoLog *entry = NULL;
+    unsigned mask = eco_table_size - 1;
+    unsigned ix = (unsigned) game_details.final_hash_value & mask;
     /* Assume that it can be saved: that there is no collision. */
     Boolean can_save = TRUE;
-    /* In an effort to save string space, keep a record of the
-     * last entry stored, because there is a good chance that it
-     * will have the same ECO_tag and Opening_tag as the next
-     * one.
+    /* In an effort to save string space, use the last entry stored,
+     * because there is a good chance that it will have the same
+     * ECO_tag and Opening_tag as the next one.
      */
-    static EcoLog *last_entry = NULL;
+    const EcoLog *last_entry = num_eco_entries > 0 ? &EcoDetails[num_eco_entries - 1] : NULL;
 
-    for (entry = EcoTable[ix]; (entry != NULL) && can_save; entry = entry->next) {
+    for (; (EcoTable[ix].details != 0) && can_save; ix = (ix + 1) & mask) {
+        const EcoEntry *entry = &EcoTable[ix];
         if ((entry->required_hash_value == game_details.final_hash_value) &&
                 (entry->half_moves == number_of_half_moves) &&
                 (entry->cumulative_hash_value == game_details.cumulative_hash_value)) {
-            const char *tag = entry->ECO_tag,
-                    *opening = entry->Opening_tag,
-                    *variation = entry->Variation_tag;
+            const EcoLog *details = &EcoDetails[entry->details - 1];
+            const char *tag = details->ECO_tag,
+                    *opening = details->Opening_tag,
+                    *variation = details->Variation_tag;
             if (tag == NULL) {
                 tag = "";
             }
@@ -196,106 +309,131 @@ save_eco_details(Game game_details, unsigned number_of_half_moves)
     }
 
     if (can_save) {
-        /* First occurrence, so add it to the log. */
-        entry = (EcoLog *) malloc_or_die(sizeof (*entry));
+        /* First occurrence, so add it to the table. */
+        EcoEntry entry;
+        EcoLog *details;
 
-        entry->required_hash_value = game_details.final_hash_value;
-        entry->cumulative_hash_value = game_details.cumulative_hash_value;
+        if (2 * (num_eco_entries + 1) > eco_table_size) {
+            grow_eco_table();
+        }
+        if (num_eco_entries == max_eco_entries) {
+            max_eco_entries = max_eco_entries == 0 ? INITIAL_ECO_TABLE_SIZE : 2 * max_eco_entries;
+            EcoDetails = (EcoLog *) realloc_or_die((void *) EcoDetails,
+                    max_eco_entries * sizeof (*EcoDetails));
+            if (last_entry != NULL) {
+                last_entry = &EcoDetails[num_eco_entries - 1];
+            }
+        }
+        details = &EcoDetails[num_eco_entries];
+        num_eco_entries++;
+
+        entry.required_hash_value = game_details.final_hash_value;
+        entry.cumulative_hash_value = game_details.cumulative_hash_value;
         /* Keep a record of the current move number as a sanity
          * check on matches.
          */
-        entry->half_moves = number_of_half_moves;
-        /* Check for a new greater depth. */
-        if (number_of_half_moves + ECO_HALF_MOVE_LIMIT > maximum_half_moves) {
-            maximum_half_moves = number_of_half_moves + ECO_HALF_MOVE_LIMIT;
-        }
+        entry.half_moves = number_of_half_moves;
+        entry.details = num_eco_entries;
         if (game_details.tags[ECO_TAG] != NULL) {
             if ((last_entry != NULL) && (last_entry->ECO_tag != NULL) &&
                     (strcmp(last_entry->ECO_tag, game_details.tags[ECO_TAG]) == 0)) {
                 /* Share the last entry's tag. */
-                entry->ECO_tag = last_entry->ECO_tag;
+                details->ECO_tag = last_entry->ECO_tag;
             }
             else {
-                entry->ECO_tag = copy_string(game_details.tags[ECO_TAG]);
+                details->ECO_tag = copy_string(game_details.tags[ECO_TAG]);
             }
         }
         else {
-            entry->ECO_tag = NULL;
+            details->ECO_tag = NULL;
         }
         if (game_details.tags[OPENING_TAG] != NULL) {
             if ((last_entry != NULL) && (last_entry->Opening_tag != NULL) &&
                     (strcmp(last_entry->Opening_tag,
                     game_details.tags[OPENING_TAG]) == 0)) {
                 /* Share the last entry's tag. */
-                entry->Opening_tag = last_entry->Opening_tag;
+                details->Opening_tag = last_entry->Opening_tag;
             }
             else {
-                entry->Opening_tag = copy_string(game_details.tags[OPENING_TAG]);
+                details->Opening_tag = copy_string(game_details.tags[OPENING_TAG]);
             }
         }
         else {
-            entry->Opening_tag = NULL;
+            details->Opening_tag = NULL;
         }
         if (game_details.tags[VARIATION_TAG] != NULL) {
-            entry->Variation_tag = copy_string(game_details.tags[VARIATION_TAG]);
+            details->Variation_tag = copy_string(game_details.tags[VARIATION_TAG]);
         }
         else {
-            entry->Variation_tag = NULL;
+            details->Variation_tag = NULL;
         }
         if (game_details.tags[SUB_VARIATION_TAG] != NULL) {
-            entry->Sub_Variation_tag =
+            details->Sub_Variation_tag =
                     copy_string(game_details.tags[SUB_VARIATION_TAG]);
         }
         else {
-            entry->Sub_Variation_tag = NULL;
+            details->Sub_Variation_tag = NULL;
         }
-        /* Link it into the head at this index. */
-        entry->next = EcoTable[ix];
-        EcoTable[ix] = entry;
-        /* Keep this one for next time around. */
-        last_entry = entry;
+        place_eco_entry(&entry);
     }
 }
 
+/* Return the number of half moves beyond which eco_matches
+ * finds no match, so the classification of a game is settled.
+ */
+unsigned
+eco_half_move_limit(void)
+{
+    return maximum_half_moves;
+}
+
 /* Look in EcoTable for current_hash_value.
  * Use cumulative_hash_value to refine the match.
  * An exact match is preferable to a partial match.
+ * The most recently added exact match is preferred, and otherwise
+ * the earliest added partial match.
  */
 EcoLog *
 eco_matches(HashCode current_hash_value, HashCode cumulative_hash_value,
         unsigned half_moves_played)
 {
+    EcoLog *exact = NULL;
     EcoLog *possible = NULL;
 
     /* Don't bother trying if we are too far on in the game.  */
-    if (half_moves_played <= maximum_half_moves) {
+    if (half_moves_played <= maximum_half_moves && num_eco_entries > 0) {
         /* Where to look. */
-        unsigned ix = current_hash_value % ECO_TABLE_SIZE;
-        EcoLog *entry;
+        unsigned mask = eco_table_size - 1;
+        unsigned ix = (unsigned) current_hash_value & mask;
+        const EcoEntry *entry;
 
-        for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
+        for (entry = &EcoTable[ix]; entry->details != 0; entry = &EcoTable[ix]) {
             if (entry->required_hash_value == current_hash_value) {
                 /* See if we have a full match. */
                 if (half_moves_played == entry->half_moves &&
                         entry->cumulative_hash_value == cumulative_hash_value) {
-                    return entry;
+                    exact = &EcoDetails[entry->details - 1];
                 }
-                else if ((half_moves_played - entry->half_moves) <=
-                        ECO_HALF_MOVE_LIMIT) {
+                else if (possible == NULL &&
+                        entry->half_moves <= half_moves_played &&
+                        (half_moves_played - entry->half_moves) <=
+                            ECO_HALF_MOVE_LIMIT) {
                     /* Retain this as a possible. */
-                    possible = entry;
+                    possible = &EcoDetails[entry->details - 1];
                 }
                 else {
                     /* Ignore it, as the lines are too distant. */
                 }
             }
+            ix = (ix + 1) & mask;
         }
     }
-    return possible;
+    return exact != NULL ? exact : possible;
 }
 
 /* Depending upon the ECO_level and the eco string of the
- * current game, open the correctly named ECO file.
+ * current game, select the correctly named ECO file.
+ * It is left open for later games (see outputcache.c).
  */
 FILE *
 open_eco_output_file(EcoDivision ECO_level, const char *eco)
@@ -327,5 +465,267 @@ open_eco_output_file(EcoDivision ECO_level, const char *eco)
         filename[ECO_level] = '\0';
         strcat(filename, suffix);
     }
-    return must_open_file(filename, "a");
+    return select_cached_output_file(filename);
+}
+
+/* Set *size and *checksum for the contents of filename.
+ * Return FALSE if it cannot be read.
+ */
+static Boolean
+eco_file_checksum(const char *filename, uint64_t *size, uint64_t *checksum)
+{
+    FILE *fp = fopen(filename, "rb");
+    /* FNV-1a */
+    uint64_t hash = (uint64_t) 0xcbf29ce484222325ULL;
+    uint64_t length = 0;
+    unsigned char buffer[BUFSIZ];
+    size_t bytes;
+
+    if (fp == NULL) {
+        return FALSE;
+    }
+    while ((bytes = fread((void *) buffer, 1, sizeof (buffer), fp)) > 0) {
+        size_t i;
+        for (i = 0; i < bytes; i++) {
+            hash ^= buffer[i];
+            hash *= (uint64_t) 0x100000001b3ULL;
+        }
+        length += bytes;
+    }
+    (void) fclose(fp);
+    *size = length;
+    *checksum = hash;
+    return TRUE;
+}
+
+/* Fill EcoTable from cache_file if it is a valid cache of eco_file.
+ * Return TRUE if it is.
+ */
+Boolean
+load_eco_cache(const char *cache_file, const char *eco_file)
+{
+    uint64_t source_size, source_checksum;
+    size_t size;
+    const char *contents;
+    const EcoCacheHeader *header;
+    const EcoEntry *slots;
+    const EcoCacheDetails *cached;
+    const char *strings;
+    uint64_t n, occupied = 0;
+    unsigned max_half_moves = ECO_HALF_MOVE_LIMIT;
+    Boolean ok;
+
+    if (!eco_file_checksum(eco_file, &source_size, &source_checksum)) {
+        return FALSE;
+    }
+    /* The contents are retained for the rest of the run, because
+     * the entries of EcoTable refer to the strings in them.
+     */
+    contents = read_whole_file(cache_file, &size);
+    if (contents == NULL) {
+        return FALSE;
+    }
+    if (size < sizeof (EcoCacheHeader)) {
+        release_whole_file(contents, size);
+        return FALSE;
+    }
+    header = (const EcoCacheHeader *) contents;
+    ok = memcmp(header->magic, ECO_CACHE_MAGIC, sizeof (header->magic)) == 0 &&
+            header->byte_order == NATIVE_BYTE_ORDER &&
+            header->source_size == source_size &&
+            header->source_checksum == source_checksum &&
+            header->table_size > 0 &&
+            (header->table_size & (header->table_size - 1)) == 0 &&
+            header->table_size <= (size - sizeof (*header)) / sizeof (EcoEntry) &&
+            header->num_entries < header->table_size &&
+            size == sizeof (*header) + header->table_size * sizeof (EcoEntry) +
+                    header->num_entries * sizeof (EcoCacheDetails) +
+                    header->strings_length &&
+            (header->strings_length == 0 || contents[size - 1] == '\0');
+    slots = (const EcoEntry *) (contents + sizeof (*header));
+    cached = (const EcoCacheDetails *) (slots + header->table_size);
+    strings = (const char *) (cached + header->num_entries);
+    for (n = 0; ok && n < header->table_size; n++) {
+        if (slots[n].details != 0) {
+            occupied++;
+            ok = slots[n].details <= header->num_entries;
+            if (slots[n].half_moves + ECO_HALF_MOVE_LIMIT > max_half_moves) {
+                max_half_moves = slots[n].half_moves + ECO_HALF_MOVE_LIMIT;
+            }
+        }
+    }
+    ok = ok && occupied == header->num_entries;
+    for (n = 0; ok && n < header->num_entries; n++) {
+        int t;
+        for (t = 0; t < NUM_CACHED_TAGS; t++) {
+            if (cached[n].tags[t] > header->strings_length) {
+                ok = FALSE;
+            }
+        }
+    }
+    if (!ok) {
+        release_whole_file(contents, size);
+        return FALSE;
+    }
+
+    /* Use the slots in place. */
+    if (EcoTable != NULL && !eco_table_cached) {
+        (void) free((void *) EcoTable);
+    }
+    EcoTable = (EcoEntry *) slots;
+    eco_table_size = (unsigned) header->table_size;
+    eco_table_cached = TRUE;
+    maximum_half_moves = max_half_moves;
+    num_eco_entries = max_eco_entries = (unsigned) header->num_entries;
+    EcoDetails = (EcoLog *) malloc_or_die((num_eco_entries > 0 ? num_eco_entries : 1) *
+            sizeof (*EcoDetails));
+    for (n = 0; n < num_eco_entries; n++) {
+        const uint32_t *tags = cached[n].tags;
+        EcoLog *details = &EcoDetails[n];
+
+        details->ECO_tag = tags[CACHED_ECO] != 0 ? strings + tags[CACHED_ECO] - 1 : NULL;
+        details->Opening_tag = tags[CACHED_OPENING] != 0 ?
+                strings + tags[CACHED_OPENING] - 1 : NULL;
+        details->Variation_tag = tags[CACHED_VARIATION] != 0 ?
+                strings + tags[CACHED_VARIATION] - 1 : NULL;
+        details->Sub_Variation_tag = tags[CACHED_SUB_VARIATION] != 0 ?
+                strings + tags[CACHED_SUB_VARIATION] - 1 : NULL;
+    }
+    return TRUE;
+}
+
+/* The strings of an ECO cache, each stored once. */
+#define ECO_STRING_TABLE_SIZE 4099
+
+typedef struct EcoCacheString {
+    const char *str;
+    /* One more than its offset in the strings of the cache. */
+    uint32_t offset;
+    struct EcoCacheString *next;
+} EcoCacheString;
+
+typedef struct {
+    EcoCacheString *table[ECO_STRING_TABLE_SIZE];
+    char *strings;
+    size_t length, max_length;
+} EcoCacheStrings;
+
+/* Return the value to be stored in a cache entry for str,
+ * adding it to the strings of the cache if it is new.
+ */
+static uint32_t
+intern_eco_string(EcoCacheStrings *strings, const char *str)
+{
+    unsigned ix = 0;
+    const char *p;
+    EcoCacheString *entry;
+    size_t length;
+
+    if (str == NULL) {
+        return 0;
+    }
+    for (p = str; *p != '\0'; p++) {
+        ix = ix * 31 + (unsigned char) *p;
+    }
+    ix %= ECO_STRING_TABLE_SIZE;
+    for (entry = strings->table[ix]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->str, str) == 0) {
+            return entry->offset;
+        }
+    }
+    length = strlen(str) + 1;
+    if (strings->length + length > strings->max_length) {
+        strings->max_length = 2 * (strings->length + length);
+        strings->strings = (char *) realloc_or_die((void *) strings->strings,
+                strings->max_length);
+    }
+    memcpy((void *) (strings->strings + strings->length), (const void *) str, length);
+    entry = (EcoCacheString *) malloc_or_die(sizeof (*entry));
+    entry->str = str;
+    entry->offset = (uint32_t) strings->length + 1;
+    entry->next = strings->table[ix];
+    strings->table[ix] = entry;
+    strings->length += length;
+    return entry->offset;
+}
+
+/* Write the contents of EcoTable to cache_file as a cache of eco_file.
+ * The file is written under a temporary name and then renamed,
+ * so that a concurrent run never sees it partly written.
+ */
+void
+save_eco_cache(const char *cache_file, const char *eco_file)
+{
+    EcoCacheHeader header;
+    EcoCacheStrings *strings;
+    EcoCacheDetails *cached;
+    unsigned n;
+    char *temporary_file;
+    FILE *fp;
+    Boolean ok;
+
+    memset((void *) &header, 0, sizeof (header));
+    if (EcoTable == NULL ||
+            !eco_file_checksum(eco_file, &header.source_size, &header.source_checksum)) {
+        return;
+    }
+    strings = (EcoCacheStrings *) malloc_or_die(sizeof (*strings));
+    memset((void *) strings, 0, sizeof (*strings));
+    cached = (EcoCacheDetails *) malloc_or_die((num_eco_entries > 0 ? num_eco_entries : 1) *
+            sizeof (*cached));
+    for (n = 0; n < num_eco_entries; n++) {
+        const EcoLog *details = &EcoDetails[n];
+        cached[n].tags[CACHED_ECO] = intern_eco_string(strings, details->ECO_tag);
+        cached[n].tags[CACHED_OPENING] = intern_eco_string(strings, details->Opening_tag);
+        cached[n].tags[CACHED_VARIATION] = intern_eco_string(strings, details->Variation_tag);
+        cached[n].tags[CACHED_SUB_VARIATION] =
+                intern_eco_string(strings, details->Sub_Variation_tag);
+    }
+
+    memcpy((void *) header.magic, ECO_CACHE_MAGIC, sizeof (header.magic));
+    header.byte_order = NATIVE_BYTE_ORDER;
+    header.table_size = eco_table_size;
+    header.num_entries = num_eco_entries;
+    header.strings_length = strings->length;
+
+    temporary_file = temporary_file_name(cache_file);
+    fp = fopen(temporary_file, "wb");
+    if (fp != NULL) {
+        ok = fwrite((void *) &header, sizeof (header), 1, fp) == 1 &&
+                fwrite((void *) EcoTable, sizeof (*EcoTable), eco_table_size, fp) ==
+                        eco_table_size &&
+                (num_eco_entries == 0 ||
+                 fwrite((void *) cached, sizeof (*cached), num_eco_entries, fp) ==
+                        num_eco_entries) &&
+                (strings->length == 0 ||
+                 fwrite((void *) strings->strings, 1, strings->length, fp) == strings->length);
+        ok = fclose(fp) == 0 && ok;
+        if (ok) {
+            ok = replace_file(temporary_file, cache_file);
+        }
+        else {
+            (void) remove(temporary_file);
+        }
+    }
+    else {
+        ok = FALSE;
+    }
+    if (!ok) {
+        fprintf(GlobalState.logfile, "Unable to write the ECO cache %s\n", cache_file);
+    }
+
+    for (n = 0; n < ECO_STRING_TABLE_SIZE; n++) {
+        EcoCacheString *entry = strings->table[n];
+        while (entry != NULL) {
+            EcoCacheString *next = entry->next;
+            (void) free((void *) entry);
+            entry = next;
+        }
+    }
+    if (strings->strings != NULL) {
+        (void) free((void *) strings->strings);
+    }
+    (void) free((void *) strings);
+    (void) free((void *) cached);
+    (void) free((void *) temporary_file);
 }
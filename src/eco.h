@@ -23,29 +23,23 @@
 #ifndef ECO_H
 #define ECO_H
 
+/* The tags of an ECO line. */
 typedef struct EcoLog {
-    HashCode required_hash_value;
-    /* cumulative_hash_value is used to disambiguate clashing
-     * final hash values in duplicate detection.
-     */
-    HashCode cumulative_hash_value;
-    /* How deep the line is, from the half_moves associated with
-     * the board when the line is played out.
-     */
-    unsigned half_moves;
     const char *ECO_tag;
     const char *Opening_tag;
     const char *Variation_tag;
     const char *Sub_Variation_tag;
-    struct EcoLog *next;
 } EcoLog;
 
 EcoLog *eco_matches(HashCode current_hash_value, HashCode cumulative_hash_value,
                     unsigned half_moves_played);
+unsigned eco_half_move_limit(void);
 Boolean add_ECO(Game game_details);
 FILE *open_eco_output_file(EcoDivision ECO_level,const char *eco);
 void initEcoTable(void);
 void save_eco_details(Game game_details,unsigned number_of_moves);
+Boolean load_eco_cache(const char *cache_file, const char *eco_file);
+void save_eco_cache(const char *cache_file, const char *eco_file);
 
 #endif	// ECO_H
 
@@ -639,6 +639,13 @@ look_for_material_match(Game *game_details, Material_details *details_to_find)
     }
 }
 
+/* Return whether there are any material criteria (-z). */
+Boolean
+material_criteria_present(void)
+{
+    return endings_to_match != NULL;
+}
+
 /* Check to see whether the given moves lead to a position
  * that matches one of the required 'material match' positions.
  * In other words, a position with the required balance
@@ -62,6 +62,7 @@ typedef struct material_details {
 #define MATERIAL_CONSTRAINT ':'
 
 Boolean check_for_material_match(Game *game);
+Boolean material_criteria_present(void);
 Boolean build_endings(const char *infile, Boolean both_colours);
 Material_details *process_material_description(const char *line, Boolean both_colours, Boolean pattern_constraint);
 Boolean constraint_material_match(Material_details *details_to_find, const Board *board);
@@ -48,17 +48,58 @@
 #define NCCL '^'
 
 /**
- * Based on original pattern matching code by Rob Pike.
+ * The pattern syntax is based on original pattern matching code by Rob Pike.
  * Taken from:
  *     http://www.cs.princeton.edu/courses/archive/spr09/cos333/beautiful.html
  * and ideas from Kernighan and Plauger's "Software Tools".
  */
 
+/* Patterns are matched against the contents of a rank's squares,
+ * rather than against its text, using the following encoding.
+ * Each square's content is mapped to a small index and the squares
+ * that a pattern element accepts are held as a SquareSet with one
+ * bit per index.
+ * NUM_SQUARE_CONTENTS is the largest possible Piece value on the board plus 1.
+ */
+#define NUM_SQUARE_CONTENTS (MAKE_COLOURED_PIECE(WHITE, KING) + 1)
+/* Empty, plus six white and six black pieces. */
+#define NUM_SQUARE_INDICES 13
+typedef unsigned short SquareSet;
+
+/* The maximum number of elements in a compiled rank with a *:
+ * a * before and after each of the eight squares.
+ */
+#define MAX_RANK_ELEMENTS (2 * BOARDSIZE + 1)
+
+/* The compiled form of a single rank of a pattern.
+ * A rank without a * is a set of acceptable contents for each square.
+ * A rank with a * is simulated as a bit-parallel automaton whose
+ * state is the set of pattern elements reached so far.
+ */
+typedef struct CompiledRank {
+    Boolean has_star;
+    /* The squares accepted in each column of a rank without a *.
+     * A rank that can never match has empty sets.
+     */
+    SquareSet columns[BOARDSIZE];
+    /* For a rank with a *, the number of elements, the elements
+     * that are a *, and, for each square index, the elements
+     * that accept it.
+     */
+    unsigned num_elements;
+    unsigned long star_elements;
+    unsigned long accepting_elements[NUM_SQUARE_INDICES];
+} CompiledRank;
+
+struct FENRankGroup;
+
 /* A single rank of a FEN-based patterns to match.
  * Ranks are chained as a linear list via next_rank and
  * alternatives for the same rank via alternative_rank.
  * The optional_label (if any) is stored with the final rank of
  * the list.
+ * The first of a list of alternatives holds the group in which
+ * they are merged for matching.
  */
 typedef struct FENPatternMatch {
     char *rank;
@@ -66,22 +107,60 @@ typedef struct FENPatternMatch {
     struct FENPatternMatch *alternative_rank;
     struct FENPatternMatch *next_rank;
     Material_details *constraint;
+    CompiledRank compiled;
+    struct FENRankGroup *group;
 } FENPatternMatch;
 
+/* The alternatives for a rank merged so that the board's squares
+ * select those that might match in a single pass.
+ * column_matches holds, for each column and square index, the set
+ * of alternatives (as bits in num_words words) that accept that
+ * content there. Ranks with a * accept everything there and are
+ * checked individually. A group with a single alternative does not
+ * need column_matches.
+ * Most moves leave most ranks unchanged, so the alternatives matching
+ * the rank most recently seen by the group are kept in matching,
+ * and reused while the rank's contents are the same.
+ */
+typedef struct FENRankGroup {
+    unsigned num_alternatives;
+    FENPatternMatch **alternatives;
+    unsigned num_words;
+    uint64_t *column_matches;
+    /* The alternatives matching cached_rank. */
+    uint64_t *matching;
+    /* The contents of the rank that matching is for,
+     * packed by pack_rank().
+     */
+    uint64_t cached_rank;
+    Boolean cache_valid;
+} FENRankGroup;
+
 static FENPatternMatch *pattern_tree = NULL;
+/* Whether pattern_tree has been compiled since the last insertion. */
+static Boolean pattern_tree_compiled = FALSE;
+/* The square index of each Piece value. */
+static unsigned char square_index[NUM_SQUARE_CONTENTS];
+/* The SAN letter for each square index. */
+static char square_letter[NUM_SQUARE_INDICES];
+/* The Piece value for each square index. */
+static Piece square_piece[NUM_SQUARE_INDICES];
 
-static Boolean matchhere(const char *regexp, const char *text);
-static Boolean matchstar(const char *regexp, const char *text);
-static Boolean matchccl(const char *regexp, const char *text);
-static Boolean matchnccl(const char *regexp, const char *text);
 static Boolean matchone(char regchar, char textchar);
-static void convert_rank_to_text(const Board *board, Rank rank, char *text);
+static void init_square_indices(void);
+static SquareSet squares_matching(char regchar);
+static void compile_rank(const char *rank, CompiledRank *compiled);
+static void add_pattern_material(char **ranks);
+static void compile_pattern_tree(FENPatternMatch *pattern);
+static void free_pattern_groups(FENPatternMatch *pattern);
+static Boolean star_rank_matches(const CompiledRank *compiled, const Piece *squares);
+static uint64_t pack_rank(const Piece *squares);
+static void match_rank_alternatives(FENRankGroup *group, const Piece *squares);
 static const char *reverse_fen_pattern(const char *pattern);
 static void pattern_tree_insert(char **ranks, const char *label, Material_details *constraint);
 static void insert_pattern(FENPatternMatch *node, FENPatternMatch *next);
 static const char *pattern_match_rank(const Board *board, 
-        FENPatternMatch *pattern, int patternIndex, 
-        char ranks[BOARDSIZE+1][BOARDSIZE+1]);
+        FENPatternMatch *pattern, int patternIndex);
 
 /*
  * Add a FENPattern to be matched. If add_reverse is TRUE then
@@ -276,6 +355,7 @@ static void
 pattern_tree_insert(char **ranks, const char *label, Material_details *constraint)
 {
     FENPatternMatch *match = (FENPatternMatch *) malloc_or_die(sizeof(*match));
+    add_pattern_material(ranks);
     /* Create a linked list for the ranks. 
      * Place the label in the final link.
      */
@@ -283,6 +363,7 @@ pattern_tree_insert(char **ranks, const char *label, Material_details *constrain
     for(int i = 0; i < BOARDSIZE; i++) {
         next->rank = ranks[i];
         next->alternative_rank = NULL;
+        next->group = NULL;
         if(i != BOARDSIZE - 1) {
             next->next_rank = (FENPatternMatch *) malloc_or_die(sizeof(*match));
             next->optional_label = NULL;
@@ -300,8 +381,12 @@ pattern_tree_insert(char **ranks, const char *label, Material_details *constrain
     }
     else {
         /* Find the place to insert this list in the existing tree. */
+        if(pattern_tree_compiled) {
+            free_pattern_groups(pattern_tree);
+        }
         insert_pattern(pattern_tree, match);
     }
+    pattern_tree_compiled = FALSE;
 }
 
 /* Starting at node, try to insert next into the tree.
@@ -334,6 +419,13 @@ insert_pattern(FENPatternMatch *node, FENPatternMatch *next)
     }
 }
 
+/* Return whether any FEN patterns are to be matched. */
+Boolean
+fen_patterns_present(void)
+{
+    return pattern_tree != NULL;
+}
+
 /*
  * Try to match the board against one of the FEN patterns.
  * Return NULL if no match, otherwise a possible label for the
@@ -345,144 +437,462 @@ pattern_match_board(const Board *board)
 {
     const char *match_label = NULL;
     if(pattern_tree != NULL) {
-        /* Don't convert any ranks of the board until they
-         * are required.
-         */
-        char ranks[BOARDSIZE+1][BOARDSIZE+1];
-        for(int i = 0; i < BOARDSIZE; i++) {
-            ranks[i][0] = '\0';
+        if(!pattern_tree_compiled) {
+            init_square_indices();
+            compile_pattern_tree(pattern_tree);
+            pattern_tree_compiled = TRUE;
         }
-        match_label = pattern_match_rank(board, pattern_tree, 0, ranks);
+        match_label = pattern_match_rank(board, pattern_tree, 0);
     }
     return match_label;
 }
 
 
-/* Match ranks[patternIndex ...] against board.
+/* Match the alternatives starting with pattern against rank patternIndex
+ * of board, and the following ranks against their patterns.
  * return the corresponding match label if a match is found.
  * Return NULL if no match is found.
  */
-static const char *pattern_match_rank(const Board *board, FENPatternMatch *pattern, int patternIndex, char ranks[BOARDSIZE+1][BOARDSIZE+1])
+static const char *pattern_match_rank(const Board *board, FENPatternMatch *pattern, int patternIndex)
 {
     const char *match_label = NULL;
-    if(ranks[patternIndex][0] == '\0') {
-        /* Convert the required rank.
-         * Convert the others when/if needed.
-         */
-        convert_rank_to_text(board, LASTRANK - patternIndex, ranks[patternIndex]);
+    const Piece *squares = &board->board[RankConvert(LASTRANK - patternIndex)][ColConvert(FIRSTCOL)];
+    FENRankGroup *group = pattern->group;
+    uint64_t rank = pack_rank(squares);
+    unsigned alt;
+
+    if(!group->cache_valid || group->cached_rank != rank) {
+        match_rank_alternatives(group, squares);
+        group->cached_rank = rank;
+        group->cache_valid = TRUE;
     }
-    while(match_label == NULL && pattern != NULL) {
-        if(matchhere(pattern->rank, ranks[patternIndex])) {
+
+    /* Try the matching alternatives in their original order. */
+    for(alt = 0; match_label == NULL && alt < group->num_alternatives; alt++) {
+        if((group->matching[alt / 64] >> (alt % 64)) & 1) {
+            FENPatternMatch *candidate = group->alternatives[alt];
             if(patternIndex == BOARDSIZE - 1) {
                 /* The board matches the pattern. */
-                if(pattern->constraint != NULL) {
-                    if(constraint_material_match(pattern->constraint, board)) {
-                        match_label = pattern->optional_label;
+                if(candidate->constraint != NULL) {
+                    if(constraint_material_match(candidate->constraint, board)) {
+                        match_label = candidate->optional_label;
                     }
                 }
                 else {
-                    match_label = pattern->optional_label;
+                    match_label = candidate->optional_label;
                 }
             }
             else {
                 /* Try next rank.*/
-                match_label = pattern_match_rank(board, pattern->next_rank, patternIndex + 1, ranks);
+                match_label = pattern_match_rank(board, candidate->next_rank, patternIndex + 1);
             }
         }
-        
-        if(match_label == NULL) {
-            pattern = pattern->alternative_rank;
-        }
     }
     return match_label;
 }
 
-/**
- * matchhere: search for regexp at beginning of text
+/*
+ * Pack the contents of the squares of a rank into a single value.
+ * Every Piece value fits in a byte.
+ */
+static uint64_t
+pack_rank(const Piece *squares)
+{
+    uint64_t rank = 0;
+    int col;
+    for(col = 0; col < BOARDSIZE; col++) {
+        rank = (rank << 8) | (uint64_t) squares[col];
+    }
+    return rank;
+}
+
+/*
+ * Set group->matching to the alternatives of group that match
+ * the given squares of a rank.
+ */
+static void
+match_rank_alternatives(FENRankGroup *group, const Piece *squares)
+{
+    uint64_t *matching = group->matching;
+    unsigned num_words = group->num_words;
+    unsigned alt;
+
+    if(group->num_alternatives > 1) {
+        /* Select the alternatives accepting every square. */
+        unsigned w;
+        int col;
+        memcpy(matching,
+               &group->column_matches[square_index[squares[0]] * num_words],
+               num_words * sizeof(*matching));
+        for(col = 1; col < BOARDSIZE; col++) {
+            const uint64_t *matches =
+                &group->column_matches[((col * NUM_SQUARE_INDICES) +
+                                        square_index[squares[col]]) * num_words];
+            for(w = 0; w < num_words; w++) {
+                matching[w] &= matches[w];
+            }
+        }
+    }
+    else {
+        const CompiledRank *compiled = &group->alternatives[0]->compiled;
+        Boolean matches = TRUE;
+        if(!compiled->has_star) {
+            int col;
+            for(col = 0; matches && col < BOARDSIZE; col++) {
+                matches = (compiled->columns[col] >> square_index[squares[col]]) & 1;
+            }
+        }
+        matching[0] = matches ? 1 : 0;
+    }
+
+    /* The alternatives with a * still have to be checked. */
+    for(alt = 0; alt < group->num_alternatives; alt++) {
+        uint64_t bit = ((uint64_t) 1) << (alt % 64);
+        if((matching[alt / 64] & bit) &&
+                group->alternatives[alt]->compiled.has_star &&
+                !star_rank_matches(&group->alternatives[alt]->compiled, squares)) {
+            matching[alt / 64] &= ~bit;
+        }
+    }
+}
+
+/*
+ * Match the squares of a rank against a compiled rank containing a *.
+ * Elements are numbered from 0 and bit i of state is set if
+ * the squares so far can be matched by the elements before i.
+ * A * element keeps its bit on every square and passes it on
+ * without consuming a square.
  */
 static Boolean
-matchhere(const char *regexp, const char *text)
+star_rank_matches(const CompiledRank *compiled, const Piece *squares)
 {
-    if (regexp[0] == '\0' && text[0] == '\0') {
-        return TRUE;
+    unsigned long stars = compiled->star_elements;
+    unsigned long state = 1;
+    int col;
+
+    state |= (state & stars) << 1;
+    for(col = 0; state != 0 && col < BOARDSIZE; col++) {
+        unsigned long accepting = compiled->accepting_elements[square_index[squares[col]]];
+        state = ((state & accepting) << 1) | (state & stars);
+        state |= (state & stars) << 1;
     }
-    if (regexp[0] == ZERO_OR_MORE_OF_ANYTHING) {
-        return matchstar(regexp + 1, text);
+    return (state >> compiled->num_elements) & 1;
+}
+
+/*
+ * Set up the mapping between Piece values on the board and
+ * the indices used in SquareSets.
+ */
+static void
+init_square_indices(void)
+{
+    unsigned index = 0;
+    Piece piece;
+
+    memset(square_index, 0, sizeof(square_index));
+    square_index[EMPTY] = index;
+    square_letter[index] = EMPTY_SQUARE;
+    square_piece[index] = EMPTY;
+    index++;
+    for(piece = PAWN; piece <= KING; piece++) {
+        Piece white = MAKE_COLOURED_PIECE(WHITE, piece);
+        Piece black = MAKE_COLOURED_PIECE(BLACK, piece);
+        square_index[white] = index;
+        square_letter[index] = coloured_piece_to_SAN_letter(white);
+        square_piece[index] = white;
+        index++;
+        square_index[black] = index;
+        square_letter[index] = coloured_piece_to_SAN_letter(black);
+        square_piece[index] = black;
+        index++;
     }
-    if (*text != '\0') {
-        switch (*regexp) {
-            case ANY_SQUARE_STATE:
-                return matchhere(regexp + 1, text + 1);
-                break;
-            case NON_EMPTY_SQUARE:
-            case ANY_WHITE_PIECE:
-            case ANY_BLACK_PIECE:
-            case NOT_A_PAWN:
-                if (matchone(*regexp, *text)) {
-                    return matchhere(regexp + 1, text + 1);
+}
+
+/*
+ * Return the set of square contents matched by regchar.
+ */
+static SquareSet
+squares_matching(char regchar)
+{
+    SquareSet squares = 0;
+    unsigned index;
+    for(index = 0; index < NUM_SQUARE_INDICES; index++) {
+        if(matchone(regchar, square_letter[index])) {
+            squares |= 1 << index;
+        }
+    }
+    return squares;
+}
+
+/*
+ * Compile the text of a single rank of a pattern.
+ * A rank that could never match eight squares is compiled
+ * as a rank without a * that has empty sets.
+ */
+static void
+compile_rank(const char *rank, CompiledRank *compiled)
+{
+    SquareSet elements[MAX_RANK_ELEMENTS];
+    Boolean is_star[MAX_RANK_ELEMENTS];
+    unsigned num_elements = 0;
+    /* The number of squares consumed by the elements. */
+    unsigned num_squares = 0;
+    Boolean has_star = FALSE;
+    Boolean ok = TRUE;
+    const char *p = rank;
+
+    while(ok && *p != '\0') {
+        if(*p == ZERO_OR_MORE_OF_ANYTHING) {
+            /* Adjacent stars are equivalent to one. */
+            if(num_elements == 0 || !is_star[num_elements - 1]) {
+                elements[num_elements] = 0;
+                is_star[num_elements] = TRUE;
+                num_elements++;
+            }
+            has_star = TRUE;
+            p++;
+        }
+        else {
+            SquareSet squares = 0;
+            unsigned count = 1;
+            if(*p >= '1' && *p <= '8') {
+                /* The number of empty squares required. */
+                count = *p - '0';
+                squares = squares_matching(EMPTY_SQUARE);
+                p++;
+            }
+            else if(*p == CCL_START) {
+                Boolean negated = p[1] == NCCL;
+                p += negated ? 2 : 1;
+                while(*p != CCL_END && *p != '\0') {
+                    squares |= squares_matching(*p);
+                    p++;
                 }
-                break;
-            case CCL_START:
-                /* Closure */
-                if (regexp[1] == NCCL) {
-                    return matchnccl(regexp + 2, text);
+                if(*p == CCL_END) {
+                    p++;
+                    if(negated) {
+                        squares = ~squares & ((1 << NUM_SQUARE_INDICES) - 1);
+                    }
                 }
                 else {
-                    return matchccl(regexp + 1, text);
+                    /* Unterminated closure. */
+                    ok = FALSE;
                 }
-                break;
-            case '1': case '2': case '3': case '4':
-            case '5': case '6': case '7': case '8':
-            {
-                /* The number of empty squares required. */
-                int empty = regexp[0] - '0';
-                Boolean matches = TRUE;
-                /* The number matched. */
-                int match_count = 0;
-                while (matches && match_count < empty) {
-                    if (text[match_count] == EMPTY_SQUARE) {
-                        match_count++;
+            }
+            else {
+                squares = squares_matching(*p);
+                p++;
+            }
+            if(num_squares + count > BOARDSIZE) {
+                ok = FALSE;
+            }
+            else {
+                while(count > 0) {
+                    elements[num_elements] = squares;
+                    is_star[num_elements] = FALSE;
+                    num_elements++;
+                    num_squares++;
+                    count--;
+                }
+            }
+        }
+    }
+
+    memset(compiled, 0, sizeof(*compiled));
+    if(!ok) {
+        /* Never matches. */
+    }
+    else if(!has_star) {
+        if(num_squares == BOARDSIZE) {
+            memcpy(compiled->columns, elements, sizeof(compiled->columns));
+        }
+    }
+    else {
+        unsigned i, index;
+        compiled->has_star = TRUE;
+        compiled->num_elements = num_elements;
+        for(i = 0; i < num_elements; i++) {
+            if(is_star[i]) {
+                compiled->star_elements |= 1UL << i;
+            }
+            else {
+                for(index = 0; index < NUM_SQUARE_INDICES; index++) {
+                    if((elements[i] >> index) & 1) {
+                        compiled->accepting_elements[index] |= 1UL << i;
                     }
-                    else {
-                        matches = FALSE;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Record the least and greatest number of each kind of piece
+ * that a board matching the given ranks of a pattern could have.
+ * A square that matches only one kind of piece must hold it,
+ * and a * could cover any square of its rank.
+ * Nothing is recorded for a pattern that can never match.
+ */
+static void
+add_pattern_material(char **ranks)
+{
+    unsigned least[NUM_SQUARE_INDICES] = { 0 };
+    unsigned greatest[NUM_SQUARE_INDICES] = { 0 };
+    MaterialKey least_material = 0, greatest_material = 0;
+    /* The squares that must hold pawns, by Colour. */
+    Bitboard pawns[2] = { 0, 0 };
+    unsigned index;
+
+    init_square_indices();
+    for(int i = 0; i < BOARDSIZE; i++) {
+        CompiledRank compiled;
+        /* The sets of squares accepted by each square of the rank
+         * that is not covered by a *.
+         */
+        SquareSet squares[BOARDSIZE];
+        unsigned num_squares = 0;
+
+        compile_rank(ranks[i], &compiled);
+        if(!compiled.has_star) {
+            memcpy(squares, compiled.columns, sizeof(squares));
+            num_squares = BOARDSIZE;
+            for(int col = 0; col < BOARDSIZE; col++) {
+                Piece coloured_piece = square_piece[0];
+                for(index = 0; index < NUM_SQUARE_INDICES; index++) {
+                    if(squares[col] == (1 << index)) {
+                        coloured_piece = square_piece[index];
                     }
                 }
-                if (matches) {
-                    return matchhere(regexp + 1, text + match_count);
+                if(coloured_piece != EMPTY && EXTRACT_PIECE(coloured_piece) == PAWN) {
+                    /* Ranks are listed from the eighth. */
+                    int square = (BOARDSIZE - 1 - i) * BOARDSIZE + col;
+                    pawns[EXTRACT_COLOUR(coloured_piece)] |= ((Bitboard) 1) << square;
                 }
             }
-                break;
-            default:
-                if (*regexp == *text) {
-                    return matchhere(regexp + 1, text + 1);
+        }
+        else {
+            unsigned element;
+            for(element = 0; element < compiled.num_elements; element++) {
+                if(!((compiled.star_elements >> element) & 1)) {
+                    squares[num_squares] = 0;
+                    for(index = 0; index < NUM_SQUARE_INDICES; index++) {
+                        if((compiled.accepting_elements[index] >> element) & 1) {
+                            squares[num_squares] |= 1 << index;
+                        }
+                    }
+                    num_squares++;
+                }
+            }
+            for(index = 0; index < NUM_SQUARE_INDICES; index++) {
+                greatest[index] += BOARDSIZE - num_squares;
+            }
+        }
+        for(unsigned sq = 0; sq < num_squares; sq++) {
+            if(squares[sq] == 0) {
+                /* The pattern can never match. */
+                return;
+            }
+            for(index = 0; index < NUM_SQUARE_INDICES; index++) {
+                if((squares[sq] >> index) & 1) {
+                    greatest[index]++;
+                    if(squares[sq] == (1 << index)) {
+                        least[index]++;
+                    }
                 }
-                break;
+            }
+        }
+    }
+    for(index = 0; index < NUM_SQUARE_INDICES; index++) {
+        Piece coloured_piece = square_piece[index];
+        if(coloured_piece != EMPTY) {
+            Colour colour = EXTRACT_COLOUR(coloured_piece);
+            Piece piece = EXTRACT_PIECE(coloured_piece);
+            unsigned fewest = least[index] < MATERIAL_MAX_COUNT ?
+                                least[index] : MATERIAL_MAX_COUNT;
+            unsigned most = greatest[index] < MATERIAL_MAX_COUNT ?
+                                greatest[index] : MATERIAL_MAX_COUNT;
+            least_material += fewest * MATERIAL_UNIT(colour, piece);
+            greatest_material += most * MATERIAL_UNIT(colour, piece);
         }
     }
-    /* No match. */
-    return FALSE;
+    add_material_target(least_material, greatest_material, pawns);
 }
 
-/**
- * matchstar: leftmost longest search on a single rank.
+/*
+ * Compile the ranks of the list of alternatives starting at pattern,
+ * and the ranks that follow them, merging the alternatives into a group.
  */
-static Boolean
-matchstar(const char *regexp, const char *text)
+static void
+compile_pattern_tree(FENPatternMatch *pattern)
 {
-    const char *t;
+    FENRankGroup *group = (FENRankGroup *) malloc_or_die(sizeof(*group));
+    FENPatternMatch *alternative;
+    unsigned alt;
 
-    /* Find the end of this rank. */
-    for (t = text; *t != '\0'; t++) {
-        ;
+    group->num_alternatives = 0;
+    for(alternative = pattern; alternative != NULL; alternative = alternative->alternative_rank) {
+        group->num_alternatives++;
     }
-    /* Try from the longest match to the shortest until success. */
-    do {
-        /* * matches zero or more */
-        if (matchhere(regexp, t)) {
-            return TRUE;
+    group->alternatives = (FENPatternMatch **)
+            malloc_or_die(group->num_alternatives * sizeof(*group->alternatives));
+    group->num_words = (group->num_alternatives + 63) / 64;
+    group->column_matches = NULL;
+    group->matching = (uint64_t *) malloc_or_die(group->num_words * sizeof(uint64_t));
+    group->cached_rank = 0;
+    group->cache_valid = FALSE;
+
+    alt = 0;
+    for(alternative = pattern; alternative != NULL; alternative = alternative->alternative_rank) {
+        compile_rank(alternative->rank, &alternative->compiled);
+        group->alternatives[alt] = alternative;
+        alt++;
+        if(alternative->next_rank != NULL) {
+            compile_pattern_tree(alternative->next_rank);
         }
-    } while (t-- > text);
-    return FALSE;
+    }
+
+    if(group->num_alternatives > 1) {
+        unsigned num_words = group->num_words;
+        size_t num_sets = BOARDSIZE * NUM_SQUARE_INDICES * num_words;
+        group->column_matches = (uint64_t *) malloc_or_die(num_sets * sizeof(uint64_t));
+        memset(group->column_matches, 0, num_sets * sizeof(uint64_t));
+        for(alt = 0; alt < group->num_alternatives; alt++) {
+            const CompiledRank *compiled = &group->alternatives[alt]->compiled;
+            uint64_t bit = ((uint64_t) 1) << (alt % 64);
+            int col;
+            unsigned index;
+            for(col = 0; col < BOARDSIZE; col++) {
+                for(index = 0; index < NUM_SQUARE_INDICES; index++) {
+                    if(compiled->has_star || ((compiled->columns[col] >> index) & 1)) {
+                        group->column_matches[((col * NUM_SQUARE_INDICES) + index) * num_words +
+                                              alt / 64] |= bit;
+                    }
+                }
+            }
+        }
+    }
+    pattern->group = group;
+}
+
+/*
+ * Free the groups of a compiled tree before it is modified.
+ */
+static void
+free_pattern_groups(FENPatternMatch *pattern)
+{
+    FENPatternMatch *alternative;
+    for(alternative = pattern; alternative != NULL; alternative = alternative->alternative_rank) {
+        if(alternative->next_rank != NULL) {
+            free_pattern_groups(alternative->next_rank);
+        }
+    }
+    if(pattern->group != NULL) {
+        (void) free((void *) pattern->group->alternatives);
+        (void) free((void *) pattern->group->column_matches);
+        (void) free((void *) pattern->group->matching);
+        (void) free((void *) pattern->group);
+        pattern->group = NULL;
+    }
 }
 
 /*
@@ -540,45 +950,6 @@ matchone(char regchar, char textchar)
     }
 }
 
-/*
- * Match any of the character closure.
- */
-static Boolean
-matchccl(const char *regexp, const char *text)
-{
-    while (*regexp != CCL_END &&
-            !matchone(*regexp, *text) && *regexp != '\0') {
-        regexp++;
-    }
-    if (matchone(*regexp, *text)) {
-        do {
-            regexp++;
-        } while (*regexp != CCL_END && *regexp != '\0');
-        return matchhere(regexp + 1, text + 1);
-    }
-    else {
-        return FALSE;
-    }
-}
-
-/*
- * Match any of the characters not in the closure.
- */
-static Boolean
-matchnccl(const char *regexp, const char *text)
-{
-    while (*regexp != CCL_END &&
-            !matchone(*regexp, *text) && *regexp != '\0') {
-        regexp++;
-    }
-    if (*regexp == CCL_END) {
-        return matchhere(regexp + 1, text + 1);
-    }
-    else {
-        return FALSE;
-    }
-}
-
 #if 0
 /* Build a basic EPD string from the given board. */
 static char *
@@ -610,23 +981,3 @@ convert_board_to_text(const Board *board)
     return text;
 }
 #endif
-
-/* Build a basic EPD string from rank of the given board. */
-static void
-convert_rank_to_text(const Board *board, Rank rank, char *text)
-{
-    const Piece *rankP = board->board[RankConvert(rank)];
-    int ix = 0;
-    Col col;
-    for (col = FIRSTCOL; col <= LASTCOL; col++) {
-        int coloured_piece = rankP[ColConvert(col)];
-        if (coloured_piece != EMPTY) {
-            text[ix] = coloured_piece_to_SAN_letter(coloured_piece);
-        }
-        else {
-            text[ix] = EMPTY_SQUARE;
-        }
-        ix++;
-    }
-    text[ix] = '\0';
-}
@@ -23,6 +23,7 @@
 #define FENMATCHER_H
 
 void add_fen_pattern(const char *fen_pattern, Boolean add_reverse, const char *label);
+Boolean fen_patterns_present(void);
 const char *pattern_match_board(const Board *board);
 
 #endif	// FENMATCHER_H
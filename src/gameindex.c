@@ -0,0 +1,1021 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* An index of where each game of the input files starts (--gameindex),
+ * used to read just the games selected by number with --selectonly
+ * and --skipmatching.
+ *
+ * The index is built by scanning the text of the input files for
+ * the lines on which games start, as is done to divide them between
+ * worker processes (--threads), rather than by parsing them.
+ * A game starts on a tag line that does not follow another tag line,
+ * and it ends where the next one starts.
+ * The index records the offset, length and number of preceding lines
+ * of each game, together with a hash value of its tags, which is
+ * checked before the game is read.
+ * It is rebuilt whenever the input files are not those for which
+ * it was built or have changed since.
+ *
+ * Games are numbered by --selectonly and --skipmatching from those
+ * that match, which excludes any that are not valid.
+ * That is only known once they have all been read, so the index is
+ * written at the end of a run that reads every game without other
+ * selection criteria, recording for each indexed game how many games
+ * were processed and matched before it.
+ * Game N is then found in the last indexed game with fewer than N
+ * matched games before it.
+ * Reading must start at an indexed game at which a game was found
+ * to start when every game was read, so that the games are parsed
+ * as they were then.
+ *
+ * The file starts with a GameIndexHeader, which is followed by
+ * a GameIndexFile for each input file, their nul-terminated names
+ * and then a GameIndexEntry for each game.
+ * Values are stored in the byte order of the machine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "lines.h"
+#include "defs.h"
+#include "typedef.h"
+#include "tokens.h"
+#include "taglist.h"
+#include "lex.h"
+#include "grammar.h"
+#include "moves.h"
+#include "end.h"
+#include "gameindex.h"
+
+#define GAME_INDEX_MAGIC "PGNXGIX3"
+/* The most bytes at the start of a game covered by its fingerprint. */
+#define FINGERPRINT_LENGTH 1024
+
+/* The options that affect which games are valid, for GameIndexHeader.options. */
+#define NESTED_COMMENTS_OPTION 0x1
+#define KEEP_VARIATIONS_OPTION 0x2
+#define KEEP_BROKEN_GAMES_OPTION 0x4
+#define NULL_MOVES_OPTION 0x8
+
+/* Flags for GameIndexEntry.flags. */
+/* A game started at the start of the indexed game when every game was read. */
+#define GAME_STARTS_HERE 0x1
+
+typedef struct {
+    char magic[8];
+    uint64_t byte_order;
+    uint64_t num_files, names_length;
+    uint64_t num_games;
+    /* The options with which the games were read (see index_options). */
+    uint64_t options;
+    /* The number of games processed and matched when they were all read. */
+    uint64_t num_games_processed, num_games_matched;
+    /* The offset of the first GameIndexEntry. */
+    uint64_t games_offset;
+} GameIndexHeader;
+
+/* The details of an input file, which must be unchanged
+ * for the index to be used.
+ */
+typedef struct {
+    uint64_t size;
+    int64_t modified;
+} GameIndexFile;
+
+typedef struct {
+    /* The offset of the game's first tag line and the length of
+     * the game up to the start of the next one.
+     */
+    uint64_t start, length;
+    /* The number of lines in the file before start. */
+    uint64_t lines_before;
+    /* The hash value of the game's tags (see game_fingerprint). */
+    uint64_t fingerprint;
+    /* The number of games processed and matched before this one
+     * when every game was read.
+     */
+    uint64_t processed_before, matched_before;
+    uint32_t file_number;
+    uint32_t flags;
+} GameIndexEntry;
+
+/* An index either read from a file or just built. */
+typedef struct {
+    /* The contents of the file read, if any. */
+    const char *contents;
+    size_t size;
+    /* The games, which belong to contents if that is not NULL. */
+    const GameIndexEntry *games;
+    uint64_t num_games;
+    uint64_t num_games_processed, num_games_matched;
+} GameIndex;
+
+/* An index being built while all the games are read, to be
+ * written by complete_game_index.
+ */
+static GameIndex new_index;
+static const char *new_index_file = NULL;
+/* The indexed game to which the last game read belongs. */
+static uint64_t current_entry = 0;
+/* Whether a game has been read that belongs to no indexed game. */
+static Boolean unindexed_game_read = FALSE;
+
+static uint64_t index_options(void);
+static Boolean is_tag_line(const char *line, const char *line_end);
+static uint64_t game_fingerprint(const char *text, size_t length);
+static Boolean input_file_details(unsigned file_number, GameIndexFile *details);
+static Boolean build_game_index(GameIndex *index);
+static void write_game_index(const char *index_file, const GameIndex *index);
+static Boolean read_game_index(const char *index_file, GameIndex *index);
+static void release_game_index(GameIndex *index);
+static Boolean valid_game_index(const char *contents, size_t size);
+static Boolean game_is_unchanged(const GameIndexEntry *game);
+static const char *game_numbers_not_usable(void);
+static unsigned long next_game_wanted(unsigned long number, unsigned long *last);
+static game_number *range_at_or_after(game_number *range, unsigned long number);
+static Boolean selected_games_unchanged(const GameIndex *index);
+static void read_selected_games(const GameIndex *index);
+static uint64_t entry_of_game(const GameIndex *index, unsigned long number);
+static Boolean reading_can_start_at(const GameIndex *index, uint64_t g);
+static void read_games(const GameIndex *index, uint64_t first, uint64_t last);
+
+/* Start a scan of text, which is size bytes long, for the
+ * lines on which games start.
+ */
+void
+start_game_scan(GameScanner *scanner, const char *text, size_t size)
+{
+    scanner->text = text;
+    scanner->size = size;
+    scanner->line_start = 0;
+    scanner->line_count = 0;
+    scanner->comment_depth = 0;
+    scanner->previous_line_was_tag = FALSE;
+}
+
+/* Return the options that affect which games are valid. */
+static uint64_t
+index_options(void)
+{
+    return (GlobalState.allow_nested_comments ? NESTED_COMMENTS_OPTION : 0) |
+            (GlobalState.keep_variations ? KEEP_VARIATIONS_OPTION : 0) |
+            (GlobalState.keep_broken_games ? KEEP_BROKEN_GAMES_OPTION : 0) |
+            (GlobalState.allow_null_moves ? NULL_MOVES_OPTION : 0);
+}
+
+/* Return whether the line from line to line_end is a tag line. */
+static Boolean
+is_tag_line(const char *line, const char *line_end)
+{
+    const char *p = line;
+
+    while (p < line_end && isspace((unsigned char) *p)) {
+        p++;
+    }
+    if (p < line_end && *p == '[') {
+        p++;
+        while (p < line_end && isspace((unsigned char) *p)) {
+            p++;
+        }
+        return p < line_end && (isalnum((unsigned char) *p) || *p == '_');
+    }
+    else {
+        return FALSE;
+    }
+}
+
+/* Find the next line of the scanner's text on which a game starts:
+ * a tag line that does not follow another tag line.
+ * The text is scanned in just enough detail to avoid mistaking
+ * text in comments for the start of a game.
+ * Return FALSE if there are no more, otherwise set *start to the
+ * offset of the line and *lines_before to the number of lines before it.
+ */
+Boolean
+find_next_game(GameScanner *scanner, size_t *start, unsigned long *lines_before)
+{
+    const char *text = scanner->text;
+    const size_t size = scanner->size;
+    Boolean found = FALSE;
+
+    while (scanner->line_start < size && !found) {
+        size_t line_start = scanner->line_start;
+        size_t line_end = line_start;
+        const char *p;
+        /* Whether the line is blank or an escaped line. */
+        Boolean insignificant;
+        Boolean tag_line;
+
+        while (line_end < size && text[line_end] != '\n' && text[line_end] != '\r') {
+            line_end++;
+        }
+
+        p = &text[line_start];
+        while (p < &text[line_end] && isspace((unsigned char) *p)) {
+            p++;
+        }
+        insignificant = scanner->comment_depth == 0 &&
+                (p == &text[line_end] || *p == '\0' || *p == '%');
+        tag_line = scanner->comment_depth == 0 && is_tag_line(p, &text[line_end]);
+        if (tag_line && !scanner->previous_line_was_tag) {
+            *start = line_start;
+            *lines_before = scanner->line_count;
+            found = TRUE;
+        }
+        if (!insignificant) {
+            scanner->previous_line_was_tag = tag_line;
+        }
+
+        /* Track comments through the rest of the line. */
+        for (; p < &text[line_end] && *p != '\0'; p++) {
+            if (scanner->comment_depth > 0) {
+                if (*p == '}') {
+                    scanner->comment_depth = GlobalState.allow_nested_comments ?
+                            scanner->comment_depth - 1 : 0;
+                }
+                else if (*p == '{' && GlobalState.allow_nested_comments) {
+                    scanner->comment_depth++;
+                }
+            }
+            else if (*p == '{') {
+                scanner->comment_depth = 1;
+            }
+            else if (*p == '"') {
+                /* A string ends at the end of the line. */
+                p++;
+                while (p < &text[line_end] && *p != '"' && *p != '\0') {
+                    if (*p == '\\' && p + 1 < &text[line_end]) {
+                        p++;
+                    }
+                    p++;
+                }
+                if (p == &text[line_end] || *p == '\0') {
+                    break;
+                }
+            }
+            else if (*p == '%') {
+                /* The rest of the line is ignored. */
+                break;
+            }
+            else if (*p == '\\') {
+                /* The next character is ignored. */
+                if (p + 1 < &text[line_end]) {
+                    p++;
+                }
+            }
+        }
+
+        /* Move past the line end, counting CRLF as a single end. */
+        line_start = line_end;
+        if (line_start < size) {
+            if (text[line_start] == '\r' && line_start + 1 < size &&
+                    text[line_start + 1] == '\n') {
+                line_start++;
+            }
+            line_start++;
+        }
+        scanner->line_start = line_start;
+        scanner->line_count++;
+    }
+    return found;
+}
+
+/* Return a hash value of the tag lines at the start of the
+ * game whose text is length bytes long, considering no more
+ * than FINGERPRINT_LENGTH bytes.
+ */
+static uint64_t
+game_fingerprint(const char *text, size_t length)
+{
+    /* The FNV-1a hash. */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t line_start = 0;
+
+    if (length > FINGERPRINT_LENGTH) {
+        length = FINGERPRINT_LENGTH;
+    }
+    while (line_start < length) {
+        size_t line_end = line_start;
+        size_t i;
+
+        while (line_end < length && text[line_end] != '\n' && text[line_end] != '\r') {
+            line_end++;
+        }
+        if (!is_tag_line(&text[line_start], &text[line_end])) {
+            break;
+        }
+        for (i = line_start; i < line_end; i++) {
+            hash ^= (unsigned char) text[i];
+            hash *= 0x100000001b3ULL;
+        }
+        line_start = line_end;
+        while (line_start < length &&
+                (text[line_start] == '\n' || text[line_start] == '\r')) {
+            line_start++;
+        }
+    }
+    return hash;
+}
+
+/* Set details from the current state of the given input file.
+ * Return FALSE if it is not a regular file.
+ */
+static Boolean
+input_file_details(unsigned file_number, GameIndexFile *details)
+{
+    struct stat info;
+
+    if (stat(input_file_name(file_number), &info) != 0 || !S_ISREG(info.st_mode)) {
+        return FALSE;
+    }
+    details->size = (uint64_t) info.st_size;
+    details->modified = (int64_t) info.st_mtime;
+    return TRUE;
+}
+
+/* Build an index of the games of the input files.
+ * Return FALSE if a file cannot be read.
+ */
+static Boolean
+build_game_index(GameIndex *index)
+{
+    GameIndexEntry *games = NULL;
+    uint64_t num_games = 0;
+    uint64_t max_games = 0;
+    unsigned file_number;
+    Boolean ok = TRUE;
+
+    for (file_number = 0; input_file_name(file_number) != NULL && ok; file_number++) {
+        GameIndexFile details;
+        const char *text = NULL;
+        size_t size = 0;
+
+        ok = input_file_details(file_number, &details);
+        if (ok && details.size > 0) {
+            text = read_whole_file(input_file_name(file_number), &size);
+            ok = text != NULL;
+        }
+        if (text != NULL) {
+            GameScanner scanner;
+            size_t start;
+            unsigned long lines_before;
+            /* The first game of this file. */
+            uint64_t first_game = num_games;
+            uint64_t g;
+
+            start_game_scan(&scanner, text, size);
+            while (find_next_game(&scanner, &start, &lines_before)) {
+                if (num_games == max_games) {
+                    max_games = max_games == 0 ? 1024 : 2 * max_games;
+                    games = (GameIndexEntry *) realloc_or_die((void *) games,
+                            (size_t) max_games * sizeof (*games));
+                }
+                games[num_games].start = start;
+                games[num_games].lines_before = lines_before;
+                games[num_games].processed_before = 0;
+                games[num_games].matched_before = 0;
+                games[num_games].file_number = file_number;
+                games[num_games].flags = 0;
+                num_games++;
+            }
+            for (g = first_game; g < num_games; g++) {
+                uint64_t end = g + 1 < num_games ? games[g + 1].start : size;
+                games[g].length = end - games[g].start;
+                games[g].fingerprint = game_fingerprint(&text[games[g].start],
+                        (size_t) games[g].length);
+            }
+            release_whole_file(text, size);
+        }
+    }
+    if (!ok) {
+        fprintf(GlobalState.logfile,
+                "--gameindex requires regular input files, which %s is not: all the games will be read.\n",
+                input_file_name(file_number - 1));
+        if (games != NULL) {
+            (void) free((void *) games);
+        }
+        return FALSE;
+    }
+    index->contents = NULL;
+    index->size = 0;
+    index->games = games;
+    index->num_games = num_games;
+    index->num_games_processed = 0;
+    index->num_games_matched = 0;
+    return TRUE;
+}
+
+/* Write index to index_file.
+ * The file is written under a temporary name and then renamed,
+ * so that concurrent runs never see a partial index.
+ */
+static void
+write_game_index(const char *index_file, const GameIndex *index)
+{
+    GameIndexHeader header;
+    char *temporary_file;
+    unsigned file_number;
+    FILE *fp;
+    Boolean ok = TRUE;
+
+    memset((void *) &header, 0, sizeof (header));
+    memcpy((void *) header.magic, GAME_INDEX_MAGIC, sizeof (header.magic));
+    header.byte_order = NATIVE_BYTE_ORDER;
+    for (file_number = 0; input_file_name(file_number) != NULL; file_number++) {
+        header.names_length += strlen(input_file_name(file_number)) + 1;
+    }
+    header.num_files = file_number;
+    header.num_games = index->num_games;
+    header.options = index_options();
+    header.num_games_processed = index->num_games_processed;
+    header.num_games_matched = index->num_games_matched;
+    header.games_offset = sizeof (header) + header.num_files * sizeof (GameIndexFile) +
+            (header.names_length + 7) / 8 * 8;
+
+    temporary_file = temporary_file_name(index_file);
+    fp = fopen(temporary_file, "wb");
+    if (fp != NULL) {
+        static const char padding[8] = { 0 };
+
+        ok = fwrite((void *) &header, sizeof (header), 1, fp) == 1;
+        for (file_number = 0; file_number < header.num_files && ok; file_number++) {
+            GameIndexFile details;
+            ok = input_file_details(file_number, &details) &&
+                    fwrite((void *) &details, sizeof (details), 1, fp) == 1;
+        }
+        for (file_number = 0; file_number < header.num_files && ok; file_number++) {
+            const char *name = input_file_name(file_number);
+            ok = fwrite((void *) name, 1, strlen(name) + 1, fp) == strlen(name) + 1;
+        }
+        ok = ok && fwrite((void *) padding, 1, (size_t) ((8 - header.names_length % 8) % 8), fp) ==
+                (size_t) ((8 - header.names_length % 8) % 8);
+        ok = ok && (index->num_games == 0 ||
+                fwrite((void *) index->games, sizeof (*index->games),
+                        (size_t) index->num_games, fp) == index->num_games);
+        ok = fclose(fp) == 0 && ok;
+        if (ok) {
+            ok = replace_file(temporary_file, index_file);
+        }
+        else {
+            (void) remove(temporary_file);
+        }
+    }
+    else {
+        ok = FALSE;
+    }
+    if (!ok) {
+        fprintf(GlobalState.logfile, "Unable to write the game index %s\n", index_file);
+    }
+    else if (GlobalState.verbosity > 1) {
+        fprintf(GlobalState.logfile, "The game index %s holds %lu games.\n",
+                index_file, (unsigned long) index->num_games);
+    }
+    (void) free((void *) temporary_file);
+}
+
+/* Read index_file into index.
+ * Return FALSE if it cannot be read or is not an index of the
+ * current input files as they are now.
+ */
+static Boolean
+read_game_index(const char *index_file, GameIndex *index)
+{
+    const GameIndexHeader *header;
+    const char *contents;
+    size_t size;
+
+    contents = read_whole_file(index_file, &size);
+    if (contents == NULL) {
+        return FALSE;
+    }
+    if (size < sizeof (GameIndexHeader) || !valid_game_index(contents, size)) {
+        release_whole_file(contents, size);
+        return FALSE;
+    }
+    header = (const GameIndexHeader *) contents;
+    index->contents = contents;
+    index->size = size;
+    index->games = (const GameIndexEntry *) (contents + header->games_offset);
+    index->num_games = header->num_games;
+    index->num_games_processed = header->num_games_processed;
+    index->num_games_matched = header->num_games_matched;
+    return TRUE;
+}
+
+static void
+release_game_index(GameIndex *index)
+{
+    if (index->contents != NULL) {
+        release_whole_file(index->contents, index->size);
+    }
+    else if (index->games != NULL) {
+        (void) free((void *) index->games);
+    }
+    index->contents = NULL;
+    index->games = NULL;
+    index->num_games = 0;
+}
+
+/* Return whether contents, which is size bytes long, is an index
+ * of the current input files as they are now.
+ */
+static Boolean
+valid_game_index(const char *contents, size_t size)
+{
+    const GameIndexHeader *header = (const GameIndexHeader *) contents;
+    const GameIndexFile *files;
+    const GameIndexEntry *games;
+    const char *name;
+    unsigned file_number;
+    uint64_t g;
+
+    if (memcmp(header->magic, GAME_INDEX_MAGIC, sizeof (header->magic)) != 0 ||
+            header->byte_order != NATIVE_BYTE_ORDER ||
+            header->options != index_options() ||
+            header->num_files > size || header->names_length > size ||
+            header->num_games > size ||
+            header->games_offset != sizeof (*header) +
+                    header->num_files * sizeof (GameIndexFile) +
+                    (header->names_length + 7) / 8 * 8 ||
+            header->games_offset + header->num_games * sizeof (GameIndexEntry) != size) {
+        return FALSE;
+    }
+    files = (const GameIndexFile *) (contents + sizeof (*header));
+    games = (const GameIndexEntry *) (contents + header->games_offset);
+
+    /* The files must be the input files, unchanged. */
+    name = (const char *) &files[header->num_files];
+    for (file_number = 0; file_number < header->num_files; file_number++) {
+        GameIndexFile details;
+        const char *end = memchr(name, '\0', (size_t) (contents + header->games_offset - name));
+
+        if (end == NULL || input_file_name(file_number) == NULL ||
+                strcmp(input_file_name(file_number), name) != 0 ||
+                !input_file_details(file_number, &details) ||
+                details.size != files[file_number].size ||
+                details.modified != files[file_number].modified) {
+            return FALSE;
+        }
+        name = end + 1;
+    }
+    if (input_file_name(file_number) != NULL) {
+        return FALSE;
+    }
+
+    /* The games must lie within the files, in order, and their
+     * counts must not decrease.
+     */
+    for (g = 0; g < header->num_games; g++) {
+        const GameIndexEntry *game = &games[g];
+        if (game->file_number >= header->num_files ||
+                game->start > files[game->file_number].size ||
+                game->length > files[game->file_number].size - game->start ||
+                game->matched_before > game->processed_before ||
+                game->processed_before > header->num_games_processed ||
+                game->matched_before > header->num_games_matched ||
+                (g > 0 && (game->file_number < games[g - 1].file_number ||
+                           (game->file_number == games[g - 1].file_number &&
+                            game->start <= games[g - 1].start) ||
+                           game->processed_before < games[g - 1].processed_before ||
+                           game->matched_before < games[g - 1].matched_before))) {
+            return FALSE;
+        }
+    }
+    if (header->num_games_matched > header->num_games_processed) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Return whether the tags of game are still those indexed. */
+static Boolean
+game_is_unchanged(const GameIndexEntry *game)
+{
+    FILE *fp = fopen(input_file_name(game->file_number), "rb");
+    size_t length = game->length < FINGERPRINT_LENGTH ?
+            (size_t) game->length : FINGERPRINT_LENGTH;
+    char text[FINGERPRINT_LENGTH];
+    Boolean unchanged = FALSE;
+
+    if (fp != NULL) {
+        unchanged = fseek(fp, (long) game->start, SEEK_SET) == 0 &&
+                fread((void *) text, 1, length, fp) == length &&
+                game_fingerprint(text, length) == game->fingerprint;
+        (void) fclose(fp);
+    }
+    return unchanged;
+}
+
+/* Return why games selected by number cannot be found from the
+ * index, or NULL if they can.
+ * A game's number only follows from the valid games before it
+ * if there are no other criteria.
+ */
+static const char *
+game_numbers_not_usable(void)
+{
+    unsigned file_number;
+
+    if (GlobalState.check_tags || GlobalState.positional_variations ||
+            textual_variations_present() || material_criteria_present() ||
+            GlobalState.check_move_bounds || GlobalState.match_only_checkmate ||
+            GlobalState.match_only_stalemate || GlobalState.check_for_repetition ||
+            GlobalState.check_for_fifty_move_rule || GlobalState.match_underpromotion ||
+            GlobalState.setup_status != SETUP_TAG_OK ||
+            GlobalState.reject_inconsistent_results) {
+        return "games are matched by other criteria";
+    }
+    else if (GlobalState.suppress_duplicates || GlobalState.suppress_originals) {
+        return "duplicate games are suppressed";
+    }
+    else if (GlobalState.non_matching_file != NULL) {
+        return "games that do not match are to be output";
+    }
+    else if (GlobalState.build_position_index != NULL) {
+        return "a position index is being built";
+    }
+    for (file_number = 0; input_file_name(file_number) != NULL; file_number++) {
+        if (input_file_type(file_number) != NORMALFILE) {
+            return "check files are to be read";
+        }
+    }
+    return NULL;
+}
+
+/* Return the first range of the list starting at range that
+ * does not end before number, or NULL if there is none.
+ */
+static game_number *
+range_at_or_after(game_number *range, unsigned long number)
+{
+    while (range != NULL && range->max < number) {
+        range = range->next;
+    }
+    return range;
+}
+
+/* Return the number of the first game to be read, from number on,
+ * or 0 if there is none, setting *last to the number of the last
+ * game of the run of games that it starts.
+ */
+static unsigned long
+next_game_wanted(unsigned long number, unsigned long *last)
+{
+    for (;;) {
+        game_number *selected = range_at_or_after(GlobalState.matching_game_numbers, number);
+        game_number *skipped;
+
+        if (GlobalState.matching_game_numbers != NULL) {
+            if (selected == NULL) {
+                return 0;
+            }
+            if (number < selected->min) {
+                number = selected->min;
+            }
+        }
+        skipped = range_at_or_after(GlobalState.skip_game_numbers, number);
+        if (skipped != NULL && skipped->min <= number) {
+            number = skipped->max + 1;
+        }
+        else {
+            *last = selected != NULL ? selected->max : (unsigned long) -1;
+            if (skipped != NULL && skipped->min - 1 < *last) {
+                *last = skipped->min - 1;
+            }
+            return number;
+        }
+    }
+}
+
+/* Return the indexed game in which the game numbered number,
+ * counting from 1 those that matched, was found.
+ */
+static uint64_t
+entry_of_game(const GameIndex *index, unsigned long number)
+{
+    /* Find the last indexed game with fewer than number matched before it. */
+    uint64_t low = 0, high = index->num_games;
+
+    while (high - low > 1) {
+        uint64_t middle = low + (high - low) / 2;
+        if (index->games[middle].matched_before < number) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* Return whether reading may start at the indexed game g, because
+ * that is where a game started when every game was read.
+ */
+static Boolean
+reading_can_start_at(const GameIndex *index, uint64_t g)
+{
+    return g == 0 ||
+            index->games[g - 1].file_number != index->games[g].file_number ||
+            (index->games[g].flags & GAME_STARTS_HERE) != 0;
+}
+
+/* Return whether the first and last games of each run of games to
+ * be read are those indexed.
+ */
+static Boolean
+selected_games_unchanged(const GameIndex *index)
+{
+    unsigned long number = 1, last;
+    Boolean unchanged = TRUE;
+
+    while (unchanged && number <= index->num_games_matched &&
+            (number = next_game_wanted(number, &last)) != 0 &&
+            number <= index->num_games_matched) {
+        if (last > index->num_games_matched) {
+            last = (unsigned long) index->num_games_matched;
+        }
+        unchanged = game_is_unchanged(&index->games[entry_of_game(index, number)]) &&
+                game_is_unchanged(&index->games[entry_of_game(index, last)]);
+        number = last + 1;
+    }
+    return unchanged;
+}
+
+/* Read and deal with the games of the indexed games first to last.
+ * Reading must be able to start at first and at the indexed game
+ * after last.
+ * The games are numbered as they would be if all the games before
+ * them had been read.
+ */
+static void
+read_games(const GameIndex *index, uint64_t first, uint64_t last)
+{
+    uint64_t g = first;
+
+    while (g <= last && !finished_processing()) {
+        const GameIndexEntry *game = &index->games[g];
+        unsigned file_number = game->file_number;
+        /* The last indexed game to be read from this file. */
+        uint64_t end = g;
+        Boolean first_in_file = g == 0 || index->games[g - 1].file_number != file_number;
+        Boolean last_in_file;
+        uint64_t start, section_end;
+
+        while (end < last && index->games[end + 1].file_number == file_number) {
+            end++;
+        }
+        last_in_file = end + 1 == index->num_games ||
+                index->games[end + 1].file_number != file_number;
+        /* Anything before the first game belongs to it. */
+        start = first_in_file ? 0 : game->start;
+        section_end = index->games[end].start + index->games[end].length;
+
+        GlobalState.num_games_processed = (unsigned long) game->processed_before;
+        GlobalState.num_games_matched = (unsigned long) game->matched_before;
+        if (GlobalState.matching_game_numbers != NULL) {
+            GlobalState.next_game_number_to_output =
+                    range_at_or_after(GlobalState.matching_game_numbers,
+                                      GlobalState.num_games_matched + 1);
+        }
+        if (GlobalState.skip_game_numbers != NULL) {
+            GlobalState.next_game_number_to_skip =
+                    range_at_or_after(GlobalState.skip_game_numbers,
+                                      GlobalState.num_games_matched + 1);
+        }
+        if (open_input_section(file_number, (long) start, (long) (section_end - start),
+                    first_in_file ? 0 : (unsigned long) game->lines_before)) {
+            parse_selected_section(GlobalState.current_file_type,
+                    !(last_in_file && input_file_name(file_number + 1) == NULL));
+            close_input_section();
+        }
+        else {
+            fprintf(GlobalState.logfile, "Unable to read the PGN file: %s\n",
+                    input_file_name(file_number));
+        }
+        g = end + 1;
+    }
+}
+
+/* Read and deal with just the games selected by number. */
+static void
+read_selected_games(const GameIndex *index)
+{
+    unsigned long number = 1, last;
+    /* The first indexed game not yet read. */
+    uint64_t next_unread = 0;
+
+    terminate_input();
+    while (number <= index->num_games_matched && !finished_processing() &&
+            (number = next_game_wanted(number, &last)) != 0 &&
+            number <= index->num_games_matched) {
+        uint64_t first_game, last_game;
+
+        if (last > index->num_games_matched) {
+            last = (unsigned long) index->num_games_matched;
+        }
+        if (GlobalState.maximum_matches > 0) {
+            /* Games beyond the maximum would not be reached. */
+            if (number > GlobalState.maximum_matches) {
+                break;
+            }
+            if (last > GlobalState.maximum_matches) {
+                last = GlobalState.maximum_matches;
+            }
+        }
+        first_game = entry_of_game(index, number);
+        last_game = entry_of_game(index, last);
+        /* Start and end where games started when they were all read. */
+        while (!reading_can_start_at(index, first_game)) {
+            first_game--;
+        }
+        while (last_game + 1 < index->num_games &&
+                !reading_can_start_at(index, last_game + 1)) {
+            last_game++;
+        }
+        if (first_game < next_unread) {
+            first_game = next_unread;
+        }
+        if (first_game <= last_game) {
+            read_games(index, first_game, last_game);
+            next_unread = last_game + 1;
+        }
+        number = last + 1;
+    }
+    if (!finished_processing()) {
+        /* The remaining games would all have been read. */
+        GlobalState.num_games_processed = (unsigned long) index->num_games_processed;
+        GlobalState.num_games_matched = (unsigned long) index->num_games_matched;
+    }
+}
+
+/* Use index_file, an index of the games of the input files (--gameindex),
+ * to read and deal with just the games selected by number
+ * (--selectonly, --skipmatching), and return TRUE.
+ * Otherwise, return FALSE, having read nothing, in which case every
+ * game must be read.
+ * If the index is missing or out of date and no other selection
+ * criteria are in use then a new one is built while the games are
+ * read, to be written by complete_game_index.
+ * The first input file has already been opened by open_first_file.
+ */
+Boolean
+process_games_with_game_index(const char *index_file)
+{
+    GameIndex index;
+    const char *reason;
+    Boolean selecting = GlobalState.matching_game_numbers != NULL ||
+            GlobalState.skip_game_numbers != NULL;
+    Boolean up_to_date;
+
+    if (input_file_name(0) == NULL) {
+        fprintf(GlobalState.logfile,
+                "--gameindex requires named input files: all the games will be read.\n");
+        return FALSE;
+    }
+    reason = game_numbers_not_usable();
+    up_to_date = read_game_index(index_file, &index);
+    if (up_to_date && selecting && reason == NULL &&
+            !selected_games_unchanged(&index)) {
+        /* The files have changed without changing their size or time. */
+        release_game_index(&index);
+        up_to_date = FALSE;
+    }
+    if (!up_to_date) {
+        if (reason != NULL) {
+            fprintf(GlobalState.logfile,
+                    "--gameindex is not built because %s: all the games will be read.\n",
+                    reason);
+        }
+        else if (build_game_index(&new_index)) {
+            new_index_file = index_file;
+            current_entry = 0;
+            unindexed_game_read = FALSE;
+        }
+        return FALSE;
+    }
+    if (!selecting) {
+        release_game_index(&index);
+        return FALSE;
+    }
+    if (reason != NULL) {
+        fprintf(GlobalState.logfile,
+                "--gameindex is not used because %s: all the games will be read.\n",
+                reason);
+        release_game_index(&index);
+        return FALSE;
+    }
+    read_selected_games(&index);
+    release_game_index(&index);
+    return TRUE;
+}
+
+/* Record that a game starting at start_offset in the given input
+ * file has been read, and whether it matched, in any game index
+ * being built.
+ * start_offset is -1 if it is not known.
+ */
+void
+note_indexed_game(unsigned file_number, long start_offset, Boolean matched)
+{
+    GameIndexEntry *games = (GameIndexEntry *) new_index.games;
+    uint64_t g = current_entry;
+
+    if (new_index_file == NULL || unindexed_game_read) {
+        return;
+    }
+    if (start_offset < 0) {
+        unindexed_game_read = TRUE;
+        return;
+    }
+    /* Find the last indexed game that starts no later than this one.
+     * Anything before the first game of a file belongs to it.
+     */
+    while (g + 1 < new_index.num_games &&
+            (games[g + 1].file_number < file_number ||
+             (games[g + 1].file_number == file_number &&
+              games[g + 1].start <= (uint64_t) start_offset))) {
+        g++;
+    }
+    if (g >= new_index.num_games ||
+            games[g].file_number != file_number) {
+        unindexed_game_read = TRUE;
+        return;
+    }
+    current_entry = g;
+    /* The counts are of the games of each indexed game until
+     * complete_game_index turns them into running totals.
+     */
+    games[g].processed_before++;
+    if (matched) {
+        games[g].matched_before++;
+    }
+    if ((uint64_t) start_offset == games[g].start) {
+        games[g].flags |= GAME_STARTS_HERE;
+    }
+}
+
+/* Write any game index built while the games were read, provided
+ * that all of them were read, recording how many games were
+ * processed and matched before each one.
+ */
+void
+complete_game_index(Boolean all_games_read)
+{
+    if (new_index_file == NULL) {
+        return;
+    }
+    if (!all_games_read) {
+        fprintf(GlobalState.logfile,
+                "Not all the games were read, so the game index %s was not written.\n",
+                new_index_file);
+    }
+    else if (unindexed_game_read) {
+        fprintf(GlobalState.logfile,
+                "Not every game could be found in the game index %s, so it was not written.\n",
+                new_index_file);
+    }
+    else {
+        GameIndexEntry *games = (GameIndexEntry *) new_index.games;
+        uint64_t processed = 0, matched = 0;
+        uint64_t g;
+
+        for (g = 0; g < new_index.num_games; g++) {
+            uint64_t processed_here = games[g].processed_before;
+            uint64_t matched_here = games[g].matched_before;
+
+            games[g].processed_before = processed;
+            games[g].matched_before = matched;
+            processed += processed_here;
+            matched += matched_here;
+        }
+        new_index.num_games_processed = processed;
+        new_index.num_games_matched = matched;
+        write_game_index(new_index_file, &new_index);
+    }
+    release_game_index(&new_index);
+    new_index_file = NULL;
+}
@@ -0,0 +1,47 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+#ifndef GAMEINDEX_H
+#define GAMEINDEX_H
+
+/* The state of a scan of the text of a PGN file for the
+ * lines on which games start.
+ */
+typedef struct {
+    const char *text;
+    size_t size;
+    /* The offset of the next line to be scanned. */
+    size_t line_start;
+    /* The number of lines before line_start. */
+    unsigned long line_count;
+    /* The comment nesting depth at the start of the next line. */
+    unsigned comment_depth;
+    /* Whether the previous significant line was a tag line. */
+    Boolean previous_line_was_tag;
+} GameScanner;
+
+void start_game_scan(GameScanner *scanner, const char *text, size_t size);
+Boolean find_next_game(GameScanner *scanner, size_t *start, unsigned long *lines_before);
+Boolean process_games_with_game_index(const char *index_file);
+void note_indexed_game(unsigned file_number, long start_offset, Boolean matched);
+void complete_game_index(Boolean all_games_read);
+
+#endif	// GAMEINDEX_H
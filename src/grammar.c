@@ -39,9 +39,27 @@
 #include "end.h"
 #include "grammar.h"
 #include "hashing.h"
+#include "parallel.h"
+#include "outputcache.h"
+#include "posindex.h"
+#include "gameindex.h"
 
 static TokenType current_symbol = NO_TOKEN;
 
+/* Whether the outcome of each game is to be sent to a parent
+ * process rather than acted upon (see parse_input_section).
+ */
+static Boolean sending_outcomes = FALSE;
+/* Whether the end of the input is the start of another game
+ * rather than the true end of the input (see parse_input_section).
+ */
+static Boolean section_ends_at_game_boundary = FALSE;
+/* The input file and the offset in it of the line on which the
+ * current game starts, or -1 if the offset is not known.
+ */
+static long game_start_offset = -1;
+static unsigned game_start_file = 0;
+
 /* Keep track of which RAV level we are at.
  * This is used to check whether a TERMINATING_RESULT is the final one
  * and whether NULL_MOVEs are allowed.
@@ -63,7 +81,8 @@ static struct {
 } GameHeader;
 
 static void parse_opt_game_list(SourceFileType file_type);
-static Boolean parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *end_line);
+static Boolean parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *end_line,
+                          Boolean judge_tags_first, Boolean *rejected_on_tags);
 Boolean parse_opt_tag_list(void);
 Boolean parse_tag(void);
 static Move *parse_move_list(void);
@@ -82,7 +101,16 @@ void free_tags(void);
 static void check_result(char **Tags, const char *terminating_result);
 static void deal_with_ECO_line(Move *move_list);
 static void deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line);
-static Boolean finished_processing(void);
+static Boolean tags_can_be_judged_first(SourceFileType file_type);
+static Boolean tags_rejected_early(void);
+static void deal_with_rejected_game(void);
+static Boolean game_is_wanted(Game *current_game, unsigned *plycount);
+static void dispose_of_game(Game *current_game, Boolean wanted, unsigned plycount,
+                            const GameOutcome *outcome);
+static void write_game(Game *current_game, const GameOutcome *outcome, FILE *outputfile);
+static void send_outcome_of_game(Game *current_game, Boolean wanted, unsigned plycount);
+static void report_progress(void);
+static Boolean more_games_follow(Boolean game_found);
 static void output_game(Game *game,FILE *outputfile);
 static void split_variants(Game *game, FILE *outputfile, unsigned depth);
 static Boolean chess960_setup(Board *board);
@@ -180,15 +208,15 @@ check_result(char **Tags, const char *terminating_result)
     
     if(result_tag != NULL && strcmp(result_tag, "1/2") == 0) {
         /* Inappropriate short form. */
-        (void) free(result_tag);
-        result_tag = Tags[RESULT_TAG] = copy_string("1/2-1/2");
+        game_free(result_tag);
+        result_tag = Tags[RESULT_TAG] = game_copy_string("1/2-1/2");
     }
 
     if (terminating_result != NULL) {
         if ((result_tag == NULL) || (*result_tag == '\0') ||
                 (strcmp(result_tag, "?") == 0)) {
             /* Use a copy of terminating result. */
-            result_tag = copy_string(terminating_result);
+            result_tag = game_copy_string(terminating_result);
             Tags[RESULT_TAG] = result_tag;
         }
         else {
@@ -224,7 +252,7 @@ select_output_file(StateInfo *GameState, const char *eco)
             sprintf(filename, "%u%s",
                     GameState->next_file_number,
                     output_file_suffix(GameState->output_format));
-            GameState->outputfile = must_open_file(filename, "w");
+            GameState->outputfile = open_buffered_output_file(filename, "w");
             GameState->next_file_number++;
             if (GlobalState.json_format) {
                 fputs("[\n", GlobalState.outputfile);
@@ -233,16 +261,10 @@ select_output_file(StateInfo *GameState, const char *eco)
     }
     else {
         if (GameState->ECO_level > DONT_DIVIDE) {
-            /* Open a file of the appropriate name. */
-            if (GameState->outputfile != NULL) {
-                /* @@@ In practice, this might need refinement.
-                 * Repeated opening and closing may prove inefficient.
-                 */
-                (void) fclose(GameState->outputfile);
-                GameState->outputfile = open_eco_output_file(
-                        GameState->ECO_level,
-                        eco);
-            }
+            /* Select a file of the appropriate name. */
+            GameState->outputfile = open_eco_output_file(
+                    GameState->ECO_level,
+                    eco);
         }
         else if (GlobalState.json_format && GameState->num_games_matched == 1) {
             fputs("[\n", GlobalState.outputfile);
@@ -257,7 +279,7 @@ select_output_file(StateInfo *GameState, const char *eco)
  * Conditions for finishing processing, other than all the input
  * having been processed.
  */
-static Boolean finished_processing(void)
+Boolean finished_processing(void)
 {
     return (GlobalState.matching_game_numbers != NULL &&
             GlobalState.next_game_number_to_output == NULL) ||
@@ -279,9 +301,16 @@ parse_opt_game_list(SourceFileType file_type)
 {
     Move *move_list = NULL;
     unsigned long start_line, end_line;
-
-    while (parse_game(&move_list, &start_line, &end_line) && !finished_processing()) {
-        if (file_type == NORMALFILE) {
+    const Boolean judge_tags_first = tags_can_be_judged_first(file_type);
+    Boolean rejected_on_tags = FALSE;
+
+    while (parse_game(&move_list, &start_line, &end_line,
+                      judge_tags_first, &rejected_on_tags) &&
+            !finished_processing()) {
+        if (rejected_on_tags) {
+            deal_with_rejected_game();
+        }
+        else if (file_type == NORMALFILE) {
             deal_with_game(move_list, start_line, end_line);
         }
         else if (file_type == CHECKFILE) {
@@ -294,6 +323,8 @@ parse_opt_game_list(SourceFileType file_type)
             else {
                 fprintf(GlobalState.logfile, "ECO line with zero moves.\n");
                 report_details(GlobalState.logfile);
+                /* Its comment lives in the arena that is about to be reused. */
+                GameHeader.prefix_comment = NULL;
             }
         }
         else {
@@ -311,9 +342,13 @@ parse_opt_game_list(SourceFileType file_type)
 
 /* Parse a game and return a pointer to any valid list of moves
  * in returned_move_list.
+ * If judge_tags_first then the game's tags are checked before
+ * its moves are parsed. If they are rejected then the moves are
+ * skipped and *rejected_on_tags is set.
  */
 static Boolean
-parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *end_line)
+parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *end_line,
+           Boolean judge_tags_first, Boolean *rejected_on_tags)
 { /* Boolean something_found = FALSE; */
     CommentList *prefix_comment;
     Move *move_list = NULL;
@@ -322,11 +357,15 @@ parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *
      * but there sometimes is.
      */
     CommentList *hanging_comment;
+    /* Whether there is anything other than the end of the input. */
+    Boolean game_found;
 
     /* Assume that we won't return anything. */
     *returned_move_list = NULL;
+    *rejected_on_tags = FALSE;
     /* Skip over any junk between games. */
     current_symbol = skip_to_next_game(current_symbol);
+    game_found = current_symbol != EOF_TOKEN;
     prefix_comment = parse_opt_comment_list();
     if (prefix_comment != NULL) {
         /* Free this here, as it is hard to
@@ -338,6 +377,8 @@ parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *
         prefix_comment = NULL;
     }
     *start_line = get_line_number();
+    game_start_offset = get_line_offset();
+    game_start_file = current_file_number();
     if (parse_opt_tag_list()) {
         /* something_found = TRUE; */
     }
@@ -350,6 +391,14 @@ parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *
         current_symbol = next_token();
     }
 
+    if (judge_tags_first && tags_rejected_early()) {
+        /* There is no need to parse the moves. */
+        current_symbol = skip_movetext(current_symbol);
+        *end_line = get_line_number();
+        *rejected_on_tags = TRUE;
+        return more_games_follow(game_found);
+    }
+
     /* @@@ Beware of comments and/or tags without moves. */
     move_list = parse_move_list();
 
@@ -384,7 +433,7 @@ parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *
     }
     else {
         /* @@@ Nothing to attach the comment to. */
-        (void) free((void *) hanging_comment);
+        game_free((void *) hanging_comment);
         hanging_comment = NULL;
         /*
          * Workaround for games with zero moves.
@@ -395,11 +444,22 @@ parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *
          */
         check_result(GameHeader.Tags, result);
         if (result != NULL) {
-            (void) free((void *) result);
+            game_free((void *) result);
         }
         *returned_move_list = NULL;
     }
-    return current_symbol != EOF_TOKEN;
+    return more_games_follow(game_found);
+}
+
+/* Return TRUE if the game just parsed should be dealt with because
+ * the input continues beyond it.
+ * game_found indicates whether anything was found to parse.
+ */
+static Boolean
+more_games_follow(Boolean game_found)
+{
+    return current_symbol != EOF_TOKEN ||
+            (game_found && section_ends_at_game_boundary);
 }
 
 Boolean
@@ -513,7 +573,7 @@ parse_tag(void)
     else if (current_symbol == STRING) {
         print_error_context(GlobalState.logfile);
         fprintf(GlobalState.logfile, "Missing tag for %s.\n", yylval.token_string);
-        (void) free((void *) yylval.token_string);
+        game_free((void *) yylval.token_string);
         current_symbol = next_token();
     }
     else {
@@ -643,7 +703,7 @@ static void
 parse_opt_NAG_list(Move *move_details)
 {
     while (current_symbol == NAG) {
-        Nag *details = (Nag *) malloc_or_die(sizeof(*details));
+        Nag *details = (Nag *) game_alloc(sizeof(*details));
         details->text = NULL;
         details->comments = NULL;
         details->next = NULL;
@@ -695,7 +755,7 @@ parse_variant(void)
         Move *moves;
 
         RAV_level++;
-        variation = (Variation *) malloc_or_die(sizeof (Variation));
+        variation = (Variation *) game_alloc(sizeof (Variation));
 
         current_symbol = next_token();
         prefix_comment = parse_opt_comment_list();
@@ -766,11 +826,29 @@ parse_result(void)
     return result;
 }
 
+/* Move into the new game's arena any tags that were not freed
+ * with the previous game, e.g. those of an ECO line with zero moves,
+ * so that they do not refer to space that is about to be reused.
+ */
+static void
+keep_unfreed_tags(void)
+{
+    unsigned tag;
+
+    for (tag = 0; tag < GameHeader.header_tags_length; tag++) {
+        if (GameHeader.Tags[tag] != NULL) {
+            GameHeader.Tags[tag] = game_copy_string(GameHeader.Tags[tag]);
+        }
+    }
+}
+
 static void
 setup_for_new_game(void)
 {
     restart_lex_for_new_game();
     RAV_level = 0;
+    next_game_arena();
+    keep_unfreed_tags();
 }
 
 /* Discard any data held in the GameHeader.Tags structure. */
@@ -781,7 +859,7 @@ free_tags(void)
 
     for (tag = 0; tag < GameHeader.header_tags_length; tag++) {
         if (GameHeader.Tags[tag] != NULL) {
-            free(GameHeader.Tags[tag]);
+            game_free(GameHeader.Tags[tag]);
             GameHeader.Tags[tag] = NULL;
         }
     }
@@ -797,9 +875,9 @@ free_string_list(StringList *list)
         next = list;
         list = list->next;
         if (next->str != NULL) {
-            (void) free((void *) next->str);
+            game_free((void *) next->str);
         }
-        (void) free((void *) next);
+        game_free((void *) next);
     }
 }
 
@@ -813,7 +891,7 @@ free_comment_list(CommentList *comment_list)
             free_string_list(comment_list->comment);
         }
         comment_list = comment_list->next;
-        (void) free((void *) this_comment);
+        game_free((void *) this_comment);
     }
 }
 
@@ -834,7 +912,7 @@ free_variation(Variation *variation)
         if (next->moves != NULL) {
             (void) free_move_list(next->moves);
         }
-        (void) free((void *) next);
+        game_free((void *) next);
     }
 }
 
@@ -844,7 +922,7 @@ static void free_NAG_list(Nag *nag_list)
         Nag *nextNAG = nag_list->next;
         free_string_list(nag_list->text);
         free_comment_list(nag_list->comments);
-        (void) free((void *) nag_list);
+        game_free((void *) nag_list);
         nag_list = nextNAG;
     }
 }
@@ -863,17 +941,17 @@ free_move_list(Move *move_list)
         free_variation(nextMove->Variants);
         
         if (nextMove->epd != NULL) {
-            (void) free((void *) nextMove->epd);
+            game_free((void *) nextMove->epd);
         }
         if(nextMove->fen_suffix != NULL) {
-            (void) free((void *) nextMove->fen_suffix);
+            game_free((void *) nextMove->fen_suffix);
             nextMove->fen_suffix = NULL;
         }
         if (nextMove->terminating_result != NULL) {
-            (void) free((void *) nextMove->terminating_result);
+            game_free((void *) nextMove->terminating_result);
         }
         
-        (void) free((void *) nextMove);
+        game_free((void *) nextMove);
     }
 }
 
@@ -886,7 +964,7 @@ save_string_list_item(StringList *list, const char *str)
     if (str != NULL && *str != '\0') {
         StringList *new_item;
 
-        new_item = (StringList *) malloc_or_die(sizeof (*new_item));
+        new_item = (StringList *) game_alloc(sizeof (*new_item));
         new_item->str = str;
         new_item->next = NULL;
         if (list == NULL) {
@@ -908,7 +986,7 @@ save_string_list_item(StringList *list, const char *str)
      * cautious.
      */
     else if(str != NULL) {
-        (void) free((void *) str);
+        game_free((void *) str);
     }
 #endif
     return list;
@@ -978,7 +1056,7 @@ static Boolean consistent_FEN_tags(Game *current_game)
                 print_error_context(GlobalState.logfile);
 #endif
                 /* Fix the inconsistency. */
-                current_game->tags[SETUP_TAG] = copy_string("1");
+                current_game->tags[SETUP_TAG] = game_copy_string("1");
             }
 
             Boolean chess960 = chess960_setup(board);
@@ -993,7 +1071,7 @@ static Boolean consistent_FEN_tags(Game *current_game)
                             tag_header_string(VARIANT_TAG),
 			    missing_value);
                     /* Fix the inconsistency. */
-                    current_game->tags[VARIANT_TAG] = copy_string(missing_value);
+                    current_game->tags[VARIANT_TAG] = game_copy_string(missing_value);
                 }
             }
             else if(chess960) {
@@ -1009,36 +1087,84 @@ static Boolean consistent_FEN_tags(Game *current_game)
     return consistent;
 }
 
-static void
-deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line)
+/* Return TRUE if the tags of games in a file of the given type
+ * may be judged before their moves are parsed.
+ * This is only done with --skiprejected, is only worthwhile if there
+ * are tag criteria, and is only possible if a rejected game is not
+ * required for anything else, and errors in every game are not
+ * being checked for (-r).
+ */
+static Boolean
+tags_can_be_judged_first(SourceFileType file_type)
 {
-    Game current_game;
-    /* We need a dummy argument for apply_move_list. */
-    unsigned plycount;
-    /* Whether the game matches, as long as it is not in a CHECKFILE. */
-    Boolean game_matches = FALSE;
-    /* Whether to output the game. */
-    Boolean output_the_game = FALSE;
+    return file_type != ECOFILE &&
+            GlobalState.skip_rejected_moves &&
+            (GlobalState.check_tags || GlobalState.setup_status != SETUP_TAG_OK) &&
+            GlobalState.non_matching_file == NULL &&
+            GlobalState.build_position_index == NULL &&
+            !GlobalState.check_only;
+}
 
-    /* Update the count of how many games handled. */
-    GlobalState.num_games_processed++;
+/* Return TRUE if the tags of the game just parsed mean that
+ * it will be rejected by deal_with_game, regardless of its moves.
+ * Return FALSE if the game is wanted or it is not possible
+ * to tell yet.
+ */
+static Boolean
+tags_rejected_early(void)
+{
+    char **tags = GameHeader.Tags;
+    const char *result = tags[RESULT_TAG];
 
-    /* Fill in the information currently known. */
-    current_game.tags = GameHeader.Tags;
-    current_game.tags_length = GameHeader.header_tags_length;
-    current_game.prefix_comment = GameHeader.prefix_comment;
-    current_game.moves = move_list;
-    current_game.moves_checked = FALSE;
-    current_game.moves_ok = FALSE;
-    current_game.error_ply = 0;
-    current_game.position_counts = NULL;
-    current_game.start_line = start_line;
-    current_game.end_line = end_line;
+    if (tags[FEN_TAG] != NULL) {
+        /* consistent_FEN_tags may add to the tags. */
+        return FALSE;
+    }
+    else if (result == NULL || *result == '\0' ||
+            strcmp(result, "?") == 0 || strcmp(result, "1/2") == 0) {
+        /* check_result may fill in the Result tag from the moves. */
+        return FALSE;
+    }
+    else {
+        return !check_tag_details_not_ECO(tags, GameHeader.header_tags_length) ||
+                !check_setup_tag(tags);
+    }
+}
 
-    /* Determine whether or not this game is wanted, on the
-     * basis of the various selection criteria available.
-     */
+/* Report progress through the input on stderr. */
+static void
+report_progress(void)
+{
+    if (GlobalState.verbosity != 0 && (GlobalState.num_games_processed % PROGRESS_RATE) == 0) {
+        fprintf(stderr, "Games: %lu\r", GlobalState.num_games_processed);
+    }
+}
 
+/* Dispose of a game whose tags were rejected by tags_rejected_early. */
+static void
+deal_with_rejected_game(void)
+{
+    if (sending_outcomes) {
+        send_outcome_of_game(NULL, FALSE, 0);
+    }
+    else {
+        GlobalState.num_games_processed++;
+        note_indexed_game(game_start_file, game_start_offset, FALSE);
+        report_progress();
+    }
+    if (GameHeader.prefix_comment != NULL) {
+        free_comment_list(GameHeader.prefix_comment);
+        GameHeader.prefix_comment = NULL;
+    }
+    free_tags();
+}
+
+/* Return TRUE if current_game satisfies the selection criteria.
+ * The number of ply in the game is returned in plycount.
+ */
+static Boolean
+game_is_wanted(Game *current_game, unsigned *plycount)
+{
     /*
      * apply_move_list checks out the moves.
      * If it returns TRUE as a match, it will also fill in the
@@ -1057,20 +1183,58 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
      * Therefore, Check for the ECO tag only after everything else has
      * been checked.
      */
-    if (consistent_FEN_tags(&current_game) &&
-        check_tag_details_not_ECO(current_game.tags, current_game.tags_length) &&
-        check_setup_tag(current_game.tags) &&
-        apply_move_list(&current_game, &plycount, GlobalState.depth_of_positional_search) &&
-        check_move_bounds(plycount) &&
-        check_textual_variations(&current_game) &&
-        check_for_material_match(&current_game) &&
-        check_for_only_checkmate(&current_game) &&
-        check_for_only_repetition(current_game.position_counts) &&
-        check_ECO_tag(current_game.tags)) {
+    return consistent_FEN_tags(current_game) &&
+        check_tag_details_not_ECO(current_game->tags, current_game->tags_length) &&
+        check_setup_tag(current_game->tags) &&
+        check_move_bounds_before_play(current_game) &&
+        apply_move_list(current_game, plycount, GlobalState.depth_of_positional_search) &&
+        check_move_bounds(*plycount) &&
+        check_textual_variations(current_game) &&
+        check_for_material_match(current_game) &&
+        check_for_only_checkmate(current_game) &&
+        check_for_only_repetition(current_game->position_counts) &&
+        check_ECO_tag(current_game->tags);
+}
+
+/* Write the game either by formatting current_game or, if
+ * it has already been formatted by a worker process,
+ * from the text in outcome.
+ */
+static void
+write_game(Game *current_game, const GameOutcome *outcome, FILE *outputfile)
+{
+    if (outcome == NULL) {
+        output_game(current_game, outputfile);
+    }
+    else if (outcome->text != NULL) {
+        if (outcome->output_messages != NULL) {
+            fputs(outcome->output_messages, GlobalState.logfile);
+        }
+        (void) fwrite((const void *) outcome->text, 1, outcome->text_length, outputfile);
+    }
+}
+
+/* Decide what to do with current_game now that it is known
+ * whether it satisfies the selection criteria.
+ * This is the part of dealing with a game that depends on
+ * the games that came before it.
+ * outcome is NULL, unless the game was dealt with by a worker process
+ * and current_game holds just its hash values.
+ */
+static void
+dispose_of_game(Game *current_game, Boolean wanted, unsigned plycount,
+                const GameOutcome *outcome)
+{
+    /* Whether the game matches, as long as it is not in a CHECKFILE. */
+    Boolean game_matches = FALSE;
+    /* Whether to output the game. */
+    Boolean output_the_game = FALSE;
+
+    if (wanted) {
         /* If there is no original filename then the game is not a
          * duplicate.
          */
-        const char *original_filename = previous_occurance(current_game, plycount);
+        const char *original_filename = previous_occurance(*current_game, plycount);
 
         if ((original_filename == NULL) && GlobalState.suppress_originals) {
             /* Don't output first occurrences. */
@@ -1097,7 +1261,12 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
                     /* We are only checking. */
                     if (GlobalState.verbosity > 1) {
                         /* Report progress on logfile. */
-                        report_details(GlobalState.logfile);
+                        if (outcome == NULL) {
+                            report_details(GlobalState.logfile);
+                        }
+                        else {
+                            fputs(outcome->details, GlobalState.logfile);
+                        }
                     }
                 }
                 else {
@@ -1107,7 +1276,7 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
             if(output_the_game) {
                 /* This game is to be kept and output. */
                 FILE *outputfile = select_output_file(&GlobalState,
-                        current_game.tags[ECO_TAG]);
+                        outcome == NULL ? current_game->tags[ECO_TAG] : outcome->eco);
 
                 /* See if we wish to separate out duplicates. */
                 if ((original_filename != NULL) &&
@@ -1137,10 +1306,15 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
                     }
                 }
                 /* Now output what we have. */
-                output_game(&current_game, outputfile);
+                write_game(current_game, outcome, outputfile);
                 if (GlobalState.verbosity > 1) {
                     /* Report progress on logfile. */
-                    report_details(GlobalState.logfile);
+                    if (outcome == NULL) {
+                        report_details(GlobalState.logfile);
+                    }
+                    else {
+                        fputs(outcome->details, GlobalState.logfile);
+                    }
                 }
             }
         }
@@ -1148,14 +1322,25 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
     if (!game_matches && (GlobalState.non_matching_file != NULL) &&
             GlobalState.current_file_type != CHECKFILE) {
         /* The user wants to keep everything else. */
-        if (!current_game.moves_checked) {
-            /* Make sure that the move text is in a reasonable state.
-             * Force checking of the whole game.
-             */
-            (void) apply_move_list(&current_game, &plycount, 0);
+        if (outcome != NULL) {
+            if (outcome->non_matching_ok) {
+                write_game(current_game, outcome, GlobalState.non_matching_file);
+            }
+            else if (outcome->output_messages != NULL) {
+                /* Report the problems found in checking the moves. */
+                fputs(outcome->output_messages, GlobalState.logfile);
+            }
         }
-        if (current_game.moves_ok || GlobalState.keep_broken_games) {
-            output_game(&current_game, GlobalState.non_matching_file);
+        else {
+            if (!current_game->moves_checked) {
+                /* Make sure that the move text is in a reasonable state.
+                 * Force checking of the whole game.
+                 */
+                (void) apply_move_list(current_game, &plycount, 0);
+            }
+            if (current_game->moves_ok || GlobalState.keep_broken_games) {
+                output_game(current_game, GlobalState.non_matching_file);
+            }
         }
     }
     if (game_matches && GlobalState.matching_game_numbers != NULL &&
@@ -1165,6 +1350,119 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
             GlobalState.next_game_number_to_output = GlobalState.next_game_number_to_output->next;
         }
     }
+}
+
+/* Record the outcome of dealing with current_game in a
+ * worker process and send it to the parent.
+ * current_game is NULL if it was rejected on its tags alone.
+ */
+static void
+send_outcome_of_game(Game *current_game, Boolean wanted, unsigned plycount)
+{
+    GameOutcome outcome;
+
+    outcome.wanted = wanted;
+    outcome.non_matching_ok = FALSE;
+    outcome.plycount = plycount;
+    outcome.start_offset = game_start_offset;
+    outcome.final_hash_value = 0;
+    outcome.cumulative_hash_value = 0;
+    outcome.fuzzy_duplicate_hash = 0;
+    outcome.eco = NULL;
+    outcome.details = NULL;
+    outcome.text = NULL;
+    outcome.text_length = 0;
+    outcome.output_messages = NULL;
+
+    if (current_game != NULL) {
+        end_of_matching_messages();
+        outcome.final_hash_value = current_game->final_hash_value;
+        outcome.cumulative_hash_value = current_game->cumulative_hash_value;
+        outcome.fuzzy_duplicate_hash = current_game->fuzzy_duplicate_hash;
+        outcome.eco = current_game->tags[ECO_TAG];
+        if (GlobalState.verbosity > 1) {
+            size_t length;
+            FILE *details = open_string_output();
+            report_details(details);
+            outcome.details = close_string_output(details, &length);
+        }
+        /* Format the game if it might be output. */
+        if (GlobalState.current_file_type != CHECKFILE &&
+                ((wanted && !GlobalState.check_only) ||
+                GlobalState.non_matching_file != NULL)) {
+            if (!wanted && !current_game->moves_checked) {
+                /* As in dispose_of_game, check the whole of a game
+                 * that may be written to the non-matching file.
+                 */
+                unsigned full_plycount;
+                (void) apply_move_list(current_game, &full_plycount, 0);
+            }
+            outcome.non_matching_ok = current_game->moves_ok ||
+                    GlobalState.keep_broken_games;
+            if (wanted || outcome.non_matching_ok) {
+                FILE *text = open_string_output();
+                output_game(current_game, text);
+                outcome.text = close_string_output(text, &outcome.text_length);
+            }
+        }
+    }
+    send_game_outcome(&outcome);
+    if (outcome.details != NULL) {
+        (void) free((void *) outcome.details);
+    }
+    if (outcome.text != NULL) {
+        (void) free((void *) outcome.text);
+    }
+}
+
+static void
+deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line)
+{
+    Game current_game;
+    /* We need a dummy argument for apply_move_list. */
+    unsigned plycount = 0;
+    Boolean wanted;
+
+    /* Fill in the information currently known. */
+    current_game.tags = GameHeader.Tags;
+    current_game.tags_length = GameHeader.header_tags_length;
+    current_game.prefix_comment = GameHeader.prefix_comment;
+    current_game.moves = move_list;
+    current_game.moves_checked = FALSE;
+    current_game.fuzzy_duplicate_hash = 0;
+    current_game.moves_ok = FALSE;
+    current_game.error_ply = 0;
+    current_game.position_counts = NULL;
+    current_game.start_line = start_line;
+    current_game.end_line = end_line;
+
+    if (sending_outcomes) {
+        /* Separate the messages of parsing from those of judging. */
+        end_of_parsing_messages();
+    }
+    else {
+        /* Update the count of how many games handled. */
+        GlobalState.num_games_processed++;
+    }
+    if (GlobalState.build_position_index != NULL &&
+            GlobalState.current_file_type == NORMALFILE) {
+        index_game_positions(&current_game, game_start_file, game_start_offset);
+    }
+
+    /* Determine whether or not this game is wanted, on the
+     * basis of the various selection criteria available.
+     */
+    wanted = game_is_wanted(&current_game, &plycount);
+    if (sending_outcomes) {
+        send_outcome_of_game(&current_game, wanted, plycount);
+    }
+    else {
+        unsigned long matched_before = GlobalState.num_games_matched;
+
+        dispose_of_game(&current_game, wanted, plycount, NULL);
+        note_indexed_game(game_start_file, game_start_offset,
+                          GlobalState.num_games_matched != matched_before);
+    }
 
     /* Game is finished with, so free everything. */
     if (GameHeader.prefix_comment != NULL) {
@@ -1181,9 +1479,63 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
         free_position_count_list(current_game.position_counts);
         current_game.position_counts = NULL;
     }
-    if (GlobalState.verbosity != 0 && (GlobalState.num_games_processed % PROGRESS_RATE) == 0) {
-        fprintf(stderr, "Games: %lu\r", GlobalState.num_games_processed);
+    if (!sending_outcomes) {
+        report_progress();
+    }
+}
+
+/* Deal with the outcome of a game dealt with by a worker process,
+ * in input order.
+ * Messages logged while parsing the game have already been written.
+ */
+void
+deal_with_game_outcome(const GameOutcome *outcome)
+{
+    Game current_game;
+    unsigned long matched_before = GlobalState.num_games_matched;
+
+    GlobalState.num_games_processed++;
+    if (outcome->wanted) {
+        /* Only the hash values are needed for duplicate detection. */
+        memset((void *) &current_game, 0, sizeof (current_game));
+        current_game.final_hash_value = outcome->final_hash_value;
+        current_game.cumulative_hash_value = outcome->cumulative_hash_value;
+        current_game.fuzzy_duplicate_hash = outcome->fuzzy_duplicate_hash;
+        dispose_of_game(&current_game, TRUE, outcome->plycount, outcome);
+    }
+    else {
+        dispose_of_game(NULL, FALSE, outcome->plycount, outcome);
     }
+    note_indexed_game(current_file_number(), outcome->start_offset,
+                      GlobalState.num_games_matched != matched_before);
+    report_progress();
+}
+
+/* Parse the games in a section of an input file in a worker process
+ * and send the outcome of each to the parent.
+ * If the section ends where another game starts, rather than at the
+ * end of all the input, then a game at the end of the section without
+ * a terminating result is dealt with as it would be with the next
+ * game's tags following it.
+ */
+void
+parse_input_section(SourceFileType file_type, Boolean ends_at_game_boundary)
+{
+    sending_outcomes = TRUE;
+    section_ends_at_game_boundary = ends_at_game_boundary;
+    (void) yyparse(file_type);
+}
+
+/* Parse and deal with the games in a section of an input file
+ * opened by open_input_section, as if the whole file were being read
+ * (see posindex.c).
+ */
+void
+parse_selected_section(SourceFileType file_type, Boolean ends_at_game_boundary)
+{
+    sending_outcomes = FALSE;
+    section_ends_at_game_boundary = ends_at_game_boundary;
+    (void) yyparse(file_type);
 }
 
 /*
@@ -1232,7 +1584,7 @@ split_variants(Game *game, FILE *outputfile, unsigned depth)
            GlobalState.split_depth_limit > depth) {
         /* Now all the variations. */
         char *result_tag = game->tags[RESULT_TAG];
-        game->tags[RESULT_TAG] = copy_string("*");
+        game->tags[RESULT_TAG] = game_copy_string("*");
         move = game->moves;
         Move *prev = NULL;
         while(move != NULL) {
@@ -1247,7 +1599,7 @@ split_variants(Game *game, FILE *outputfile, unsigned depth)
                         last_move = last_move->next;
                     }
                     if(last_move->terminating_result == NULL) {
-                        last_move->terminating_result = copy_string("*");
+                        last_move->terminating_result = game_copy_string("*");
                     }
                     /* Replace the main line with the variants. */
                     if(prev != NULL) {
@@ -1313,7 +1665,7 @@ split_variants(Game *game, FILE *outputfile, unsigned depth)
             move = move->next;
         }
         /* Put everything back as it was. */
-        (void) free((void *) game->tags[RESULT_TAG]);
+        game_free((void *) game->tags[RESULT_TAG]);
         game->tags[RESULT_TAG] = result_tag;
     }
 }
@@ -1333,6 +1685,7 @@ deal_with_ECO_line(Move *move_list)
     current_game.prefix_comment = GameHeader.prefix_comment;
     current_game.moves = move_list;
     current_game.moves_checked = FALSE;
+    current_game.fuzzy_duplicate_hash = 0;
     current_game.moves_ok = FALSE;
     current_game.error_ply = 0;
 
@@ -1368,20 +1721,26 @@ deal_with_ECO_line(Move *move_list)
 int
 yyparse(SourceFileType file_type)
 {
+    int status;
+
+    /* Each game is allocated in its own arena while parsing. */
+    start_game_arenas();
     setup_for_new_game();
     current_symbol = skip_to_next_game(NO_TOKEN);
     parse_opt_game_list(file_type);
     if (current_symbol == EOF_TOKEN) {
         /* Ok -- EOF. */
-        return 0;
+        status = 0;
     }
     else if (finished_processing()) {
         /* Ok -- done all we need to. */
-        return 0;
+        status = 0;
     }
     else {
         fprintf(GlobalState.logfile, "End of input reached before end of file.\n");
-        return 1;
+        status = 1;
     }
+    stop_game_arenas();
+    return status;
 }
 
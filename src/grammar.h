@@ -31,6 +31,10 @@ void append_comments_to_move(Move *move,CommentList *Comment);
 /* The following function is used for linking list items together. */
 StringList *save_string_list_item(StringList *list,const char *str);
 void free_comment_list(CommentList *comment_list);
+Boolean finished_processing(void);
+void deal_with_game_outcome(const GameOutcome *outcome);
+void parse_input_section(SourceFileType file_type, Boolean ends_at_game_boundary);
+void parse_selected_section(SourceFileType file_type, Boolean ends_at_game_boundary);
 
 #endif	// GRAMMAR_H
 
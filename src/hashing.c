@@ -19,19 +19,25 @@
  *  https://www.cs.kent.ac.uk/people/staff/djb/
  */
 
+/* For fileno() and ftruncate() with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#if defined(__BORLANDC__) || defined(_MSC_VER)
-/* For unlink() */
-#include <io.h>
-#else
-/* For unlink() */
-#include <unistd.h>
-#endif
 #include "bool.h"
 #include "mymalloc.h"
+#include "lines.h"
+#ifdef MAPPED_FILES
+/* A duplicate database file (--dupdb) can be memory-mapped rather
+ * than read in full and written out again on exit.
+ */
+#include <sys/types.h>
+#include <sys/mman.h>
+/* For ftruncate() */
+#include <unistd.h>
+#endif
 #include "defs.h"
 #include "typedef.h"
 #include "tokens.h"
@@ -39,68 +45,114 @@
 #include "lex.h"
 #include "hashing.h"
 
-/* Routines, similar in nature to those in apply.c
- * to implement a duplicate hash-table lookup using
+/* Define the size of the hash table.
+ */
+#define LOG_TABLE_SIZE 100003
+
+/* Define a table to hold hash values of the extracted games.
+ * This is used to enable duplicate detection when not using
+ * the virtual hash table or a duplicate database.
+ */
+static HashLog **LogTable = NULL;
+
+/* Routines to implement a duplicate hash-table lookup using
  * an external file, rather than malloc'd memory.
+ * The file holds either a duplicate database that is kept between
+ * runs (--dupdb) or the virtual hash table (-Z), which is an
+ * anonymous temporary file that disappears when it is closed.
  * The only limit should be a file system limit.
- * NB: Using an external, virtual file seems obsolete now.
  *
  * This version should be slightly more accurate than
  * the alternative because the final_ and cumulative_
  * hash values are both stored, rather than the XOR
  * of them.
+ *
+ * The file starts with a DuplicateFileHeader, which is followed by
+ * an open-addressing table of DuplicateSlots and then, for a database,
+ * by the names of the files in which the games were first found.
+ * Each name is written when its file is first given an id, before
+ * any slot refers to it, so the names of a mapped database cover its
+ * slots even if a run does not end normally.
+ * Values are stored in the byte order of the machine.
  */
 
-/*
- * The name of the file used.
- * This is overwritten each time, and removed on normal
- * program exit.
- */
-static char VIRTUAL_FILE[] = "virtual.tmp";
+/* How the file of the virtual hash table is referred to in messages. */
+static const char VIRTUAL_FILE[] = "the virtual hash table file";
 
-/* Define the size of the hash table.
+#define DUPLICATE_DB_MAGIC "PGNXDUP2"
+/* The number of slots in a new table: a power of two. */
+#define INITIAL_DB_SLOTS (1 << 16)
+/* Probing starts at the beginning of a group of slots that
+ * occupies a whole number of 64-byte cache lines.
  */
-#define LOG_TABLE_SIZE 100003
+#define DB_SLOTS_PER_GROUP 8
 
-/* Define a table to hold hash values of the extracted games.
- * This is used to enable duplicate detection.
- */
 typedef struct {
-    /* Record the file offset of the first and last entries
-     * for an index. (head == -1) => empty.
+    char magic[8];
+    uint64_t byte_order;
+    /* The number of slots in the table: a power of two. */
+    uint64_t capacity;
+    /* The number of occupied slots. */
+    uint64_t num_entries;
+    /* The number and total length of the nul-terminated file names
+     * that follow the slots.
+     * These are 0 while the table grows, when the names are overwritten.
      */
-    long head, tail;
-} LogHeaderEntry;
+    uint64_t num_names, names_length;
+    uint64_t reserved[2];
+} DuplicateFileHeader;
 
-/* If use_virtual_hash_table */
-static LogHeaderEntry *VirtualLogTable = NULL;
-
-/* Define a table to hold hash values of the extracted games.
- * This is used to enable duplicate detection when not using
- * the virtual hash table.
- */
-static HashLog **LogTable = NULL;
-
-/* Define a type to hold hash values of interest.
- * This is used both to aid in duplicate detection
- * and in finding positional variations.
- */
-typedef struct VirtualHashLog {
-    /* Store the final position hash value and
-     * the cumulative hash value for a game.
-     */
+typedef struct {
     HashCode final_hash_value, cumulative_hash_value;
-    /* Record the file list index for the file this game was first found in. */
-    int file_number;
-    /* Record the file offset of the next element
-     * in this list. -1 => end-of-list.
+    /* One more than the index of the file in which the game
+     * was first found. 0 => an empty slot.
+     * The index is of the names in a database, and of the
+     * list of input files for the virtual hash table.
      */
-    long next;
-} VirtualHashLog;
+    uint32_t file_id;
+    uint32_t reserved;
+} DuplicateSlot;
 
-static FILE *hash_file = NULL;
+typedef struct {
+    const char *filename;
+    FILE *fp;
+    /* Whether the file is kept after the run (--dupdb). */
+    Boolean persistent;
+    /* The header and slots of the file: either mapped or read
+     * from fp.
+     */
+    char *space;
+    size_t space_size;
+    DuplicateFileHeader *header;
+    DuplicateSlot *slots;
+    /* The names of the files in which games were first found. */
+    char **names;
+    unsigned num_names, max_names;
+    /* The total length of the names in the file. */
+    size_t names_length;
+    /* The file id for the most recent input file. */
+    unsigned last_file_number;
+    uint32_t last_file_id;
+} DuplicateDatabase;
+
+/* If --dupdb or use_virtual_hash_table. */
+static DuplicateDatabase *duplicate_database = NULL;
+
+static DuplicateDatabase *open_duplicate_database(const char *filename, Boolean persistent);
+static void close_duplicate_database(DuplicateDatabase *db);
+static const char *previous_database_occurance(DuplicateDatabase *db, Game game_details);
+
+/* The initial number of slots in a position count table.
+ * This must be a power of two.
+ * The seventy-five-move rule means that a game rarely has more than
+ * 150 positions between pawn moves and captures, but the table
+ * grows if necessary.
+ */
+#define INITIAL_POSITION_COUNT_TABLE_SIZE 256
 
-static const char *previous_virtual_occurance(Game game_details);
+static PositionCountEntry *find_position_slot(PositionCount *position_counts,
+                                              const Board *board);
+static void grow_position_count_table(PositionCount *position_counts);
 
 /*
  * Check whether the position counts indicate a three-fold repetition.
@@ -110,11 +162,7 @@ static const char *previous_virtual_occurance(Game game_details);
 Boolean check_for_only_repetition(PositionCount *position_counts)
 {
     if (GlobalState.check_for_repetition) {
-        PositionCount *entry = position_counts;
-        while (entry != NULL && entry->count < 3) {
-            entry = entry->next;
-        }
-        return entry != NULL;
+        return position_counts != NULL && position_counts->repetition_found;
     }
     else {
         return TRUE;
@@ -153,7 +201,7 @@ encode_castling_rights(const Board *board)
  *     + Same player to move.
  */
 static Boolean
-position_matches(PositionCount *entry, const Board *board)
+position_matches(const PositionCountEntry *entry, const Board *board)
 {
     if(board->weak_hash_value != entry->hash_value) {
         return FALSE;
@@ -173,121 +221,180 @@ position_matches(PositionCount *entry, const Board *board)
 }
 
 /*
- * Add hash_value as a position in the current game.
- * Return TRUE if a match is made, false otherwise.
- * NB: The assumption is that position_counts is not NULL.
+ * Return the slot for the position on board: either the slot
+ * already holding it or the free slot where it belongs.
+ */
+static PositionCountEntry *
+find_position_slot(PositionCount *position_counts, const Board *board)
+{
+    unsigned mask = position_counts->table_size - 1;
+    unsigned index = (unsigned) board->weak_hash_value & mask;
+    PositionCountEntry *entry = &position_counts->entries[index];
+    while (entry->generation == position_counts->generation &&
+            !position_matches(entry, board)) {
+        index = (index + 1) & mask;
+        entry = &position_counts->entries[index];
+    }
+    return entry;
+}
+
+/*
+ * Double the size of the table, keeping the positions
+ * of the current generation.
+ */
+static void
+grow_position_count_table(PositionCount *position_counts)
+{
+    PositionCountEntry *old_entries = position_counts->entries;
+    unsigned old_size = position_counts->table_size;
+    unsigned generation = position_counts->generation;
+    unsigned new_size = old_size * 2;
+    unsigned mask = new_size - 1;
+    unsigned i;
+
+    position_counts->entries =
+        (PositionCountEntry *) malloc_or_die(new_size * sizeof (PositionCountEntry));
+    for (i = 0; i < new_size; i++) {
+        position_counts->entries[i].generation = generation - 1;
+    }
+    position_counts->table_size = new_size;
+    for (i = 0; i < old_size; i++) {
+        if (old_entries[i].generation == generation) {
+            unsigned index = (unsigned) old_entries[i].hash_value & mask;
+            while (position_counts->entries[index].generation == generation) {
+                index = (index + 1) & mask;
+            }
+            position_counts->entries[index] = old_entries[i];
+        }
+    }
+    (void) free((void *) old_entries);
+}
+
+/*
+ * Add the position on board to those in the current game.
+ * Return TRUE if it has now occurred three times, FALSE otherwise.
+ * Nothing is recorded if position_counts is NULL.
  */
 Boolean
 update_position_counts(PositionCount *position_counts, const Board *board)
 {
-    //fprintf(stderr, "U: %d,%d\n", board->ep_rank, board->ep_col);
-    PositionCount *entry = position_counts;
+    PositionCountEntry *entry;
     if (position_counts == NULL) {
         /* Don't try to match in variations. */
         return FALSE;
     }
-    /* Try to find an existing entry. */
-    while (entry != NULL && !position_matches(entry, board)) {
-        entry = entry->next;
+    if (board->halfmove_clock == 0) {
+        /* A pawn move or capture: no earlier position can recur,
+         * so discard them all by starting a new generation.
+         */
+        position_counts->generation++;
+        position_counts->num_entries = 0;
     }
-    if (entry == NULL) {
+    entry = find_position_slot(position_counts, board);
+    if (entry->generation != position_counts->generation) {
         /* New position. */
-        entry = new_position_count_list(board);
-        /* Insert just after the head of the list. */
-        entry->next = position_counts->next;
-        position_counts->next = entry;
+        entry->hash_value = board->weak_hash_value;
+        entry->to_move = board->to_move;
+        entry->castling_rights = encode_castling_rights(board);
+        if(board->EnPassant) {
+            entry->ep_rank = board->ep_rank;
+            entry->ep_col = board->ep_col;
+        }
+        else {
+            entry->ep_rank = '\0';
+            entry->ep_col = '\0';
+        }
+        entry->count = 1;
+        entry->generation = position_counts->generation;
+        position_counts->num_entries++;
+        if (position_counts->num_entries * 2 > position_counts->table_size) {
+            grow_position_count_table(position_counts);
+        }
+        return FALSE;
     }
     else {
-        /* Increment the count. */
         entry->count++;
+        if (entry->count >= 3) {
+            position_counts->repetition_found = TRUE;
+            return TRUE;
+        }
+        else {
+            return FALSE;
+        }
     }
-    return entry->count >= 3;
 }
 
 /*
- * Free the list of position counts.
+ * Free the table of position counts.
  */
 void
 free_position_count_list(PositionCount *position_counts)
 {
-    PositionCount *entry = position_counts;
-    while (entry != NULL) {
-        PositionCount *next = entry->next;
-        (void) free((void *) entry);
-        entry = next;
+    if (position_counts != NULL) {
+        (void) free((void *) position_counts->entries);
+        (void) free((void *) position_counts);
     }
 }
 
 /*
- * Create a new position count list.
- * This will have a single entry at its head.
+ * Empty the table of position counts and record the
+ * position on board as its single entry.
  */
-PositionCount *
-new_position_count_list(const Board *board)
+void
+reset_position_counts(PositionCount *position_counts, const Board *board)
 {
-    PositionCount *head = (PositionCount *) malloc_or_die(sizeof (*head));
-    head->hash_value = board->weak_hash_value;
-    head->to_move = board->to_move;
-    head->castling_rights = encode_castling_rights(board);
-    if(board->EnPassant) {
-        head->ep_rank = board->ep_rank;
-        head->ep_col = board->ep_col;
-    }
-    else {
-        head->ep_rank = '\0';
-        head->ep_col = '\0';
-    }
-    head->count = 1;
-    head->next = NULL;
-    return head;
+    /* Start a new generation to discard any existing entries. */
+    position_counts->generation++;
+    position_counts->num_entries = 0;
+    position_counts->repetition_found = FALSE;
+    (void) update_position_counts(position_counts, board);
 }
 
 /*
- * Return an identical copy of the given list.
+ * Create a new table of position counts.
+ * This will have a single entry for the position on board.
  */
-PositionCount *copy_position_count_list(PositionCount *original)
+PositionCount *
+new_position_count_list(const Board *board)
 {
-    PositionCount *copy = NULL;
-    PositionCount *tail = NULL;
-    while (original != NULL) {
-        PositionCount *entry = (PositionCount *) malloc_or_die(sizeof (*entry));
-        entry->hash_value = original->hash_value;
-        entry->to_move = original->to_move;
-        entry->castling_rights = original->castling_rights;
-        entry->count = original->count;
-        entry->next = NULL;
-
-        if (copy == NULL) {
-            copy = entry;
-        }
-        else {
-            tail->next = entry;
-        }
-        tail = entry;
-        original = original->next;
-    }
-    return copy;
+    PositionCount *position_counts =
+        (PositionCount *) malloc_or_die(sizeof (*position_counts));
+    unsigned i;
+
+    position_counts->table_size = INITIAL_POSITION_COUNT_TABLE_SIZE;
+    position_counts->entries = (PositionCountEntry *)
+        malloc_or_die(position_counts->table_size * sizeof (PositionCountEntry));
+    /* Mark every slot as belonging to an earlier generation. */
+    position_counts->generation = 1;
+    for (i = 0; i < position_counts->table_size; i++) {
+        position_counts->entries[i].generation = 0;
+    }
+    position_counts->num_entries = 0;
+    position_counts->repetition_found = FALSE;
+    (void) update_position_counts(position_counts, board);
+    return position_counts;
 }
 
 /* Determine which table to initialise, depending
- * on whether use_virtual_hash_table is set or not.
+ * on whether use_virtual_hash_table or duplicate_database
+ * is set or not.
  */
 void
 init_duplicate_hash_table(void)
 {
     int i;
 
+    if (GlobalState.duplicate_database != NULL &&
+            (GlobalState.use_virtual_hash_table || GlobalState.fuzzy_match_duplicates)) {
+        fprintf(GlobalState.logfile,
+                "--dupdb cannot be used with -Z or --fuzzydepth.\n");
+        exit(1);
+    }
     if (GlobalState.use_virtual_hash_table) {
-        VirtualLogTable = (LogHeaderEntry *)
-                malloc_or_die(LOG_TABLE_SIZE * sizeof (*VirtualLogTable));
-        for (i = 0; i < LOG_TABLE_SIZE; i++) {
-            VirtualLogTable[i].head = VirtualLogTable[i].tail = -1;
-        }
-        hash_file = fopen(VIRTUAL_FILE, "w+b");
-        if (hash_file == NULL) {
-            fprintf(GlobalState.logfile, "Unable to open %s\n",
-                    VIRTUAL_FILE);
-        }
+        duplicate_database = open_duplicate_database(VIRTUAL_FILE, FALSE);
+    }
+    else if (GlobalState.duplicate_database != NULL) {
+        duplicate_database = open_duplicate_database(GlobalState.duplicate_database, TRUE);
     }
     else {
         LogTable = (HashLog**) malloc_or_die(LOG_TABLE_SIZE * sizeof (*LogTable));
@@ -297,148 +404,18 @@ init_duplicate_hash_table(void)
     }
 }
 
-/* Close and remove the temporary file if in use. */
+/* Close and remove the temporary file if in use.
+ * Save the contents of the duplicate database if in use.
+ */
 void
 clear_duplicate_hash_table(void)
 {
-    if (GlobalState.use_virtual_hash_table) {
-        if (hash_file != NULL) {
-            (void) fclose(hash_file);
-            unlink(VIRTUAL_FILE);
-            hash_file = NULL;
-        }
-    }
-}
-
-/* Retrieve a duplicate table entry from the hash file. */
-static int
-retrieve_virtual_entry(long ix, VirtualHashLog *entry)
-{
-    if (hash_file == NULL) {
-        return 0;
-    }
-    else if (fseek(hash_file, ix, SEEK_SET) != 0) {
-        fprintf(GlobalState.logfile,
-                "Fseek error to %ld in retrieve_virtual_entry\n", ix);
-        return 0;
-    }
-    else if (fread((void *) entry, sizeof (*entry), 1, hash_file) != 1) {
-        fprintf(GlobalState.logfile,
-                "Fread error from %ld in retrieve_virtual_entry\n", ix);
-        return 0;
-    }
-    else {
-        return 1;
-    }
-}
-
-/* Write a duplicate table entry to the hash file. */
-static int
-write_virtual_entry(long where, const VirtualHashLog *entry)
-{
-    if (fseek(hash_file, where, SEEK_SET) != 0) {
-        fprintf(GlobalState.logfile,
-                "Fseek error to %ld in write_virtual_entry\n", where);
-        return 0;
-    }
-    else if (fwrite((void *) entry, sizeof (*entry), 1, hash_file) != 1) {
-        fprintf(GlobalState.logfile,
-                "Fwrite error from %ld in write_virtual_entry\n", where);
-        fflush(hash_file);
-        return 0;
-    }
-    else {
-        /* Written ok. */
-        return 1;
+    if (duplicate_database != NULL) {
+        close_duplicate_database(duplicate_database);
+        duplicate_database = NULL;
     }
 }
 
-/* Return the name of the original file if it looks like we
- * have met the moves in game_details before, otherwise return
- * NULL.  A match is assumed to be so if both
- * the final_ and cumulative_ hash values in game_details
- * are already present in VirtualLogTable.
- */
-static const char *
-previous_virtual_occurance(Game game_details)
-{
-    unsigned ix = game_details.final_hash_value % LOG_TABLE_SIZE;
-    VirtualHashLog entry;
-    Boolean duplicate = FALSE;
-    const char *original_filename = NULL;
-
-
-    /* Are we keeping this information? */
-    if (GlobalState.suppress_duplicates || GlobalState.suppress_originals ||
-            GlobalState.duplicate_file != NULL) {
-        if (VirtualLogTable[ix].head < 0l) {
-            /* First occurrence. */
-        }
-        else {
-            int keep_going =
-                    retrieve_virtual_entry(VirtualLogTable[ix].head, &entry);
-
-            while (keep_going && !duplicate) {
-                if ((entry.final_hash_value == game_details.final_hash_value) &&
-                        (entry.cumulative_hash_value == game_details.cumulative_hash_value)) {
-                    /* We have a match.
-                     * Determine where it first occured.
-                     */
-                    original_filename = input_file_name(entry.file_number);
-                    duplicate = TRUE;
-                }
-                else if (entry.next >= 0l) {
-                    keep_going = retrieve_virtual_entry(entry.next, &entry);
-                }
-                else {
-                    keep_going = 0;
-                }
-            }
-        }
-
-        if (!duplicate) {
-            /* Write an entry for it. */
-            /* Where to write the next VirtualHashLog entry. */
-            static long next_free_entry = 0l;
-
-            /* Avoid valgrind error when writing unset bytes that
-             * are part of the structure padding.
-             */
-            memset((void *) &entry, 0, sizeof(entry));
-            /* Store the XOR of the two hash values. */
-            entry.final_hash_value = game_details.final_hash_value;
-            entry.cumulative_hash_value = game_details.cumulative_hash_value;
-            entry.file_number = current_file_number();
-            entry.next = -1l;
-
-            /* Write out these details. */
-            if (write_virtual_entry(next_free_entry, &entry)) {
-                long where_written = next_free_entry;
-                /* Move on ready for next time. */
-                next_free_entry += sizeof (entry);
-
-                /* Now update the index table. */
-                if (VirtualLogTable[ix].head < 0l) {
-                    /* First occurrence. */
-                    VirtualLogTable[ix].head =
-                            VirtualLogTable[ix].tail = where_written;
-                }
-                else {
-                    VirtualHashLog tail;
-
-                    if (retrieve_virtual_entry(VirtualLogTable[ix].tail, &tail)) {
-                        tail.next = where_written;
-                        (void) write_virtual_entry(VirtualLogTable[ix].tail, &tail);
-                        /* Store the new tail address. */
-                        VirtualLogTable[ix].tail = where_written;
-                    }
-                }
-            }
-        }
-    }
-    return original_filename;
-}
-
 /* Return the name of the original file if it looks like we
  * have met the moves in game_details before, otherwise return
  * NULL.
@@ -452,8 +429,13 @@ const char *
 previous_occurance(Game game_details, unsigned plycount)
 {
     const char *original_filename = NULL;
-    if (GlobalState.use_virtual_hash_table) {
-        original_filename = previous_virtual_occurance(game_details);
+    if (duplicate_database != NULL) {
+        /* Are we keeping this information? */
+        if (GlobalState.suppress_duplicates ||
+                GlobalState.suppress_originals ||
+                GlobalState.duplicate_file != NULL) {
+            original_filename = previous_database_occurance(duplicate_database, game_details);
+        }
     }
     else {
 
@@ -538,3 +520,374 @@ previous_occurance(Game game_details, unsigned plycount)
     }
     return original_filename;
 }
+
+/* Return the size of the header and slots of a duplicate database
+ * with the given capacity.
+ */
+static size_t
+database_size(uint64_t capacity)
+{
+    return sizeof (DuplicateFileHeader) + (size_t) capacity * sizeof (DuplicateSlot);
+}
+
+/* Give db space for a header and slots of size bytes.
+ * Any space beyond that previously held is zero.
+ * A mapped file is resized to hold the space and the names after it.
+ */
+static void
+resize_database_space(DuplicateDatabase *db, size_t size)
+{
+#ifdef MAPPED_FILES
+    void *addr;
+
+    if (db->space != NULL) {
+        (void) munmap((void *) db->space, db->space_size);
+    }
+    (void) fflush(db->fp);
+    if (ftruncate(fileno(db->fp), (off_t) (size + db->names_length)) != 0) {
+        fprintf(GlobalState.logfile, "Unable to extend %s\n", db->filename);
+        exit(1);
+    }
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(db->fp), 0);
+    if (addr == MAP_FAILED) {
+        fprintf(GlobalState.logfile, "Unable to map %s\n", db->filename);
+        exit(1);
+    }
+    db->space = (char *) addr;
+#else
+    db->space = (char *) realloc_or_die((void *) db->space, size);
+    if (size > db->space_size) {
+        memset((void *) (db->space + db->space_size), 0, size - db->space_size);
+    }
+#endif
+    db->space_size = size;
+    db->header = (DuplicateFileHeader *) db->space;
+    db->slots = (DuplicateSlot *) (db->space + sizeof (DuplicateFileHeader));
+}
+
+/* Add name to the names of the files known to db. */
+static void
+add_database_name(DuplicateDatabase *db, const char *name)
+{
+    if (db->num_names == db->max_names) {
+        db->max_names = db->max_names == 0 ? 16 : 2 * db->max_names;
+        db->names = (char **) realloc_or_die((void *) db->names,
+                db->max_names * sizeof (*db->names));
+    }
+    db->names[db->num_names] = copy_string(name);
+    db->num_names++;
+}
+
+/* Write the names of db from the first'th onwards to its file,
+ * after the slots, and record them in the header.
+ */
+static void
+write_database_names(DuplicateDatabase *db, unsigned first)
+{
+    unsigned n;
+    Boolean ok = fseek(db->fp, (long) (db->space_size + db->names_length), SEEK_SET) == 0;
+
+    for (n = first; ok && n < db->num_names; n++) {
+        size_t length = strlen(db->names[n]) + 1;
+
+        ok = fwrite((void *) db->names[n], 1, length, db->fp) == length;
+        db->names_length += length;
+    }
+    if (!ok || fflush(db->fp) != 0) {
+        fprintf(GlobalState.logfile, "Error writing %s\n", db->filename);
+        exit(1);
+    }
+    db->header->names_length = db->names_length;
+    db->header->num_names = db->num_names;
+}
+
+/* Read the file names that follow the slots of db. */
+static Boolean
+read_database_names(DuplicateDatabase *db, const DuplicateFileHeader *header)
+{
+    uint64_t names_length = header->names_length;
+    Boolean ok = TRUE;
+
+    if (names_length > 0) {
+        char *names = (char *) malloc_or_die((size_t) names_length);
+        const char *name = names;
+        uint64_t n;
+
+        ok = fseek(db->fp, (long) database_size(header->capacity), SEEK_SET) == 0 &&
+                fread((void *) names, 1, (size_t) names_length, db->fp) == names_length &&
+                names[names_length - 1] == '\0';
+        for (n = 0; ok && n < header->num_names; n++) {
+            if (name >= names + names_length) {
+                ok = FALSE;
+            }
+            else {
+                add_database_name(db, name);
+                name += strlen(name) + 1;
+            }
+        }
+        (void) free((void *) names);
+    }
+    return ok;
+}
+
+/* Open the duplicate database in filename, creating it if
+ * it does not exist.
+ * If it is not persistent then a new temporary file is used instead,
+ * and filename only describes it in messages.
+ */
+static DuplicateDatabase *
+open_duplicate_database(const char *filename, Boolean persistent)
+{
+    DuplicateDatabase *db = (DuplicateDatabase *) malloc_or_die(sizeof (*db));
+    DuplicateFileHeader header;
+    size_t header_bytes;
+    Boolean ok;
+
+    db->filename = filename;
+    db->persistent = persistent;
+    db->space = NULL;
+    db->space_size = 0;
+    db->names = NULL;
+    db->num_names = db->max_names = 0;
+    db->names_length = 0;
+    db->last_file_number = 0;
+    db->last_file_id = 0;
+
+    if (persistent) {
+        db->fp = fopen(filename, "r+b");
+        if (db->fp == NULL) {
+            db->fp = fopen(filename, "w+b");
+        }
+    }
+    else {
+        /* Concurrent runs must not share the file, and it must not
+         * outlive the run even if the run is killed.
+         */
+        db->fp = tmpfile();
+    }
+    if (db->fp == NULL) {
+        fprintf(GlobalState.logfile, "Unable to open %s\n", filename);
+        exit(1);
+    }
+    header_bytes = fread((void *) &header, 1, sizeof (header), db->fp);
+    if (header_bytes == 0) {
+        /* A new database. */
+        resize_database_space(db, database_size(INITIAL_DB_SLOTS));
+        memcpy(db->header->magic, DUPLICATE_DB_MAGIC, sizeof (db->header->magic));
+        db->header->byte_order = NATIVE_BYTE_ORDER;
+        db->header->capacity = INITIAL_DB_SLOTS;
+        db->header->num_entries = 0;
+        return db;
+    }
+
+    ok = header_bytes == sizeof (header) &&
+            memcmp(header.magic, DUPLICATE_DB_MAGIC, sizeof (header.magic)) == 0 &&
+            header.byte_order == NATIVE_BYTE_ORDER &&
+            header.capacity >= DB_SLOTS_PER_GROUP &&
+            (header.capacity & (header.capacity - 1)) == 0 &&
+            header.num_entries < header.capacity &&
+            /* Every entry has the id of a name: the names are missing
+             * if a run ended while the table was growing.
+             */
+            (header.num_entries == 0 || header.num_names > 0);
+    if (ok) {
+        ok = read_database_names(db, &header);
+    }
+    if (!ok) {
+        fprintf(GlobalState.logfile, "%s is not a valid duplicate database.\n", filename);
+        exit(1);
+    }
+    db->names_length = (size_t) header.names_length;
+    resize_database_space(db, database_size(header.capacity));
+#ifndef MAPPED_FILES
+    if (fseek(db->fp, 0L, SEEK_SET) != 0 ||
+            fread((void *) db->space, 1, db->space_size, db->fp) != db->space_size) {
+        fprintf(GlobalState.logfile, "Unable to read %s\n", filename);
+        exit(1);
+    }
+#endif
+    return db;
+}
+
+/* Write any unmapped slots of db to its file and close it.
+ * The file is discarded if it is not persistent.
+ */
+static void
+close_duplicate_database(DuplicateDatabase *db)
+{
+    unsigned n;
+    Boolean ok = TRUE;
+
+    if (!db->persistent) {
+#ifdef MAPPED_FILES
+        (void) munmap((void *) db->space, db->space_size);
+#else
+        (void) free((void *) db->space);
+#endif
+        (void) fclose(db->fp);
+        (void) free((void *) db);
+        return;
+    }
+
+#ifdef MAPPED_FILES
+    (void) munmap((void *) db->space, db->space_size);
+#else
+    ok = fseek(db->fp, 0L, SEEK_SET) == 0 &&
+            fwrite((void *) db->space, 1, db->space_size, db->fp) == db->space_size;
+    (void) free((void *) db->space);
+#endif
+    if (fclose(db->fp) != 0 || !ok) {
+        fprintf(GlobalState.logfile, "Error writing %s\n", db->filename);
+    }
+    for (n = 0; n < db->num_names; n++) {
+        (void) free((void *) db->names[n]);
+    }
+    if (db->names != NULL) {
+        (void) free((void *) db->names);
+    }
+    (void) free((void *) db);
+}
+
+/* Return the slot index at which to start looking for the
+ * given hash values in a table of the given capacity.
+ * This is the first slot of a group.
+ */
+static uint64_t
+database_slot_index(HashCode final_hash_value, HashCode cumulative_hash_value,
+                    uint64_t capacity)
+{
+    uint64_t mix = (final_hash_value ^ cumulative_hash_value) * 0x9E3779B97F4A7C15ULL;
+
+    return ((mix ^ (mix >> 32)) * DB_SLOTS_PER_GROUP) & (capacity - 1);
+}
+
+/* Place slot in the first free slot of its probe sequence in
+ * a table of the given capacity.
+ */
+static void
+insert_database_slot(DuplicateSlot *slots, uint64_t capacity, const DuplicateSlot *slot)
+{
+    uint64_t ix = database_slot_index(slot->final_hash_value,
+            slot->cumulative_hash_value, capacity);
+
+    while (slots[ix].file_id != 0) {
+        ix = (ix + 1) & (capacity - 1);
+    }
+    slots[ix] = *slot;
+}
+
+/* Double the capacity of db and rehash its entries.
+ * The new table is built in the file beyond the old one and then
+ * moved down over it, so that a large table is not copied into
+ * memory.
+ * The names that followed the old table are written again after
+ * the new one.
+ */
+static void
+grow_duplicate_database(DuplicateDatabase *db)
+{
+    uint64_t capacity = db->header->capacity;
+    DuplicateSlot *new_slots;
+    uint64_t ix;
+
+    db->header->num_names = 0;
+    db->header->names_length = 0;
+    db->names_length = 0;
+    resize_database_space(db, database_size(capacity) +
+            (size_t) (2 * capacity) * sizeof (DuplicateSlot));
+    new_slots = db->slots + capacity;
+    /* This may hold the old names. */
+    memset((void *) new_slots, 0, (size_t) (2 * capacity) * sizeof (DuplicateSlot));
+    for (ix = 0; ix < capacity; ix++) {
+        if (db->slots[ix].file_id != 0) {
+            insert_database_slot(new_slots, 2 * capacity, &db->slots[ix]);
+        }
+    }
+    memmove((void *) db->slots, (void *) new_slots,
+            (size_t) (2 * capacity) * sizeof (DuplicateSlot));
+    db->header->capacity = 2 * capacity;
+    resize_database_space(db, database_size(2 * capacity));
+    if (db->persistent) {
+        write_database_names(db, 0);
+    }
+}
+
+/* Return the id of the current input file in db, adding
+ * its name to a persistent database if it is new.
+ */
+static uint32_t
+database_file_id(DuplicateDatabase *db)
+{
+    unsigned file_number = current_file_number();
+
+    if (!db->persistent) {
+        return file_number + 1;
+    }
+    else if (db->last_file_id == 0 || file_number != db->last_file_number) {
+        const char *name = input_file_name(file_number);
+        unsigned n = 0;
+
+        if (name == NULL) {
+            name = "stdin";
+        }
+        while (n < db->num_names && strcmp(db->names[n], name) != 0) {
+            n++;
+        }
+        if (n == db->num_names) {
+            add_database_name(db, name);
+            write_database_names(db, n);
+        }
+        db->last_file_number = file_number;
+        db->last_file_id = n + 1;
+    }
+    return db->last_file_id;
+}
+
+/* Return the name of the file with the given id in db. */
+static const char *
+database_file_name(const DuplicateDatabase *db, uint32_t file_id)
+{
+    if (!db->persistent) {
+        return input_file_name(file_id - 1);
+    }
+    else if (file_id <= db->num_names) {
+        return db->names[file_id - 1];
+    }
+    else {
+        /* Shouldn't happen. */
+        return db->filename;
+    }
+}
+
+/* Return the name of the file in which a game with the
+ * hash values of game_details was first found, either in this
+ * run or, for a persistent database, an earlier one.
+ * Otherwise return NULL and add them to db.
+ */
+static const char *
+previous_database_occurance(DuplicateDatabase *db, Game game_details)
+{
+    uint64_t ix = database_slot_index(game_details.final_hash_value,
+            game_details.cumulative_hash_value, db->header->capacity);
+    DuplicateSlot slot;
+
+    while (db->slots[ix].file_id != 0) {
+        if (db->slots[ix].final_hash_value == game_details.final_hash_value &&
+                db->slots[ix].cumulative_hash_value == game_details.cumulative_hash_value) {
+            return database_file_name(db, db->slots[ix].file_id);
+        }
+        ix = (ix + 1) & (db->header->capacity - 1);
+    }
+
+    /* Keep the table no more than half full. */
+    if (2 * (db->header->num_entries + 1) > db->header->capacity) {
+        grow_duplicate_database(db);
+    }
+    memset((void *) &slot, 0, sizeof (slot));
+    slot.final_hash_value = game_details.final_hash_value;
+    slot.cumulative_hash_value = game_details.cumulative_hash_value;
+    slot.file_id = database_file_id(db);
+    insert_database_slot(db->slots, db->header->capacity, &slot);
+    db->header->num_entries++;
+    return NULL;
+}
@@ -38,17 +38,35 @@ typedef struct HashLog {
 } HashLog;
 
 /*
- * A structure for counting the number of times a position arises
- * in a game.
+ * A slot in the table of positions used for counting the number
+ * of times a position arises in a game.
+ * A slot is only in use if its generation matches that of the table.
  */
-typedef struct PositionCount {
+typedef struct PositionCountEntry {
     HashCode hash_value;
     Colour to_move;
     unsigned short castling_rights;
     Rank ep_rank;
     Col ep_col;
     unsigned count;
-    struct PositionCount *next;
+    unsigned generation;
+} PositionCountEntry;
+
+/*
+ * A structure for counting the number of times a position arises
+ * in a game.
+ * Only positions since the most recent pawn move or capture are held,
+ * because no earlier position can arise again.
+ * The table is open-addressed and its size is a power of two.
+ */
+typedef struct PositionCount {
+    PositionCountEntry *entries;
+    unsigned table_size;
+    /* The number of slots in use in the current generation. */
+    unsigned num_entries;
+    unsigned generation;
+    /* Whether any position has occurred three times. */
+    Boolean repetition_found;
 } PositionCount;
 
 void init_duplicate_hash_table(void);
@@ -59,7 +77,7 @@ Boolean check_for_only_repetition(PositionCount *position_counts);
 Boolean update_position_counts(PositionCount *position_counts, const Board *board);
 void free_position_count_list(PositionCount *position_counts);
 PositionCount *new_position_count_list(const Board *board);
-PositionCount *copy_position_count_list(PositionCount *original);
+void reset_position_counts(PositionCount *position_counts, const Board *board);
 
 #endif	// HASHING_H
 
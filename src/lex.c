@@ -54,13 +54,18 @@ static void save_string(const char *result);
 static void save_move(const unsigned char *move);
 static void save_q_castle(void);
 static void save_k_castle(void);
-static void terminate_input(void);
 static Boolean extract_yytext(const unsigned char *symbol_start,
         const unsigned char *linep);
 static Boolean open_input(const char *infile);
 static Boolean open_input_file(int file_number);
+static void set_input_source(FILE *fp);
 
 static unsigned long line_number = 0;
+/* The lines counted before the first input file was opened, such as
+ * those of a tag file, which are included in the line numbers of
+ * the first file.
+ */
+static unsigned long first_file_lines_before = 0;
 /* Keep track of the Recursive Annotation Variation level. */
 static unsigned RAV_level = 0;
 /* Keep track of the last move found. */
@@ -72,6 +77,19 @@ static unsigned games_in_file = 0;
  * This is intialised in init_lex_tables.
  */
 static FILE *yyin = NULL;
+/* The source of lines from yyin.
+ * This is set up whenever a new input file is opened.
+ */
+static LineSource *yyin_source = NULL;
+/* The current line of input being tokenised and the position
+ * of the next character in it.
+ */
+static char *input_line = NULL;
+static unsigned char *input_linep = NULL;
+/* Whether the input is restricted to a section of a single file
+ * (see open_input_section).
+ */
+static Boolean reading_input_section = FALSE;
 
 /* Define space for holding matched tokens. */
 #define MAX_YYTEXT 100
@@ -371,7 +389,7 @@ gather_string(char *line, unsigned char *linep)
 		linep = lookahead;
 	    }
 	    /* Replace any previous closing double quotes with single quotes. */
-	    str = (char *) malloc_or_die(len + 1);
+	    str = (char *) game_alloc(len + 1);
 	    unsigned char *p = linep - len - 1;
 	    int i = 0;
 	    while(p < linep - 1) {
@@ -392,7 +410,7 @@ gather_string(char *line, unsigned char *linep)
 	else {
             /* The last one doesn't belong in the string. */
             len--;
-	    str = (char *) malloc_or_die(len + 1);
+	    str = (char *) game_alloc(len + 1);
 	    strncpy(str, (const char *) (linep - len - 1), len);
 	    str[len] = '\0';
 	}
@@ -401,7 +419,7 @@ gather_string(char *line, unsigned char *linep)
 	/* The last one doesn't belong in the string. */
 	len--;
 	/* Allocate space for the result. */
-	str = (char *) malloc_or_die(len + 1);
+	str = (char *) game_alloc(len + 1);
 	strncpy(str, (const char *) (linep - len - 1), len);
 	str[len] = '\0';
     }
@@ -504,7 +522,7 @@ gather_comment(char *line, unsigned char *linep)
                 start++;
             }
             /* Allocate space for the result. */
-            comment_str = (char *) malloc_or_die(end - start + 1);
+            comment_str = (char *) game_alloc(end - start + 1);
             strncpy(comment_str, (const char *) (str + start), end - start);
             comment_str[end - start] = '\0';
             current_comment = save_string_list_item(current_comment, comment_str);
@@ -520,7 +538,7 @@ gather_comment(char *line, unsigned char *linep)
     }
 
     /* Set up the structure to be returned. */
-    comment = (CommentList *) malloc_or_die(sizeof (*comment));
+    comment = (CommentList *) game_alloc(sizeof (*comment));
     comment->comment = current_comment;
     comment->next = NULL;
     yylval.comment = comment;
@@ -675,7 +693,7 @@ gather_tag(char *line, unsigned char *linep)
             char *tag_string;
 
             /* Allocate space for the result. */
-            tag_string = (char *) malloc_or_die(len + 1);
+            tag_string = (char *) game_alloc(len + 1);
             strncpy((char *) tag_string, (const char *) (linep - len), len);
             tag_string[len] = '\0';
             tag_item = identify_tag(tag_string);
@@ -685,7 +703,7 @@ gather_tag(char *line, unsigned char *linep)
             if (tag_item >= 0 && ((unsigned) tag_item) < tag_list_length) {
                 yylval.tag_index = tag_item;
                 resulting_line.token = TAG;
-                (void) free((void *) tag_string);
+                game_free((void *) tag_string);
             }
             else {
                 fprintf(GlobalState.logfile,
@@ -733,8 +751,6 @@ extract_yytext(const unsigned char *symbol_start, const unsigned char *linep)
 static TokenType
 get_next_symbol(void)
 {
-    static char *line = NULL;
-    static unsigned char *linep = NULL;
     /* The token to be returned. */
     TokenType token;
     LinePair resulting_line;
@@ -745,10 +761,10 @@ get_next_symbol(void)
 
         /* Clear any remaining symbol. */
         *yytext = '\0';
-        if (line == NULL) {
-            line = next_input_line(yyin);
-            linep = (unsigned char *) line;
-            if (line != NULL) {
+        if (input_line == NULL) {
+            input_line = next_input_line(yyin);
+            input_linep = (unsigned char *) input_line;
+            if (input_line != NULL) {
                 token = NO_TOKEN;
             }
             else {
@@ -756,41 +772,41 @@ get_next_symbol(void)
             }
         }
         else {
-            int next_char = *linep & 0x0ff;
+            int next_char = *input_linep & 0x0ff;
 
             /* Remember where we start. */
-            symbol_start = linep;
-            linep++;
+            symbol_start = input_linep;
+            input_linep++;
             token = ChTab[next_char];
 
             switch (token) {
                 case WHITESPACE:
-                    while (ChTab[(unsigned) *linep] == WHITESPACE)
-                        linep++;
+                    while (ChTab[(unsigned) *input_linep] == WHITESPACE)
+                        input_linep++;
                     token = NO_TOKEN;
                     break;
                 case TAG_START:
-                    resulting_line = gather_tag(line, linep);
+                    resulting_line = gather_tag(input_line, input_linep);
                     /* Pick up where we are now. */
-                    line = resulting_line.line;
-                    linep = resulting_line.linep;
+                    input_line = resulting_line.line;
+                    input_linep = resulting_line.linep;
                     token = resulting_line.token;
                     break;
                 case TAG_END:
                     token = NO_TOKEN;
                     break;
                 case DOUBLE_QUOTE:
-                    resulting_line = gather_string(line, linep);
+                    resulting_line = gather_string(input_line, input_linep);
                     /* Pick up where we are now. */
-                    line = resulting_line.line;
-                    linep = resulting_line.linep;
+                    input_line = resulting_line.line;
+                    input_linep = resulting_line.linep;
                     token = resulting_line.token;
                     break;
                 case COMMENT_START:
-                    resulting_line = gather_comment(line, linep);
+                    resulting_line = gather_comment(input_line, input_linep);
                     /* Pick up where we are now. */
-                    line = resulting_line.line;
-                    linep = resulting_line.linep;
+                    input_line = resulting_line.line;
+                    input_linep = resulting_line.linep;
                     token = resulting_line.token;
                     break;
                 case COMMENT_END:
@@ -800,10 +816,10 @@ get_next_symbol(void)
                     token = NO_TOKEN;
                     break;
                 case NAG:
-                    while (isdigit((unsigned) *linep)) {
-                        linep++;
+                    while (isdigit((unsigned) *input_linep)) {
+                        input_linep++;
                     }
-                    if (extract_yytext(symbol_start, linep)) {
+                    if (extract_yytext(symbol_start, input_linep)) {
                         save_string((const char *) yytext);
                     }
                     else {
@@ -813,10 +829,10 @@ get_next_symbol(void)
                 case ANNOTATE:
                     /* Don't return anything in case of error. */
                     token = NO_TOKEN;
-                    while (ChTab[(unsigned) *linep] == ANNOTATE) {
-                        linep++;
+                    while (ChTab[(unsigned) *input_linep] == ANNOTATE) {
+                        input_linep++;
                     }
-                    if (extract_yytext(symbol_start, linep)) {
+                    if (extract_yytext(symbol_start, input_linep)) {
                         switch (yytext[0]) {
                             case '!':
                                 switch (yytext[1]) {
@@ -851,25 +867,25 @@ get_next_symbol(void)
                     break;
                 case CHECK_SYMBOL:
                     /* Allow ++ */
-                    while (ChTab[(unsigned) *linep] == CHECK_SYMBOL) {
-                        linep++;
+                    while (ChTab[(unsigned) *input_linep] == CHECK_SYMBOL) {
+                        input_linep++;
                     }
                     break;
                 case DOT:
-                    while (ChTab[(unsigned) *linep] == DOT)
-                        linep++;
+                    while (ChTab[(unsigned) *input_linep] == DOT)
+                        input_linep++;
                     token = NO_TOKEN;
                     break;
                 case PERCENT:
                     /* Trash the rest of the line. */
-                    line = next_input_line(yyin);
-                    linep = (unsigned char *) line;
+                    input_line = next_input_line(yyin);
+                    input_linep = (unsigned char *) input_line;
                     token = NO_TOKEN;
                     break;
                 case ESCAPE:
                     /* @@@ What to do about this? */
-                    if (*linep != '\0') {
-                        linep++;
+                    if (*input_linep != '\0') {
+                        input_linep++;
                     }
                     token = NO_TOKEN;
                     break;
@@ -877,10 +893,10 @@ get_next_symbol(void)
                     /* Not all ALPHAs are move characters. */
                     if (MoveChars[next_char]) {
                         /* Scan through the possible move characters. */
-                        while (MoveChars[*linep & 0x0ff]) {
-                            linep++;
+                        while (MoveChars[*input_linep & 0x0ff]) {
+                            input_linep++;
                         }
-                        if (extract_yytext(symbol_start, linep)) {
+                        if (extract_yytext(symbol_start, input_linep)) {
                             /* Only classify it as a move if it
                              * seems to be a complete move.
                              */
@@ -901,8 +917,8 @@ get_next_symbol(void)
                             token = NO_TOKEN;
                         }
                     }
-                    else if (next_char == 'Z' && *linep == '0') {
-                        linep++;
+                    else if (next_char == 'Z' && *input_linep == '0') {
+                        input_linep++;
                         save_move((const unsigned char *) NULL_MOVE_STRING);
                         token = MOVE;
                     }
@@ -912,8 +928,8 @@ get_next_symbol(void)
                             fprintf(GlobalState.logfile,
                                     "Unknown character %c (Hex: %x).\n",
                                     next_char, next_char);
-                            fprintf(GlobalState.logfile, "%s\n", line);
-                            unsigned pos = linep - (unsigned char *) line - 1;
+                            fprintf(GlobalState.logfile, "%s\n", input_line);
+                            unsigned pos = input_linep - (unsigned char *) input_line - 1;
                             for(unsigned i = 0; i < pos; i++) {
                                 fputc(' ', GlobalState.logfile);
                             }
@@ -921,8 +937,8 @@ get_next_symbol(void)
                             fputc('\n', GlobalState.logfile);
                         }
                         /* Skip any sequence of them. */
-                        while (ChTab[(unsigned) *linep] == ERROR_TOKEN) {
-                            linep++;
+                        while (ChTab[(unsigned) *input_linep] == ERROR_TOKEN) {
+                            input_linep++;
                         }
                     }
                     break;
@@ -931,10 +947,10 @@ get_next_symbol(void)
                      * Remember that 1 can start 1-0 and 1/2.
                      */
                     resulting_line = gather_possible_numeric(
-                            line, linep, next_char);
+                            input_line, input_linep, next_char);
                     /* Pick up where we are now. */
-                    line = resulting_line.line;
-                    linep = resulting_line.linep;
+                    input_line = resulting_line.line;
+                    input_linep = resulting_line.linep;
                     token = resulting_line.token;
                     break;
                 case EOF_TOKEN:
@@ -959,8 +975,8 @@ get_next_symbol(void)
                     token = TERMINATING_RESULT;
                     break;
                 case DASH:
-                    if (ChTab[(unsigned) *linep] == DASH) {
-                        linep++;
+                    if (ChTab[(unsigned) *input_linep] == DASH) {
+                        input_linep++;
                         save_move((const unsigned char *) NULL_MOVE_STRING);
                         token = MOVE;
                     }
@@ -972,8 +988,8 @@ get_next_symbol(void)
                     break;
                 case EOS:
                     /* End of the string. */
-                    line = next_input_line(yyin);
-                    linep = (unsigned char *) line;
+                    input_line = next_input_line(yyin);
+                    input_linep = (unsigned char *) input_line;
                     token = NO_TOKEN;
                     break;
                 case ERROR_TOKEN:
@@ -984,8 +1000,8 @@ get_next_symbol(void)
                                 next_char, next_char);
                     }
                     /* Skip any sequence of them. */
-                    while (ChTab[(unsigned) *linep] == ERROR_TOKEN) {
-                        linep++;
+                    while (ChTab[(unsigned) *input_linep] == ERROR_TOKEN) {
+                        input_linep++;
                     }
                     break;
                 case OPERATOR:
@@ -993,8 +1009,8 @@ get_next_symbol(void)
                     fprintf(GlobalState.logfile,
                             "Operator in illegal context: %c.\n", *symbol_start);
                     /* Skip any sequence of them. */
-                    while (ChTab[(unsigned) *linep] == OPERATOR)
-                        linep++;
+                    while (ChTab[(unsigned) *input_linep] == OPERATOR)
+                        input_linep++;
                     token = NO_TOKEN;
                     break;
                 default:
@@ -1058,7 +1074,7 @@ skip_to_next_game(TokenType token)
                 if ((yylval.comment != NULL) &&
                         (yylval.comment->comment != NULL)) {
                     free_string_list(yylval.comment->comment);
-                    free((void *) yylval.comment);
+                    game_free((void *) yylval.comment);
                     yylval.comment = NULL;
                 }
             }
@@ -1069,6 +1085,203 @@ skip_to_next_game(TokenType token)
     return token;
 }
 
+/* Skip over the characters of a comment, starting just after
+ * its opening brace.
+ * Return FALSE if the end of the input is reached first.
+ */
+static Boolean
+skip_comment_text(void)
+{
+    unsigned depth = 1;
+
+    while (depth > 0) {
+        unsigned char ch = *input_linep;
+        if (ch == '\0') {
+            input_line = next_input_line(yyin);
+            input_linep = (unsigned char *) input_line;
+            if (input_line == NULL) {
+                return FALSE;
+            }
+        }
+        else {
+            input_linep++;
+            if (ch == '}') {
+                depth--;
+            }
+            else if (ch == '{' && GlobalState.allow_nested_comments) {
+                depth++;
+            }
+        }
+    }
+    return TRUE;
+}
+
+/* Skip the remaining move text of the current game without
+ * tokenising it, and so without decoding moves or saving
+ * strings and comments.
+ * token is the lookahead symbol, which is the first
+ * symbol of the move text.
+ * Comments, strings and variations are taken into account
+ * in finding the end of the game, which is either a terminating
+ * result outside any variation or the tag section of the next game.
+ * Return the new lookahead symbol, which is NO_TOKEN after
+ * a terminating result, as with the parser.
+ */
+TokenType
+skip_movetext(TokenType token)
+{
+    /* The depth of variation nesting. */
+    unsigned depth = 0;
+    Boolean result_found = FALSE;
+    Boolean next_game_found = FALSE;
+
+    /* Release any value associated with the lookahead. */
+    switch (token) {
+        case MOVE:
+            free_move_list(yylval.move_details);
+            break;
+        case COMMENT:
+            if (yylval.comment != NULL) {
+                free_string_list(yylval.comment->comment);
+                game_free((void *) yylval.comment);
+                yylval.comment = NULL;
+            }
+            break;
+        case NAG:
+        case STRING:
+            game_free((void *) yylval.token_string);
+            break;
+        case TERMINATING_RESULT:
+            /* There is no move text. */
+            game_free((void *) yylval.token_string);
+            return NO_TOKEN;
+        case TAG:
+        case EOF_TOKEN:
+            return token;
+        case RAV_START:
+            depth++;
+            break;
+        default:
+            break;
+    }
+
+    GlobalState.skipping_current_game = TRUE;
+    while (!result_found && !next_game_found && input_line != NULL) {
+        unsigned char ch = *input_linep;
+
+        switch (ChTab[ch]) {
+            case EOS:
+            case PERCENT:
+                input_line = next_input_line(yyin);
+                input_linep = (unsigned char *) input_line;
+                break;
+            case COMMENT_START:
+                input_linep++;
+                (void) skip_comment_text();
+                break;
+            case DOUBLE_QUOTE:
+                /* Strings are confined to a single line. */
+                input_linep++;
+                while (*input_linep != '"' && *input_linep != '\0') {
+                    if (*input_linep == '\\' && input_linep[1] != '\0') {
+                        input_linep++;
+                    }
+                    input_linep++;
+                }
+                if (*input_linep == '"') {
+                    input_linep++;
+                }
+                break;
+            case ESCAPE:
+                input_linep++;
+                if (*input_linep != '\0') {
+                    input_linep++;
+                }
+                break;
+            case TAG_START:
+                /* Leave it for the lexer. */
+                next_game_found = TRUE;
+                break;
+            case RAV_START:
+                depth++;
+                input_linep++;
+                break;
+            case RAV_END:
+                if (depth > 0) {
+                    depth--;
+                }
+                input_linep++;
+                break;
+            case STAR:
+                input_linep++;
+                result_found = depth == 0;
+                break;
+            case NAG:
+                input_linep++;
+                while (isdigit((unsigned) *input_linep)) {
+                    input_linep++;
+                }
+                break;
+            case DIGIT:
+                /* Distinguish results from move numbers and
+                 * digit castling in the same way as
+                 * gather_possible_numeric.
+                 */
+                input_linep++;
+                if (ch == '0' && strncmp((const char *) input_linep, "-1", 2) == 0) {
+                    input_linep += 2;
+                    result_found = depth == 0;
+                }
+                else if (ch == '0' && strncmp((const char *) input_linep, "-0-0", 4) == 0) {
+                    input_linep += 4;
+                }
+                else if (ch == '0' && strncmp((const char *) input_linep, "-0", 2) == 0) {
+                    input_linep += 2;
+                }
+                else if (ch == '1' && strncmp((const char *) input_linep, "-0", 2) == 0) {
+                    input_linep += 2;
+                    result_found = depth == 0;
+                }
+                else if (ch == '1' && strncmp((const char *) input_linep, "/2", 2) == 0) {
+                    input_linep += 2;
+                    if (strncmp((const char *) input_linep, "-1/2", 4) == 0) {
+                        input_linep += 4;
+                    }
+                    result_found = depth == 0;
+                }
+                else {
+                    while (isdigit((unsigned) *input_linep)) {
+                        input_linep++;
+                    }
+                }
+                break;
+            case ALPHA:
+                /* Skip the whole of a move so that any digits in it
+                 * are not mistaken for a result.
+                 */
+                input_linep++;
+                if (MoveChars[ch]) {
+                    while (MoveChars[*input_linep & 0x0ff]) {
+                        input_linep++;
+                    }
+                }
+                break;
+            default:
+                input_linep++;
+                break;
+        }
+    }
+    GlobalState.skipping_current_game = FALSE;
+
+    if (result_found) {
+        return NO_TOKEN;
+    }
+    else {
+        /* Either the next game's tags or the end of the input. */
+        return next_token();
+    }
+}
+
 /* Save castling moves in a standard way. */
 static void
 save_q_castle(void)
@@ -1233,11 +1446,23 @@ add_filename_to_source_list(const char *filename, SourceFileType file_type)
     list_of_files.files[list_of_files.num_files] = (char *) NULL;
 }
 
+/* Make fp the source of input lines, releasing any previous source. */
+static void
+set_input_source(FILE *fp)
+{
+    close_line_source(yyin_source);
+    yyin_source = NULL;
+    yyin = fp;
+    if (yyin != NULL) {
+        yyin_source = open_line_source(yyin);
+    }
+}
+
 /* Use infile as the input source. */
 static Boolean
 open_input(const char *infile)
 {
-    yyin = fopen(infile, "rb");
+    set_input_source(fopen(infile, "rb"));
     if (yyin != NULL) {
         GlobalState.current_input_file = infile;
         if (GlobalState.verbosity > 1) {
@@ -1271,15 +1496,74 @@ open_input_file(int file_number)
     }
 }
 
+/* Make the file whose number is the argument the current input file
+ * without reading from it.
+ * This allows games read by another process to be attributed to it.
+ */
+void
+set_current_file(unsigned file_number)
+{
+    current_file_num = file_number;
+    GlobalState.current_input_file = list_of_files.files[file_number];
+    GlobalState.current_file_type = list_of_files.file_type[file_number];
+}
+
+/* Use just the section of the given input file that starts at
+ * offset start and is length bytes long as the input source.
+ * The section must start at the beginning of a line, and
+ * lines_before is the number of lines preceding it in the file.
+ * Its lines are numbered as if the whole of the input had been read.
+ * Nothing beyond the section will be read.
+ * Return FALSE if the section could not be opened.
+ */
+Boolean
+open_input_section(unsigned file_number, long start, long length,
+                   unsigned long lines_before)
+{
+    FILE *fp;
+
+    close_input_section();
+    fp = fopen(list_of_files.files[file_number], "rb");
+    if (fp == NULL) {
+        return FALSE;
+    }
+    yyin_source = open_line_source_section(fp, start, length);
+    if (yyin_source == NULL) {
+        (void) fclose(fp);
+        return FALSE;
+    }
+    yyin = fp;
+    set_current_file(file_number);
+    reading_input_section = TRUE;
+    input_line = NULL;
+    input_linep = NULL;
+    line_number = lines_before + lines_before_file(file_number);
+    restart_lex_for_new_game();
+    return TRUE;
+}
+
+/* Finish with any section opened by open_input_section. */
+void
+close_input_section(void)
+{
+    if (reading_input_section) {
+        terminate_input();
+        reading_input_section = FALSE;
+        input_line = NULL;
+        input_linep = NULL;
+    }
+}
+
 /* Open the first input file. */
 Boolean
 open_first_file(void)
 {
     Boolean ok = TRUE;
 
+    first_file_lines_before = line_number;
     if (list_of_files.num_files == 0) {
         /* Use standard input. */
-        yyin = stdin;
+        set_input_source(stdin);
         GlobalState.current_input_file = "stdin";
         /* @@@ Should this be set?
         GlobalState.current_file_type = NORMALFILE;
@@ -1313,6 +1597,13 @@ input_file_name(unsigned file_number)
     }
 }
 
+/* Return the type of the given input file. */
+SourceFileType
+input_file_type(unsigned file_number)
+{
+    return list_of_files.file_type[file_number];
+}
+
 /* Give some error information. */
 void
 print_error_context(FILE *fp)
@@ -1330,22 +1621,27 @@ save_string(const char *str)
     const size_t len = strlen(str);
     char *token;
 
-    token = (char *) malloc_or_die(len + 1);
+    token = (char *) game_alloc(len + 1);
     strcpy(token, str);
     yylval.token_string = token;
 }
 
-/* Return the next line of input from fp. */
+/* Return the next line of input from fp.
+ * The line is only valid until the next call.
+ */
 char *
 next_input_line(FILE *fp)
-{ /* Retain each line in turn, so as to be able to free it. */
-    static char *line = NULL;
+{ /* Space for lines from files other than yyin. */
+    static char *buffer = NULL;
+    static size_t buffer_size = 0;
+    char *line;
 
-    if (line != NULL) {
-        (void) free((void *) line);
+    if (fp == yyin && yyin_source != NULL) {
+        line = next_source_line(yyin_source);
+    }
+    else {
+        line = read_line_into(fp, &buffer, &buffer_size);
     }
-
-    line = read_line(fp);
 
     if (line != NULL) {
         line_number++;
@@ -1360,7 +1656,11 @@ yywrap(void)
     int time_to_exit;
 
     /* Beware of this being called in inappropriate circumstances. */
-    if (list_of_files.files == NULL) {
+    if (reading_input_section) {
+        /* There is nothing beyond the end of the section. */
+        time_to_exit = 1;
+    }
+    else if (list_of_files.files == NULL) {
         /* There are no files. */
         time_to_exit = 1;
     }
@@ -1406,6 +1706,24 @@ get_line_number(void)
     return line_number;
 }
 
+/* Return the offset in the current input file of the start of the
+ * current line, or -1 if it is not known.
+ */
+long
+get_line_offset(void)
+{
+    return yyin_source != NULL ? source_line_offset(yyin_source) : -1L;
+}
+
+/* Return the number of lines counted before those of the given
+ * input file, which are included in its line numbers.
+ */
+unsigned long
+lines_before_file(unsigned file_number)
+{
+    return file_number == 0 ? first_file_lines_before : 0;
+}
+
 /* Reset the file's line number. */
 void
 reset_line_number(void)
@@ -1413,9 +1731,11 @@ reset_line_number(void)
     line_number = 0;
 }
 
-static void
+void
 terminate_input(void)
 {
+    close_line_source(yyin_source);
+    yyin_source = NULL;
     if ((yyin != stdin) && (yyin != NULL)) {
         (void) fclose(yyin);
         yyin = NULL;
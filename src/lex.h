@@ -76,15 +76,24 @@ void print_error_context(FILE *fp);
 void init_lex_tables(void);
 TokenType next_token(void);
 TokenType skip_to_next_game(TokenType token);
+TokenType skip_movetext(TokenType token);
 const char *tag_header_string(TagName tag);
 Boolean open_first_file(void);
 const char *input_file_name(unsigned file_number);
+SourceFileType input_file_type(unsigned file_number);
 unsigned current_file_number(void);
 Boolean open_eco_file(const char *eco_file);
+void set_current_file(unsigned file_number);
+Boolean open_input_section(unsigned file_number, long start, long length,
+                           unsigned long lines_before);
+void close_input_section(void);
+void terminate_input(void);
 int yywrap(void);
 void add_filename_to_source_list(const char *filename,SourceFileType file_type);
 void add_filename_list_from_file(FILE *fp,SourceFileType file_type);
 unsigned long get_line_number(void);
+long get_line_offset(void);
+unsigned long lines_before_file(unsigned file_number);
 void reset_line_number(void);
 char *next_input_line(FILE *fp);
 LinePair gather_tag(char *line, unsigned char *linep);
@@ -19,6 +19,9 @@
  *  https://www.cs.kent.ac.uk/people/staff/djb/
  */
 
+/* For fileno() with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,6 +29,13 @@
 #include "bool.h"
 #include "mymalloc.h"
 #include "lines.h"
+#ifdef MAPPED_FILES
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 /* Read a single line of input. */
 #define INIT_LINE_LENGTH 80
@@ -37,6 +47,351 @@
  */
 #define COMMENT_CHAR '%'
 
+/* Once this many bytes of a mapped file have been read, the
+ * pages that hold them are unmapped so that the memory used
+ * does not grow with the size of the file.
+ */
+#define RELEASE_THRESHOLD (8 * 1024 * 1024)
+
+/* A source of lines from an input file.
+ * Where possible, a regular file is mapped read-only into memory
+ * and each line is copied from the mapping into a single buffer
+ * that is reused from one line to the next.
+ * Otherwise (stdin, pipes, etc.) lines are streamed into that buffer.
+ */
+struct line_source {
+    FILE *fp;
+    /* The mapped file contents, or NULL if streaming. */
+    char *mapping;
+    size_t mapping_size;
+    /* Index of the start of the part of mapping that has not
+     * yet been unmapped.
+     */
+    size_t mapped_from;
+    /* Index of the start of the next line in mapping. */
+    size_t next;
+    /* Index just beyond the last character to be read. */
+    size_t end;
+    /* Index of the start of the line most recently returned. */
+    size_t line_start;
+    /* The line most recently returned. */
+    char *buffer;
+    size_t buffer_size;
+};
+
+/* Read the next line from fpin into *buffer, extending it if necessary.
+ * The line terminator is not retained.
+ * Return NULL at end of file.
+ * Line endings are treated as for read_line.
+ */
+char *
+read_line_into(FILE *fpin, char **buffer, size_t *buffer_size)
+{
+    char *line = *buffer;
+    size_t max_length = *buffer_size;
+    size_t len = 0;
+    int ch;
+
+    ch = getc(fpin);
+    if (ch == EOF) {
+        return NULL;
+    }
+    if (line == NULL) {
+        max_length = INIT_LINE_LENGTH;
+        line = (char *) malloc_or_die(max_length + 1);
+    }
+    while ((ch != '\n') && (ch != '\r') && (ch != EOF)) {
+        if (len == max_length) {
+            /* Double the space, as this buffer is long-lived. */
+            max_length *= 2;
+            line = (char *) realloc_or_die((void *) line, max_length + 1);
+        }
+        line[len] = ch;
+        len++;
+        ch = getc(fpin);
+    }
+    line[len] = '\0';
+    if (ch == '\r') {
+        /* Try to avoid double counting lines in dos-format files. */
+        ch = getc(fpin);
+        if (ch != '\n' && ch != EOF) {
+            ungetc(ch, fpin);
+        }
+    }
+    *buffer = line;
+    *buffer_size = max_length;
+    return line;
+}
+
+/* Prepare to read lines from fpin.
+ * The caller retains responsibility for closing fpin, which
+ * must not be done before close_line_source is called.
+ */
+LineSource *
+open_line_source(FILE *fpin)
+{
+    LineSource *source = (LineSource *) malloc_or_die(sizeof (*source));
+
+    source->fp = fpin;
+    source->mapping = NULL;
+    source->mapping_size = 0;
+    source->mapped_from = 0;
+    source->next = 0;
+    source->end = 0;
+    source->line_start = 0;
+    source->buffer = NULL;
+    source->buffer_size = 0;
+#ifdef MAPPED_FILES
+    {
+        struct stat info;
+        int fd = fileno(fpin);
+
+        /* Only regular, non-empty files are mapped, and only if
+         * nothing has yet been read from them.
+         */
+        if (fd >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+                info.st_size > 0 && (off_t) (size_t) info.st_size == info.st_size &&
+                ftell(fpin) == 0) {
+            void *addr = mmap(NULL, (size_t) info.st_size,
+                    PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                source->mapping = (char *) addr;
+                source->mapping_size = (size_t) info.st_size;
+                source->end = source->mapping_size;
+            }
+        }
+    }
+#endif
+    return source;
+}
+
+/* Prepare to read lines from just the section of fpin that starts
+ * at offset start and is length bytes long.
+ * The section should start at the beginning of a line and end
+ * at the end of one.
+ * This is only possible with a memory-mapped file, so return
+ * NULL if the file cannot be mapped.
+ */
+LineSource *
+open_line_source_section(FILE *fpin, long start, long length)
+{
+    LineSource *source = open_line_source(fpin);
+
+    if (source->mapping == NULL || start < 0 || length < 0 ||
+            (size_t) start + (size_t) length > source->mapping_size) {
+        close_line_source(source);
+        return NULL;
+    }
+    else {
+        source->next = (size_t) start;
+        source->end = (size_t) start + (size_t) length;
+        return source;
+    }
+}
+
+#ifdef MAPPED_FILES
+/* Unmap the pages of source's mapping that lie wholly before
+ * the next line to be read, once there are enough of them.
+ */
+static void
+release_read_pages(LineSource *source)
+{
+    if (source->next - source->mapped_from >= RELEASE_THRESHOLD) {
+        size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+        size_t release_to = source->next - source->next % page_size;
+
+        if (release_to > source->mapped_from &&
+                munmap((void *) &source->mapping[source->mapped_from],
+                       release_to - source->mapped_from) == 0) {
+            source->mapped_from = release_to;
+        }
+    }
+}
+#endif
+
+/* Return the next line from source, or NULL at the end of the input.
+ * The line remains valid until the next call.
+ */
+char *
+next_source_line(LineSource *source)
+{
+    if (source->mapping == NULL) {
+        return read_line_into(source->fp, &source->buffer, &source->buffer_size);
+    }
+    else if (source->next >= source->end) {
+        return NULL;
+    }
+    else {
+        const char *start = &source->mapping[source->next];
+        const char *end = &source->mapping[source->end];
+        const char *p = start;
+        size_t len;
+
+        source->line_start = source->next;
+
+        while (p < end && *p != '\n' && *p != '\r') {
+            p++;
+        }
+        len = (size_t) (p - start);
+        if (source->buffer == NULL || source->buffer_size < len) {
+            size_t new_size = source->buffer_size > 0 ?
+                        source->buffer_size : INIT_LINE_LENGTH;
+            while (new_size < len) {
+                new_size *= 2;
+            }
+            if (source->buffer != NULL) {
+                (void) free((void *) source->buffer);
+            }
+            source->buffer = (char *) malloc_or_die(new_size + 1);
+            source->buffer_size = new_size;
+        }
+        memcpy(source->buffer, start, len);
+        source->buffer[len] = '\0';
+
+        if (p < end) {
+            if (*p == '\r' && p + 1 < end && p[1] == '\n') {
+                /* Skip the second character of a dos-format line end. */
+                p++;
+            }
+            p++;
+        }
+        source->next = (size_t) (p - source->mapping);
+#ifdef MAPPED_FILES
+        release_read_pages(source);
+#endif
+        return source->buffer;
+    }
+}
+
+/* Return the offset in the file of the start of the line most
+ * recently returned by next_source_line, or -1 if it is not known
+ * because the lines are streamed.
+ */
+long
+source_line_offset(const LineSource *source)
+{
+    return source->mapping != NULL ? (long) source->line_start : -1L;
+}
+
+/* Release the resources associated with source.
+ * The underlying file is not closed.
+ */
+void
+close_line_source(LineSource *source)
+{
+    if (source != NULL) {
+#ifdef MAPPED_FILES
+        if (source->mapping != NULL &&
+                source->mapped_from < source->mapping_size) {
+            (void) munmap((void *) &source->mapping[source->mapped_from],
+                          source->mapping_size - source->mapped_from);
+        }
+#endif
+        if (source->buffer != NULL) {
+            (void) free((void *) source->buffer);
+        }
+        (void) free((void *) source);
+    }
+}
+
+/* Return the whole of filename, setting *size to its length,
+ * or NULL if it cannot be read or is empty.
+ * Where possible the file is memory-mapped rather than read.
+ * The contents must be released with release_whole_file.
+ */
+const char *
+read_whole_file(const char *filename, size_t *size)
+{
+#ifdef MAPPED_FILES
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    void *addr;
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size <= 0 ||
+            (off_t) (size_t) info.st_size != info.st_size) {
+        (void) close(fd);
+        return NULL;
+    }
+    *size = (size_t) info.st_size;
+    addr = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void) close(fd);
+    return addr == MAP_FAILED ? NULL : (const char *) addr;
+#else
+    FILE *fp = fopen(filename, "rb");
+    char *contents = NULL;
+    long length;
+
+    if (fp == NULL) {
+        return NULL;
+    }
+    if (fseek(fp, 0L, SEEK_END) == 0 && (length = ftell(fp)) > 0 &&
+            fseek(fp, 0L, SEEK_SET) == 0) {
+        contents = (char *) malloc_or_die((size_t) length);
+        if (fread((void *) contents, 1, (size_t) length, fp) == (size_t) length) {
+            *size = (size_t) length;
+        }
+        else {
+            (void) free((void *) contents);
+            contents = NULL;
+        }
+    }
+    (void) fclose(fp);
+    return contents;
+#endif
+}
+
+/* Release the contents, size bytes long, returned by read_whole_file. */
+void
+release_whole_file(const char *contents, size_t size)
+{
+#ifdef MAPPED_FILES
+    (void) munmap((void *) contents, size);
+#else
+    (void) free((void *) contents);
+#endif
+}
+
+/* Return a name under which to write a new version of filename
+ * before replacing it with replace_file.
+ * Where possible the name is unique to this process, so that
+ * concurrent runs do not write to the same file.
+ */
+char *
+temporary_file_name(const char *filename)
+{
+    char *temporary_file = (char *) malloc_or_die(strlen(filename) + 32);
+
+#ifdef MAPPED_FILES
+    sprintf(temporary_file, "%s.%ld", filename, (long) getpid());
+#else
+    sprintf(temporary_file, "%s.tmp", filename);
+#endif
+    return temporary_file;
+}
+
+/* Replace filename with temporary_file, so that readers never see
+ * a partial file.
+ * Return FALSE, having removed temporary_file, if it cannot be done.
+ */
+Boolean
+replace_file(const char *temporary_file, const char *filename)
+{
+    Boolean ok;
+
+#ifndef MAPPED_FILES
+    /* Not every rename replaces an existing file. */
+    (void) remove(filename);
+#endif
+    ok = rename(temporary_file, filename) == 0;
+    if (!ok) {
+        (void) remove(temporary_file);
+    }
+    return ok;
+}
+
 char *
 read_line(FILE *fpin)
 {
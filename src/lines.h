@@ -22,10 +22,33 @@
 #ifndef LINES_H
 #define LINES_H
 
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+/* Regular files can be memory-mapped rather than read. */
+#define MAPPED_FILES
+#endif
+
+/* Stored in binary files, such as indexes and caches, to check that
+ * they are read on a machine with the byte order that wrote them.
+ */
+#define NATIVE_BYTE_ORDER ((uint64_t) 0x0102030405060708ULL)
+
+/* A source of input lines: see lines.c */
+typedef struct line_source LineSource;
+
 char *read_line(FILE *fpin);
+char *read_line_into(FILE *fpin, char **buffer, size_t *buffer_size);
+LineSource *open_line_source(FILE *fpin);
+LineSource *open_line_source_section(FILE *fpin, long start, long length);
+char *next_source_line(LineSource *source);
+long source_line_offset(const LineSource *source);
+void close_line_source(LineSource *source);
 Boolean non_blank_line(const char *line);
 Boolean blank_line(const char *line);
 Boolean comment_line(const char *line);
+const char *read_whole_file(const char *filename, size_t *size);
+void release_whole_file(const char *contents, size_t size);
+char *temporary_file_name(const char *filename);
+Boolean replace_file(const char *temporary_file, const char *filename);
 
 #endif	// LINES_H
 
@@ -783,18 +783,32 @@ check_tag_details_not_ECO(char *Details[], int num_details)
 /* Check just the ECO tag from the game's tag details. */
 Boolean
 check_ECO_tag(char *Details[])
+{
+    return check_ECO_value(Details[ECO_TAG]);
+}
+
+/* Return TRUE if there are criteria for the ECO tag. */
+Boolean
+ECO_tag_is_checked(void)
+{
+    return GlobalState.check_tags && TagLists[ECO_TAG].num_used_elements != 0;
+}
+
+/* Check eco, the value of a game's ECO tag (NULL if it has none),
+ * against any criteria for the ECO tag.
+ */
+Boolean
+check_ECO_value(const char *eco)
 {
     Boolean wanted = TRUE;
 
-    if (GlobalState.check_tags) {
-        if (TagLists[ECO_TAG].num_used_elements != 0) {
-            if (Details[ECO_TAG] != NULL) {
-                wanted = check_list(ECO_TAG, Details[ECO_TAG], &TagLists[ECO_TAG]);
-            }
-            else {
-                /* Required tag not present. */
-                wanted = FALSE;
-            }
+    if (ECO_tag_is_checked()) {
+        if (eco != NULL) {
+            wanted = check_list(ECO_TAG, eco, &TagLists[ECO_TAG]);
+        }
+        else {
+            /* Required tag not present. */
+            wanted = FALSE;
         }
     }
     return wanted;
@@ -45,6 +45,8 @@ void extract_tag_argument(const char *argstr);
 void add_tag_to_list(int tag,const char *tagstr,TagOperator operator);
 Boolean check_tag_details_not_ECO(char *Details[],int num_details);
 Boolean check_ECO_tag(char *Details[]);
+Boolean ECO_tag_is_checked(void);
+Boolean check_ECO_value(const char *eco);
 void init_tag_lists(void);
 Boolean check_setup_tag(char *Details[]);
 
@@ -34,10 +34,16 @@
 #include "map.h"
 #include "lists.h"
 #include "output.h"
+#include "eco.h"
 #include "end.h"
 #include "grammar.h"
 #include "hashing.h"
 #include "argsfile.h"
+#include "parallel.h"
+#include "prefixcache.h"
+#include "outputcache.h"
+#include "posindex.h"
+#include "gameindex.h"
 
 /* The maximum length of an output line.  This is conservatively
  * slightly smaller than the PGN export standard of 80.
@@ -51,6 +57,13 @@
 #define DEFAULT_ECO_FILE "eco.pgn"
 #endif
 
+/* The number of positions held by the cache of opening lines.
+ * Each takes a little under 1KB.
+ */
+#ifndef DEFAULT_PREFIX_CACHE_SIZE
+#define DEFAULT_PREFIX_CACHE_SIZE 8192
+#endif
+
 /* This structure holds details of the program state
  * available to all parts of the program.
  * This goes against the grain of good structured programming
@@ -88,6 +101,7 @@ StateInfo GlobalState = {
     TRUE,               /* keep_checks (--nochecks) */
     FALSE,              /* output_evaluation (--evaluation) */
     FALSE,              /* keep_broken_games (--keepbroken) */
+    FALSE,              /* skip_rejected_moves (--skiprejected) */
     FALSE,              /* suppress_redundant_ep_info (--nofauxep) */
     FALSE,              /* json_format (--json) */
     FALSE,              /* check_for_repetition (--repetition) */
@@ -124,6 +138,9 @@ StateInfo GlobalState = {
     FALSE,              /* add_matchlabel_tag (--addlabeltag) */
     FALSE,              /* only_output_wanted_tags (--xroster) */
     0,                  /* split_depth_limit */
+    0,                  /* num_threads (--threads) */
+    DEFAULT_PREFIX_CACHE_SIZE, /* prefix_cache_size (--prefixcache) */
+    FALSE,              /* report_prefix_cache (--prefixstats) */
     NORMALFILE,         /* current_file_type */
     SETUP_TAG_OK,       /* setup_status */
     EITHER_TO_MOVE,     /* whose_move */
@@ -133,6 +150,11 @@ StateInfo GlobalState = {
     (char *) NULL,      /* line_number_marker (--linenumbers) */
     (char *) NULL,      /* current_input_file */
     DEFAULT_ECO_FILE,   /* eco_file (-e) */
+    (char *) NULL,      /* eco_cache_file (--ecocache) */
+    (char *) NULL,      /* duplicate_database (--dupdb) */
+    (char *) NULL,      /* build_position_index (--buildposindex) */
+    (char *) NULL,      /* use_position_index (--useposindex) */
+    (char *) NULL,      /* game_index (--gameindex) */
     (FILE *) NULL,      /* outputfile (-o, -a). Default is stdout */
     (char *) NULL,      /* output_filename (-o, -a) */
     (FILE *) NULL,      /* logfile (-l). Default is stderr */
@@ -166,6 +188,8 @@ main(int argc, char *argv[])
     init_tag_lists();
     /* Prepare the hash tables for transposition detection. */
     init_hashtab();
+    /* Prepare the tables for move generation. */
+    init_attack_tables();
     /* Initialise the lexical analyser's tables. */
     init_lex_tables();
     /* Allow for some arguments. */
@@ -377,14 +401,13 @@ main(int argc, char *argv[])
     /* Make some adjustments to other settings if JSON output is required. */
     if (GlobalState.json_format) {
         if (GlobalState.output_format != EPD &&
-                GlobalState.output_format != CM &&
-                GlobalState.ECO_level == DONT_DIVIDE) {
+                GlobalState.output_format != CM) {
             GlobalState.keep_comments = FALSE;
             GlobalState.keep_variations = FALSE;
             GlobalState.keep_results = FALSE;
         }
         else {
-            fprintf(GlobalState.logfile, "JSON output is not currently supported with -E, -Wepd or -Wcm\n");
+            fprintf(GlobalState.logfile, "JSON output is not currently supported with -Wepd or -Wcm\n");
             GlobalState.json_format = FALSE;
         }
     }
@@ -393,13 +416,22 @@ main(int argc, char *argv[])
     init_duplicate_hash_table();
 
     if (GlobalState.add_ECO) {
-        /* Read in a list of ECO lines in order to classify the games. */
-        if (open_eco_file(GlobalState.eco_file)) {
+        /* Read in a list of ECO lines in order to classify the games,
+         * unless they are already in an up-to-date cache.
+         */
+        if (GlobalState.eco_cache_file != NULL &&
+                load_eco_cache(GlobalState.eco_cache_file, GlobalState.eco_file)) {
+            /* The table is ready. */
+        }
+        else if (open_eco_file(GlobalState.eco_file)) {
             /* Indicate that the ECO file is currently being parsed. */
             GlobalState.parsing_ECO_file = TRUE;
             yyparse(ECOFILE);
             reset_line_number();
             GlobalState.parsing_ECO_file = FALSE;
+            if (GlobalState.eco_cache_file != NULL) {
+                save_eco_cache(GlobalState.eco_cache_file, GlobalState.eco_file);
+            }
         }
         else {
             fprintf(GlobalState.logfile, "Unable to open the ECO file %s.\n",
@@ -413,14 +445,44 @@ main(int argc, char *argv[])
         exit(1);
     }
 
-    yyparse(GlobalState.current_file_type);
+    if (GlobalState.use_position_index != NULL &&
+            process_games_with_position_index(GlobalState.use_position_index)) {
+        /* Only the games selected by the index have been read. */
+    }
+    else if (GlobalState.game_index != NULL &&
+            process_games_with_game_index(GlobalState.game_index)) {
+        /* Only the games selected by number have been read. */
+    }
+    else if (GlobalState.num_threads > 1 && can_process_in_parallel()) {
+        process_games_in_parallel();
+        if (GlobalState.report_prefix_cache) {
+            fprintf(GlobalState.logfile,
+                    "--prefixstats is not supported with --threads.\n");
+        }
+    }
+    else {
+        yyparse(GlobalState.current_file_type);
+        if (GlobalState.report_prefix_cache) {
+            report_prefix_cache();
+        }
+    }
+
+    if (GlobalState.build_position_index != NULL) {
+        write_position_index(GlobalState.build_position_index, !finished_processing());
+    }
+    if (GlobalState.game_index != NULL) {
+        complete_game_index(!finished_processing());
+    }
 
     /* @@@ I would prefer this to be somewhere else. */
     if (GlobalState.json_format &&
             !GlobalState.check_only &&
-            GlobalState.num_games_matched > 0) {
+            GlobalState.num_games_matched > 0 &&
+            GlobalState.ECO_level == DONT_DIVIDE) {
         fputs("\n]\n", GlobalState.outputfile);
     }
+    /* Close the files of -E, terminating their JSON output. */
+    close_cached_output_files();
 
     /* Remove any temporary files. */
     clear_duplicate_hash_table();
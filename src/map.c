@@ -33,6 +33,7 @@
 #include "map.h"
 #include "decode.h"
 #include "apply.h"
+#include "zobrist.h"
 
 /* Structures to hold the x,y displacements of the various
  * piece movements.
@@ -50,22 +51,6 @@ static int Knight_moves[2 * NUM_KNIGHT_MOVES] = {
     -2, 1,
     -2, -1,};
 
-/* Define a list of possible Bishop moves. */
-#define NUM_BISHOP_MOVES 4
-static int Bishop_moves[2 * NUM_BISHOP_MOVES] = {
-    1, 1,
-    1, -1,
-    -1, 1,
-    -1, -1};
-
-/* Define a list of possible Rook moves. */
-#define NUM_ROOK_MOVES 4
-static int Rook_moves[2 * NUM_ROOK_MOVES] = {
-    1, 0,
-    0, 1,
-    -1, 0,
-    0, -1};
-
 /* Define a list of possible King moves. */
 #define NUM_KING_MOVES 8
 static int King_moves[2 * NUM_KING_MOVES] = {
@@ -78,88 +63,376 @@ static int King_moves[2 * NUM_KING_MOVES] = {
     -1, 1,
     -1, -1,};
 
-/* Define a list of possible Queen moves. */
-#define NUM_QUEEN_MOVES 8
-static int Queen_moves[2 * NUM_QUEEN_MOVES] = {
+/* Bitboard attack tables, indexed by square number (0 = a1, 63 = h8).
+ * The tables for knights, kings and pawns give the squares attacked
+ * from each square. Those for sliding pieces give the rays from each
+ * square in each direction to the edge of the board. The directions
+ * that increase the square number come first.
+ */
+#define NUM_SQUARES (BOARDSIZE * BOARDSIZE)
+typedef enum {
+    NORTH, EAST, NORTH_EAST, NORTH_WEST,
+    SOUTH, WEST, SOUTH_EAST, SOUTH_WEST,
+    NUM_DIRECTIONS
+} Direction;
+/* Rank and column displacements of each Direction. */
+static const int Direction_offsets[2 * NUM_DIRECTIONS] = {
     1, 0,
+    0, 1,
     1, 1,
     1, -1,
-    0, 1,
-    0, -1,
     -1, 0,
+    0, -1,
     -1, 1,
     -1, -1,};
+static Bitboard Knight_attacks[NUM_SQUARES];
+static Bitboard King_attacks[NUM_SQUARES];
+/* Indexed by the colour of the attacking pawn. */
+static Bitboard Pawn_attacks[2][NUM_SQUARES];
+static Bitboard Rays[NUM_DIRECTIONS][NUM_SQUARES];
+
+/* Conversions between board indices and square numbers. */
+#define SQUARE_NUMBER(r, c) (((r) - HEDGE) * BOARDSIZE + ((c) - HEDGE))
+#define SQUARE_BIT(square) (((Bitboard) 1) << (square))
+#define SQUARE_COL(square) ((Col) (FIRSTCOL + (square) % BOARDSIZE))
+#define SQUARE_RANK(square) ((Rank) (FIRSTRANK + (square) / BOARDSIZE))
+/* Whether col and rank are on the board. */
+#define ON_BOARD(col, rank) (((col) >= FIRSTCOL) && ((col) <= LASTCOL) && \
+                             ((rank) >= FIRSTRANK) && ((rank) <= LASTRANK))
+#define COL_RANK_SQUARE(col, rank) (((rank) - FIRSTRANK) * BOARDSIZE + ((col) - FIRSTCOL))
+
+static void add_move(MoveList *moves, Col from_col, Rank from_rank,
+                Col to_col, Rank to_rank);
+static void keep_legal_moves(Piece piece, Colour colour, MoveList *moves,
+                unsigned first, const Board *board);
+static Boolean square_is_attacked(const Board *board, int square, Colour attacker,
+                                  Bitboard occupied, Bitboard excluded);
+static Boolean move_leaves_king_in_check(Piece piece, Colour colour,
+                const MovePair *move, const Board *board);
+static void moves_from_squares(Bitboard squares, Col to_col, Rank to_rank,
+                MoveList *moves);
+static void moves_to_squares(Col from_col, Rank from_rank, Bitboard squares,
+                MoveList *moves);
+
+/* Return the number of the lowest square in the non-empty set squares. */
+static int
+lowest_square(Bitboard squares)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(squares);
+#else
+    int square = 0;
+    while ((squares & 1) == 0) {
+        squares >>= 1;
+        square++;
+    }
+    return square;
+#endif
+}
 
+/* Return the number of the highest square in the non-empty set squares. */
+static int
+highest_square(Bitboard squares)
+{
+#if defined(__GNUC__)
+    return (NUM_SQUARES - 1) - __builtin_clzll(squares);
+#else
+    int square = NUM_SQUARES - 1;
+    while ((squares & SQUARE_BIT(NUM_SQUARES - 1)) == 0) {
+        squares <<= 1;
+        square--;
+    }
+    return square;
+#endif
+}
 
-/* A table of hash values for square/piece/colour combinations.
- * When a piece is moved, the hash value is xor-ed into a
- * running description of the current board state.
+/* Return the set of squares reached from (r, c) by the given
+ * rank and column displacements, if it is on the board.
  */
-#define NUMBER_OF_PIECES 6
-static HashCode HashTab[BOARDSIZE][BOARDSIZE][NUMBER_OF_PIECES][2];
+static Bitboard
+displaced_square(int r, int c, int rank_offset, int col_offset)
+{
+    r += rank_offset;
+    c += col_offset;
+    if (r >= 0 && r < BOARDSIZE && c >= 0 && c < BOARDSIZE) {
+        return SQUARE_BIT(r * BOARDSIZE + c);
+    }
+    else {
+        return 0;
+    }
+}
 
-/* Code to allocate and free MovePair structures.  New moves are
- * allocated from the move_pool, if it isn't empty.  Old moves
- * are freed to this pool.
- * This is used to avoid too much fragmentation of the heap.
- * Since the program will spend a lot of its life allocating and
- * deallocating move structures, we might as well hang on to them.
- */
-/* Keep a pool of free move structures. */
-static MovePair *move_pool = NULL;
+/* Fill in the attack tables. */
+void
+init_attack_tables(void)
+{
+    for (int square = 0; square < NUM_SQUARES; square++) {
+        int r = square / BOARDSIZE, c = square % BOARDSIZE;
+        unsigned ix;
+
+        Knight_attacks[square] = 0;
+        for (ix = 0; ix < 2 * NUM_KNIGHT_MOVES; ix += 2) {
+            Knight_attacks[square] |=
+                    displaced_square(r, c, Knight_moves[ix], Knight_moves[ix + 1]);
+        }
+        King_attacks[square] = 0;
+        for (ix = 0; ix < 2 * NUM_KING_MOVES; ix += 2) {
+            King_attacks[square] |=
+                    displaced_square(r, c, King_moves[ix], King_moves[ix + 1]);
+        }
+        Pawn_attacks[WHITE][square] = displaced_square(r, c, 1, -1) |
+                displaced_square(r, c, 1, 1);
+        Pawn_attacks[BLACK][square] = displaced_square(r, c, -1, -1) |
+                displaced_square(r, c, -1, 1);
+        for (ix = 0; ix < NUM_DIRECTIONS; ix++) {
+            int rank_offset = Direction_offsets[2 * ix];
+            int col_offset = Direction_offsets[2 * ix + 1];
+            Bitboard ray = 0;
+            Bitboard next;
+            int distance = 1;
+
+            while ((next = displaced_square(r, c, distance * rank_offset,
+                                            distance * col_offset)) != 0) {
+                ray |= next;
+                distance++;
+            }
+            Rays[ix][square] = ray;
+        }
+    }
+}
 
-static MovePair *
-malloc_move(void)
+/* Set the bitboards of board from the contents of board->board. */
+void
+set_board_bitboards(Board *board)
 {
-    MovePair *move;
+    memset((void *) board->pieces, 0, sizeof (board->pieces));
+    memset((void *) board->occupied, 0, sizeof (board->occupied));
+    board->material = 0;
+    for (int r = HEDGE; r < HEDGE + BOARDSIZE; r++) {
+        for (int c = HEDGE; c < HEDGE + BOARDSIZE; c++) {
+            Piece occupant = board->board[r][c];
 
-    if (move_pool != NULL) {
-        move = move_pool;
-        move_pool = move_pool->next;
+            if (occupant != EMPTY && occupant != OFF) {
+                Bitboard bit = SQUARE_BIT(SQUARE_NUMBER(r, c));
+                board->pieces[EXTRACT_COLOUR(occupant)][EXTRACT_PIECE(occupant)] |= bit;
+                board->occupied[EXTRACT_COLOUR(occupant)] |= bit;
+            }
+        }
     }
-    else {
-        move = (MovePair *) malloc_or_die(sizeof (MovePair));
+    for (Colour colour = BLACK; colour <= WHITE; colour++) {
+        for (Piece piece = PAWN; piece <= QUEEN; piece++) {
+            unsigned count = __builtin_popcountll(board->pieces[colour][piece]);
+            if (count > MATERIAL_MAX_COUNT) {
+                board->material = MATERIAL_UNKNOWN;
+            }
+            else if (board->material != MATERIAL_UNKNOWN) {
+                board->material += count * MATERIAL_UNIT(colour, piece);
+            }
+        }
     }
-    move->next = NULL;
-    return move;
 }
 
-/* Append another move pair onto moves, and return the new list. */
-static MovePair *
-append_move_pair(Col from_col, Rank from_rank, Col to_col, Rank to_rank, MovePair *moves)
+/* Clear the square at board index r,c, keeping the bitboards
+ * and Zobrist hash in step.
+ */
+static void
+clear_square(Board *board, int r, int c)
 {
-    MovePair *move = malloc_move();
-
-    move->from_rank = from_rank;
-    move->from_col = from_col;
-    move->to_rank = to_rank;
-    move->to_col = to_col;
-    move->next = moves;
-    return move;
+    Piece occupant = board->board[r][c];
+
+    if (occupant != EMPTY && occupant != OFF) {
+        int square = SQUARE_NUMBER(r, c);
+        Bitboard bit = SQUARE_BIT(square);
+        board->pieces[EXTRACT_COLOUR(occupant)][EXTRACT_PIECE(occupant)] &= ~bit;
+        board->occupied[EXTRACT_COLOUR(occupant)] &= ~bit;
+        board->zobrist ^= zobrist_piece_key(occupant, square);
+        if (board->material != MATERIAL_UNKNOWN) {
+            board->material -= MATERIAL_UNIT(EXTRACT_COLOUR(occupant), EXTRACT_PIECE(occupant));
+        }
+    }
+    board->board[r][c] = EMPTY;
 }
 
-/* Simply add the move to the free move pool. */
+/* Place coloured_piece on the square at board index r,c,
+ * keeping the bitboards and Zobrist hash in step.
+ */
 static void
-free_move_pair(MovePair *move)
+place_piece(Board *board, int r, int c, Piece coloured_piece)
 {
-    move->next = move_pool;
-    move_pool = move;
+    int square = SQUARE_NUMBER(r, c);
+    Bitboard bit = SQUARE_BIT(square);
+
+    clear_square(board, r, c);
+    board->board[r][c] = coloured_piece;
+    board->pieces[EXTRACT_COLOUR(coloured_piece)][EXTRACT_PIECE(coloured_piece)] |= bit;
+    board->occupied[EXTRACT_COLOUR(coloured_piece)] |= bit;
+    board->zobrist ^= zobrist_piece_key(coloured_piece, square);
+    if (board->material != MATERIAL_UNKNOWN) {
+        board->material += MATERIAL_UNIT(EXTRACT_COLOUR(coloured_piece), EXTRACT_PIECE(coloured_piece));
+    }
 }
 
-/* Free a whole list of moves to the move pool. */
-void
-free_move_pair_list(MovePair *move_list)
+/* Return the squares attacked from square in the given direction,
+ * given the occupied squares.
+ * The ray stops at the first occupied square, which is included.
+ */
+static Bitboard
+ray_attacks(Direction direction, int square, Bitboard occupied)
+{
+    Bitboard ray = Rays[direction][square];
+    Bitboard blockers = ray & occupied;
+
+    if (blockers != 0) {
+        int blocker = direction < SOUTH ?
+                lowest_square(blockers) : highest_square(blockers);
+        ray ^= Rays[direction][blocker];
+    }
+    return ray;
+}
+
+/* The squares attacked by a rook on square. */
+static Bitboard
+rook_attacks(int square, Bitboard occupied)
+{
+    return ray_attacks(NORTH, square, occupied) | ray_attacks(EAST, square, occupied) |
+            ray_attacks(SOUTH, square, occupied) | ray_attacks(WEST, square, occupied);
+}
+
+/* The squares attacked by a bishop on square. */
+static Bitboard
+bishop_attacks(int square, Bitboard occupied)
+{
+    return ray_attacks(NORTH_EAST, square, occupied) |
+            ray_attacks(NORTH_WEST, square, occupied) |
+            ray_attacks(SOUTH_EAST, square, occupied) |
+            ray_attacks(SOUTH_WEST, square, occupied);
+}
+
+/* Return TRUE if square is attacked by a piece of colour attacker,
+ * with the given squares occupied, ignoring any pieces on the
+ * excluded squares.
+ */
+static Boolean
+square_is_attacked(const Board *board, int square, Colour attacker,
+                   Bitboard occupied, Bitboard excluded)
 {
-    if(move_pool == NULL) {
-        move_pool = move_list;
+    const Bitboard *pieces = board->pieces[attacker];
+    Bitboard queens = pieces[QUEEN] & ~excluded;
+
+    return (rook_attacks(square, occupied) & ((pieces[ROOK] & ~excluded) | queens)) != 0 ||
+            (bishop_attacks(square, occupied) & ((pieces[BISHOP] & ~excluded) | queens)) != 0 ||
+            (Knight_attacks[square] & pieces[KNIGHT] & ~excluded) != 0 ||
+            /* A pawn attacks square from where a pawn of the other
+             * colour on square would attack.
+             */
+            (Pawn_attacks[OPPOSITE_COLOUR(attacker)][square] & pieces[PAWN] & ~excluded) != 0 ||
+            (King_attacks[square] & pieces[KING] & ~excluded) != 0;
+}
+
+/* Return the squares of the pieces of colour attacker that attack
+ * square, with the given squares occupied.
+ */
+static Bitboard
+attackers_of(const Board *board, int square, Colour attacker, Bitboard occupied)
+{
+    const Bitboard *pieces = board->pieces[attacker];
+
+    return (rook_attacks(square, occupied) & (pieces[ROOK] | pieces[QUEEN])) |
+            (bishop_attacks(square, occupied) & (pieces[BISHOP] | pieces[QUEEN])) |
+            (Knight_attacks[square] & pieces[KNIGHT]) |
+            (Pawn_attacks[OPPOSITE_COLOUR(attacker)][square] & pieces[PAWN]) |
+            (King_attacks[square] & pieces[KING]);
+}
+
+/* Return the squares strictly between from and the square of a piece
+ * attacking it along a rank, file or diagonal, together with the
+ * attacker's own square.
+ * Only the attacker's square is returned for any other attacker.
+ */
+static Bitboard
+squares_to_attacker(int from, int attacker)
+{
+    for (int direction = 0; direction < NUM_DIRECTIONS; direction++) {
+        if ((Rays[direction][from] & SQUARE_BIT(attacker)) != 0) {
+            return Rays[direction][from] ^ Rays[direction][attacker];
+        }
     }
-    else if (move_list != NULL) {
-        MovePair *tail = move_list;
-        while(tail->next != NULL) {
-            tail = tail->next;
+    return SQUARE_BIT(attacker);
+}
+
+/* Return the pieces of colour that are pinned against
+ * the king on king_square.
+ */
+static Bitboard
+pinned_pieces(const Board *board, Colour colour, int king_square, Bitboard occupied)
+{
+    const Bitboard *opponent_pieces = board->pieces[OPPOSITE_COLOUR(colour)];
+    Bitboard pinned = 0;
+
+    for (int direction = 0; direction < NUM_DIRECTIONS; direction++) {
+        Bitboard sliders = opponent_pieces[QUEEN] |
+                (direction == NORTH || direction == EAST ||
+                 direction == SOUTH || direction == WEST ?
+                 opponent_pieces[ROOK] : opponent_pieces[BISHOP]);
+        /* The nearest piece in this direction, if it is one of colour's. */
+        Bitboard blocker = ray_attacks(direction, king_square, occupied) &
+                board->occupied[colour];
+
+        if (blocker != 0 &&
+                (ray_attacks(direction, king_square, occupied & ~blocker) & sliders) != 0) {
+            pinned |= blocker;
         }
-        tail->next = move_pool;
-        move_pool = move_list;
+    }
+    return pinned;
+}
+
+/* Add moves to to_col,to_rank from each of squares to moves. */
+static void
+moves_from_squares(Bitboard squares, Col to_col, Rank to_rank, MoveList *moves)
+{
+    while (squares != 0) {
+        int square = lowest_square(squares);
+
+        add_move(moves, SQUARE_COL(square), SQUARE_RANK(square), to_col, to_rank);
+        squares &= squares - 1;
+    }
+}
+
+/* Add moves from from_col,from_rank to each of squares to moves. */
+static void
+moves_to_squares(Col from_col, Rank from_rank, Bitboard squares, MoveList *moves)
+{
+    while (squares != 0) {
+        int square = lowest_square(squares);
+
+        add_move(moves, from_col, from_rank, SQUARE_COL(square), SQUARE_RANK(square));
+        squares &= squares - 1;
+    }
+}
+
+
+/* A table of hash values for square/piece/colour combinations.
+ * When a piece is moved, the hash value is xor-ed into a
+ * running description of the current board state.
+ */
+#define NUMBER_OF_PIECES 6
+static HashCode HashTab[BOARDSIZE][BOARDSIZE][NUMBER_OF_PIECES][2];
+
+/* Add a move to the end of moves.
+ * Only a position set up from an unusual FEN string could have more
+ * moves than a MoveList can hold, and any beyond that are ignored.
+ */
+static void
+add_move(MoveList *moves, Col from_col, Rank from_rank, Col to_col, Rank to_rank)
+{
+    if (moves->num_moves < MAX_MOVES) {
+        MovePair *move = &moves->moves[moves->num_moves];
+
+        move->from_col = from_col;
+        move->from_rank = from_rank;
+        move->to_col = to_col;
+        move->to_rank = to_rank;
+        moves->num_moves++;
     }
 }
 
@@ -227,6 +500,8 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
     Boolean capture = FALSE;
     /* For a castling move, where is the Rook? */
     Col castling_rook_col;
+    /* The castling rights before the move, for updating the Zobrist hash. */
+    uint64_t castling_key = zobrist_castling_key(board);
 
     /* Determine which rook will be moving if castling.
      * Needed for Chess960.
@@ -301,7 +576,7 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
             else if ((board->EnPassant) && (board->ep_rank == to_rank) &&
                     (board->ep_col == to_col)) {
                 /* This is an ep capture. Remove the intermediate pawn. */
-                board->board[RankConvert(to_rank) - 1][ColConvert(to_col)] = EMPTY;
+                clear_square(board, RankConvert(to_rank) - 1, ColConvert(to_col));
                 board->weak_hash_value ^= hash_lookup(to_col, to_rank - 1, PAWN, BLACK);
                 board->EnPassant = FALSE;
             }
@@ -318,7 +593,7 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
             else if ((board->EnPassant) && (board->ep_rank == to_rank) &&
                     (board->ep_col == to_col)) {
                 /* This is an ep capture. Remove the intermediate pawn. */
-                board->board[RankConvert(to_rank) + 1][ColConvert(to_col)] = EMPTY;
+                clear_square(board, RankConvert(to_rank) + 1, ColConvert(to_col));
                 board->weak_hash_value ^= hash_lookup(to_col, to_rank + 1, PAWN, WHITE);
                 board->EnPassant = FALSE;
             }
@@ -335,7 +610,7 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
     else {
         board->weak_hash_value ^= hash_lookup(from_col, from_rank, piece, colour);
     }
-    board->board[from_r][from_c] = EMPTY;
+    clear_square(board, from_r, from_c);
     if (board->board[to_r][to_c] != EMPTY) {
         /* Delete the removed piece from the hash value. */
         Piece coloured_piece = board->board[to_r][to_c];
@@ -392,7 +667,7 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
         board->halfmove_clock++;
     }
     /* Place the piece at its destination. */
-    board->board[to_r][to_c] = MAKE_COLOURED_PIECE(colour, piece);
+    place_piece(board, to_r, to_c, MAKE_COLOURED_PIECE(colour, piece));
     /* Insert the moved piece into the hash value. */
     board->weak_hash_value ^= hash_lookup(to_col, to_rank, piece, colour);
     if(!board->EnPassant) {
@@ -405,13 +680,15 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
         if (castling_rook_col != to_col) {
             /* It must be removed. */
             board->weak_hash_value ^= hash_lookup(castling_rook_col, from_rank, ROOK, colour);
-            board->board[from_r][ColConvert(castling_rook_col)] = EMPTY;
+            clear_square(board, from_r, ColConvert(castling_rook_col));
         }
         int rook_offset = (class == KINGSIDE_CASTLE ? -1 : 1);
         /* Place the rook at its destination. */
-        board->board[to_r][to_c + rook_offset] = MAKE_COLOURED_PIECE(colour, ROOK);
+        place_piece(board, to_r, to_c + rook_offset, MAKE_COLOURED_PIECE(colour, ROOK));
         board->weak_hash_value ^= hash_lookup(to_col + rook_offset, to_rank, ROOK, colour);
     }
+    /* Replace the old castling rights in the Zobrist hash. */
+    board->zobrist ^= castling_key ^ zobrist_castling_key(board);
 }
 
 /* Find pawn moves matching the to_ and from_ information.
@@ -419,35 +696,33 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
  * incomplete.  For instance: e4 supplies just the to_ information
  * whereas cb supplies some from_ and some to_.
  */
-MovePair *
+void
 find_pawn_moves(Col from_col, Rank from_rank, Col to_col, Rank to_rank,
-        Colour colour, const Board *board)
+        Colour colour, const Board *board, MoveList *moves)
 {
     int to_r = RankConvert(to_rank);
     int to_c = ColConvert(to_col);
     int from_r = RankConvert(from_rank);
     int from_c = ColConvert(from_col);
-    MovePair *move_list = NULL;
-    MovePair *move = NULL;
     /* White pawn moves are offset by +1, Black by -1. */
     int offset = COLOUR_OFFSET(colour);
     Piece piece_to_move = MAKE_COLOURED_PIECE(colour, PAWN);
 
+    moves->num_moves = 0;
     if ((to_col != 0) && (to_rank != 0)) {
         /* We know the complete destination. */
         if (board->board[to_r][to_c] == EMPTY) {
             /* Destination must be empty for this form. */
             if (board->board[to_r - offset][to_c] == piece_to_move) {
                 /* MovePair of one square. */
-                move = append_move_pair(ToCol(to_c), ToRank(to_r - offset),
-                        to_col, to_rank, NULL);
+                add_move(moves, ToCol(to_c), ToRank(to_r - offset), to_col, to_rank);
             }
             else if ((board->board[to_r - offset][to_c] == EMPTY) &&
                     (to_rank == (colour == WHITE ? '4' : '5'))) {
                 /* Special case of initial two square move. */
                 if (board->board[to_r - 2 * offset][to_c] == piece_to_move) {
-                    move = append_move_pair(ToCol(to_c), ToRank(to_r - 2 * offset),
-                            to_col, to_rank, NULL);
+                    add_move(moves, ToCol(to_c), ToRank(to_r - 2 * offset),
+                            to_col, to_rank);
                 }
             }
             else if (board->EnPassant &&
@@ -457,8 +732,8 @@ find_pawn_moves(Col from_col, Rank from_rank, Col to_col, Rank to_rank,
                 if (from_col != 0) {
                     from_r = to_r - offset;
                     if (board->board[from_r][from_c] == piece_to_move) {
-                        move = append_move_pair(ToCol(from_c), ToRank(from_r),
-                                to_col, ToRank(to_r), NULL);
+                        add_move(moves, ToCol(from_c), ToRank(from_r),
+                                to_col, ToRank(to_r));
                     }
                 }
             }
@@ -472,17 +747,15 @@ find_pawn_moves(Col from_col, Rank from_rank, Col to_col, Rank to_rank,
 		if(abs(from_col - to_col) == 1) {
 		    from_r = to_r - offset;
 		    if (board->board[from_r][from_c] == piece_to_move) {
-			move = append_move_pair(ToCol(from_c), ToRank(from_r),
-				to_col, to_rank, NULL);
+			add_move(moves, ToCol(from_c), ToRank(from_r),
+				to_col, to_rank);
 		    }
 		}
             }
         }
         else {
             /* We have no move. */
-            move = NULL;
         }
-        move_list = move;
     }
     else if ((from_col != 0) && (to_col != 0)) {
         /* Should be a diagonal capture. */
@@ -500,13 +773,13 @@ find_pawn_moves(Col from_col, Rank from_rank, Col to_col, Rank to_rank,
 
                     if ((occupant != EMPTY) &&
                             (piece_is_colour(occupant, OPPOSITE_COLOUR(colour)))) {
-                        move = append_move_pair(ToCol(from_c), ToRank(from_r),
-                                to_col, ToRank(to_r), NULL);
+                        add_move(moves, ToCol(from_c), ToRank(from_r),
+                                to_col, ToRank(to_r));
                     }
                     else if (board->EnPassant && (board->ep_rank == ToRank(to_r)) &&
                             (board->ep_col == ToCol(to_c))) {
-                        move = append_move_pair(ToCol(from_c), ToRank(from_r),
-                                to_col, ToRank(to_r), NULL);
+                        add_move(moves, ToCol(from_c), ToRank(from_r),
+                                to_col, ToRank(to_r));
                     }
                 }
             }
@@ -532,450 +805,147 @@ find_pawn_moves(Col from_col, Rank from_rank, Col to_col, Rank to_rank,
 
                         if ((occupant != EMPTY) &&
                                 (piece_is_colour(occupant, OPPOSITE_COLOUR(colour)))) {
-                            move_list = append_move_pair(ToCol(from_c), ToRank(from_r),
-                                    to_col, ToRank(to_r), move_list);
+                            add_move(moves, ToCol(from_c), ToRank(from_r),
+                                    to_col, ToRank(to_r));
                         }
                         else if (board->EnPassant && (board->ep_rank == ToRank(to_r)) &&
                                 (board->ep_col == ToCol(to_c))) {
-                            move_list = append_move_pair(ToCol(from_c), ToRank(from_r),
-                                    to_col, ToRank(to_r), move_list);
+                            add_move(moves, ToCol(from_c), ToRank(from_r),
+                                    to_col, ToRank(to_r));
                         }
                     }
                 }
             }
         }
     }
-    return move_list;
 }
 
 /* Find knight moves to the given square. */
-MovePair *
-find_knight_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    unsigned ix;
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, KNIGHT);
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Knight of
-     * the right colour.
-     */
-    for (ix = 0; ix < 2 * NUM_KNIGHT_MOVES; ix += 2) {
-        int r = Knight_moves[ix] + to_r;
-        int c = Knight_moves[ix + 1] + to_c;
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-        }
-    }
-    return move_list;
-}
-
-/* Find bishop moves to the given square. */
-MovePair *
-find_bishop_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, BISHOP);
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Bishop of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_BISHOP_MOVES; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a bishop of
-         * the right colour.
-         */
-        do {
-            r += Bishop_moves[ix];
-            c += Bishop_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-        }
-    }
-    return move_list;
-}
-
-/* Find rook moves to the given square. */
-MovePair *
-find_rook_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, ROOK);
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Rook of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_ROOK_MOVES; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a rook of
-         * the right colour.
-         */
-        do {
-            r += Rook_moves[ix];
-            c += Rook_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-        }
-    }
-    return move_list;
-}
-
-/* Find queen moves to the given square. */
-MovePair *
-find_queen_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, QUEEN);
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Queen of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_QUEEN_MOVES; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a queen of
-         * the right colour.
-         */
-        do {
-            r += Queen_moves[ix];
-            c += Queen_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-        }
-    }
-    return move_list;
-}
-
-/* Find King moves to the given square. */
-MovePair *
-find_king_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, KING);
-    /* Stop once the single King is found. */
-    Boolean found = FALSE;
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a King of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_KING_MOVES && !found; ix += 2) {
-        int r = King_moves[ix] + to_r;
-        int c = King_moves[ix + 1] + to_c;
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-            found = TRUE;
-        }
-    }
-    if(!found) {
-        /* Check for possible Chess960 castling moves.
-         * Represented as a move to the position occupied by
-         * one of colour's own rooks.
-         */
-        Boolean possible_castling_move = FALSE;
-        if(colour == WHITE) {
-            if(to_rank == '1') {
-                if(to_col == board->WKingCastle || to_col == board->WQueenCastle) {
-                    possible_castling_move = TRUE;
-                }
-            }
-        }
-        else {
-            if(to_rank == '8') {
-                if(to_col == board->BKingCastle || to_col == board->BQueenCastle) {
-                    possible_castling_move = TRUE;
-                }
-            }
-        }
-        if(possible_castling_move) {
-            int c = ColConvert(COLBASE);
-            for(char col = COLBASE; col < COLBASE + BOARDSIZE && !found; col++ ) {
-                if(board->board[to_r][c] == target_piece) {
-                    move_list = append_move_pair(col, to_rank, to_col, to_rank, move_list);
-                    found = TRUE;
-                }
-                else {
-                    c++;
-                }
-            }
-        }
-    }
-    return move_list;
-}
-
-/* Find pawn moves matching the to_ and from_ information.
- * Depending on the input form of the move, some of this will be
- * incomplete.  For instance: e4 supplies just the to_ information
- * whereas cb supplies some from_ and some to_.
- */
-static Boolean
-find_single_pawn_move(Col from_col, Rank from_rank, Col to_col, Rank to_rank,
-        Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    int from_r = RankConvert(from_rank);
-    int from_c = ColConvert(from_col);
-    /* White pawn moves are offset by +1, Black by -1. */
-    int offset = COLOUR_OFFSET(colour);
-    Piece piece_to_move = MAKE_COLOURED_PIECE(colour, PAWN);
-    Boolean found = FALSE;
-
-    if ((to_col != 0) && (to_rank != 0)) {
-        /* We know the complete destination. */
-        if (board->board[to_r][to_c] == EMPTY) {
-            /* Destination must be empty for this form. */
-            if (board->board[to_r - offset][to_c] == piece_to_move) {
-                /* MovePair of one square. */
-                found = TRUE;
-            }
-            else if ((board->board[to_r - offset][to_c] == EMPTY) &&
-                    (to_rank == (colour == WHITE ? '4' : '5'))) {
-                /* Special case of initial two square move. */
-                if (board->board[to_r - 2 * offset][to_c] == piece_to_move) {
-                    found = TRUE;
-                }
-            }
-            else if (board->EnPassant &&
-                    (board->ep_rank == to_rank) &&
-                    (board->ep_col == to_col)) {
-                /* Make sure that there is a valid pawn in position. */
-                if (from_col != 0) {
-                    from_r = to_r - offset;
-                    if (board->board[from_r][from_c] == piece_to_move) {
-                        found = TRUE;
-                    }
-                }
-            }
-        }
-        else if (piece_is_colour(board->board[to_r][to_c], OPPOSITE_COLOUR(colour))) {
-            /* Capture on the destination square. */
-            if (from_col != 0) {
-                /* We know the from column. */
-                from_r = to_r - offset;
-                if (board->board[from_r][from_c] == piece_to_move) {
-                    found = TRUE;
-                }
-            }
-        }
-        else {
-            /* We have no move. */
-        }
-    }
-    else if ((from_col != 0) && (to_col != 0)) {
-        /* Should be a diagonal capture. */
-        if (((from_col + 1) != to_col) && ((from_col - 1) != to_col)) {
-            /* Inconsistent information. */
-        }
-        else {
-            if (from_rank != 0) {
-                /* We have complete source information. Check its
-                 * veracity.
-                 */
-                to_r = from_r - offset;
-                if (board->board[from_r][from_c] == piece_to_move) {
-                    Piece occupant = board->board[to_r][to_c];
-
-                    if ((occupant != EMPTY) &&
-                            (piece_is_colour(occupant, OPPOSITE_COLOUR(colour)))) {
-                        found = TRUE;
-                    }
-                    else if (board->EnPassant && (board->ep_rank == ToRank(to_r)) &&
-                            (board->ep_col == ToCol(to_c))) {
-                        found = TRUE;
-                    }
-                }
-            }
-            else {
-                /* We must search the from_col and to_col for appropriate
-                 * combinations.  There may be more than one.
-                 */
-                int start_rank, end_rank;
-
-                /* Work out from where to start and end. */
-                if (colour == WHITE) {
-                    start_rank = RankConvert(FIRSTRANK + 1);
-                    end_rank = RankConvert(LASTRANK);
-                }
-                else {
-                    start_rank = RankConvert(LASTRANK - 1);
-                    end_rank = RankConvert(FIRSTRANK);
-                }
-                for (from_r = start_rank; from_r != end_rank && !found; from_r += offset) {
-                    to_r = from_r + offset;
-                    if (board->board[from_r][from_c] == piece_to_move) {
-                        Piece occupant = board->board[to_r][to_c];
-
-                        if ((occupant != EMPTY) &&
-                                (piece_is_colour(occupant, OPPOSITE_COLOUR(colour)))) {
-                            found = TRUE;
-                        }
-                        else if (board->EnPassant && (board->ep_rank == ToRank(to_r)) &&
-                                (board->ep_col == ToCol(to_c))) {
-                            found = TRUE;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    return found;
-}
-
-/* Find knight moves to the given square. */
-static Boolean
-find_single_knight_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
+void
+find_knight_moves(Col to_col, Rank to_rank, Colour colour, const Board *board,
+        MoveList *moves)
 {
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    unsigned ix;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, KNIGHT);
-    Boolean found = FALSE;
+    moves->num_moves = 0;
+    if (ON_BOARD(to_col, to_rank)) {
+        int to_square = COL_RANK_SQUARE(to_col, to_rank);
 
-    /* Pick up pairs of offsets from to_r,to_c to look for a Knight of
-     * the right colour.
-     */
-    for (ix = 0; ix < 2 * NUM_KNIGHT_MOVES && !found; ix += 2) {
-        int r = Knight_moves[ix] + to_r;
-        int c = Knight_moves[ix + 1] + to_c;
-
-        if (board->board[r][c] == target_piece) {
-            found = TRUE;
-        }
+        moves_from_squares(Knight_attacks[to_square] & board->pieces[colour][KNIGHT],
+                to_col, to_rank, moves);
     }
-    return found;
 }
 
-/* See if there is at least one bishop move to the given square. */
-static Boolean
-find_single_bishop_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, BISHOP);
-    Boolean found = FALSE;
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Bishop of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_BISHOP_MOVES && !found; ix += 2) {
-        int r = to_r, c = to_c;
+/* Find bishop moves to the given square. */
+void
+find_bishop_moves(Col to_col, Rank to_rank, Colour colour, const Board *board,
+        MoveList *moves)
+{
+    moves->num_moves = 0;
+    if (ON_BOARD(to_col, to_rank)) {
+        int to_square = COL_RANK_SQUARE(to_col, to_rank);
+        Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
 
-        /* Work backwards from the destination to find a bishop of
+        /* Work backwards from the destination to find bishops of
          * the right colour.
          */
-        do {
-            r += Bishop_moves[ix];
-            c += Bishop_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            found = TRUE;
-        }
+        moves_from_squares(bishop_attacks(to_square, occupied) &
+                board->pieces[colour][BISHOP], to_col, to_rank, moves);
     }
-    return found;
 }
 
 /* Find rook moves to the given square. */
-static Boolean
-find_single_rook_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
+void
+find_rook_moves(Col to_col, Rank to_rank, Colour colour, const Board *board,
+        MoveList *moves)
 {
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, ROOK);
-    Boolean found = FALSE;
+    moves->num_moves = 0;
+    if (ON_BOARD(to_col, to_rank)) {
+        int to_square = COL_RANK_SQUARE(to_col, to_rank);
+        Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
 
-    /* Pick up pairs of offsets from to_r,to_c to look for a Rook of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_ROOK_MOVES && !found; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a rook of
+        /* Work backwards from the destination to find rooks of
          * the right colour.
          */
-        do {
-            r += Rook_moves[ix];
-            c += Rook_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            found = TRUE;
-        }
+        moves_from_squares(rook_attacks(to_square, occupied) &
+                board->pieces[colour][ROOK], to_col, to_rank, moves);
     }
-    return found;
 }
 
 /* Find queen moves to the given square. */
-static Boolean
-find_single_queen_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
+void
+find_queen_moves(Col to_col, Rank to_rank, Colour colour, const Board *board,
+        MoveList *moves)
 {
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, QUEEN);
-    Boolean found = FALSE;
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Queen of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_QUEEN_MOVES && !found; ix += 2) {
-        int r = to_r, c = to_c;
+    moves->num_moves = 0;
+    if (ON_BOARD(to_col, to_rank)) {
+        int to_square = COL_RANK_SQUARE(to_col, to_rank);
+        Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
 
-        /* Work backwards from the destination to find a queen of
+        /* Work backwards from the destination to find queens of
          * the right colour.
          */
-        do {
-            r += Queen_moves[ix];
-            c += Queen_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            found = TRUE;
-        }
+        moves_from_squares((rook_attacks(to_square, occupied) |
+                bishop_attacks(to_square, occupied)) &
+                board->pieces[colour][QUEEN], to_col, to_rank, moves);
     }
-    return found;
 }
 
 /* Find King moves to the given square. */
-static Boolean
-find_single_king_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
+void
+find_king_moves(Col to_col, Rank to_rank, Colour colour, const Board *board,
+        MoveList *moves)
 {
     int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
     Piece target_piece = MAKE_COLOURED_PIECE(colour, KING);
-    /* Store once the single King is found. */
+    /* Stop once the single King is found. */
     Boolean found = FALSE;
 
-    /* Pick up pairs of offsets from to_r,to_c to look for a King of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_KING_MOVES && !found; ix += 2) {
-        int r = King_moves[ix] + to_r;
-        int c = King_moves[ix + 1] + to_c;
+    moves->num_moves = 0;
+    if (!ON_BOARD(to_col, to_rank)) {
+        return;
+    }
+    else {
+        Bitboard kings = King_attacks[COL_RANK_SQUARE(to_col, to_rank)] &
+                board->pieces[colour][KING];
 
-        if (board->board[r][c] == target_piece) {
+        if (kings != 0) {
+            int square = lowest_square(kings);
+            add_move(moves, SQUARE_COL(square), SQUARE_RANK(square), to_col, to_rank);
             found = TRUE;
         }
     }
-    return found;
+    if(!found) {
+        /* Check for possible Chess960 castling moves.
+         * Represented as a move to the position occupied by
+         * one of colour's own rooks.
+         */
+        Boolean possible_castling_move = FALSE;
+        if(colour == WHITE) {
+            if(to_rank == '1') {
+                if(to_col == board->WKingCastle || to_col == board->WQueenCastle) {
+                    possible_castling_move = TRUE;
+                }
+            }
+        }
+        else {
+            if(to_rank == '8') {
+                if(to_col == board->BKingCastle || to_col == board->BQueenCastle) {
+                    possible_castling_move = TRUE;
+                }
+            }
+        }
+        if(possible_castling_move) {
+            int c = ColConvert(COLBASE);
+            for(char col = COLBASE; col < COLBASE + BOARDSIZE && !found; col++ ) {
+                if(board->board[to_r][c] == target_piece) {
+                    add_move(moves, col, to_rank, to_col, to_rank);
+                    found = TRUE;
+                }
+                else {
+                    c++;
+                }
+            }
+        }
+    }
 }
 
 /* Return true if the king of the given colour is
@@ -999,43 +969,11 @@ king_is_in_check(const Board *board, Colour king_colour)
         king_col = board->BKingCol;
         king_rank = board->BKingRank;
     }
-    /* Try and find one move that leaves this king in check.
-     * There is probably an optimal order for these tests but 
-     * I don't know for sure what it is.
-     * Try the pieces with greatest mobility first.
-     * 
-     * @@@ NB: Since a single move would be enough, this could
-     * be made more efficient.
-     */
-    if (find_single_queen_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a queen. */
-    }
-    else if (find_single_rook_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a rook. */
-    }
-    else if (find_single_bishop_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a bishop. */
-    }
-    else if (find_single_knight_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a knight. */
-    }
-    else if ((king_col != LASTCOL) &&
-            (find_single_pawn_move(king_col + 1, 0, king_col, king_rank,
-            opponent_colour, board))) {
-        /* King is in check from a pawn to its right. */
-    }
-    else if ((king_col != FIRSTCOL) &&
-            (find_single_pawn_move(king_col - 1, 0, king_col, king_rank,
-            opponent_colour, board))) {
-        /* King is in check from a pawn. to its left */
-    }
-    else if (find_single_king_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a king. */
+    if (ON_BOARD(king_col, king_rank) &&
+            square_is_attacked(board, COL_RANK_SQUARE(king_col, king_rank),
+                    opponent_colour,
+                    board->occupied[WHITE] | board->occupied[BLACK], 0)) {
+        /* King is in check. */
     }
     else {
         /* King is safe. */
@@ -1044,52 +982,86 @@ king_is_in_check(const Board *board, Colour king_colour)
     return in_check;
 }
 
-/* possibles contains a list of possible moves of piece.
- * NB: Elements of possibles might be freed by this function
- * so it is invalidated by the call.
- * 
- * This function should exclude all of those moves of this piece
- * which leave its own king in check.  
- * The list of remaining legal moves is returned as result.
- * This function operates by looking for at least one reply by the
- * opponent that could capture the king of the given colour.
- * Only one such move needs to be found to invalidate one of the
- * possible moves.
+/* Return TRUE if playing move with piece would leave the king of
+ * the given colour in check.
+ * The position after the move is described only by its occupied
+ * squares and the squares of captured pieces, rather than by
+ * making the move on a copy of the board.
  */
-MovePair *
-exclude_checks(Piece piece, Colour colour, MovePair *possibles, const Board *board)
-{   /* As this function is not called recursively, it should be
-     * safe to retain a single copy of the board on the stack without risking
-     * overflow. This has been a problem in the past with the PC version.
-     */
-    Board copy_board;
-    MovePair *valid_move_list = NULL;
-    MovePair *move;
-
-    /* For each possible move, make the move and see if it leaves the king
-     * in check.
-     */
-    for (move = possibles; move != NULL;) {
-        /* Take a copy of the board before playing this next move. */
-        copy_board = *board;
+static Boolean
+move_leaves_king_in_check(Piece piece, Colour colour, const MovePair *move,
+        const Board *board)
+{
+    if (!ON_BOARD(move->from_col, move->from_rank) ||
+            !ON_BOARD(move->to_col, move->to_rank)) {
+        /* Play it safe with an unusual move. */
+        Board copy_board = *board;
         make_move(UNKNOWN_MOVE, move->from_col, move->from_rank,
                 move->to_col, move->to_rank, piece, colour, &copy_board);
-        if (king_is_in_check(&copy_board, colour) != NOCHECK) {
-            MovePair *illegal_move = move;
-            move = move->next;
-            /* Free the illegal move. */
-            free_move_pair(illegal_move);
+        return king_is_in_check(&copy_board, colour) != NOCHECK;
+    }
+    else {
+        int to_square = COL_RANK_SQUARE(move->to_col, move->to_rank);
+        Bitboard from_bit = SQUARE_BIT(COL_RANK_SQUARE(move->from_col, move->from_rank));
+        Bitboard to_bit = SQUARE_BIT(to_square);
+        /* Whatever is on the destination is removed by the move. */
+        Bitboard removed = to_bit;
+        Bitboard occupied;
+        int king_square;
+
+        if (piece == PAWN && board->EnPassant &&
+                board->ep_col == move->to_col && board->ep_rank == move->to_rank) {
+            /* An en passant capture removes the pawn behind the destination. */
+            Rank captured_rank = move->to_rank - COLOUR_OFFSET(colour);
+            removed |= SQUARE_BIT(COL_RANK_SQUARE(move->to_col, captured_rank));
+        }
+        occupied = ((board->occupied[WHITE] | board->occupied[BLACK]) &
+                ~from_bit & ~removed) | to_bit;
+        if (piece == KING) {
+            king_square = to_square;
         }
         else {
-            /* King is safe and the move may be kept. */
-            MovePair *legal_move = move;
+            Col king_col = colour == WHITE ? board->WKingCol : board->BKingCol;
+            Rank king_rank = colour == WHITE ? board->WKingRank : board->BKingRank;
+
+            if (!ON_BOARD(king_col, king_rank)) {
+                return FALSE;
+            }
+            king_square = COL_RANK_SQUARE(king_col, king_rank);
+        }
+        return square_is_attacked(board, king_square, OPPOSITE_COLOUR(colour),
+                occupied, removed);
+    }
+}
+
+/* Remove from moves those moves of piece, from index first onwards,
+ * that leave the king of the given colour in check.
+ * The order of the remaining moves is retained.
+ */
+static void
+keep_legal_moves(Piece piece, Colour colour, MoveList *moves, unsigned first,
+        const Board *board)
+{
+    unsigned num_legal = first;
 
-            move = move->next;
-            legal_move->next = valid_move_list;
-            valid_move_list = legal_move;
+    for (unsigned ix = first; ix < moves->num_moves; ix++) {
+        if (!move_leaves_king_in_check(piece, colour, &moves->moves[ix], board)) {
+            /* King is safe and the move may be kept. */
+            moves->moves[num_legal] = moves->moves[ix];
+            num_legal++;
         }
     }
-    return valid_move_list;
+    moves->num_moves = num_legal;
+}
+
+/* moves contains a list of possible moves of piece.
+ * Exclude all of those moves of this piece which leave its
+ * own king in check, leaving just the legal ones.
+ */
+void
+exclude_checks(Piece piece, Colour colour, MoveList *moves, const Board *board)
+{
+    keep_legal_moves(piece, colour, moves, 0, board);
 }
 
 /* We must exclude the possibility of the king passing
@@ -1100,7 +1072,7 @@ exclude_castling_across_checks(Col king_start_col, Col king_end_col,
         Colour colour, const Board *board)
 {
     Boolean Ok = TRUE;
-    MovePair *move = malloc_move();
+    MovePair move;
     Rank rank = (colour == WHITE) ? FIRSTRANK : LASTRANK;
     int direction = king_end_col >= king_start_col ? 1 : -1;
     Col boundary = king_end_col + direction;
@@ -1108,36 +1080,31 @@ exclude_castling_across_checks(Col king_start_col, Col king_end_col,
 
     /* Start where we are, because you can't castle out of check. */
     for (to_col = king_start_col; (to_col != boundary) && Ok; to_col += direction) {
-        move->from_col = king_start_col;
-        move->from_rank = rank;
-        move->to_col = to_col;
-        move->to_rank = rank;
-        move = exclude_checks(KING, colour, move, board);
-        if (move == NULL) {
+        move.from_col = king_start_col;
+        move.from_rank = rank;
+        move.to_col = to_col;
+        move.to_rank = rank;
+        if (move_leaves_king_in_check(KING, colour, &move, board)) {
             Ok = FALSE;
         }
     }
-    if (move != NULL) {
-        free_move_pair(move);
-    }
     return Ok;
 }
 
-/* Possibles is a list of possible moves of piece.
+/* moves is a list of possible moves of piece.
  * Exclude all of those that either leave the king in check
  * or those excluded by non-null information in from_col or from_rank.
  */
-static MovePair *
+static void
 exclude_moves(Piece piece, Colour colour, Col from_col, Rank from_rank,
-        MovePair *possibles, const Board *board)
+        MoveList *moves, const Board *board)
 {
-    MovePair *move_list = NULL;
-
     /* See if we have disambiguating from_ information. */
     if ((from_col != 0) || (from_rank != 0)) {
-        MovePair *move, *temp;
+        unsigned num_kept = 0;
 
-        for (move = possibles; move != NULL;) {
+        for (unsigned ix = 0; ix < moves->num_moves; ix++) {
+            const MovePair *move = &moves->moves[ix];
             Boolean excluded = FALSE;
 
             if (from_col != 0) {
@@ -1151,27 +1118,18 @@ exclude_moves(Piece piece, Colour colour, Col from_col, Rank from_rank,
                     excluded = TRUE;
                 }
             }
-            temp = move;
-            move = move->next;
             if (!excluded) {
-                /* Add it to the list of possibles. */
-                temp->next = move_list;
-                move_list = temp;
-            }
-            else {
-                /* Discard it. */
-                free_move_pair(temp);
+                /* Keep it in the list of possibles. */
+                moves->moves[num_kept] = *move;
+                num_kept++;
             }
         }
+        moves->num_moves = num_kept;
     }
     else {
         /* Everything is still possible. */
-        move_list = possibles;
     }
-    if (move_list != NULL) {
-        move_list = exclude_checks(piece, colour, move_list, board);
-    }
-    return move_list;
+    exclude_checks(piece, colour, moves, board);
 }
 
 /* Make a pawn move.
@@ -1186,8 +1144,8 @@ pawn_move(Move *move_details, Colour colour, Board *board)
     Rank from_rank = move_details->from_rank;
     Col to_col = move_details->to_col;
     Rank to_rank = move_details->to_rank;
-    /* Find the basic set of moves that match the move_details criteria. */
-    MovePair *move_list;
+    /* The basic set of moves that match the move_details criteria. */
+    MoveList move_list;
     Boolean Ok = TRUE;
 
     /* Make sure that the col values are consistent with a pawn move. */
@@ -1199,31 +1157,27 @@ pawn_move(Move *move_details, Colour colour, Board *board)
         /* Inconsistent. */
         Ok = FALSE;
     }
-    else if ((move_list = find_pawn_moves(from_col, from_rank, to_col, to_rank,
-            colour, board)) == NULL) {
-        Ok = FALSE;
-    }
     else {
+        find_pawn_moves(from_col, from_rank, to_col, to_rank, colour, board, &move_list);
         /* Exclude any moves that leave the king in check, or are disambiguate
          * by from_information.
          */
-        move_list = exclude_moves(PAWN, colour, from_col, from_rank, move_list, board);
-        if (move_list != NULL) {
-            if (move_list->next == NULL) {
+        exclude_moves(PAWN, colour, from_col, from_rank, &move_list, board);
+        if (move_list.num_moves != 0) {
+            if (move_list.num_moves == 1) {
                 /* Unambiguous move. Some pawn moves will have supplied
                  * incomplete destinations (e.g. cd as opposed to cxd4)
                  * so pick up both from_ and to_ information.
                  */
-                move_details->from_col = move_list->from_col;
-                move_details->from_rank = move_list->from_rank;
-                move_details->to_col = move_list->to_col;
-                move_details->to_rank = move_list->to_rank;
+                move_details->from_col = move_list.moves[0].from_col;
+                move_details->from_rank = move_list.moves[0].from_rank;
+                move_details->to_col = move_list.moves[0].to_col;
+                move_details->to_rank = move_list.moves[0].to_rank;
             }
             else {
                 /* Ambiguous. */
                 Ok = FALSE;
             }
-            free_move_pair_list(move_list);
         }
         else {
             /* Excluded. */
@@ -1241,7 +1195,7 @@ promote(Move *move_details, Colour colour, Board *board)
     Rank from_rank = move_details->from_rank;
     Col to_col = move_details->to_col;
     Rank to_rank = move_details->to_rank;
-    MovePair *move_list;
+    MoveList move_list;
     Boolean Ok = FALSE;
 
     if (to_rank == '\0') {
@@ -1259,23 +1213,22 @@ promote(Move *move_details, Colour colour, Board *board)
         fprintf(GlobalState.logfile, "Illegal pawn promotion to %c%c\n", to_col, to_rank);
     }
     else {
-        move_list = find_pawn_moves(from_col, from_rank, to_col, to_rank, colour, board);
-        if (move_list != NULL) {
-            if (move_list->next == NULL) {
+        find_pawn_moves(from_col, from_rank, to_col, to_rank, colour, board, &move_list);
+        if (move_list.num_moves != 0) {
+            if (move_list.num_moves == 1) {
                 /* Unambiguous move. Some pawn moves will have supplied
                  * incomplete destinations (e.g. cd as opposed to cxd8)
                  * so pick up both from_ and to_ information.
                  */
-                move_details->from_col = move_list->from_col;
-                move_details->from_rank = move_list->from_rank;
-                move_details->to_col = move_list->to_col;
-                move_details->to_rank = move_list->to_rank;
+                move_details->from_col = move_list.moves[0].from_col;
+                move_details->from_rank = move_list.moves[0].from_rank;
+                move_details->to_col = move_list.moves[0].to_col;
+                move_details->to_rank = move_list.moves[0].to_rank;
                 Ok = TRUE;
             }
             else {
                 fprintf(GlobalState.logfile, "Ambiguous pawn move to %c%c\n", to_col, to_rank);
             }
-            free_move_pair_list(move_list);
         }
         else {
             fprintf(GlobalState.logfile, "Illegal pawn promotion to %c%c\n", to_col, to_rank);
@@ -1296,34 +1249,33 @@ knight_move(Move *move_details, Colour colour, Board *board)
     Rank to_rank = move_details->to_rank;
     int to_r = RankConvert(to_rank);
     int to_c = ColConvert(to_col);
-    MovePair *move_list = find_knight_moves(to_col, to_rank, colour, board);
+    MoveList move_list;
     /* Assume everything will be ok. */
     Boolean Ok = TRUE;
 
-    move_list = exclude_moves(KNIGHT, colour, from_col, from_rank, move_list, board);
+    find_knight_moves(to_col, to_rank, colour, board, &move_list);
+    exclude_moves(KNIGHT, colour, from_col, from_rank, &move_list, board);
 
-    if (move_list == NULL) {
+    if (move_list.num_moves == 0) {
         fprintf(GlobalState.logfile, "No knight move possible to %c%c.\n", to_col, to_rank);
         Ok = FALSE;
     }
-    else if (move_list->next == NULL) {
+    else if (move_list.num_moves == 1) {
         /* Only one possible.  Check for legality. */
         Piece occupant = board->board[to_r][to_c];
 
         if ((occupant == EMPTY) || piece_is_colour(occupant, OPPOSITE_COLOUR(colour))) {
-            move_details->from_col = move_list->from_col;
-            move_details->from_rank = move_list->from_rank;
+            move_details->from_col = move_list.moves[0].from_col;
+            move_details->from_rank = move_list.moves[0].from_rank;
         }
         else {
             fprintf(GlobalState.logfile, "Knight destination square %c%c is illegal.\n",
                     to_col, to_rank);
             Ok = FALSE;
         }
-        free_move_pair(move_list);
     }
     else {
         fprintf(GlobalState.logfile, "Ambiguous knight move to %c%c.\n", to_col, to_rank);
-        free_move_pair_list(move_list);
         Ok = FALSE;
     }
     return Ok;
@@ -1341,34 +1293,33 @@ bishop_move(Move *move_details, Colour colour, Board *board)
     Rank to_rank = move_details->to_rank;
     int to_r = RankConvert(to_rank);
     int to_c = ColConvert(to_col);
-    MovePair *move_list = find_bishop_moves(to_col, to_rank, colour, board);
+    MoveList move_list;
     /* Assume that it is ok. */
     Boolean Ok = TRUE;
 
-    move_list = exclude_moves(BISHOP, colour, from_col, from_rank, move_list, board);
+    find_bishop_moves(to_col, to_rank, colour, board, &move_list);
+    exclude_moves(BISHOP, colour, from_col, from_rank, &move_list, board);
 
-    if (move_list == NULL) {
+    if (move_list.num_moves == 0) {
         fprintf(GlobalState.logfile, "No bishop move possible to %c%c.\n", to_col, to_rank);
         Ok = FALSE;
     }
-    else if (move_list->next == NULL) {
+    else if (move_list.num_moves == 1) {
         /* Only one possible.  Check for legality. */
         Piece occupant = board->board[to_r][to_c];
 
         if ((occupant == EMPTY) || piece_is_colour(occupant, OPPOSITE_COLOUR(colour))) {
-            move_details->from_col = move_list->from_col;
-            move_details->from_rank = move_list->from_rank;
+            move_details->from_col = move_list.moves[0].from_col;
+            move_details->from_rank = move_list.moves[0].from_rank;
         }
         else {
             fprintf(GlobalState.logfile, "Bishop's destination square %c%c is illegal.\n",
                     to_col, to_rank);
             Ok = FALSE;
         }
-        free_move_pair(move_list);
     }
     else {
         fprintf(GlobalState.logfile, "Ambiguous bishop move to %c%c.\n", to_col, to_rank);
-        free_move_pair_list(move_list);
         Ok = FALSE;
     }
     return Ok;
@@ -1386,28 +1337,29 @@ rook_move(Move *move_details, Colour colour, Board *board)
     Rank to_rank = move_details->to_rank;
     int to_r = RankConvert(to_rank);
     int to_c = ColConvert(to_col);
-    MovePair *move_list = find_rook_moves(to_col, to_rank, colour, board);
+    MoveList move_list;
     /* Assume that it is ok. */
     Boolean Ok = TRUE;
 
-    if (move_list == NULL) {
+    find_rook_moves(to_col, to_rank, colour, board, &move_list);
+    if (move_list.num_moves == 0) {
         fprintf(GlobalState.logfile, "No rook move possible to %c%c.\n", to_col, to_rank);
         Ok = FALSE;
     }
     else {
-        move_list = exclude_moves(ROOK, colour, from_col, from_rank, move_list, board);
+        exclude_moves(ROOK, colour, from_col, from_rank, &move_list, board);
 
-        if (move_list == NULL) {
+        if (move_list.num_moves == 0) {
             fprintf(GlobalState.logfile, "Indicated rook move is excluded.\n");
             Ok = FALSE;
         }
-        else if (move_list->next == NULL) {
+        else if (move_list.num_moves == 1) {
             /* Only one possible.  Check for legality. */
             Piece occupant = board->board[to_r][to_c];
 
             if ((occupant == EMPTY) || piece_is_colour(occupant, OPPOSITE_COLOUR(colour))) {
-                move_details->from_col = move_list->from_col;
-                move_details->from_rank = move_list->from_rank;
+                move_details->from_col = move_list.moves[0].from_col;
+                move_details->from_rank = move_list.moves[0].from_rank;
             }
             else {
                 fprintf(GlobalState.logfile,
@@ -1415,11 +1367,9 @@ rook_move(Move *move_details, Colour colour, Board *board)
                         to_col, to_rank);
                 Ok = FALSE;
             }
-            free_move_pair(move_list);
         }
         else {
             fprintf(GlobalState.logfile, "Ambiguous rook move to %c%c.\n", to_col, to_rank);
-            free_move_pair_list(move_list);
             Ok = FALSE;
         }
     }
@@ -1438,34 +1388,33 @@ queen_move(Move *move_details, Colour colour, Board *board)
     Rank to_rank = move_details->to_rank;
     int to_r = RankConvert(to_rank);
     int to_c = ColConvert(to_col);
-    MovePair *move_list = find_queen_moves(to_col, to_rank, colour, board);
+    MoveList move_list;
     /* Assume that it is ok. */
     Boolean Ok = TRUE;
 
-    move_list = exclude_moves(QUEEN, colour, from_col, from_rank, move_list, board);
+    find_queen_moves(to_col, to_rank, colour, board, &move_list);
+    exclude_moves(QUEEN, colour, from_col, from_rank, &move_list, board);
 
-    if (move_list == NULL) {
+    if (move_list.num_moves == 0) {
         fprintf(GlobalState.logfile, "No queen move possible to %c%c.\n", to_col, to_rank);
         Ok = FALSE;
     }
-    else if (move_list->next == NULL) {
+    else if (move_list.num_moves == 1) {
         /* Only one possible.  Check for legality. */
         Piece occupant = board->board[to_r][to_c];
 
         if ((occupant == EMPTY) || piece_is_colour(occupant, OPPOSITE_COLOUR(colour))) {
-            move_details->from_col = move_list->from_col;
-            move_details->from_rank = move_list->from_rank;
+            move_details->from_col = move_list.moves[0].from_col;
+            move_details->from_rank = move_list.moves[0].from_rank;
         }
         else {
             fprintf(GlobalState.logfile, "Queen's destination square %c%c is illegal.\n",
                     to_col, to_rank);
             Ok = FALSE;
         }
-        free_move_pair(move_list);
     }
     else {
         fprintf(GlobalState.logfile, "Ambiguous queen move to %c%c.\n", to_col, to_rank);
-        free_move_pair_list(move_list);
         Ok = FALSE;
     }
     return Ok;
@@ -1709,12 +1658,13 @@ king_move(Move *move_details, Colour colour, Board *board)
     Rank from_rank = move_details->from_rank;
     Col to_col = move_details->to_col;
     Rank to_rank = move_details->to_rank;
-    /* Find all possible king moves to the destination squares. */
-    MovePair *move_list = find_king_moves(to_col, to_rank, colour, board);
+    /* All possible king moves to the destination squares. */
+    MoveList move_list;
     /* Assume that it is ok. */
     Boolean Ok = TRUE;
 
-    if (move_list == NULL) {
+    find_king_moves(to_col, to_rank, colour, board, &move_list);
+    if (move_list.num_moves == 0) {
         fprintf(GlobalState.logfile, "No king move possible to %c%c.\n",
                 to_col, to_rank);
         Ok = FALSE;
@@ -1732,10 +1682,10 @@ king_move(Move *move_details, Colour colour, Board *board)
              */
             Boolean kingside;
             if(colour == WHITE) {
-                kingside = move_list->to_col == board->WKingCastle;
+                kingside = move_list.moves[0].to_col == board->WKingCastle;
             }
             else {
-                kingside = move_list->to_col == board->BKingCastle;
+                kingside = move_list.moves[0].to_col == board->BKingCastle;
             }
             if(kingside) {
                 move_details->class = KINGSIDE_CASTLE;
@@ -1748,20 +1698,20 @@ king_move(Move *move_details, Colour colour, Board *board)
         }
         else {
             /* Exclude disambiguated and illegal moves. */
-            move_list = exclude_moves(KING, colour, from_col, from_rank, move_list, board);
+            exclude_moves(KING, colour, from_col, from_rank, &move_list, board);
 
-            if(move_list == NULL) {
+            if(move_list.num_moves == 0) {
                 fprintf(GlobalState.logfile, "No king move possible to %c%c.\n",
                         to_col, to_rank);
                 Ok = FALSE;
             }
             else if (occupant == EMPTY) {
-                move_details->from_col = move_list->from_col;
-                move_details->from_rank = move_list->from_rank;
+                move_details->from_col = move_list.moves[0].from_col;
+                move_details->from_rank = move_list.moves[0].from_rank;
             }
             else if(piece_is_colour(occupant, OPPOSITE_COLOUR(colour))) {
-                move_details->from_col = move_list->from_col;
-                move_details->from_rank = move_list->from_rank;
+                move_details->from_col = move_list.moves[0].from_col;
+                move_details->from_rank = move_list.moves[0].from_rank;
             }
             else {
                 fprintf(GlobalState.logfile, "King's destination square %c%c is illegal.\n",
@@ -1769,9 +1719,6 @@ king_move(Move *move_details, Colour colour, Board *board)
                 Ok = FALSE;
             }
         }
-        if(move_list != NULL) {
-            free_move_pair(move_list);
-        }
     }
     return Ok;
 }
@@ -1816,9 +1763,12 @@ determine_move_details(Colour colour, Move *move_details, Board *board)
         const unsigned char *move = move_details->move;
         MoveClass class = move_details->class;
         Boolean move_handled = FALSE;
+        /* Whether the move text gave any disambiguation. */
+        Boolean from_given;
 
         /* A new piece on promotion. */
         move_details->promoted_piece = EMPTY;
+        move_details->unambiguous = FALSE;
 
         /* Because the decoding process did not have the current board
          * position available, trap apparent pawn moves that may be something
@@ -1837,6 +1787,8 @@ determine_move_details(Colour colour, Move *move_details, Board *board)
             class = move_details->class;
         }
 
+        from_given = (move_details->from_col != 0) || (move_details->from_rank != 0);
+
         /* Deal with apparent pawn moves first. */
         if ((class == PAWN_MOVE) || (class == ENPASSANT_PAWN_MOVE) ||
                 (class == PAWN_MOVE_WITH_PROMOTION)) {
@@ -1914,6 +1866,10 @@ determine_move_details(Colour colour, Move *move_details, Board *board)
             else {
                 /* Shouldn't get here. */
             }
+            /* Only one pawn of a column can reach a square without
+             * capturing, and a capture always gives its column.
+             */
+            move_details->unambiguous = Ok;
             if (!move_handled) {
                 /* We failed to find the move, for some reason. */
                 /* See if it might be a Bishop move with a lower case 'b'. */
@@ -1977,6 +1933,14 @@ determine_move_details(Colour colour, Move *move_details, Board *board)
                             fprintf(GlobalState.logfile, "Unknown piece move %s\n", move);
                             break;
                     }
+                    /* Without any from_ information, success means that
+                     * this was the only legal move of the piece.
+                     * A king might have been turned into a castling move.
+                     */
+                    if (Ok && !from_given && (move_details->class == PIECE_MOVE) &&
+                            (move_details->piece_to_move != KING)) {
+                        move_details->unambiguous = TRUE;
+                    }
                     break;
                 case KINGSIDE_CASTLE:
                     move_details->piece_to_move = KING;
@@ -2021,110 +1985,58 @@ determine_move_details(Colour colour, Move *move_details, Board *board)
     return Ok;
 }
 
-/* Generate a list of moves of a king or knight from from_col,from_rank.
+/* Add to moves the legal moves of a king or knight from from_col,from_rank.
  * This does not include castling for the king, because it is used
  * by the code that looks for ways to escape from check for which
  * castling is illegal, of course.
  */
-static MovePair *
+static void
 generate_single_moves(Colour colour, Piece piece,
-        const Board *board, Col from_col, Rank from_rank)
+        const Board *board, Col from_col, Rank from_rank, MoveList *moves)
 {
-    int from_r = RankConvert(from_rank);
-    int from_c = ColConvert(from_col);
-    unsigned ix;
-    MovePair *moves = NULL;
-    Colour target_colour = OPPOSITE_COLOUR(colour);
-    unsigned num_directions = piece == KING ? NUM_KING_MOVES : NUM_KNIGHT_MOVES;
-    const int *Piece_moves = piece == KING ? King_moves : Knight_moves;
+    unsigned first = moves->num_moves;
+    int from_square = COL_RANK_SQUARE(from_col, from_rank);
+    const Bitboard *attacks = piece == KING ? King_attacks : Knight_attacks;
 
-    /* Pick up pairs of offsets from from_r,from_c to look for an
-     * EMPTY square, or one containing a piece of OPPOSITE_COLOUR(colour).
+    /* Any square that is EMPTY, or contains a piece of
+     * OPPOSITE_COLOUR(colour).
      */
-    for (ix = 0; ix < 2 * num_directions; ix += 2) {
-        int r = Piece_moves[ix] + from_r;
-        int c = Piece_moves[ix + 1] + from_c;
-        Piece occupant = board->board[r][c];
-        Boolean Ok = FALSE;
-
-        if (occupant == OFF) {
-            /* Not a valid move. */
-        }
-        else if (board->board[r][c] == EMPTY) {
-            Ok = TRUE;
-        }
-        else if (EXTRACT_COLOUR(occupant) == target_colour) {
-            Ok = TRUE;
-        }
-        else {
-        }
-        if (Ok) {
-            /* Fill in the details, and add it to the list. */
-            moves = append_move_pair(from_col, from_rank, ToCol(c), ToRank(r), moves);
-        }
-    }
-    if (moves != NULL) {
-        moves = exclude_checks(piece, colour, moves, board);
-    }
-    return moves;
+    moves_to_squares(from_col, from_rank,
+            attacks[from_square] & ~board->occupied[colour], moves);
+    keep_legal_moves(piece, colour, moves, first, board);
 }
 
-/* Generate a list of moves of a queen, rook or bishop from
+/* Add to moves the legal moves of a queen, rook or bishop from
  * from_col,from_rank.
  */
-static MovePair *
+static void
 generate_multiple_moves(Colour colour, Piece piece,
-        const Board *board, Col from_col, Rank from_rank)
+        const Board *board, Col from_col, Rank from_rank, MoveList *moves)
 {
-    int from_r = RankConvert(from_rank);
-    int from_c = ColConvert(from_col);
-    unsigned ix;
-    MovePair *moves = NULL;
-    Colour target_colour = OPPOSITE_COLOUR(colour);
-    unsigned num_directions = piece == QUEEN ? NUM_QUEEN_MOVES :
-            piece == ROOK ? NUM_ROOK_MOVES : NUM_BISHOP_MOVES;
-    const int *Piece_moves = piece == QUEEN ? Queen_moves :
-            piece == ROOK ? Rook_moves : Bishop_moves;
+    unsigned first = moves->num_moves;
+    int from_square = COL_RANK_SQUARE(from_col, from_rank);
+    Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
+    Bitboard attacks = 0;
 
-    /* Pick up pairs of offsets from from_r,from_c to look for an
-     * EMPTY square, or one containing a piece of OPPOSITE_COLOUR(colour).
-     */
-    for (ix = 0; ix < 2 * num_directions; ix += 2) {
-        int r = Piece_moves[ix] + from_r;
-        int c = Piece_moves[ix + 1] + from_c;
-        Piece occupant = board->board[r][c];
-
-        /* Include EMPTY squares as possible moves. */
-        while (occupant == EMPTY) {
-            /* Fill in the details, and add it to the list. */
-            moves = append_move_pair(from_col, from_rank, ToCol(c), ToRank(r), moves);
-            /* Move on to the next square in this direction. */
-            r += Piece_moves[ix];
-            c += Piece_moves[ix + 1];
-            occupant = board->board[r][c];
-        }
-        /* We have come up against an obstruction. */
-        if (occupant == OFF) {
-            /* Not a valid move. */
-        }
-        else if (EXTRACT_COLOUR(occupant) == target_colour) {
-            moves = append_move_pair(from_col, from_rank, ToCol(c), ToRank(r), moves);
-        }
-        else {
-            /* Should be a piece of our own colour. */
-        }
+    if (piece == QUEEN || piece == ROOK) {
+        attacks |= rook_attacks(from_square, occupied);
     }
-    if (moves != NULL) {
-        moves = exclude_checks(piece, colour, moves, board);
+    if (piece == QUEEN || piece == BISHOP) {
+        attacks |= bishop_attacks(from_square, occupied);
     }
-    return moves;
+    /* Include EMPTY squares and those containing a piece of
+     * OPPOSITE_COLOUR(colour).
+     */
+    moves_to_squares(from_col, from_rank, attacks & ~board->occupied[colour], moves);
+    keep_legal_moves(piece, colour, moves, first, board);
 }
 
-/* Generate a list of moves of a pawn from from_col,from_rank. */
-static MovePair *
-generate_pawn_moves(Colour colour, const Board *board, Col from_col, Rank from_rank)
+/* Add to moves the legal moves of a pawn from from_col,from_rank. */
+static void
+generate_pawn_moves(Colour colour, const Board *board, Col from_col, Rank from_rank,
+        MoveList *moves)
 {
-    MovePair *moves = NULL;
+    unsigned first = moves->num_moves;
     Piece piece = PAWN;
     Colour target_colour = OPPOSITE_COLOUR(colour);
     /* Determine the direction in which a pawn can move. */
@@ -2135,13 +2047,13 @@ generate_pawn_moves(Colour colour, const Board *board, Col from_col, Rank from_r
     to_r = RankConvert(from_rank) + offset;
     if (board->board[to_r][to_c] == EMPTY) {
         /* Fill in the details, and add it to the list. */
-        moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
+        add_move(moves, from_col, from_rank, ToCol(to_c), ToRank(to_r));
         if (((colour == WHITE) && (from_rank == FIRSTRANK + 1)) ||
                 ((colour == BLACK) && (from_rank == LASTRANK - 1))) {
             /* Try two steps. */
             to_r = RankConvert(from_rank) + 2 * offset;
             if (board->board[to_r][to_c] == EMPTY) {
-                moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
+                add_move(moves, from_col, from_rank, ToCol(to_c), ToRank(to_r));
             }
         }
     }
@@ -2153,11 +2065,11 @@ generate_pawn_moves(Colour colour, const Board *board, Col from_col, Rank from_r
     else if (board->board[to_r][to_c] == EMPTY) {
         if (board->EnPassant && (ToRank(to_r) == board->ep_rank) &&
                 (ToCol(to_c) == board->ep_col)) {
-            moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
+            add_move(moves, from_col, from_rank, ToCol(to_c), ToRank(to_r));
         }
     }
     else if (EXTRACT_COLOUR(board->board[to_r][to_c]) == target_colour) {
-        moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
+        add_move(moves, from_col, from_rank, ToCol(to_c), ToRank(to_r));
     }
     else {
     }
@@ -2170,78 +2082,52 @@ generate_pawn_moves(Colour colour, const Board *board, Col from_col, Rank from_r
     else if (board->board[to_r][to_c] == EMPTY) {
         if (board->EnPassant && (ToRank(to_r) == board->ep_rank) &&
                 (ToCol(to_c) == board->ep_col)) {
-            moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
+            add_move(moves, from_col, from_rank, ToCol(to_c), ToRank(to_r));
         }
     }
     else if (EXTRACT_COLOUR(board->board[to_r][to_c]) == target_colour) {
-        moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
+        add_move(moves, from_col, from_rank, ToCol(to_c), ToRank(to_r));
     }
     else {
     }
 
-    if (moves != NULL) {
-        moves = exclude_checks(piece, colour, moves, board);
+    keep_legal_moves(piece, colour, moves, first, board);
+}
+
+/* Add to moves the legal moves of the piece of colour at col,rank,
+ * other than castling moves.
+ */
+static void
+generate_piece_moves(Colour colour, Piece piece, const Board *board,
+        Col col, Rank rank, MoveList *moves)
+{
+    switch (piece) {
+        case KING:
+        case KNIGHT:
+            generate_single_moves(colour, piece, board, col, rank, moves);
+            break;
+        case QUEEN:
+        case ROOK:
+        case BISHOP:
+            generate_multiple_moves(colour, piece, board, col, rank, moves);
+            break;
+        case PAWN:
+            generate_pawn_moves(colour, board, col, rank, moves);
+            break;
+        default:
+            fprintf(GlobalState.logfile,
+                    "Internal error: unknown piece %d in generate_piece_moves().\n",
+                    piece);
     }
-    return moves;
 }
 
 /* See whether the king of the given colour is in checkmate.
- * Assuming that the king is in check, generate all possible moves
- * for colour on board until at least one saving move is found.
- * Excepted from this are the castling moves (not legal whilst in check)
- * and underpromotions (inadequate in thwarting a check).
+ * The king is assumed to be in check.
  */
 Boolean
 king_is_in_checkmate(Colour colour, Board *board)
 {
-    Rank rank;
-    Col col;
-    MovePair *moves = NULL;
-    Boolean in_checkmate = FALSE;
-
-    /* Search the board for pieces of the right colour.
-     * Keep going until we have exhausted all pieces, or until
-     * we have found a saving move.
-     */
-    for (rank = LASTRANK; (rank >= FIRSTRANK) && (moves == NULL); rank--) {
-        for (col = FIRSTCOL; (col <= LASTCOL) && (moves == NULL); col++) {
-            int r = RankConvert(rank);
-            int c = ColConvert(col);
-            Piece occupant = board->board[r][c];
-
-            if ((occupant != EMPTY) && (colour == EXTRACT_COLOUR(occupant))) {
-                /* This square is occupied by a piece of the required colour. */
-                Piece piece = EXTRACT_PIECE(occupant);
-
-                switch (piece) {
-                    case KING:
-                    case KNIGHT:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        break;
-                    case QUEEN:
-                    case ROOK:
-                    case BISHOP:
-                        moves = generate_multiple_moves(colour, piece, board, col, rank);
-                        break;
-                    case PAWN:
-                        moves = generate_pawn_moves(colour, board, col, rank);
-                        break;
-                    default:
-                        fprintf(GlobalState.logfile,
-                                "Internal error: unknown piece %d in king_is_in_checkmate().\n",
-                                piece);
-                }
-            }
-        }
-    }
-    if (moves != NULL) {
-        /* No checkmate.  Free the move list. */
-        free_move_pair_list(moves);
-    }
-    else {
-        in_checkmate = TRUE;
-    }
-    return in_checkmate;
+    return !has_legal_move(board, colour);
 }
 
 #if INCLUDE_UNUSED_FUNCTIONS
@@ -2258,66 +2144,35 @@ approx_how_many_moves(Board *board)
     Rank rank;
     Col col;
     Colour colour = board->to_move;
-    unsigned num_moves = 0;
+    MoveList moves;
 
-    /* Search the board for pieces of the right colour.
-     * Keep going until we have exhausted all pieces, or until
-     * we have found a saving move.
-     */
+    moves.num_moves = 0;
+    /* Search the board for pieces of the right colour. */
     for (rank = LASTRANK; rank >= FIRSTRANK; rank--) {
         for (col = FIRSTCOL; col <= LASTCOL; col++) {
             int r = RankConvert(rank);
             int c = ColConvert(col);
             Piece occupant = board->board[r][c];
-            MovePair *moves = NULL;
 
             if ((occupant != EMPTY) && (colour == EXTRACT_COLOUR(occupant))) {
                 /* This square is occupied by a piece of the required colour. */
-                Piece piece = EXTRACT_PIECE(occupant);
-
-                switch (piece) {
-                    case KING:
-                    case KNIGHT:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        break;
-                    case QUEEN:
-                    case ROOK:
-                    case BISHOP:
-                        moves = generate_multiple_moves(colour, piece, board, col, rank);
-                        break;
-                    case PAWN:
-                        moves = generate_pawn_moves(colour, board, col, rank);
-                        break;
-                    default:
-                        fprintf(GlobalState.logfile,
-                                "Internal error: unknown piece %d in king_is_in_checkmate().\n",
-                                piece);
-                }
-                if (moves != NULL) {
-                    /* At least one move. */
-                    MovePair *m;
-                    for (m = moves; m != NULL; m = m->next) {
-                        num_moves++;
-                    }
-                    /* Free the move list. */
-                    free_move_pair_list(moves);
-                }
+                generate_piece_moves(colour, EXTRACT_PIECE(occupant), board,
+                        col, rank, &moves);
             }
         }
     }
-    return num_moves;
+    return moves.num_moves;
 }
 #endif
 
 /* Find all moves for on the given board for colour. */
-MovePair *
-find_all_moves(const Board *board, Colour colour)
+void
+find_all_moves(const Board *board, Colour colour, MoveList *moves)
 {
     Rank rank;
     Col col;
-    /* All moves for colour. */
-    MovePair *all_moves = NULL;
 
+    moves->num_moves = 0;
     /* Pick up each piece of the required colour. */
     for (rank = LASTRANK; rank >= FIRSTRANK; rank--) {
         int r = RankConvert(rank);
@@ -2328,74 +2183,31 @@ find_all_moves(const Board *board, Colour colour)
             if ((occupant != EMPTY) && (colour == EXTRACT_COLOUR(occupant))) {
                 /* This square is occupied by a piece of the required colour. */
                 Piece piece = EXTRACT_PIECE(occupant);
-                /* List of moves for this piece. */
-                MovePair *moves = NULL;
 
-                switch (piece) {
-                    case KING:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        /* Add any castling, as this is not covered
-                         * by GenerateSingleMoves.
-                         */
-                        if (can_castle(KINGSIDE_CASTLE, colour, board)) {
-                            MovePair *m = (MovePair *)
-                                    malloc_or_die(sizeof (MovePair));
-                            m->from_col = find_castling_king_col(colour, board);
-                            m->from_rank = rank;
-                            m->to_col = 'g';
-                            m->to_rank = rank;
-                            /* Prepend. */
-                            m->next = moves;
-                            moves = m;
-                        }
-                        if (can_castle(QUEENSIDE_CASTLE, colour, board)) {
-                            MovePair *m = (MovePair *)
-                                    malloc_or_die(sizeof (MovePair));
-                            m->from_col = find_castling_king_col(colour, board);
-                            m->from_rank = rank;
-                            m->to_col = 'c';
-                            m->to_rank = rank;
-                            /* Prepend. */
-                            m->next = moves;
-                            moves = m;
-                        }
-                        break;
-                    case KNIGHT:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        break;
-                    case QUEEN:
-                    case ROOK:
-                    case BISHOP:
-                        moves = generate_multiple_moves(colour, piece, board, col, rank);
-                        break;
-                    case PAWN:
-                        moves = generate_pawn_moves(colour, board, col, rank);
-                        break;
-                    default:
-                        fprintf(GlobalState.logfile,
-                                "Internal error: unknown piece %d in king_is_in_checkmate().\n",
-                                piece);
-                }
-                if (moves != NULL) {
-                    /* At least one move.
-                     * Append what we have so far to this list.
-                     * Find the last one.
+                generate_piece_moves(colour, piece, board, col, rank, moves);
+                if (piece == KING) {
+                    /* Add any castling, as this is not covered
+                     * by generate_single_moves.
                      */
-                    MovePair *m;
-                    for (m = moves; m->next != NULL; m = m->next) {
+                    if (can_castle(KINGSIDE_CASTLE, colour, board)) {
+                        add_move(moves, find_castling_king_col(colour, board), rank,
+                                'g', rank);
+                    }
+                    if (can_castle(QUEENSIDE_CASTLE, colour, board)) {
+                        add_move(moves, find_castling_king_col(colour, board), rank,
+                                'c', rank);
                     }
-                    m->next = all_moves;
-                    all_moves = moves;
                 }
             }
         }
     }
-    return all_moves;
 }
 
-/* Return TRUE if there is at least one move on the given board for colour. */
-Boolean
-at_least_one_move(const Board *board, Colour colour)
+/* Return TRUE if there is at least one move on the given board for colour,
+ * by generating the moves of each piece in turn.
+ */
+static Boolean
+piece_by_piece_has_move(const Board *board, Colour colour)
 {
     Boolean move_found = FALSE;
 
@@ -2408,56 +2220,170 @@ at_least_one_move(const Board *board, Colour colour)
             if ((occupant != EMPTY) && (colour == EXTRACT_COLOUR(occupant))) {
                 /* This square is occupied by a piece of the required colour. */
                 Piece piece = EXTRACT_PIECE(occupant);
-                MovePair *moves = NULL;
+                MoveList moves;
+
+                moves.num_moves = 0;
+                generate_piece_moves(colour, piece, board, col, rank, &moves);
+                if (moves.num_moves != 0) {
+                    move_found = TRUE;
+                }
+                else if (piece == KING) {
+                    /* Add any castling, as this is not covered
+                     * by generate_single_moves.
+                     */
+                    move_found = can_castle(KINGSIDE_CASTLE, colour, board) ||
+                            can_castle(QUEENSIDE_CASTLE, colour, board);
+                }
+            }
+        }
+    }
+    return move_found;
+}
+
+/* Return TRUE if at least one of the moves of piece from from_square
+ * to the targets squares is legal.
+ * Those of a piece that is not pinned are all legal.
+ */
+static Boolean
+legal_move_to_targets(Piece piece, Colour colour, int from_square,
+        Bitboard targets, Bitboard pinned, const Board *board)
+{
+    if ((pinned & SQUARE_BIT(from_square)) == 0) {
+        return targets != 0;
+    }
+    while (targets != 0) {
+        int to_square = lowest_square(targets);
+        MovePair move;
+
+        move.from_col = SQUARE_COL(from_square);
+        move.from_rank = SQUARE_RANK(from_square);
+        move.to_col = SQUARE_COL(to_square);
+        move.to_rank = SQUARE_RANK(to_square);
+        if (!move_leaves_king_in_check(piece, colour, &move, board)) {
+            return TRUE;
+        }
+        targets &= targets - 1;
+    }
+    return FALSE;
+}
+
+/* Return TRUE if there is at least one legal move on the given board
+ * for colour.
+ * This stops at the first legal move found rather than generating
+ * them all.  When the king is in check, only king moves, captures of
+ * the checking piece and interpositions are considered.
+ */
+Boolean
+has_legal_move(const Board *board, Colour colour)
+{
+    Colour opponent = OPPOSITE_COLOUR(colour);
+    Col king_col = colour == WHITE ? board->WKingCol : board->BKingCol;
+    Rank king_rank = colour == WHITE ? board->WKingRank : board->BKingRank;
+
+    if (!ON_BOARD(king_col, king_rank) ||
+            board->pieces[colour][KING] != SQUARE_BIT(COL_RANK_SQUARE(king_col, king_rank))) {
+        /* Not a single king where expected, so do it the long way. */
+        return piece_by_piece_has_move(board, colour);
+    }
+    else {
+        int king_square = COL_RANK_SQUARE(king_col, king_rank);
+        Bitboard own = board->occupied[colour];
+        Bitboard occupied = own | board->occupied[opponent];
+        Bitboard checkers = attackers_of(board, king_square, opponent, occupied);
+        /* The squares to which a move might deal with any check. */
+        Bitboard evasions = ~((Bitboard) 0);
+        Bitboard pinned, targets, pawns;
+        int forward = colour == WHITE ? BOARDSIZE : -BOARDSIZE;
+        Rank pawn_start_rank = colour == WHITE ? FIRSTRANK + 1 : LASTRANK - 1;
+
+        /* Try the king first, with it removed from the board so that
+         * it cannot block a check along the line of its move.
+         */
+        targets = King_attacks[king_square] & ~own;
+        while (targets != 0) {
+            int to_square = lowest_square(targets);
+
+            if (!square_is_attacked(board, to_square, opponent,
+                    occupied & ~SQUARE_BIT(king_square), SQUARE_BIT(to_square))) {
+                return TRUE;
+            }
+            targets &= targets - 1;
+        }
+        if (checkers != 0) {
+            if ((checkers & (checkers - 1)) != 0) {
+                /* Only the king can escape from a double check. */
+                return FALSE;
+            }
+            evasions = squares_to_attacker(king_square, lowest_square(checkers));
+        }
+        pinned = pinned_pieces(board, colour, king_square, occupied);
+
+        for (Piece piece = KNIGHT; piece <= QUEEN; piece++) {
+            Bitboard squares = board->pieces[colour][piece];
+
+            while (squares != 0) {
+                int from_square = lowest_square(squares);
 
                 switch (piece) {
-                    case KING:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        if (moves != NULL) {
-                            move_found = TRUE;
-                            free_move_pair_list(moves);
-                        }
-                            /* Add any castling, as this is not covered
-                             * by GenerateSingleMoves.
-                             */
-                        else if (can_castle(KINGSIDE_CASTLE, colour, board)) {
-                            move_found = TRUE;
-                        }
-                        else if (can_castle(QUEENSIDE_CASTLE, colour, board)) {
-                            move_found = TRUE;
-                        }
-                        break;
                     case KNIGHT:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        if (moves != NULL) {
-                            move_found = TRUE;
-                            free_move_pair_list(moves);
-                        }
+                        targets = Knight_attacks[from_square];
                         break;
-                    case QUEEN:
-                    case ROOK:
                     case BISHOP:
-                        moves = generate_multiple_moves(colour, piece, board, col, rank);
-                        if (moves != NULL) {
-                            move_found = TRUE;
-                            free_move_pair_list(moves);
-                        }
+                        targets = bishop_attacks(from_square, occupied);
                         break;
-                    case PAWN:
-                        moves = generate_pawn_moves(colour, board, col, rank);
-                        if (moves != NULL) {
-                            move_found = TRUE;
-                            free_move_pair_list(moves);
-                        }
+                    case ROOK:
+                        targets = rook_attacks(from_square, occupied);
                         break;
                     default:
-                        fprintf(GlobalState.logfile,
-                                "Internal error: unknown piece %d in king_is_in_checkmate().\n",
-                                piece);
+                        targets = bishop_attacks(from_square, occupied) |
+                                rook_attacks(from_square, occupied);
+                        break;
+                }
+                if (legal_move_to_targets(piece, colour, from_square,
+                        targets & ~own & evasions, pinned, board)) {
+                    return TRUE;
+                }
+                squares &= squares - 1;
+            }
+        }
+
+        pawns = board->pieces[colour][PAWN];
+        while (pawns != 0) {
+            int from_square = lowest_square(pawns);
+            int to_square = from_square + forward;
+
+            targets = Pawn_attacks[colour][from_square] & board->occupied[opponent];
+            if (to_square >= 0 && to_square < NUM_SQUARES &&
+                    (occupied & SQUARE_BIT(to_square)) == 0) {
+                targets |= SQUARE_BIT(to_square);
+                to_square += forward;
+                if (SQUARE_RANK(from_square) == pawn_start_rank &&
+                        (occupied & SQUARE_BIT(to_square)) == 0) {
+                    targets |= SQUARE_BIT(to_square);
                 }
             }
+            if (legal_move_to_targets(PAWN, colour, from_square,
+                    targets & evasions, pinned, board)) {
+                return TRUE;
+            }
+            if (board->EnPassant && ON_BOARD(board->ep_col, board->ep_rank)) {
+                /* An en passant capture removes two pieces from the
+                 * board, so always check it in full.
+                 */
+                Bitboard ep_bit = SQUARE_BIT(COL_RANK_SQUARE(board->ep_col, board->ep_rank));
+
+                if ((Pawn_attacks[colour][from_square] & ep_bit & ~occupied) != 0 &&
+                        legal_move_to_targets(PAWN, colour, from_square, ep_bit,
+                                ~((Bitboard) 0), board)) {
+                    return TRUE;
+                }
+            }
+            pawns &= pawns - 1;
         }
+
+        /* Castling is only possible out of check. */
+        return checkers == 0 &&
+                (can_castle(KINGSIDE_CASTLE, colour, board) ||
+                 can_castle(QUEENSIDE_CASTLE, colour, board));
     }
-    return move_found;
 }
-
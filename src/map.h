@@ -23,26 +23,31 @@
 #define MAP_H
 
 void init_hashtab(void);
+void init_attack_tables(void);
+void set_board_bitboards(Board *board);
 Boolean determine_move_details(Colour colour,Move *move_details, Board *board);
 HashCode hash_lookup(Col col, Rank rank, Piece piece, Colour colour);
 void make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_rank,
                 Piece piece, Colour colour,Board *board);
 CheckStatus king_is_in_check(const Board *board,Colour king_colour);
-MovePair *find_pawn_moves(Col from_col, Rank from_rank, Col to_col,Rank to_rank,
-                Colour colour, const Board *board);
-MovePair *find_knight_moves(Col to_col,Rank to_rank, Colour colour, const Board *board);
-MovePair *find_bishop_moves(Col to_col,Rank to_rank, Colour colour, const Board *board);
-MovePair *find_rook_moves(Col to_col,Rank to_rank, Colour colour, const Board *board);
-MovePair *find_queen_moves(Col to_col,Rank to_rank, Colour colour, const Board *board);
-MovePair *find_king_moves(Col to_col,Rank to_rank, Colour colour, const Board *board);
-MovePair *exclude_checks(Piece piece, Colour colour,MovePair *possibles,
-                                const Board *board);
-void free_move_pair_list(MovePair *move_list);
+void find_pawn_moves(Col from_col, Rank from_rank, Col to_col,Rank to_rank,
+                Colour colour, const Board *board, MoveList *moves);
+void find_knight_moves(Col to_col,Rank to_rank, Colour colour, const Board *board,
+                MoveList *moves);
+void find_bishop_moves(Col to_col,Rank to_rank, Colour colour, const Board *board,
+                MoveList *moves);
+void find_rook_moves(Col to_col,Rank to_rank, Colour colour, const Board *board,
+                MoveList *moves);
+void find_queen_moves(Col to_col,Rank to_rank, Colour colour, const Board *board,
+                MoveList *moves);
+void find_king_moves(Col to_col,Rank to_rank, Colour colour, const Board *board,
+                MoveList *moves);
+void exclude_checks(Piece piece, Colour colour, MoveList *moves, const Board *board);
 Boolean king_is_in_checkmate(Colour colour,Board *board);
 Col find_castling_king_col(Colour colour, const Board *board);
 Col find_castling_rook_col(Colour colour, const Board *board, MoveClass castling);
-MovePair *find_all_moves(const Board *board, Colour colour);
-Boolean at_least_one_move(const Board *board, Colour colour);
+void find_all_moves(const Board *board, Colour colour, MoveList *moves);
+Boolean has_legal_move(const Board *board, Colour colour);
 
 #endif	// MAP_H
 
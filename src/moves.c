@@ -101,14 +101,69 @@ typedef struct variation_list {
     unsigned num_black_disallowed_moves;
     /* How many half-moves in the variation? */
     unsigned length;
+    /* The number of the last game this variation was tried against
+     * when matching permutations.
+     */
+    unsigned long last_game_tried;
     struct variation_list *next;
 } variation_list;
 
 /* The head of the variations-of-interest list. */
 static variation_list *games_to_keep = NULL;
 
+/* A node of the trie into which the variations are compiled for
+ * matching without permutations.
+ * Variations that start with the same move texts share the
+ * nodes for those moves.
+ */
+typedef struct variation_node {
+    /* The text of the variant move leading to this node. */
+    const char *move;
+    /* Whether a variation ends at this node. */
+    Boolean complete;
+    /* The first of the nodes for the next move. */
+    struct variation_node *children;
+    /* The next node for the same move as this one. */
+    struct variation_node *sibling;
+} variation_node;
+
+/* An entry of the index of the variations to be matched with
+ * permutations.
+ * Each variation has a key move: an unadorned move that must be
+ * matched by one of the game's moves of the same colour for the
+ * variation to match.  There is an entry for each move text that
+ * the key move would match.
+ */
+typedef struct {
+    /* A move text matched by the key move. */
+    char *move;
+    /* The colour of the key move: 0 for White and 1 for Black. */
+    unsigned colour;
+    variation_list *variation;
+} permutation_key;
+
+/* The root of the trie of variations. */
+static variation_node *variation_trie = NULL;
+/* The index of variations, sorted by colour and move text. */
+static permutation_key *permutation_index = NULL;
+static unsigned num_permutation_keys = 0;
+/* The variations without a key move, which must be tried against
+ * every game.
+ */
+static variation_list **unindexed_variations = NULL;
+static unsigned num_unindexed_variations = 0;
+/* The length of the longest indexed variation.
+ * Later moves of a game cannot match a key move.
+ */
+static unsigned longest_indexed_variation = 0;
+/* Whether the trie or index is up to date with games_to_keep. */
+static Boolean variations_compiled = FALSE;
+/* The number of games checked against the variations. */
+static unsigned long games_checked = 0;
+
 static Boolean textual_variation_match(const char *variation_move,
         const unsigned char *actual_move);
+static void free_compiled_variations(void);
 
 /*** Functions concerned with reading details of the variations
  *** of interest.
@@ -226,6 +281,7 @@ compose_variation(char *line)
     }
     variation->moves = move_list;
     variation->length = num_moves;
+    variation->last_game_tried = 0;
     variation->next = NULL;
     return variation;
 }
@@ -253,6 +309,9 @@ add_textual_variation_from_line(char *line)
         if (next_variation != NULL) {
             next_variation->next = games_to_keep;
             games_to_keep = next_variation;
+            if (variations_compiled) {
+                free_compiled_variations();
+            }
         }
     }
 }
@@ -430,68 +489,86 @@ textual_variation_match(const char *variation_move, const unsigned char *actual_
  *** against the variations of interest.
  ***/
 
-/* Do the moves of the current game match the given variation?
- * Go for a straight 1-1 match in the ordering, without considering
- * permutations.
- * Return TRUE if so, FALSE otherwise.
+/* Return TRUE if actual_move matches the given move of a variation
+ * when the moves are matched in order.
  */
 static Boolean
-straight_match(Move *current_game_head, variation_list variation)
+variant_move_match(const char *variation_move, const unsigned char *actual_move)
 {
-    variant_move *moves_of_the_variation;
-    /* Which is the next move that we wish to match. */
-    Move *next_move;
-    unsigned move_index = 0;
-    /* Assume that it matches. */
-    Boolean matches = TRUE;
+    if (*variation_move == ANY_MOVE) {
+        /* We don't care what the actual move is. */
+        return TRUE;
+    }
+    else if (*variation_move == DISALLOWED_MOVE) {
+        return !textual_variation_match(variation_move, actual_move);
+    }
+    else {
+        return textual_variation_match(variation_move, actual_move);
+    }
+}
 
-    /* Access the head of the current game. */
-    next_move = current_game_head;
-    /* Go for a straight move-by-move match in the order in which
-     * the variation is listed.
-     * Point at the head of the moves list.
-     */
-    moves_of_the_variation = variation.moves;
-    move_index = 0;
-    while (matches && (next_move != NULL) && (move_index < variation.length)) {
-        Boolean this_move_matches;
+/* Add the moves of variation to the trie rooted at root. */
+static void
+add_variation_to_trie(variation_node *root, const variation_list *variation)
+{
+    variation_node *node = root;
+    unsigned move_index;
 
-        if (*(moves_of_the_variation[move_index].move) == ANY_MOVE) {
-            /* Still matching as we don't care what the actual move is. */
-        }
-        else {
-            this_move_matches =
-                    textual_variation_match(moves_of_the_variation[move_index].move,
-                    next_move->move);
-            if (this_move_matches) {
-                /* We found a match, check that it isn't disallowed. */
-                if (*moves_of_the_variation[move_index].move == DISALLOWED_MOVE) {
-                    /* This move is disallowed and implies failure. */
-                    matches = FALSE;
-                }
-            }
-            else {
-                if (*moves_of_the_variation[move_index].move != DISALLOWED_MOVE) {
-                    /* No match found for this move. */
-                    matches = FALSE;
-                }
-                else {
-                    /* This is ok, because we didn't want a match. */
-                }
-            }
+    for (move_index = 0; move_index < variation->length; move_index++) {
+        const char *move = variation->moves[move_index].move;
+        variation_node *child = node->children;
 
+        while (child != NULL && strcmp(child->move, move) != 0) {
+            child = child->sibling;
         }
-        /* If we are still matching, go on to the next move. */
-        if (matches) {
-            move_index++;
-            next_move = next_move->next;
+        if (child == NULL) {
+            child = (variation_node *) malloc_or_die(sizeof (*child));
+            child->move = move;
+            child->complete = FALSE;
+            child->children = NULL;
+            child->sibling = node->children;
+            node->children = child;
         }
+        node = child;
+    }
+    node->complete = TRUE;
+}
+
+/* Do the moves from next_move onwards complete a variation
+ * from the given node of the trie?
+ * Go for a straight 1-1 match in the ordering, without considering
+ * permutations.
+ * The game could be shorter than the variation.
+ */
+static Boolean
+trie_match(const variation_node *node, const Move *next_move)
+{
+    const variation_node *child;
+
+    if (node->complete) {
+        return TRUE;
+    }
+    if (next_move == NULL) {
+        return FALSE;
+    }
+    for (child = node->children; child != NULL; child = child->sibling) {
+        if (variant_move_match(child->move, next_move->move) &&
+                trie_match(child, next_move->next)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void
+free_variation_trie(variation_node *node)
+{
+    while (node != NULL) {
+        variation_node *sibling = node->sibling;
+        free_variation_trie(node->children);
+        (void) free((void *) node);
+        node = sibling;
     }
-    /* The game could be shorter than the variation, so don't rely
-     * on the fact that matches is still true.
-     */
-    matches = (move_index == variation.length);
-    return matches;
 }
 
 /* Do the moves of the current game match the given variation?
@@ -675,6 +752,232 @@ permutation_match(Move *current_game_head, variation_list variation)
     return matches;
 }
 
+/* Add entries to the permutation index for each of the move texts
+ * that key_move would match for variation.
+ * A match must start with a move character at the start of key_move
+ * or after a non-move character, and end before a non-move character
+ * or at the end of key_move (see textual_variation_match).
+ */
+static void
+add_permutation_keys(const char *key_move, unsigned colour, variation_list *variation)
+{
+    static unsigned max_permutation_keys = 0;
+    size_t length = strlen(key_move);
+    size_t start, end;
+
+    for (start = 0; start < length; start++) {
+        if (move_char(key_move[start]) &&
+                (start == 0 || !move_char(key_move[start - 1]))) {
+            for (end = start + 1; end <= length; end++) {
+                if (end == length || !move_char(key_move[end])) {
+                    permutation_key *key;
+                    if (num_permutation_keys == max_permutation_keys) {
+                        max_permutation_keys = max_permutation_keys == 0 ?
+                                INIT_MOVE_NUMBER : 2 * max_permutation_keys;
+                        permutation_index = (permutation_key *) realloc_or_die(
+                                (void *) permutation_index,
+                                max_permutation_keys * sizeof (*permutation_index));
+                    }
+                    key = &permutation_index[num_permutation_keys];
+                    key->move = (char *) malloc_or_die(end - start + 1);
+                    strncpy(key->move, key_move + start, end - start);
+                    key->move[end - start] = '\0';
+                    key->colour = colour;
+                    key->variation = variation;
+                    num_permutation_keys++;
+                }
+            }
+        }
+    }
+}
+
+/* Add variation to the permutation index under its key move.
+ * Use the last unadorned move as the key move, because the earlier
+ * moves of variations are more often shared.
+ * Variations without a key move are added to unindexed_variations.
+ * An ANY_MOVE followed by additional move text could be matched
+ * instead of the key move, so those variations are not indexed either.
+ */
+static void
+index_variation(variation_list *variation)
+{
+    Boolean indexable = TRUE;
+    Boolean key_found = FALSE;
+    unsigned key_index = 0;
+    unsigned move_index;
+
+    for (move_index = 0; move_index < variation->length; move_index++) {
+        const char *move = variation->moves[move_index].move;
+        if (*move == ANY_MOVE) {
+            if (move[1] != '\0') {
+                indexable = FALSE;
+            }
+        }
+        else if (*move != DISALLOWED_MOVE) {
+            key_index = move_index;
+            key_found = TRUE;
+        }
+    }
+    if (indexable && key_found) {
+        add_permutation_keys(variation->moves[key_index].move, key_index & 0x01,
+                variation);
+        if (variation->length > longest_indexed_variation) {
+            longest_indexed_variation = variation->length;
+        }
+    }
+    else {
+        unindexed_variations = (variation_list **) realloc_or_die(
+                (void *) unindexed_variations,
+                (num_unindexed_variations + 1) * sizeof (*unindexed_variations));
+        unindexed_variations[num_unindexed_variations] = variation;
+        num_unindexed_variations++;
+    }
+}
+
+/* Order permutation keys by colour and then move text. */
+static int
+compare_permutation_keys(const void *a, const void *b)
+{
+    const permutation_key *key_a = (const permutation_key *) a;
+    const permutation_key *key_b = (const permutation_key *) b;
+
+    if (key_a->colour != key_b->colour) {
+        return key_a->colour < key_b->colour ? -1 : 1;
+    }
+    else {
+        return strcmp(key_a->move, key_b->move);
+    }
+}
+
+/* Return the index of the first permutation key for the given
+ * colour and move, or of where it would be if there is none.
+ */
+static unsigned
+first_permutation_key(unsigned colour, const char *move)
+{
+    unsigned low = 0, high = num_permutation_keys;
+
+    while (low < high) {
+        unsigned mid = low + (high - low) / 2;
+        const permutation_key *key = &permutation_index[mid];
+        if (key->colour < colour ||
+                (key->colour == colour && strcmp(key->move, move) < 0)) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/* Do the moves of the current game match any of the variations
+ * when permutations are allowed?
+ * Only the variations whose key move matches one of the game's
+ * moves need to be tried.
+ */
+static Boolean
+indexed_permutation_match(Move *current_game_head)
+{
+    Boolean wanted = FALSE;
+    Move *next_move = current_game_head;
+    unsigned ply = 0;
+    unsigned variation_index;
+
+    games_checked++;
+    for (variation_index = 0; !wanted && variation_index < num_unindexed_variations;
+            variation_index++) {
+        wanted = permutation_match(current_game_head,
+                *unindexed_variations[variation_index]);
+    }
+    while (!wanted && next_move != NULL && ply < longest_indexed_variation) {
+        const char *move = (const char *) next_move->move;
+        unsigned colour = ply & 0x01;
+        unsigned key_index;
+
+        if (!move_char(*move)) {
+            /* The index only holds texts starting with a move character,
+             * so try everything.
+             */
+            variation_list *variation;
+            for (variation = games_to_keep; (variation != NULL) && !wanted;
+                    variation = variation->next) {
+                wanted = permutation_match(current_game_head, *variation);
+            }
+            return wanted;
+        }
+        for (key_index = first_permutation_key(colour, move);
+                !wanted && key_index < num_permutation_keys &&
+                permutation_index[key_index].colour == colour &&
+                strcmp(permutation_index[key_index].move, move) == 0;
+                key_index++) {
+            variation_list *variation = permutation_index[key_index].variation;
+            /* The key move must be matched within the length of
+             * the variation, and only needs to be tried once.
+             */
+            if (ply < variation->length && variation->last_game_tried != games_checked) {
+                variation->last_game_tried = games_checked;
+                wanted = permutation_match(current_game_head, *variation);
+            }
+        }
+        next_move = next_move->next;
+        ply++;
+    }
+    return wanted;
+}
+
+/* Compile games_to_keep into the form needed for matching:
+ * a permutation index if permutations are to be matched and
+ * a trie otherwise.
+ */
+static void
+compile_variations(void)
+{
+    variation_list *variation;
+
+    if (GlobalState.match_permutations) {
+        for (variation = games_to_keep; variation != NULL; variation = variation->next) {
+            index_variation(variation);
+        }
+        if (num_permutation_keys > 0) {
+            qsort((void *) permutation_index, num_permutation_keys,
+                    sizeof (*permutation_index), compare_permutation_keys);
+        }
+    }
+    else {
+        variation_trie = (variation_node *) malloc_or_die(sizeof (*variation_trie));
+        variation_trie->move = NULL;
+        variation_trie->complete = FALSE;
+        variation_trie->children = NULL;
+        variation_trie->sibling = NULL;
+        for (variation = games_to_keep; variation != NULL; variation = variation->next) {
+            add_variation_to_trie(variation_trie, variation);
+        }
+    }
+    variations_compiled = TRUE;
+}
+
+/* Free the results of compile_variations. */
+static void
+free_compiled_variations(void)
+{
+    unsigned key_index;
+
+    free_variation_trie(variation_trie);
+    variation_trie = NULL;
+    for (key_index = 0; key_index < num_permutation_keys; key_index++) {
+        (void) free((void *) permutation_index[key_index].move);
+    }
+    num_permutation_keys = 0;
+    if (unindexed_variations != NULL) {
+        (void) free((void *) unindexed_variations);
+        unindexed_variations = NULL;
+    }
+    num_unindexed_variations = 0;
+    longest_indexed_variation = 0;
+    variations_compiled = FALSE;
+}
+
 /* Determine whether or not the current game is wanted.
  * It will be if we are either not looking for checkmate-only
  * games, or if we are and the games does end in checkmate.
@@ -735,7 +1038,7 @@ is_stalemate(const Board *board, const Move *moves)
             return FALSE;
         }
     }
-    return !at_least_one_move(board, board->to_move);
+    return !has_legal_move(board, board->to_move);
 }
 
 /* Determine whether or not the current game is wanted.
@@ -746,17 +1049,16 @@ Boolean
 check_textual_variations(const Game *game_details)
 {
     Boolean wanted = FALSE;
-    variation_list *variation;
 
     if (games_to_keep != NULL) {
-        for (variation = games_to_keep; (variation != NULL) && !wanted;
-                variation = variation->next) {
-            if (GlobalState.match_permutations) {
-                wanted = permutation_match(game_details->moves, *variation);
-            }
-            else {
-                wanted = straight_match(game_details->moves, *variation);
-            }
+        if (!variations_compiled) {
+            compile_variations();
+        }
+        if (GlobalState.match_permutations) {
+            wanted = indexed_permutation_match(game_details->moves);
+        }
+        else {
+            wanted = trie_match(variation_trie, game_details->moves);
         }
     }
     else {
@@ -768,6 +1070,13 @@ check_textual_variations(const Game *game_details)
     return wanted;
 }
 
+/* Return whether there are any textual variations (-v). */
+Boolean
+textual_variations_present(void)
+{
+    return games_to_keep != NULL;
+}
+
 /* Determine whether the number of ply in this game
  * is within the bounds of what we want.
  */
@@ -784,3 +1093,32 @@ check_move_bounds(unsigned plycount)
         return TRUE;
     }
 }
+
+/* Determine, before its moves are played, whether the number of ply
+ * in game_details might be within the bounds of what we want.
+ * This can only be known for games from the standard starting
+ * position that must be valid to be wanted, and then, with
+ * --skiprejected, the moves of games that are not wanted need not
+ * be played at all, unless every game is being checked for errors (-r).
+ */
+Boolean
+check_move_bounds_before_play(const Game *game_details)
+{
+    if (GlobalState.check_move_bounds &&
+            game_details->tags[FEN_TAG] == NULL &&
+            !GlobalState.keep_broken_games &&
+            GlobalState.non_matching_file == NULL &&
+            GlobalState.skip_rejected_moves &&
+            !GlobalState.check_only) {
+        unsigned plycount = 0;
+        const Move *move;
+
+        for (move = game_details->moves; move != NULL; move = move->next) {
+            plycount++;
+        }
+        return check_move_bounds(plycount);
+    }
+    else {
+        return TRUE;
+    }
+}
@@ -27,7 +27,9 @@ void add_positional_variation_from_line(char *line);
 void add_textual_variations_from_file(FILE *fpin);
 void add_textual_variation_from_line(char *line);
 Boolean check_textual_variations(const Game *game_details);
+Boolean textual_variations_present(void);
 Boolean check_move_bounds(unsigned plycount);
+Boolean check_move_bounds_before_play(const Game *game_details);
 void add_fen_positional_match(const char *fen_string);
 void add_fen_pattern_match(const char *fen_pattern, Boolean add_reverse, const char *label);
 Boolean check_for_only_checkmate(const Game *game_details);
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "mymalloc.h"
 
 /* Allocate the required space or abort the program. */
@@ -50,3 +51,204 @@ realloc_or_die(void *space, size_t nbytes)
     }
     return result;
 }
+
+/* The nodes of a game's parse tree and the strings of its tokens are
+ * carved out of large blocks rather than being malloc'd one at a time.
+ * The whole game is then released by resetting its blocks for reuse.
+ * Two arenas are used in turn because the lookahead symbol of the next
+ * game has already been allocated when the current game is finished with.
+ * Space is only taken from the arenas while games are being parsed;
+ * otherwise game_alloc falls back on malloc_or_die.
+ * Each arena normally has a single block, so that game_free can tell
+ * arena space from malloc'd space by its address.
+ * A game that does not fit has further blocks added, and these are
+ * merged into one larger block when the arena is next reset.
+ */
+
+/* The minimum size of an arena block. */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* A type with the strictest alignment needed by anything allocated. */
+typedef union {
+    long double ld;
+    long long ll;
+    void *p;
+    void (*f)(void);
+} ArenaAlignment;
+
+#define ARENA_ROUND(n) \
+    (((n) + sizeof (ArenaAlignment) - 1) / sizeof (ArenaAlignment) * sizeof (ArenaAlignment))
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    /* The extent of the block's space. */
+    char *start, *end;
+} ArenaBlock;
+
+typedef struct {
+    /* The block that a game is normally allocated from. */
+    ArenaBlock *main;
+    /* Blocks added since the last reset because main was full. */
+    ArenaBlock *overflow;
+    /* The block currently being allocated from. */
+    ArenaBlock *current;
+    /* The next free byte in current. */
+    char *next_free;
+} Arena;
+
+static Arena arenas[2];
+/* Index of the arena in use for the current game. */
+static unsigned current_arena = 0;
+/* Whether allocations are currently taken from the arenas. */
+static int arenas_in_use = 0;
+
+static ArenaBlock *
+new_arena_block(size_t nbytes)
+{
+    ArenaBlock *block =
+            (ArenaBlock *) malloc_or_die(ARENA_ROUND(sizeof (ArenaBlock)) + nbytes);
+
+    block->next = NULL;
+    block->start = (char *) block + ARENA_ROUND(sizeof (ArenaBlock));
+    block->end = block->start + nbytes;
+    return block;
+}
+
+/* Allocate space that lives until the game currently being
+ * parsed has been dealt with.
+ */
+void *
+game_alloc(size_t nbytes)
+{
+    Arena *arena;
+    void *space;
+
+    if (!arenas_in_use) {
+        return malloc_or_die(nbytes);
+    }
+    arena = &arenas[current_arena];
+    nbytes = ARENA_ROUND(nbytes);
+    if (arena->current == NULL ||
+            (size_t) (arena->current->end - arena->next_free) < nbytes) {
+        ArenaBlock *block =
+                new_arena_block(nbytes > ARENA_BLOCK_SIZE ? nbytes : ARENA_BLOCK_SIZE);
+
+        if (arena->main == NULL) {
+            arena->main = block;
+        }
+        else {
+            block->next = arena->overflow;
+            arena->overflow = block;
+        }
+        arena->current = block;
+        arena->next_free = block->start;
+    }
+    space = arena->next_free;
+    arena->next_free += nbytes;
+    return space;
+}
+
+/* Return a copy of str that lives as long as the current game. */
+char *
+game_copy_string(const char *str)
+{
+    char *result;
+
+    if (str != NULL) {
+        size_t len = strlen(str);
+
+        result = (char *) game_alloc(len + 1);
+        memcpy(result, str, len + 1);
+    }
+    else {
+        result = NULL;
+    }
+    return result;
+}
+
+/* Return whether space lies within block. */
+static int
+block_contains(const ArenaBlock *block, const void *space)
+{
+    return block != NULL &&
+            (const char *) space >= block->start &&
+            (const char *) space < block->end;
+}
+
+/* Return whether space was allocated from one of the arenas.
+ * Overflow blocks only exist until a game larger than any before
+ * it has been dealt with.
+ */
+static int
+is_game_allocation(const void *space)
+{
+    unsigned a;
+
+    for (a = 0; a < 2; a++) {
+        const ArenaBlock *block;
+
+        if (block_contains(arenas[a].main, space)) {
+            return 1;
+        }
+        for (block = arenas[a].overflow; block != NULL; block = block->next) {
+            if (block_contains(block, space)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Free space that might have come from game_alloc.
+ * Space within the arenas is reclaimed when they are reset.
+ */
+void
+game_free(void *space)
+{
+    if (space != NULL && !is_game_allocation(space)) {
+        free(space);
+    }
+}
+
+/* Take game allocations from the arenas until stop_game_arenas. */
+void
+start_game_arenas(void)
+{
+    arenas_in_use = 1;
+}
+
+void
+stop_game_arenas(void)
+{
+    arenas_in_use = 0;
+}
+
+/* Switch to the other arena for the next game and make all of its
+ * space available again.
+ * Anything left in it belongs to the game before last.
+ * If that game overflowed the main block, replace the arena's blocks
+ * with a single one big enough for it.
+ */
+void
+next_game_arena(void)
+{
+    Arena *arena;
+
+    current_arena = 1 - current_arena;
+    arena = &arenas[current_arena];
+    if (arena->overflow != NULL) {
+        size_t size = (size_t) (arena->main->end - arena->main->start);
+
+        while (arena->overflow != NULL) {
+            ArenaBlock *block = arena->overflow;
+
+            arena->overflow = block->next;
+            size += (size_t) (block->end - block->start);
+            free((void *) block);
+        }
+        free((void *) arena->main);
+        arena->main = new_arena_block(size);
+    }
+    arena->current = arena->main;
+    arena->next_free = arena->main != NULL ? arena->main->start : NULL;
+}
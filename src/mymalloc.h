@@ -25,6 +25,12 @@
 void *malloc_or_die(size_t nbytes);
 void *realloc_or_die(void *space,size_t nbytes);
 char *copy_string(const char *str);
+void *game_alloc(size_t nbytes);
+char *game_copy_string(const char *str);
+void game_free(void *space);
+void start_game_arenas(void);
+void stop_game_arenas(void);
+void next_game_arena(void);
 
 #endif	// MYMALLOC_H
 
@@ -34,6 +34,7 @@
 #include "apply.h"
 #include "output.h"
 #include "mymalloc.h"
+#include "outputcache.h"
 
 
 /* Functions for outputting games in the required format. */
@@ -659,7 +660,7 @@ print_move(FILE *outputfile, unsigned move_number, Boolean print_move_number,
                          * char text, as the source may be 8-bit rather
                          * than 7-bit.
                          */
-                        move_to_print = copy_string((const char *) move_text);
+                        move_to_print = game_copy_string((const char *) move_text);
                         if (!GlobalState.keep_checks) {
                             /* Look for a check or mate symbol. */
                             char *check = strchr((const char *) move_text, '+');
@@ -719,7 +720,7 @@ print_move(FILE *outputfile, unsigned move_number, Boolean print_move_number,
                                     break;
                             }
                         }
-                        move_to_print = copy_string(algebraic);
+                        move_to_print = game_copy_string(algebraic);
                     }
                         break;
                     case LALG:
@@ -821,7 +822,7 @@ print_move(FILE *outputfile, unsigned move_number, Boolean print_move_number,
                                     break;
                             }
                         }
-                        move_to_print = copy_string(algebraic);
+                        move_to_print = game_copy_string(algebraic);
                     }
                         break;
                     default:
@@ -854,7 +855,7 @@ print_move(FILE *outputfile, unsigned move_number, Boolean print_move_number,
                 }
             }
             if (move_to_print != NULL) {
-                (void) free(move_to_print);
+                game_free(move_to_print);
             }
             if(print_items_following_move(outputfile, move_details, move_number, white_to_move)) {
                 something_printed = TRUE;
@@ -1449,7 +1450,10 @@ print_algebraic_game(Game *current_game, FILE *outputfile,
     if (GlobalState.json_format) {
         /* Need to take account of splitting output over multiple files. */
         Boolean comma_needed;
-        if (GlobalState.games_per_file == 0) {
+        if (GlobalState.ECO_level > DONT_DIVIDE) {
+            comma_needed = games_in_cached_output_file() > 1;
+        }
+        else if (GlobalState.games_per_file == 0) {
             comma_needed = GlobalState.num_games_matched > 1;
         }
         else {
@@ -1630,7 +1634,7 @@ void add_plycount(const Game *game)
     sprintf(formatted_count, "%u", count);
 
     if (game->tags[PLY_COUNT_TAG] != NULL) {
-        (void) free(game->tags[PLY_COUNT_TAG]);
+        game_free(game->tags[PLY_COUNT_TAG]);
     }
     game->tags[PLY_COUNT_TAG] = copy_string(formatted_count);
 }
@@ -1646,7 +1650,7 @@ void add_total_plycount(const Game *game, Boolean count_variations)
     sprintf(formatted_count, "%u", count);
 
     if (game->tags[TOTAL_PLY_COUNT_TAG] != NULL) {
-        (void) free(game->tags[TOTAL_PLY_COUNT_TAG]);
+        game_free(game->tags[TOTAL_PLY_COUNT_TAG]);
     }
     game->tags[TOTAL_PLY_COUNT_TAG] = copy_string(formatted_count);
 }
@@ -1662,7 +1666,7 @@ static void add_hashcode_tag(const Game *game)
     sprintf(formatted_code, "%08x", (unsigned) hashcode);
 
     if (game->tags[HASHCODE_TAG] != NULL) {
-        (void) free(game->tags[HASHCODE_TAG]);
+        game_free(game->tags[HASHCODE_TAG]);
     }
     game->tags[HASHCODE_TAG] = copy_string(formatted_code);
 }
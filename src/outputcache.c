@@ -0,0 +1,189 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* Keep the output files of -E open between games.
+ * Successive games are often written to different ECO files, and
+ * closing and reopening a file for every game is slow, so a bounded
+ * number of files are kept open, with large buffers, and the least
+ * recently used is closed when another is needed.
+ * Every file written during the run is remembered along with the
+ * number of games written to it, so that a closed file is reopened
+ * for appending and JSON output can be framed separately in each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "outputcache.h"
+
+/* The most output files to be open at once. */
+#define MAX_OPEN_OUTPUT_FILES 64
+/* The size of the buffer of each output file. */
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+/* The number of chains in the table of output files.
+ * This should be a prime number.
+ */
+#define OUTPUT_FILE_TABLE_SIZE 1021
+
+typedef struct OutputFile {
+    char *filename;
+    /* The open file, or NULL if it is closed. */
+    FILE *fp;
+    /* The number of games written to the file during this run. */
+    unsigned long games;
+    /* When the file was last selected. */
+    unsigned long last_used;
+    struct OutputFile *next;
+} OutputFile;
+
+static OutputFile *output_files[OUTPUT_FILE_TABLE_SIZE];
+/* The files that are currently open. */
+static OutputFile *open_files[MAX_OPEN_OUTPUT_FILES];
+static unsigned num_open_files = 0;
+/* The number of selections made, to order their use. */
+static unsigned long selections = 0;
+/* The most recently selected file. */
+static OutputFile *current_file = NULL;
+
+static unsigned
+filename_hash(const char *filename)
+{
+    unsigned hash = 0;
+
+    while (*filename != '\0') {
+        hash = hash * 31 + (unsigned char) *filename;
+        filename++;
+    }
+    return hash % OUTPUT_FILE_TABLE_SIZE;
+}
+
+/* Open filename for output with a large buffer. */
+FILE *
+open_buffered_output_file(const char *filename, const char *mode)
+{
+    FILE *fp = must_open_file(filename, mode);
+    (void) setvbuf(fp, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    return fp;
+}
+
+/* Return the index in open_files of the least recently used file. */
+static unsigned
+least_recently_used(void)
+{
+    unsigned oldest = 0;
+    unsigned i;
+
+    for (i = 1; i < num_open_files; i++) {
+        if (open_files[i]->last_used < open_files[oldest]->last_used) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+/* Return the file to which the next game should be appended,
+ * opening it if necessary.
+ * The game is counted as written to it.
+ */
+FILE *
+select_cached_output_file(const char *filename)
+{
+    unsigned ix = filename_hash(filename);
+    OutputFile *file = output_files[ix];
+
+    while (file != NULL && strcmp(file->filename, filename) != 0) {
+        file = file->next;
+    }
+    if (file == NULL) {
+        file = (OutputFile *) malloc_or_die(sizeof (*file));
+        file->filename = copy_string(filename);
+        file->fp = NULL;
+        file->games = 0;
+        file->next = output_files[ix];
+        output_files[ix] = file;
+    }
+    if (file->fp == NULL) {
+        unsigned slot;
+        if (num_open_files < MAX_OPEN_OUTPUT_FILES) {
+            slot = num_open_files;
+            num_open_files++;
+        }
+        else {
+            slot = least_recently_used();
+            (void) fclose(open_files[slot]->fp);
+            open_files[slot]->fp = NULL;
+        }
+        file->fp = open_buffered_output_file(filename, "a");
+        open_files[slot] = file;
+        if (GlobalState.json_format && file->games == 0) {
+            fputs("[\n", file->fp);
+        }
+    }
+    file->games++;
+    selections++;
+    file->last_used = selections;
+    current_file = file;
+    return file->fp;
+}
+
+/* Return the number of games written to the most recently
+ * selected file, including the current one.
+ */
+unsigned long
+games_in_cached_output_file(void)
+{
+    return current_file != NULL ? current_file->games : 0;
+}
+
+/* Close all of the output files, terminating the JSON array
+ * of each that has had games written to it.
+ */
+void
+close_cached_output_files(void)
+{
+    unsigned ix;
+
+    for (ix = 0; ix < OUTPUT_FILE_TABLE_SIZE; ix++) {
+        OutputFile *file = output_files[ix];
+        while (file != NULL) {
+            OutputFile *next = file->next;
+            if (GlobalState.json_format && file->games > 0) {
+                if (file->fp == NULL) {
+                    file->fp = must_open_file(file->filename, "a");
+                }
+                fputs("\n]\n", file->fp);
+            }
+            if (file->fp != NULL) {
+                (void) fclose(file->fp);
+            }
+            (void) free((void *) file->filename);
+            (void) free((void *) file);
+            file = next;
+        }
+        output_files[ix] = NULL;
+    }
+    num_open_files = 0;
+    current_file = NULL;
+}
@@ -0,0 +1,749 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* Processing of the input by several worker processes (--threads).
+ *
+ * The parent process reads each input file and divides it into
+ * sections at game boundaries. Each section is handed to one of the
+ * workers, which parses, checks, matches and formats its games exactly
+ * as a single process would. For each game, the worker sends back
+ * an outcome: whether the game matched, its hash values, its formatted
+ * text and any messages logged while dealing with it.
+ * The parent collects the outcomes strictly in input order and does
+ * everything that depends on the games that came before:
+ * duplicate detection, game numbering, choice of output file and
+ * the output itself. The result is the same as without --threads.
+ *
+ * Workers are processes rather than threads because the parsing
+ * and matching state is held in global variables.
+ */
+
+/* For fdopen(), fileno() and open_memstream() with -std=c99. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+#define WORKER_PROCESSES
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "tokens.h"
+#include "taglist.h"
+#include "lex.h"
+#include "grammar.h"
+#include "parallel.h"
+#include "gameindex.h"
+#include "lines.h"
+
+#ifdef WORKER_PROCESSES
+
+/* The approximate size in bytes of each section of
+ * input handed to a worker.
+ */
+#define SECTION_SIZE (256 * 1024)
+/* How many sections each worker may have outstanding. */
+#define SECTIONS_PER_WORKER 4
+
+/* The description of a section of an input file sent to a worker. */
+typedef struct {
+    unsigned file_number;
+    long start, length;
+    /* The number of lines in the file before the section. */
+    unsigned long lines_before;
+    /* Whether the end of the section is the start of another game. */
+    Boolean ends_at_game_boundary;
+} Section;
+
+/* The kinds of record sent from a worker to the parent. */
+typedef enum {
+    GAME_RECORD, END_OF_SECTION_RECORD
+} RecordKind;
+
+/* The fixed part of a record sent from a worker to the parent.
+ * It is followed by the strings whose lengths it holds.
+ */
+typedef struct {
+    RecordKind kind;
+    Boolean wanted, non_matching_ok;
+    unsigned plycount;
+    long start_offset;
+    HashCode final_hash_value;
+    HashCode cumulative_hash_value;
+    HashCode fuzzy_duplicate_hash;
+    /* NO_STRING for strings that are NULL. */
+    size_t eco_length, details_length, text_length;
+    size_t parse_log_length, deal_log_length, output_log_length;
+} Record;
+
+#define NO_STRING ((size_t) -1)
+
+/* An entry in the queue of sections awaiting collection by the parent. */
+typedef struct {
+    unsigned file_number;
+    /* The worker processing the section, or -1 if the entry
+     * just marks the start of the file.
+     */
+    int worker;
+    /* Whether the file could not be opened. */
+    Boolean unopenable;
+} PendingSection;
+
+/* The parent's view of a worker. */
+typedef struct {
+    pid_t pid;
+    /* For sending sections. */
+    int task_fd;
+    /* For receiving records. */
+    FILE *results;
+} Worker;
+
+static Worker *workers = NULL;
+static unsigned num_workers = 0;
+/* The next worker to be given a section. */
+static unsigned next_worker = 0;
+
+/* The queue of sections in input order. */
+static PendingSection *pending = NULL;
+static unsigned max_pending = 0;
+static unsigned first_pending = 0;
+static unsigned num_pending = 0;
+
+/* The number of the file whose games were most recently collected. */
+static unsigned current_file = 0;
+/* Whether processing has finished before the end of the input. */
+static Boolean stopped = FALSE;
+
+/* In a worker: where records are sent. */
+static FILE *record_output = NULL;
+/* In a worker: the capture of GlobalState.logfile. */
+static char *log_buffer = NULL;
+static size_t log_size = 0;
+/* Where the messages of the current game start in log_buffer. */
+static size_t game_log_start = 0;
+/* Where the messages of the current game's parsing and matching
+ * end in log_buffer, or NO_STRING if not yet known.
+ */
+static size_t parse_log_end = NO_STRING;
+static size_t deal_log_end = NO_STRING;
+/* The string gathered by the stream from open_string_output. */
+static char *string_output = NULL;
+static size_t string_output_size = 0;
+
+static void start_workers(void);
+static void stop_workers(void);
+static void run_worker(int task_fd, int result_fd);
+static void start_log_capture(void);
+static void send_record(const Record *record, const char *eco,
+                        const char *details, const char *text);
+static void send_end_of_section(void);
+static void divide_file(unsigned file_number, Boolean last_file);
+static void add_section(unsigned file_number, long start, long length,
+                        unsigned long lines_before, Boolean ends_at_game_boundary);
+static void add_pending(unsigned file_number, int worker, Boolean unopenable);
+static void collect_section(void);
+static char *read_record_string(FILE *fp, size_t length);
+static void read_fully(FILE *fp, void *data, size_t length);
+static void write_fully(int fd, const void *data, size_t length);
+
+/* Return TRUE if the input can be processed by worker processes.
+ * Every input file must be a regular file, which excludes
+ * standard input, and game order must not affect the output format.
+ */
+Boolean
+can_process_in_parallel(void)
+{
+    unsigned file_number;
+    const char *filename;
+
+    if (GlobalState.json_format) {
+        fprintf(GlobalState.logfile,
+                "--threads is not supported with --json: the games will be processed serially.\n");
+        return FALSE;
+    }
+    if (GlobalState.build_position_index != NULL) {
+        fprintf(GlobalState.logfile,
+                "--threads is not supported with --buildposindex: the games will be processed serially.\n");
+        return FALSE;
+    }
+    if (input_file_name(0) == NULL) {
+        fprintf(GlobalState.logfile,
+                "--threads requires named input files: the games will be processed serially.\n");
+        return FALSE;
+    }
+    for (file_number = 0; (filename = input_file_name(file_number)) != NULL;
+            file_number++) {
+        struct stat info;
+        /* Files that do not exist are reported when their turn comes. */
+        if (stat(filename, &info) == 0 && !S_ISREG(info.st_mode)) {
+            fprintf(GlobalState.logfile,
+                    "--threads requires regular input files: the games will be processed serially.\n");
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Process all the input files using GlobalState.num_threads
+ * worker processes.
+ * The first file has already been opened by open_first_file.
+ */
+void
+process_games_in_parallel(void)
+{
+    unsigned file_number;
+
+    /* The input is read afresh in sections. */
+    terminate_input();
+
+    num_workers = GlobalState.num_threads;
+    max_pending = num_workers * SECTIONS_PER_WORKER;
+    pending = (PendingSection *) malloc_or_die(max_pending * sizeof (*pending));
+    start_workers();
+
+    for (file_number = 0; input_file_name(file_number) != NULL && !stopped;
+            file_number++) {
+        divide_file(file_number, input_file_name(file_number + 1) == NULL);
+    }
+    while (num_pending > 0 && !stopped) {
+        collect_section();
+    }
+
+    stop_workers();
+    (void) free((void *) pending);
+    pending = NULL;
+}
+
+/* Divide the given input file into sections, each of which starts
+ * with the tags of a game, and queue them for the workers.
+ * The file is scanned in just enough detail to avoid mistaking
+ * text in comments for the start of a game (see find_next_game).
+ */
+static void
+divide_file(unsigned file_number, Boolean last_file)
+{
+    const char *filename = input_file_name(file_number);
+    struct stat info;
+    const char *text;
+    size_t size;
+    GameScanner scanner;
+    size_t section_start = 0;
+    unsigned long section_lines_before = 0;
+    size_t game_start;
+    unsigned long game_lines_before;
+
+    if (stat(filename, &info) == 0 && info.st_size == 0) {
+        /* There are no games. */
+        add_pending(file_number, -1, FALSE);
+        return;
+    }
+    text = read_whole_file(filename, &size);
+    if (text == NULL) {
+        add_pending(file_number, -1, TRUE);
+        return;
+    }
+
+    start_game_scan(&scanner, text, size);
+    while (!stopped && find_next_game(&scanner, &game_start, &game_lines_before)) {
+        if (game_start - section_start >= SECTION_SIZE) {
+            add_section(file_number, (long) section_start,
+                    (long) (game_start - section_start),
+                    section_lines_before, TRUE);
+            section_start = game_start;
+            section_lines_before = game_lines_before;
+        }
+    }
+    if (!stopped) {
+        add_section(file_number, (long) section_start,
+                (long) (size - section_start), section_lines_before, !last_file);
+    }
+    release_whole_file(text, size);
+}
+
+/* Queue the given section and send it to the next worker. */
+static void
+add_section(unsigned file_number, long start, long length,
+            unsigned long lines_before, Boolean ends_at_game_boundary)
+{
+    Section section;
+
+    section.file_number = file_number;
+    section.start = start;
+    section.length = length;
+    section.lines_before = lines_before;
+    section.ends_at_game_boundary = ends_at_game_boundary;
+
+    add_pending(file_number, (int) next_worker, FALSE);
+    if (!stopped) {
+        write_fully(workers[next_worker].task_fd, &section, sizeof (section));
+        next_worker = (next_worker + 1) % num_workers;
+    }
+}
+
+/* Add an entry to the queue of sections, first making room by
+ * collecting the oldest if necessary.
+ */
+static void
+add_pending(unsigned file_number, int worker, Boolean unopenable)
+{
+    PendingSection *entry;
+
+    while (num_pending == max_pending && !stopped) {
+        collect_section();
+    }
+    if (!stopped) {
+        entry = &pending[(first_pending + num_pending) % max_pending];
+        entry->file_number = file_number;
+        entry->worker = worker;
+        entry->unopenable = unopenable;
+        num_pending++;
+    }
+}
+
+/* Collect the outcomes of the games in the oldest queued section
+ * and deal with them in order.
+ */
+static void
+collect_section(void)
+{
+    PendingSection entry = pending[first_pending];
+    Boolean end_of_section = FALSE;
+
+    first_pending = (first_pending + 1) % max_pending;
+    num_pending--;
+
+    if (entry.file_number != current_file) {
+        current_file = entry.file_number;
+        if (!entry.unopenable && GlobalState.verbosity > 1) {
+            fprintf(GlobalState.logfile, "Processing %s\n",
+                    input_file_name(current_file));
+        }
+    }
+    if (entry.unopenable) {
+        fprintf(GlobalState.logfile,
+                "Unable to open the PGN file: %s\n", input_file_name(entry.file_number));
+        stopped = TRUE;
+        return;
+    }
+    if (entry.worker < 0) {
+        return;
+    }
+
+    while (!end_of_section) {
+        FILE *results = workers[entry.worker].results;
+        Record record;
+        GameOutcome outcome;
+        char *parse_log, *deal_log;
+
+        read_fully(results, &record, sizeof (record));
+        parse_log = read_record_string(results, record.parse_log_length);
+        deal_log = read_record_string(results, record.deal_log_length);
+        outcome.output_messages = read_record_string(results, record.output_log_length);
+        if (record.kind == END_OF_SECTION_RECORD) {
+            fputs(parse_log, GlobalState.logfile);
+            end_of_section = TRUE;
+        }
+        else {
+            outcome.wanted = record.wanted;
+            outcome.non_matching_ok = record.non_matching_ok;
+            outcome.plycount = record.plycount;
+            outcome.start_offset = record.start_offset;
+            outcome.final_hash_value = record.final_hash_value;
+            outcome.cumulative_hash_value = record.cumulative_hash_value;
+            outcome.fuzzy_duplicate_hash = record.fuzzy_duplicate_hash;
+            outcome.eco = read_record_string(results, record.eco_length);
+            outcome.details = read_record_string(results, record.details_length);
+            outcome.text = read_record_string(results, record.text_length);
+            outcome.text_length = outcome.text != NULL ? record.text_length : 0;
+
+            fputs(parse_log, GlobalState.logfile);
+            if (finished_processing()) {
+                stopped = TRUE;
+                end_of_section = TRUE;
+            }
+            else {
+                fputs(deal_log, GlobalState.logfile);
+                set_current_file(entry.file_number);
+                deal_with_game_outcome(&outcome);
+            }
+            if (outcome.eco != NULL) {
+                (void) free((void *) outcome.eco);
+            }
+            if (outcome.details != NULL) {
+                (void) free((void *) outcome.details);
+            }
+            if (outcome.text != NULL) {
+                (void) free((void *) outcome.text);
+            }
+        }
+        (void) free((void *) parse_log);
+        (void) free((void *) outcome.output_messages);
+        (void) free((void *) deal_log);
+    }
+}
+
+/* Read a string of the given length sent by a worker.
+ * Return NULL if the length is NO_STRING.
+ */
+static char *
+read_record_string(FILE *fp, size_t length)
+{
+    if (length == NO_STRING) {
+        return NULL;
+    }
+    else {
+        char *str = (char *) malloc_or_die(length + 1);
+        read_fully(fp, str, length);
+        str[length] = '\0';
+        return str;
+    }
+}
+
+static void
+read_fully(FILE *fp, void *data, size_t length)
+{
+    if (length > 0 && fread(data, 1, length, fp) != length) {
+        fprintf(GlobalState.logfile, "A worker process failed.\n");
+        exit(1);
+    }
+}
+
+static void
+write_fully(int fd, const void *data, size_t length)
+{
+    const char *p = (const char *) data;
+
+    while (length > 0) {
+        ssize_t written = write(fd, p, length);
+        if (written <= 0) {
+            fprintf(GlobalState.logfile, "A worker process failed.\n");
+            exit(1);
+        }
+        p += written;
+        length -= (size_t) written;
+    }
+}
+
+/* Create the worker processes. */
+static void
+start_workers(void)
+{
+    unsigned w;
+
+    workers = (Worker *) malloc_or_die(num_workers * sizeof (*workers));
+    /* Nothing buffered should be written twice. */
+    (void) fflush(NULL);
+    for (w = 0; w < num_workers; w++) {
+        int task_pipe[2], result_pipe[2];
+        pid_t pid;
+
+        if (pipe(task_pipe) != 0 || pipe(result_pipe) != 0) {
+            fprintf(GlobalState.logfile, "Unable to create a worker process.\n");
+            exit(1);
+        }
+        pid = fork();
+        if (pid < 0) {
+            fprintf(GlobalState.logfile, "Unable to create a worker process.\n");
+            exit(1);
+        }
+        else if (pid == 0) {
+            unsigned earlier;
+
+            /* Release the parent's ends of the pipes so that
+             * each worker sees the end of its tasks.
+             */
+            for (earlier = 0; earlier < w; earlier++) {
+                (void) close(workers[earlier].task_fd);
+                (void) close(fileno(workers[earlier].results));
+            }
+            (void) close(task_pipe[1]);
+            (void) close(result_pipe[0]);
+            run_worker(task_pipe[0], result_pipe[1]);
+        }
+        else {
+            (void) close(task_pipe[0]);
+            (void) close(result_pipe[1]);
+            workers[w].pid = pid;
+            workers[w].task_fd = task_pipe[1];
+            workers[w].results = fdopen(result_pipe[0], "rb");
+            if (workers[w].results == NULL) {
+                fprintf(GlobalState.logfile, "Unable to create a worker process.\n");
+                exit(1);
+            }
+        }
+    }
+}
+
+/* Tell the workers that there are no more sections and
+ * wait for them to finish.
+ */
+static void
+stop_workers(void)
+{
+    unsigned w;
+
+    for (w = 0; w < num_workers; w++) {
+        (void) close(workers[w].task_fd);
+        (void) fclose(workers[w].results);
+    }
+    for (w = 0; w < num_workers; w++) {
+        int status;
+        (void) waitpid(workers[w].pid, &status, 0);
+    }
+    (void) free((void *) workers);
+    workers = NULL;
+}
+
+/* The body of a worker process.
+ * Process each section received on task_fd and send the
+ * outcomes of its games on result_fd.
+ */
+static void
+run_worker(int task_fd, int result_fd)
+{
+    Section section;
+    FILE *tasks = fdopen(task_fd, "rb");
+
+    record_output = fdopen(result_fd, "wb");
+    if (tasks == NULL || record_output == NULL) {
+        _exit(1);
+    }
+    while (fread(&section, sizeof (section), 1, tasks) == 1) {
+        start_log_capture();
+        if (open_input_section(section.file_number, section.start,
+                    section.length, section.lines_before)) {
+            parse_input_section(GlobalState.current_file_type,
+                    section.ends_at_game_boundary);
+            close_input_section();
+        }
+        else {
+            fprintf(GlobalState.logfile, "Unable to read the PGN file: %s\n",
+                    input_file_name(section.file_number));
+        }
+        send_end_of_section();
+    }
+    (void) fflush(record_output);
+    _exit(0);
+}
+
+/* Capture the messages logged while processing a section. */
+static void
+start_log_capture(void)
+{
+    if (record_output == NULL) {
+        /* Not a worker. */
+        return;
+    }
+    if (log_buffer != NULL) {
+        (void) fclose(GlobalState.logfile);
+        (void) free((void *) log_buffer);
+        log_buffer = NULL;
+    }
+    GlobalState.logfile = open_memstream(&log_buffer, &log_size);
+    if (GlobalState.logfile == NULL) {
+        _exit(1);
+    }
+    game_log_start = 0;
+    parse_log_end = NO_STRING;
+    deal_log_end = NO_STRING;
+}
+
+/* Note that the messages about parsing the current game
+ * have all been logged.
+ */
+void
+end_of_parsing_messages(void)
+{
+    (void) fflush(GlobalState.logfile);
+    parse_log_end = log_size;
+}
+
+/* Note that the messages about matching the current game
+ * have all been logged. Any that follow concern its output.
+ */
+void
+end_of_matching_messages(void)
+{
+    (void) fflush(GlobalState.logfile);
+    deal_log_end = log_size;
+}
+
+/* Send the outcome of a game to the parent. */
+void
+send_game_outcome(const GameOutcome *outcome)
+{
+    Record record;
+
+    record.kind = GAME_RECORD;
+    record.wanted = outcome->wanted;
+    record.non_matching_ok = outcome->non_matching_ok;
+    record.plycount = outcome->plycount;
+    record.start_offset = outcome->start_offset;
+    record.final_hash_value = outcome->final_hash_value;
+    record.cumulative_hash_value = outcome->cumulative_hash_value;
+    record.fuzzy_duplicate_hash = outcome->fuzzy_duplicate_hash;
+    record.eco_length = outcome->eco != NULL ? strlen(outcome->eco) : NO_STRING;
+    record.details_length = outcome->details != NULL ?
+            strlen(outcome->details) : NO_STRING;
+    record.text_length = outcome->text != NULL ? outcome->text_length : NO_STRING;
+    send_record(&record, outcome->eco, outcome->details, outcome->text);
+}
+
+/* Send the messages logged since the last game of the section. */
+static void
+send_end_of_section(void)
+{
+    Record record;
+
+    memset((void *) &record, 0, sizeof (record));
+    record.kind = END_OF_SECTION_RECORD;
+    record.eco_length = NO_STRING;
+    record.details_length = NO_STRING;
+    record.text_length = NO_STRING;
+    send_record(&record, NULL, NULL, NULL);
+    (void) fflush(record_output);
+}
+
+/* Complete record with the logged messages and send it,
+ * followed by the given strings.
+ */
+static void
+send_record(const Record *record, const char *eco,
+            const char *details, const char *text)
+{
+    Record complete = *record;
+    size_t log_end;
+
+    (void) fflush(GlobalState.logfile);
+    log_end = log_size;
+    if (parse_log_end == NO_STRING) {
+        parse_log_end = log_end;
+    }
+    if (deal_log_end == NO_STRING) {
+        deal_log_end = log_end;
+    }
+    complete.parse_log_length = parse_log_end - game_log_start;
+    complete.deal_log_length = deal_log_end - parse_log_end;
+    complete.output_log_length = log_end - deal_log_end;
+
+    if (fwrite(&complete, sizeof (complete), 1, record_output) != 1 ||
+            fwrite(&log_buffer[game_log_start], 1, log_end - game_log_start,
+                   record_output) != log_end - game_log_start) {
+        _exit(1);
+    }
+    if (eco != NULL) {
+        (void) fwrite(eco, 1, complete.eco_length, record_output);
+    }
+    if (details != NULL) {
+        (void) fwrite(details, 1, complete.details_length, record_output);
+    }
+    if (text != NULL) {
+        (void) fwrite(text, 1, complete.text_length, record_output);
+    }
+    game_log_start = log_end;
+    parse_log_end = NO_STRING;
+    deal_log_end = NO_STRING;
+}
+
+/* Return a stream whose output is gathered into a string.
+ * Only one such stream may be open at a time.
+ */
+FILE *
+open_string_output(void)
+{
+    FILE *fp;
+
+    string_output = NULL;
+    string_output_size = 0;
+    fp = open_memstream(&string_output, &string_output_size);
+    if (fp == NULL) {
+        fprintf(GlobalState.logfile, "Unable to allocate an output buffer.\n");
+        exit(1);
+    }
+    return fp;
+}
+
+/* Close fp, opened by open_string_output, and return the string
+ * written to it, which the caller must free.
+ * Its length is returned in length.
+ */
+char *
+close_string_output(FILE *fp, size_t *length)
+{
+    (void) fclose(fp);
+    *length = string_output_size;
+    return string_output;
+}
+
+#else
+
+Boolean
+can_process_in_parallel(void)
+{
+    fprintf(GlobalState.logfile,
+            "--threads is not supported on this platform: the games will be processed serially.\n");
+    return FALSE;
+}
+
+void
+process_games_in_parallel(void)
+{
+}
+
+/* Worker processes are never used, so the remaining functions
+ * are never called.
+ */
+FILE *
+open_string_output(void)
+{
+    return NULL;
+}
+
+char *
+close_string_output(FILE *fp, size_t *length)
+{
+    *length = 0;
+    return NULL;
+}
+
+void
+end_of_parsing_messages(void)
+{
+}
+
+void
+end_of_matching_messages(void)
+{
+}
+
+void
+send_game_outcome(const GameOutcome *outcome)
+{
+}
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+Boolean can_process_in_parallel(void);
+void process_games_in_parallel(void);
+FILE *open_string_output(void);
+char *close_string_output(FILE *fp, size_t *length);
+void end_of_parsing_messages(void);
+void end_of_matching_messages(void);
+void send_game_outcome(const GameOutcome *outcome);
+
+#endif	// PARALLEL_H
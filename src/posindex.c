@@ -0,0 +1,1163 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* An index of the positions reached by the games of the input files
+ * (--buildposindex), used to read only the games that might reach
+ * a position of interest (--useposindex).
+ *
+ * Building the index replays every game, including its variations,
+ * and records the polyglot hash value of each position against the
+ * section of the input file that holds the game. A section starts on
+ * the line of the game's first tag and ends where the next game
+ * starts, so it normally holds a single game; a game that starts on
+ * the line where the previous one ended shares its section.
+ * The number of games in each section is kept so that the count of
+ * games processed is the same as when every game is read.
+ * The entries are gathered in sorted runs, which are spilled to
+ * temporary files when they grow large and merged when the index
+ * is written.
+ *
+ * The file starts with a PositionIndexHeader, which is followed by
+ * a PositionIndexFile for each input file, their nul-terminated names,
+ * the PositionIndexSections, the blocks of entries and then a
+ * PositionIndexBlock for each block.
+ * The entries are in order of hash value and then section, and each
+ * block holds POSITION_BLOCK_ENTRIES of them, apart from the last.
+ * The first hash value of a block is held in its PositionIndexBlock
+ * and the block holds the section of the first entry followed by,
+ * for each of the others, the difference between its hash value and
+ * the previous one and then either its section or, if the hash values
+ * are the same, the difference from the previous section.
+ * These are stored as variable-length numbers of seven bits per byte.
+ * Other values are stored in the byte order of the machine.
+ *
+ * Positions given as -H hash values are looked up directly.
+ * Those given by FEN or moves (-t, -x) are matched regardless of
+ * castling rights, en passant and the player to move, so every
+ * combination of those is looked up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "lines.h"
+#include "defs.h"
+#include "typedef.h"
+#include "tokens.h"
+#include "taglist.h"
+#include "lex.h"
+#include "grammar.h"
+#include "apply.h"
+#include "zobrist.h"
+#include "fenmatcher.h"
+#include "posindex.h"
+
+#define POSITION_INDEX_MAGIC "PGNXPOS2"
+/* The number of entries in each block of the index. */
+#define POSITION_BLOCK_ENTRIES 1024
+/* The number of entries gathered in memory before they are
+ * spilled to a run.
+ */
+#define POSITION_RUN_ENTRIES (1 << 22)
+/* The number of entries read at a time from each run when merging. */
+#define RUN_BUFFER_ENTRIES 4096
+/* The most bytes of a variable-length 64-bit number. */
+#define MAX_NUMBER_BYTES 10
+
+typedef struct {
+    char magic[8];
+    uint64_t byte_order;
+    uint64_t num_files, names_length;
+    uint64_t num_sections;
+    uint64_t num_entries, num_blocks;
+    /* Offsets from the start of the file. */
+    uint64_t sections_offset, blocks_offset, directory_offset;
+} PositionIndexHeader;
+
+/* The details of an input file, which must be unchanged
+ * for the index to be used.
+ */
+typedef struct {
+    uint64_t size;
+    int64_t modified;
+} PositionIndexFile;
+
+/* The part of an input file that holds one or more games. */
+typedef struct {
+    uint64_t start, length;
+    /* The number of lines in the file before the section. */
+    uint64_t lines_before;
+    uint32_t file_number;
+    /* The number of games that start in the section. */
+    uint32_t num_games;
+} PositionIndexSection;
+
+typedef struct {
+    uint64_t first_key;
+    /* The offset of the block from blocks_offset. */
+    uint64_t offset;
+} PositionIndexBlock;
+
+typedef struct {
+    uint64_t key;
+    uint32_t section;
+    uint32_t reserved;
+} PositionEntry;
+
+/* A run of sorted entries being merged: either those held in
+ * memory (fp == NULL) or those spilled to fp.
+ */
+typedef struct {
+    FILE *fp;
+    PositionEntry *entries;
+    size_t length, next;
+} RunCursor;
+
+/* The file being written and how much has been written to it. */
+typedef struct {
+    FILE *fp;
+    uint64_t offset;
+    Boolean ok;
+} IndexWriter;
+
+/* An index read for use. */
+typedef struct {
+    const char *contents;
+    size_t size;
+    const PositionIndexHeader *header;
+    const PositionIndexFile *files;
+    const char *names;
+    const PositionIndexSection *sections;
+    const unsigned char *blocks;
+    const PositionIndexBlock *directory;
+} PositionIndex;
+
+/* The entries not yet spilled to a run. */
+static PositionEntry *run_entries = NULL;
+static size_t num_run_entries = 0;
+/* The runs spilled so far. */
+static FILE **runs = NULL;
+static unsigned num_runs = 0;
+/* The completed sections, in order. */
+static FILE *section_file = NULL;
+static uint32_t num_sections = 0;
+/* The section of the most recent game, whose length is not yet known. */
+static PositionIndexSection last_section;
+static Boolean have_last_section = FALSE;
+/* The line on which the most recent game ended. */
+static unsigned long last_end_line = 0;
+/* Whether a game could not be indexed, so no index is to be written. */
+static Boolean index_incomplete = FALSE;
+/* Where messages about the moves are sent while they are replayed,
+ * as they are reported when the game is matched.
+ */
+static FILE *replay_log = NULL;
+
+/* The hash values of the positions of interest. */
+static uint64_t *target_keys = NULL;
+static size_t num_target_keys = 0;
+static size_t max_target_keys = 0;
+
+static void add_target_key(uint64_t key);
+static Boolean input_file_details(unsigned file_number, PositionIndexFile *details);
+static void end_last_section(long next_start);
+static void index_moves(Board *board, Move *moves, uint32_t section);
+static void add_entry(uint64_t key, uint32_t section);
+static int compare_entries(const void *e1, const void *e2);
+static size_t sort_entries(PositionEntry *entries, size_t length);
+static void spill_run(void);
+static Boolean entry_before(const RunCursor *r1, const RunCursor *r2);
+static void sift_down(RunCursor **heap, size_t length, size_t i);
+static Boolean advance_run(RunCursor *run);
+static void write_index_bytes(IndexWriter *writer, const void *data, size_t length);
+static void align_index(IndexWriter *writer);
+static void write_entries(IndexWriter *writer, PositionIndexHeader *header,
+                          PositionIndexBlock **directory);
+static size_t put_number(unsigned char *bytes, uint64_t value);
+static Boolean get_number(const unsigned char **p, const unsigned char *end, uint64_t *value);
+static void free_index_building(void);
+static void release_position_index(PositionIndex *index);
+static Boolean valid_position_index(PositionIndex *index);
+static Boolean index_describes_input(const PositionIndex *index);
+static Boolean look_up_position(const PositionIndex *index, uint64_t key,
+                                uint32_t **sections, size_t *num_found, size_t *max_found);
+static int compare_keys(const void *k1, const void *k2);
+static int compare_section_numbers(const void *s1, const void *s2);
+
+static void
+add_target_key(uint64_t key)
+{
+    if (num_target_keys == max_target_keys) {
+        max_target_keys = max_target_keys == 0 ? 64 : 2 * max_target_keys;
+        target_keys = (uint64_t *) realloc_or_die((void *) target_keys,
+                max_target_keys * sizeof (*target_keys));
+    }
+    target_keys[num_target_keys] = key;
+    num_target_keys++;
+}
+
+/* Note the polyglot hash value of a position of interest (-H). */
+void
+add_position_index_hash(uint64_t hash)
+{
+    add_target_key(hash);
+}
+
+/* Note a position of interest whose pieces are those of board,
+ * with any castling rights, en passant square and player to move.
+ */
+void
+add_position_index_board(const Board *board)
+{
+    Board variant = *board;
+    unsigned rights;
+    Col ep_col;
+    int side;
+
+    for (side = 0; side < 2; side++) {
+        variant.to_move = side == 0 ? WHITE : BLACK;
+        for (rights = 0; rights < 16; rights++) {
+            variant.WKingCastle = (rights & 1) ? LASTCOL : '\0';
+            variant.WQueenCastle = (rights & 2) ? FIRSTCOL : '\0';
+            variant.BKingCastle = (rights & 4) ? LASTCOL : '\0';
+            variant.BQueenCastle = (rights & 8) ? FIRSTCOL : '\0';
+            set_zobrist_hash(&variant);
+            variant.EnPassant = FALSE;
+            add_target_key(generate_zobrist_hash_from_board(&variant));
+            /* The hash value only includes an en passant square
+             * at which a capture is possible.
+             */
+            variant.EnPassant = TRUE;
+            for (ep_col = FIRSTCOL; ep_col <= LASTCOL; ep_col++) {
+                variant.ep_col = ep_col;
+                add_target_key(generate_zobrist_hash_from_board(&variant));
+            }
+        }
+    }
+}
+
+/* Set details from the current state of the given input file.
+ * Return FALSE if it cannot be found.
+ */
+static Boolean
+input_file_details(unsigned file_number, PositionIndexFile *details)
+{
+    struct stat info;
+
+    if (stat(input_file_name(file_number), &info) != 0) {
+        return FALSE;
+    }
+    details->size = (uint64_t) info.st_size;
+    details->modified = (int64_t) info.st_mtime;
+    return TRUE;
+}
+
+/* Complete last_section, which ends at next_start or, if that
+ * is negative, at the end of its file, and keep it.
+ */
+static void
+end_last_section(long next_start)
+{
+    if (next_start >= 0) {
+        last_section.length = (uint64_t) next_start - last_section.start;
+    }
+    else {
+        PositionIndexFile details;
+        if (input_file_details(last_section.file_number, &details) &&
+                details.size >= last_section.start) {
+            last_section.length = details.size - last_section.start;
+        }
+        else {
+            index_incomplete = TRUE;
+        }
+    }
+    if (section_file == NULL) {
+        section_file = tmpfile();
+    }
+    if (section_file == NULL ||
+            fwrite((void *) &last_section, sizeof (last_section), 1, section_file) != 1) {
+        fprintf(GlobalState.logfile,
+                "Unable to write a temporary file for the position index.\n");
+        exit(1);
+    }
+    have_last_section = FALSE;
+}
+
+/* Add the positions of game to the index being built (--buildposindex).
+ * start_offset is the offset in the given input file of the line
+ * on which the game starts, or -1 if it is not known, as when the
+ * input is not a regular file.
+ */
+void
+index_game_positions(const Game *game, unsigned file_number, long start_offset)
+{
+    FILE *logfile = GlobalState.logfile;
+    Board *board;
+    uint32_t section;
+
+    if (index_incomplete) {
+        return;
+    }
+    if (start_offset < 0 || input_file_name(file_number) == NULL) {
+        fprintf(GlobalState.logfile,
+                "--buildposindex requires named regular input files: no index will be written.\n");
+        index_incomplete = TRUE;
+        return;
+    }
+    if (have_last_section && last_section.file_number == file_number &&
+            game->start_line == last_end_line) {
+        /* The game starts where the previous one ended. */
+        last_section.num_games++;
+    }
+    else {
+        if (have_last_section) {
+            end_last_section(last_section.file_number == file_number ? start_offset : -1L);
+        }
+        last_section.start = (uint64_t) start_offset;
+        last_section.length = 0;
+        /* The lines of the file before the game, as the line numbers
+         * of the first file include those counted before it.
+         */
+        last_section.lines_before = game->start_line > lines_before_file(file_number) ?
+                game->start_line - 1 - lines_before_file(file_number) : 0;
+        last_section.file_number = file_number;
+        last_section.num_games = 1;
+        have_last_section = TRUE;
+        num_sections++;
+    }
+    last_end_line = game->end_line;
+    section = num_sections - 1;
+
+    if (replay_log == NULL) {
+        replay_log = tmpfile();
+    }
+    if (replay_log != NULL) {
+        rewind(replay_log);
+        GlobalState.logfile = replay_log;
+    }
+    board = new_game_board(game->tags[FEN_TAG]);
+    add_entry(generate_zobrist_hash_from_board(board), section);
+    index_moves(board, game->moves, section);
+    free_board(board);
+    GlobalState.logfile = logfile;
+}
+
+/* Play moves, and any variations, from board, adding the
+ * resulting positions to the given section.
+ */
+static void
+index_moves(Board *board, Move *moves, uint32_t section)
+{
+    Board *variation_board = NULL;
+    Move *move = moves;
+    Boolean ok = TRUE;
+
+    while (move != NULL && ok) {
+        if (*(move->move) != '\0') {
+            Variation *variation;
+
+            for (variation = move->Variants; variation != NULL;
+                    variation = variation->next) {
+                if (variation_board == NULL) {
+                    variation_board = (Board *) malloc_or_die(sizeof (*variation_board));
+                }
+                *variation_board = *board;
+                index_moves(variation_board, variation->moves, section);
+            }
+            ok = apply_move(move, board);
+            if (ok) {
+                add_entry(generate_zobrist_hash_from_board(board), section);
+            }
+        }
+        move = move->next;
+    }
+    if (variation_board != NULL) {
+        free_board(variation_board);
+    }
+}
+
+static void
+add_entry(uint64_t key, uint32_t section)
+{
+    PositionEntry *entry;
+
+    if (run_entries == NULL) {
+        run_entries = (PositionEntry *) malloc_or_die(POSITION_RUN_ENTRIES *
+                sizeof (*run_entries));
+    }
+    entry = &run_entries[num_run_entries];
+    entry->key = key;
+    entry->section = section;
+    entry->reserved = 0;
+    num_run_entries++;
+    if (num_run_entries == POSITION_RUN_ENTRIES) {
+        spill_run();
+    }
+}
+
+static int
+compare_entries(const void *e1, const void *e2)
+{
+    const PositionEntry *entry1 = (const PositionEntry *) e1;
+    const PositionEntry *entry2 = (const PositionEntry *) e2;
+
+    if (entry1->key != entry2->key) {
+        return entry1->key < entry2->key ? -1 : 1;
+    }
+    else if (entry1->section != entry2->section) {
+        return entry1->section < entry2->section ? -1 : 1;
+    }
+    else {
+        return 0;
+    }
+}
+
+/* Sort entries, removing duplicates, and return how many remain. */
+static size_t
+sort_entries(PositionEntry *entries, size_t length)
+{
+    size_t kept = 0;
+    size_t i;
+
+    qsort((void *) entries, length, sizeof (*entries), compare_entries);
+    for (i = 0; i < length; i++) {
+        if (kept == 0 || compare_entries(&entries[kept - 1], &entries[i]) != 0) {
+            entries[kept] = entries[i];
+            kept++;
+        }
+    }
+    return kept;
+}
+
+/* Sort the entries held in memory and spill them to a new run. */
+static void
+spill_run(void)
+{
+    size_t length = sort_entries(run_entries, num_run_entries);
+    FILE *fp = tmpfile();
+
+    if (fp == NULL ||
+            fwrite((void *) run_entries, sizeof (*run_entries), length, fp) != length) {
+        fprintf(GlobalState.logfile,
+                "Unable to write a temporary file for the position index.\n");
+        exit(1);
+    }
+    runs = (FILE **) realloc_or_die((void *) runs, (num_runs + 1) * sizeof (*runs));
+    runs[num_runs] = fp;
+    num_runs++;
+    num_run_entries = 0;
+}
+
+/* Whether the current entry of r1 comes before that of r2. */
+static Boolean
+entry_before(const RunCursor *r1, const RunCursor *r2)
+{
+    return compare_entries(&r1->entries[r1->next], &r2->entries[r2->next]) < 0;
+}
+
+/* Restore the order of the heap of runs below position i. */
+static void
+sift_down(RunCursor **heap, size_t length, size_t i)
+{
+    for (;;) {
+        size_t least = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+        RunCursor *swap;
+
+        if (left < length && entry_before(heap[left], heap[least])) {
+            least = left;
+        }
+        if (right < length && entry_before(heap[right], heap[least])) {
+            least = right;
+        }
+        if (least == i) {
+            return;
+        }
+        swap = heap[i];
+        heap[i] = heap[least];
+        heap[least] = swap;
+        i = least;
+    }
+}
+
+/* Move to the next entry of run.
+ * Return FALSE if there are no more.
+ */
+static Boolean
+advance_run(RunCursor *run)
+{
+    run->next++;
+    if (run->next >= run->length && run->fp != NULL) {
+        run->length = fread((void *) run->entries, sizeof (*run->entries),
+                RUN_BUFFER_ENTRIES, run->fp);
+        run->next = 0;
+    }
+    return run->next < run->length;
+}
+
+static void
+write_index_bytes(IndexWriter *writer, const void *data, size_t length)
+{
+    if (writer->ok && length > 0) {
+        writer->ok = fwrite(data, 1, length, writer->fp) == length;
+        writer->offset += length;
+    }
+}
+
+/* Pad the file to a multiple of eight bytes. */
+static void
+align_index(IndexWriter *writer)
+{
+    static const char padding[8] = { 0 };
+
+    write_index_bytes(writer, (const void *) padding,
+            (size_t) ((8 - writer->offset % 8) % 8));
+}
+
+/* Store value in bytes, seven bits at a time, and return how
+ * many bytes were used.
+ */
+static size_t
+put_number(unsigned char *bytes, uint64_t value)
+{
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        bytes[length] = (unsigned char) (value & 0x7f) | 0x80;
+        value >>= 7;
+        length++;
+    }
+    bytes[length] = (unsigned char) value;
+    return length + 1;
+}
+
+/* Read a number stored by put_number from *p, which must not pass end.
+ * Return FALSE if it is incomplete.
+ */
+static Boolean
+get_number(const unsigned char **p, const unsigned char *end, uint64_t *value)
+{
+    uint64_t result = 0;
+    unsigned shift = 0;
+
+    while (*p < end && shift < 7 * MAX_NUMBER_BYTES) {
+        unsigned char byte = **p;
+        (*p)++;
+        result |= (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return TRUE;
+        }
+        shift += 7;
+    }
+    return FALSE;
+}
+
+/* Merge the runs of entries and write them in blocks,
+ * returning the blocks in *directory.
+ */
+static void
+write_entries(IndexWriter *writer, PositionIndexHeader *header,
+              PositionIndexBlock **directory)
+{
+    RunCursor *cursors;
+    RunCursor **heap;
+    size_t heap_length = 0;
+    size_t max_blocks = 0;
+    unsigned num_cursors;
+    unsigned r;
+    PositionEntry previous;
+
+    header->num_entries = 0;
+    header->num_blocks = 0;
+    *directory = NULL;
+    memset((void *) &previous, 0, sizeof (previous));
+
+    if (num_runs > 0 && num_run_entries > 0) {
+        spill_run();
+    }
+    num_cursors = num_runs > 0 ? num_runs : 1;
+    cursors = (RunCursor *) malloc_or_die(num_cursors * sizeof (*cursors));
+    heap = (RunCursor **) malloc_or_die(num_cursors * sizeof (*heap));
+    if (num_runs == 0) {
+        cursors[0].fp = NULL;
+        cursors[0].entries = run_entries;
+        cursors[0].length = run_entries != NULL ?
+                sort_entries(run_entries, num_run_entries) : 0;
+        cursors[0].next = 0;
+    }
+    else {
+        for (r = 0; r < num_runs; r++) {
+            cursors[r].fp = runs[r];
+            cursors[r].entries = (PositionEntry *) malloc_or_die(RUN_BUFFER_ENTRIES *
+                    sizeof (*cursors[r].entries));
+            rewind(runs[r]);
+            cursors[r].length = fread((void *) cursors[r].entries,
+                    sizeof (*cursors[r].entries), RUN_BUFFER_ENTRIES, runs[r]);
+            cursors[r].next = 0;
+        }
+    }
+    for (r = 0; r < num_cursors; r++) {
+        if (cursors[r].length > 0) {
+            heap[heap_length] = &cursors[r];
+            heap_length++;
+        }
+    }
+    for (r = heap_length / 2; r > 0; r--) {
+        sift_down(heap, heap_length, r - 1);
+    }
+
+    while (heap_length > 0) {
+        const PositionEntry *entry = &heap[0]->entries[heap[0]->next];
+
+        /* Runs may hold the same entry. */
+        if (header->num_entries == 0 || compare_entries(entry, &previous) != 0) {
+            unsigned char bytes[2 * MAX_NUMBER_BYTES];
+            size_t length;
+
+            if (header->num_entries % POSITION_BLOCK_ENTRIES == 0) {
+                /* Start a new block. */
+                PositionIndexBlock *block;
+                if (header->num_blocks == max_blocks) {
+                    max_blocks = max_blocks == 0 ? 1024 : 2 * max_blocks;
+                    *directory = (PositionIndexBlock *) realloc_or_die((void *) *directory,
+                            max_blocks * sizeof (**directory));
+                }
+                block = &(*directory)[header->num_blocks];
+                block->first_key = entry->key;
+                block->offset = writer->offset - header->blocks_offset;
+                header->num_blocks++;
+                length = put_number(bytes, entry->section);
+            }
+            else if (entry->key == previous.key) {
+                length = put_number(bytes, 0);
+                length += put_number(&bytes[length], entry->section - previous.section);
+            }
+            else {
+                length = put_number(bytes, entry->key - previous.key);
+                length += put_number(&bytes[length], entry->section);
+            }
+            write_index_bytes(writer, (const void *) bytes, length);
+            previous = *entry;
+            header->num_entries++;
+        }
+        if (!advance_run(heap[0])) {
+            heap_length--;
+            heap[0] = heap[heap_length];
+        }
+        sift_down(heap, heap_length, 0);
+    }
+
+    if (num_runs > 0) {
+        for (r = 0; r < num_runs; r++) {
+            (void) free((void *) cursors[r].entries);
+        }
+    }
+    (void) free((void *) heap);
+    (void) free((void *) cursors);
+}
+
+/* Write the index of the games' positions to index_file, provided
+ * that every game of the input files has been indexed.
+ */
+void
+write_position_index(const char *index_file, Boolean all_games_read)
+{
+    PositionIndexHeader header;
+    PositionIndexFile *files = NULL;
+    PositionIndexBlock *directory = NULL;
+    IndexWriter writer;
+    char *temporary_file;
+    unsigned file_number;
+    Boolean ok = TRUE;
+
+    if (have_last_section) {
+        end_last_section(-1L);
+    }
+    if (!all_games_read) {
+        fprintf(GlobalState.logfile,
+                "Not all the games were read, so the position index %s was not written.\n",
+                index_file);
+        ok = FALSE;
+    }
+    else if (index_incomplete) {
+        ok = FALSE;
+    }
+    if (!ok) {
+        free_index_building();
+        return;
+    }
+
+    memset((void *) &header, 0, sizeof (header));
+    memcpy((void *) header.magic, POSITION_INDEX_MAGIC, sizeof (header.magic));
+    header.byte_order = NATIVE_BYTE_ORDER;
+    for (file_number = 0; input_file_name(file_number) != NULL; file_number++) {
+        files = (PositionIndexFile *) realloc_or_die((void *) files,
+                (file_number + 1) * sizeof (*files));
+        if (!input_file_details(file_number, &files[file_number])) {
+            ok = FALSE;
+        }
+        header.names_length += strlen(input_file_name(file_number)) + 1;
+    }
+    header.num_files = file_number;
+    header.num_sections = num_sections;
+
+    temporary_file = temporary_file_name(index_file);
+    writer.fp = ok ? fopen(temporary_file, "wb") : NULL;
+    writer.offset = 0;
+    writer.ok = writer.fp != NULL;
+    if (writer.ok) {
+        PositionIndexSection sections[256];
+        size_t count;
+
+        /* The header is written again when it is complete. */
+        write_index_bytes(&writer, (const void *) &header, sizeof (header));
+        if (header.num_files > 0) {
+            write_index_bytes(&writer, (const void *) files,
+                    (size_t) header.num_files * sizeof (*files));
+        }
+        for (file_number = 0; file_number < header.num_files; file_number++) {
+            const char *name = input_file_name(file_number);
+            write_index_bytes(&writer, (const void *) name, strlen(name) + 1);
+        }
+        align_index(&writer);
+        header.sections_offset = writer.offset;
+        if (section_file != NULL) {
+            rewind(section_file);
+            while ((count = fread((void *) sections, sizeof (sections[0]),
+                            sizeof (sections) / sizeof (sections[0]), section_file)) > 0) {
+                write_index_bytes(&writer, (const void *) sections,
+                        count * sizeof (sections[0]));
+            }
+        }
+        header.blocks_offset = writer.offset;
+        write_entries(&writer, &header, &directory);
+        align_index(&writer);
+        header.directory_offset = writer.offset;
+        if (header.num_blocks > 0) {
+            write_index_bytes(&writer, (const void *) directory,
+                    (size_t) header.num_blocks * sizeof (*directory));
+        }
+        writer.ok = writer.ok && fseek(writer.fp, 0L, SEEK_SET) == 0;
+        write_index_bytes(&writer, (const void *) &header, sizeof (header));
+        ok = fclose(writer.fp) == 0 && writer.ok;
+        if (ok) {
+            ok = replace_file(temporary_file, index_file);
+        }
+        else {
+            (void) remove(temporary_file);
+        }
+    }
+    else {
+        ok = FALSE;
+    }
+    if (!ok) {
+        fprintf(GlobalState.logfile, "Unable to write the position index %s\n", index_file);
+    }
+    else if (GlobalState.verbosity > 1) {
+        fprintf(GlobalState.logfile,
+                "The position index %s holds %lu positions of %lu sections.\n",
+                index_file, (unsigned long) header.num_entries,
+                (unsigned long) header.num_sections);
+    }
+
+    if (files != NULL) {
+        (void) free((void *) files);
+    }
+    if (directory != NULL) {
+        (void) free((void *) directory);
+    }
+    (void) free((void *) temporary_file);
+    free_index_building();
+}
+
+/* Release everything used to build the index. */
+static void
+free_index_building(void)
+{
+    unsigned r;
+
+    for (r = 0; r < num_runs; r++) {
+        (void) fclose(runs[r]);
+    }
+    if (runs != NULL) {
+        (void) free((void *) runs);
+        runs = NULL;
+    }
+    num_runs = 0;
+    if (run_entries != NULL) {
+        (void) free((void *) run_entries);
+        run_entries = NULL;
+    }
+    num_run_entries = 0;
+    if (section_file != NULL) {
+        (void) fclose(section_file);
+        section_file = NULL;
+    }
+    if (replay_log != NULL) {
+        (void) fclose(replay_log);
+        replay_log = NULL;
+    }
+}
+
+static void
+release_position_index(PositionIndex *index)
+{
+    release_whole_file(index->contents, index->size);
+}
+
+/* Set up the parts of index from its contents and check that
+ * they are consistent.
+ */
+static Boolean
+valid_position_index(PositionIndex *index)
+{
+    const PositionIndexHeader *header = (const PositionIndexHeader *) index->contents;
+    uint64_t size = index->size;
+    uint64_t names_offset, files_length;
+    uint64_t expected_blocks;
+    uint64_t n;
+    const char *name;
+
+    index->header = header;
+    if (memcmp(header->magic, POSITION_INDEX_MAGIC, sizeof (header->magic)) != 0 ||
+            header->byte_order != NATIVE_BYTE_ORDER ||
+            header->num_files > size || header->names_length > size ||
+            header->num_sections > size || header->num_blocks > size) {
+        return FALSE;
+    }
+    files_length = header->num_files * sizeof (PositionIndexFile);
+    names_offset = sizeof (*header) + files_length;
+    expected_blocks = (header->num_entries + POSITION_BLOCK_ENTRIES - 1) / POSITION_BLOCK_ENTRIES;
+    if (names_offset + header->names_length > header->sections_offset ||
+            header->sections_offset % 8 != 0 ||
+            header->sections_offset + header->num_sections * sizeof (PositionIndexSection) !=
+                    header->blocks_offset ||
+            header->blocks_offset > header->directory_offset ||
+            header->directory_offset % 8 != 0 ||
+            header->directory_offset + header->num_blocks * sizeof (PositionIndexBlock) != size ||
+            header->num_blocks != expected_blocks) {
+        return FALSE;
+    }
+    index->files = (const PositionIndexFile *) (index->contents + sizeof (*header));
+    index->names = index->contents + names_offset;
+    index->sections = (const PositionIndexSection *) (index->contents + header->sections_offset);
+    index->blocks = (const unsigned char *) (index->contents + header->blocks_offset);
+    index->directory = (const PositionIndexBlock *) (index->contents + header->directory_offset);
+
+    /* There must be a name for each file. */
+    name = index->names;
+    for (n = 0; n < header->num_files; n++) {
+        const char *end = memchr(name, '\0',
+                (size_t) (index->names + header->names_length - name));
+        if (end == NULL) {
+            return FALSE;
+        }
+        name = end + 1;
+    }
+    for (n = 0; n < header->num_sections; n++) {
+        const PositionIndexSection *section = &index->sections[n];
+        if (section->file_number >= header->num_files ||
+                section->start > index->files[section->file_number].size ||
+                section->length > index->files[section->file_number].size - section->start) {
+            return FALSE;
+        }
+    }
+    for (n = 0; n < header->num_blocks; n++) {
+        if (index->directory[n].offset >= header->directory_offset - header->blocks_offset ||
+                (n > 0 && index->directory[n].offset <= index->directory[n - 1].offset)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Return whether the files indexed are the input files, unchanged. */
+static Boolean
+index_describes_input(const PositionIndex *index)
+{
+    const char *name = index->names;
+    unsigned file_number;
+
+    for (file_number = 0; file_number < index->header->num_files; file_number++) {
+        PositionIndexFile details;
+
+        if (input_file_name(file_number) == NULL ||
+                strcmp(input_file_name(file_number), name) != 0 ||
+                input_file_type(file_number) != NORMALFILE ||
+                !input_file_details(file_number, &details) ||
+                details.size != index->files[file_number].size ||
+                details.modified != index->files[file_number].modified) {
+            return FALSE;
+        }
+        name += strlen(name) + 1;
+    }
+    return input_file_name(file_number) == NULL;
+}
+
+/* Add to *sections the sections of the index that hold the position
+ * with the given hash value.
+ * Return FALSE if the index is found to be corrupt.
+ */
+static Boolean
+look_up_position(const PositionIndex *index, uint64_t key,
+                 uint32_t **sections, size_t *num_found, size_t *max_found)
+{
+    const PositionIndexHeader *header = index->header;
+    size_t low = 0, high = (size_t) header->num_blocks;
+    size_t block;
+    Boolean passed = FALSE;
+
+    /* Find the first block whose first hash value is not less than key.
+     * Entries for key may also end the block before it.
+     */
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index->directory[mid].first_key < key) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    block = low > 0 ? low - 1 : 0;
+
+    for (; block < header->num_blocks && !passed; block++) {
+        const unsigned char *p = index->blocks + index->directory[block].offset;
+        const unsigned char *end = index->blocks +
+                (block + 1 < header->num_blocks ? index->directory[block + 1].offset :
+                 header->directory_offset - header->blocks_offset);
+        uint64_t entry_key = index->directory[block].first_key;
+        uint64_t section = 0;
+        uint64_t count = block + 1 < header->num_blocks ? POSITION_BLOCK_ENTRIES :
+                header->num_entries - block * (uint64_t) POSITION_BLOCK_ENTRIES;
+        uint64_t e;
+
+        for (e = 0; e < count && !passed; e++) {
+            uint64_t value;
+
+            if (e == 0) {
+                if (!get_number(&p, end, &section)) {
+                    return FALSE;
+                }
+            }
+            else if (!get_number(&p, end, &value)) {
+                return FALSE;
+            }
+            else if (value == 0) {
+                uint64_t difference;
+                if (!get_number(&p, end, &difference)) {
+                    return FALSE;
+                }
+                section += difference;
+            }
+            else {
+                entry_key += value;
+                if (!get_number(&p, end, &section)) {
+                    return FALSE;
+                }
+            }
+            if (section >= header->num_sections) {
+                return FALSE;
+            }
+            if (entry_key == key) {
+                if (*num_found == *max_found) {
+                    *max_found = *max_found == 0 ? 64 : 2 * *max_found;
+                    *sections = (uint32_t *) realloc_or_die((void *) *sections,
+                            *max_found * sizeof (**sections));
+                }
+                (*sections)[*num_found] = (uint32_t) section;
+                (*num_found)++;
+            }
+            else if (entry_key > key) {
+                passed = TRUE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+static int
+compare_keys(const void *k1, const void *k2)
+{
+    uint64_t key1 = *(const uint64_t *) k1;
+    uint64_t key2 = *(const uint64_t *) k2;
+
+    return key1 < key2 ? -1 : (key1 > key2 ? 1 : 0);
+}
+
+static int
+compare_section_numbers(const void *s1, const void *s2)
+{
+    uint32_t section1 = *(const uint32_t *) s1;
+    uint32_t section2 = *(const uint32_t *) s2;
+
+    return section1 < section2 ? -1 : (section1 > section2 ? 1 : 0);
+}
+
+/* Read and deal with just the games that the index in index_file
+ * shows to reach a position of interest (--useposindex).
+ * The first input file has already been opened by open_first_file.
+ * Return FALSE, having read nothing, if the index cannot be used,
+ * in which case every game must be read.
+ */
+Boolean
+process_games_with_position_index(const char *index_file)
+{
+    const char *reason = NULL;
+    PositionIndex index;
+    uint32_t *sections = NULL;
+    size_t num_found = 0, max_found = 0;
+    size_t kept, k;
+    /* The number of games in the sections before next_section. */
+    uint64_t games_before;
+    uint64_t next_section;
+    Boolean ok;
+
+    if (!GlobalState.positional_variations || num_target_keys == 0) {
+        reason = "there are no positions to look up";
+    }
+    else if (fen_patterns_present()) {
+        reason = "FEN patterns cannot be looked up";
+    }
+    else if (GlobalState.non_matching_file != NULL) {
+        reason = "games that do not match are to be output";
+    }
+    else if (GlobalState.check_only) {
+        reason = "every game is to be checked";
+    }
+    else if (GlobalState.build_position_index != NULL) {
+        reason = "an index is being built";
+    }
+    else if (input_file_name(0) == NULL) {
+        reason = "there are no named input files";
+    }
+    if (reason != NULL) {
+        fprintf(GlobalState.logfile,
+                "--useposindex is not used because %s: all the games will be read.\n",
+                reason);
+        return FALSE;
+    }
+
+    index.contents = read_whole_file(index_file, &index.size);
+    if (index.contents == NULL) {
+        fprintf(GlobalState.logfile,
+                "Unable to read the position index %s: all the games will be read.\n",
+                index_file);
+        return FALSE;
+    }
+    if (index.size < sizeof (PositionIndexHeader) || !valid_position_index(&index)) {
+        fprintf(GlobalState.logfile,
+                "%s is not a valid position index: all the games will be read.\n",
+                index_file);
+        release_position_index(&index);
+        return FALSE;
+    }
+    if (!index_describes_input(&index)) {
+        fprintf(GlobalState.logfile,
+                "The position index %s is not of the current input files: all the games will be read.\n",
+                index_file);
+        release_position_index(&index);
+        return FALSE;
+    }
+
+    /* Look up each position once. */
+    qsort((void *) target_keys, num_target_keys, sizeof (*target_keys), compare_keys);
+    ok = TRUE;
+    for (k = 0; k < num_target_keys && ok; k++) {
+        if (k == 0 || target_keys[k] != target_keys[k - 1]) {
+            ok = look_up_position(&index, target_keys[k], &sections, &num_found, &max_found);
+        }
+    }
+    if (!ok) {
+        fprintf(GlobalState.logfile,
+                "%s is not a valid position index: all the games will be read.\n",
+                index_file);
+        if (sections != NULL) {
+            (void) free((void *) sections);
+        }
+        release_position_index(&index);
+        return FALSE;
+    }
+
+    /* Read the sections in the order of the input. */
+    kept = 0;
+    if (num_found > 0) {
+        qsort((void *) sections, num_found, sizeof (*sections), compare_section_numbers);
+        for (k = 0; k < num_found; k++) {
+            if (kept == 0 || sections[k] != sections[kept - 1]) {
+                sections[kept] = sections[k];
+                kept++;
+            }
+        }
+    }
+    if (GlobalState.verbosity > 1) {
+        fprintf(GlobalState.logfile,
+                "The position index %s selects %lu of %lu sections.\n",
+                index_file, (unsigned long) kept,
+                (unsigned long) index.header->num_sections);
+    }
+
+    /* Number the games as if every one of them had been read. */
+    games_before = 0;
+    next_section = 0;
+    terminate_input();
+    for (k = 0; k < kept && !finished_processing(); k++) {
+        const PositionIndexSection *section = &index.sections[sections[k]];
+        unsigned file_number = section->file_number;
+        /* Only the end of the last file is the end of the input. */
+        Boolean end_of_input =
+                section->start + section->length == index.files[file_number].size &&
+                input_file_name(file_number + 1) == NULL;
+
+        for (; next_section < sections[k]; next_section++) {
+            games_before += index.sections[next_section].num_games;
+        }
+        GlobalState.num_games_processed = (unsigned long) games_before;
+        if (open_input_section(file_number, (long) section->start,
+                    (long) section->length, (unsigned long) section->lines_before)) {
+            parse_selected_section(GlobalState.current_file_type, !end_of_input);
+            close_input_section();
+        }
+        else {
+            fprintf(GlobalState.logfile, "Unable to read the PGN file: %s\n",
+                    input_file_name(file_number));
+        }
+    }
+
+    if (!finished_processing()) {
+        /* The remaining games would all have been read. */
+        for (; next_section < index.header->num_sections; next_section++) {
+            games_before += index.sections[next_section].num_games;
+        }
+        GlobalState.num_games_processed = (unsigned long) games_before;
+    }
+
+    if (sections != NULL) {
+        (void) free((void *) sections);
+    }
+    release_position_index(&index);
+    return TRUE;
+}
@@ -0,0 +1,252 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+
+/* A cache of the opening lines of games played from the standard
+ * starting position.
+ *
+ * Most games share their first few moves with many others, so
+ * play_moves looks up each move of a game's main line in a trie of
+ * the move texts already seen. Each node holds the details of its move
+ * as determined by apply_move, and the position it leads to, so that
+ * a cached line needs neither decoding against the board nor playing.
+ * Play on the real board resumes from the deepest cached position.
+ *
+ * A game adds at most one new node to the cache: the move that follows
+ * the longest cached line. So a line enters the cache one move at a
+ * time, as further games share it, rather than every game's moves
+ * being added. When the cache is full, the least recently used line
+ * is shortened to make room. The nodes of a game's line are marked as
+ * used from the deepest back to the root, so a node is never less
+ * recently used than any of its children and the least recently used
+ * node is always a leaf.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "prefixcache.h"
+
+struct PrefixNode {
+    /* The text of the move that leads to this node. */
+    unsigned char move[MAX_MOVE_LEN + 1];
+    /* The details of the move completed by apply_move. */
+    MoveClass class;
+    Col from_col;
+    Rank from_rank;
+    Col to_col;
+    Rank to_rank;
+    Piece piece_to_move;
+    Piece captured_piece;
+    Piece promoted_piece;
+    CheckStatus check_status;
+    Boolean unambiguous;
+    /* The position after the move. */
+    Board board;
+    PrefixNode *parent;
+    /* The first of the moves that have followed this one. */
+    PrefixNode *children;
+    /* The next move that has followed the parent's. */
+    PrefixNode *sibling;
+    /* Neighbours in the order of use. */
+    PrefixNode *more_recent, *less_recent;
+};
+
+/* The starting position. Only its children are used. */
+static PrefixNode root;
+/* The ends of the list of nodes in order of use. */
+static PrefixNode *most_recent = NULL, *least_recent = NULL;
+static unsigned num_nodes = 0;
+
+/* Statistics for --prefixstats. */
+static unsigned long num_lookups = 0;
+static unsigned long num_hits = 0;
+static unsigned long num_added = 0;
+static unsigned long num_evicted = 0;
+
+/* Return the root of the cache, or NULL if it is not in use. */
+PrefixNode *
+prefix_cache_root(void)
+{
+    if (GlobalState.prefix_cache_size == 0) {
+        return NULL;
+    }
+    else {
+        return &root;
+    }
+}
+
+/* Return the node for move following node, or NULL if it
+ * has not been cached.
+ */
+PrefixNode *
+prefix_cache_find(PrefixNode *node, const Move *move)
+{
+    PrefixNode *child = node->children;
+
+    num_lookups++;
+    while (child != NULL &&
+            strcmp((const char *) child->move, (const char *) move->move) != 0) {
+        child = child->sibling;
+    }
+    if (child != NULL) {
+        num_hits++;
+    }
+    return child;
+}
+
+/* Return the position reached by the move of node. */
+const Board *
+prefix_cache_position(const PrefixNode *node)
+{
+    return &node->board;
+}
+
+/* Complete the details of move, as apply_move would, from
+ * those cached in node.
+ */
+void
+prefix_cache_resolve(const PrefixNode *node, Move *move)
+{
+    move->class = node->class;
+    move->from_col = node->from_col;
+    move->from_rank = node->from_rank;
+    move->to_col = node->to_col;
+    move->to_rank = node->to_rank;
+    move->piece_to_move = node->piece_to_move;
+    move->captured_piece = node->captured_piece;
+    move->promoted_piece = node->promoted_piece;
+    move->check_status = node->check_status;
+    move->unambiguous = node->unambiguous;
+}
+
+/* Remove node from the list of nodes in order of use. */
+static void
+unlink_node(PrefixNode *node)
+{
+    if (node->more_recent != NULL) {
+        node->more_recent->less_recent = node->less_recent;
+    }
+    else {
+        most_recent = node->less_recent;
+    }
+    if (node->less_recent != NULL) {
+        node->less_recent->more_recent = node->more_recent;
+    }
+    else {
+        least_recent = node->more_recent;
+    }
+}
+
+/* Add node at the most recent end of the list of nodes in order of use. */
+static void
+link_node(PrefixNode *node)
+{
+    node->more_recent = NULL;
+    node->less_recent = most_recent;
+    if (most_recent != NULL) {
+        most_recent->more_recent = node;
+    }
+    else {
+        least_recent = node;
+    }
+    most_recent = node;
+}
+
+/* Add move, which has been applied to reach board, as a child of parent.
+ * Return the new node, or NULL if there is no room for it.
+ */
+PrefixNode *
+prefix_cache_add(PrefixNode *parent, const Move *move, const Board *board)
+{
+    PrefixNode *node;
+
+    if (num_nodes < GlobalState.prefix_cache_size) {
+        node = (PrefixNode *) malloc_or_die(sizeof (*node));
+        num_nodes++;
+    }
+    else {
+        /* Reuse the least recently used node, unless it is the parent
+         * or, exceptionally, not a leaf.
+         */
+        PrefixNode **link;
+
+        node = least_recent;
+        if (node == NULL || node == parent || node->children != NULL) {
+            return NULL;
+        }
+        unlink_node(node);
+        link = &node->parent->children;
+        while (*link != node) {
+            link = &(*link)->sibling;
+        }
+        *link = node->sibling;
+        num_evicted++;
+    }
+    strcpy((char *) node->move, (const char *) move->move);
+    node->class = move->class;
+    node->from_col = move->from_col;
+    node->from_rank = move->from_rank;
+    node->to_col = move->to_col;
+    node->to_rank = move->to_rank;
+    node->piece_to_move = move->piece_to_move;
+    node->captured_piece = move->captured_piece;
+    node->promoted_piece = move->promoted_piece;
+    node->check_status = move->check_status;
+    node->unambiguous = move->unambiguous;
+    node->board = *board;
+    node->parent = parent;
+    node->children = NULL;
+    node->sibling = parent->children;
+    parent->children = node;
+    link_node(node);
+    num_added++;
+    return node;
+}
+
+/* Mark the line ending at node as the most recently used,
+ * from node back to the root.
+ */
+void
+prefix_cache_touch(PrefixNode *node)
+{
+    while (node != &root) {
+        unlink_node(node);
+        link_node(node);
+        node = node->parent;
+    }
+}
+
+/* Report how well the cache has worked. */
+void
+report_prefix_cache(void)
+{
+    fprintf(GlobalState.logfile,
+            "Opening prefix cache: %lu of %lu moves looked up were found (%.1f%%).\n",
+            num_hits, num_lookups,
+            num_lookups == 0 ? 0.0 : 100.0 * num_hits / num_lookups);
+    fprintf(GlobalState.logfile,
+            "Opening prefix cache: %u of %u positions used, %lu added, %lu evicted.\n",
+            num_nodes, GlobalState.prefix_cache_size, num_added, num_evicted);
+}
@@ -0,0 +1,40 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+
+#ifndef PREFIXCACHE_H
+#define PREFIXCACHE_H
+
+/* A node of the cache of opening lines played from the
+ * standard starting position.
+ */
+typedef struct PrefixNode PrefixNode;
+
+PrefixNode *prefix_cache_root(void);
+PrefixNode *prefix_cache_find(PrefixNode *node, const Move *move);
+const Board *prefix_cache_position(const PrefixNode *node);
+void prefix_cache_resolve(const PrefixNode *node, Move *move);
+PrefixNode *prefix_cache_add(PrefixNode *parent, const Move *move,
+                             const Board *board);
+void prefix_cache_touch(PrefixNode *node);
+void report_prefix_cache(void);
+
+#endif	// PREFIXCACHE_H
@@ -0,0 +1,284 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2021 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* Decide whether any of the positions sought by a positional search
+ * can still be reached in the current game.
+ *
+ * Captured pieces never return and pawns never move backwards, so
+ * once a game's material and pawns fall short of what a target
+ * needs, no later position can match it. Each target records the
+ * fewest pieces of each kind it needs and the squares on which it
+ * needs pawns. A pawn can only reach the squares in the cone in
+ * front of it, widening by one file per rank through captures,
+ * and missing pieces can only be made up by promoting spare pawns.
+ * Once a target is found to be unreachable it is dropped for the
+ * rest of the game.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "reachability.h"
+
+typedef struct ReachabilityTarget {
+    /* The fewest pieces of each kind the target needs. */
+    MaterialKey least;
+    /* The squares on which the target needs pawns, by Colour. */
+    Bitboard pawns[2];
+    /* The number of squares in pawns on each rank or those behind it,
+     * counting ranks from each colour's own side of the board.
+     * See count_pawns_behind.
+     */
+    uint64_t pawns_behind[2];
+} ReachabilityTarget;
+
+/* The pawns of one colour on a board. */
+typedef struct PawnDetails {
+    /* The squares the pawns might reach. */
+    Bitboard cones;
+    /* The number of pawns on each rank or those behind it. */
+    uint64_t pawns_behind;
+} PawnDetails;
+
+/* The top bit of each byte of the pawns_behind counts. */
+#define PAWN_COUNT_GUARD_BITS ((uint64_t) 0x8080808080808080ULL)
+
+static ReachabilityTarget *targets = NULL;
+static unsigned num_targets = 0;
+static unsigned max_targets = 0;
+/* Whether there is a target that can always be reached, such as
+ * one whose position is not known.
+ */
+static Boolean always_reachable = FALSE;
+
+/* The indices of the targets still reachable in the current game. */
+static unsigned *reachable = NULL;
+static unsigned num_reachable = 0;
+
+/* The squares that can be reached by a pawn of each colour from
+ * each square.
+ */
+static Bitboard pawn_cone[2][BOARDSIZE * BOARDSIZE];
+static Boolean pawn_cones_set = FALSE;
+
+static void init_pawn_cones(void);
+static Boolean target_reachable(const ReachabilityTarget *target, const Board *board,
+                                const PawnDetails pawn_details[2]);
+static uint64_t count_pawns_behind(Colour colour, Bitboard pawns);
+
+/* Add a target needing at least the pieces in least and pawns on
+ * the squares in required_pawns, indexed by Colour.
+ * required_pawns may be NULL if no particular squares are needed.
+ */
+void
+add_reachability_target(MaterialKey least, const Bitboard *required_pawns)
+{
+    ReachabilityTarget *target;
+
+    if (least == 0 && (required_pawns == NULL ||
+                (required_pawns[WHITE] | required_pawns[BLACK]) == 0)) {
+        /* Nothing can make this unreachable. */
+        always_reachable = TRUE;
+        return;
+    }
+    if (num_targets == max_targets) {
+        max_targets = max_targets == 0 ? 16 : 2 * max_targets;
+        targets = (ReachabilityTarget *) realloc_or_die((void *) targets,
+                        max_targets * sizeof(*targets));
+        reachable = (unsigned *) realloc_or_die((void *) reachable,
+                        max_targets * sizeof(*reachable));
+    }
+    target = &targets[num_targets];
+    target->least = least;
+    if (required_pawns != NULL) {
+        target->pawns[BLACK] = required_pawns[BLACK];
+        target->pawns[WHITE] = required_pawns[WHITE];
+    }
+    else {
+        target->pawns[BLACK] = target->pawns[WHITE] = 0;
+    }
+    target->pawns_behind[BLACK] = count_pawns_behind(BLACK, target->pawns[BLACK]);
+    target->pawns_behind[WHITE] = count_pawns_behind(WHITE, target->pawns[WHITE]);
+    num_targets++;
+}
+
+/* Make all the targets reachable again at the start of a game. */
+void
+reset_reachable_targets(void)
+{
+    unsigned i;
+    for (i = 0; i < num_targets; i++) {
+        reachable[i] = i;
+    }
+    num_reachable = num_targets;
+}
+
+/* Return TRUE if at least one target can still be reached from board,
+ * dropping those that cannot.
+ * Targets that have already been dropped are not reconsidered.
+ */
+Boolean
+targets_remain_reachable(const Board *board)
+{
+    unsigned i = 0;
+    PawnDetails pawn_details[2];
+    Colour colour;
+
+    if (always_reachable || num_targets == 0 || board->material == MATERIAL_UNKNOWN) {
+        return TRUE;
+    }
+    if (!pawn_cones_set) {
+        init_pawn_cones();
+    }
+    /* Summarise the pawns once for all the targets. */
+    for (colour = BLACK; colour <= WHITE; colour++) {
+        Bitboard pawns = board->pieces[colour][PAWN];
+        Bitboard remaining = pawns;
+        pawn_details[colour].cones = 0;
+        while (remaining != 0) {
+            pawn_details[colour].cones |= pawn_cone[colour][__builtin_ctzll(remaining)];
+            remaining &= remaining - 1;
+        }
+        pawn_details[colour].pawns_behind = count_pawns_behind(colour, pawns);
+    }
+    while (i < num_reachable) {
+        if (target_reachable(&targets[reachable[i]], board, pawn_details)) {
+            i++;
+        }
+        else {
+            /* The order of the targets does not matter. */
+            num_reachable--;
+            reachable[i] = reachable[num_reachable];
+        }
+    }
+    return num_reachable > 0;
+}
+
+/* Return TRUE if target might be reached from board, whose pawns
+ * are summarised in pawn_details.
+ * Every square on which the target needs a pawn must lie in the cone
+ * of some pawn, and, as pawns only advance, there must be at least as
+ * many pawns as those squares at or behind each rank.
+ * Counts packed with guard bits are compared all at once by subtraction:
+ * a guard bit is left set if there is no borrow from its field.
+ */
+static Boolean
+target_reachable(const ReachabilityTarget *target, const Board *board,
+                 const PawnDetails pawn_details[2])
+{
+    MaterialKey material = board->material;
+    Colour colour;
+
+    if ((((material | MATERIAL_GUARD_BITS) - target->least) & MATERIAL_GUARD_BITS) !=
+            MATERIAL_GUARD_BITS) {
+        /* Some pieces are missing. */
+        for (colour = BLACK; colour <= WHITE; colour++) {
+            unsigned pawns = MATERIAL_COUNT(material, colour, PAWN);
+            unsigned least_pawns = MATERIAL_COUNT(target->least, colour, PAWN);
+            unsigned missing = 0;
+            Piece piece;
+
+            if (pawns < least_pawns) {
+                return FALSE;
+            }
+            for (piece = KNIGHT; piece <= QUEEN; piece++) {
+                unsigned count = MATERIAL_COUNT(material, colour, piece);
+                unsigned least = MATERIAL_COUNT(target->least, colour, piece);
+                if (count < least) {
+                    missing += least - count;
+                }
+            }
+            /* Missing pieces must come from promoting pawns that are not needed. */
+            if (missing > pawns - least_pawns) {
+                return FALSE;
+            }
+        }
+    }
+    for (colour = BLACK; colour <= WHITE; colour++) {
+        if ((target->pawns[colour] & ~pawn_details[colour].cones) != 0) {
+            return FALSE;
+        }
+        if ((((pawn_details[colour].pawns_behind | PAWN_COUNT_GUARD_BITS) -
+                    target->pawns_behind[colour]) & PAWN_COUNT_GUARD_BITS) !=
+                PAWN_COUNT_GUARD_BITS) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Return the number of pawns on each rank or behind it, one byte
+ * per rank, counting ranks from colour's own side of the board.
+ */
+static uint64_t
+count_pawns_behind(Colour colour, Bitboard pawns)
+{
+    unsigned counts[BOARDSIZE] = { 0 };
+    uint64_t pawns_behind = 0;
+    unsigned total = 0;
+    int rank;
+
+    while (pawns != 0) {
+        rank = __builtin_ctzll(pawns) / BOARDSIZE;
+        if (colour == BLACK) {
+            rank = BOARDSIZE - 1 - rank;
+        }
+        counts[rank]++;
+        pawns &= pawns - 1;
+    }
+    for (rank = 0; rank < BOARDSIZE; rank++) {
+        total += counts[rank];
+        pawns_behind |= ((uint64_t) total) << (rank * 8);
+    }
+    return pawns_behind;
+}
+
+/* Set the squares reachable by a pawn from each square:
+ * the square itself and, on each rank ahead, the files within
+ * that many of its own.
+ */
+static void
+init_pawn_cones(void)
+{
+    int square;
+    for (square = 0; square < BOARDSIZE * BOARDSIZE; square++) {
+        int rank = square / BOARDSIZE;
+        int file = square % BOARDSIZE;
+        int r, f;
+        pawn_cone[WHITE][square] = pawn_cone[BLACK][square] = 0;
+        for (r = 0; r < BOARDSIZE; r++) {
+            for (f = 0; f < BOARDSIZE; f++) {
+                Bitboard bit = ((Bitboard) 1) << (r * BOARDSIZE + f);
+                int distance = f > file ? f - file : file - f;
+                if (r >= rank && r - rank >= distance) {
+                    pawn_cone[WHITE][square] |= bit;
+                }
+                if (r <= rank && rank - r >= distance) {
+                    pawn_cone[BLACK][square] |= bit;
+                }
+            }
+        }
+    }
+    pawn_cones_set = TRUE;
+}
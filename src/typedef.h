@@ -111,6 +111,11 @@ typedef struct move {
     Piece promoted_piece;
     /* Whether this move gives check. */
     CheckStatus check_status;
+    /* Set by determine_move_details when no other piece of the same
+     * kind could legally reach the destination, so that rewrite_SAN_string
+     * can compose the SAN without generating the alternatives again.
+     */
+    Boolean unambiguous;
     /* An EPD representation of the board immediately before this move
      * has been played.
      */
@@ -178,6 +183,37 @@ typedef struct {
     unsigned long start_line, end_line;
 } Game;
 
+/* The outcome of dealing with a game in a worker process.
+ * This holds what the parent process needs in order to act upon
+ * it once the outcomes of all previous games have been dealt with.
+ */
+typedef struct {
+    /* Whether the game satisfied the selection criteria. */
+    Boolean wanted;
+    /* Whether the game may be written to the non-matching file. */
+    Boolean non_matching_ok;
+    unsigned plycount;
+    /* The offset in the input file of the line on which the game
+     * starts, or -1 if it is not known.
+     */
+    long start_offset;
+    /* The game's hash values, for duplicate detection. */
+    HashCode final_hash_value;
+    HashCode cumulative_hash_value;
+    HashCode fuzzy_duplicate_hash;
+    /* The game's ECO tag, for -E, or NULL. */
+    char *eco;
+    /* The game's details, as written by report_details, if required. */
+    char *details;
+    /* The formatted game, if it might be output, or NULL. */
+    char *text;
+    size_t text_length;
+    /* Messages logged while preparing text, to be logged only
+     * if it is output.
+     */
+    char *output_messages;
+} GameOutcome;
+
 /* Define a type to distinguish between CHECK files, NORMAL files,
  * and ECO files.
  * CHECKFILEs are those whose contents are not output.
@@ -286,6 +322,10 @@ typedef struct {
     Boolean output_evaluation;
     /* Whether to keep games which have incorrect moves. */
     Boolean keep_broken_games;
+    /* Whether to leave the rest of the moves of a game unchecked
+     * once it has been rejected.
+     */
+    Boolean skip_rejected_moves;
     /* Whether to suppress irrelevant ep info in EPD and FEN output. */
     Boolean suppress_redundant_ep_info;
     /* Whether the output should be in JSON format. */
@@ -372,6 +412,16 @@ typedef struct {
      * 0 => no limit.
      */
     unsigned split_depth_limit;
+    /* The number of worker processes to use (--threads).
+     * 0 or 1 => process the games serially.
+     */
+    unsigned num_threads;
+    /* The number of positions in the opening prefix cache (--prefixcache).
+     * 0 => no cache.
+     */
+    unsigned prefix_cache_size;
+    /* Whether to report on the opening prefix cache (--prefixstats). */
+    Boolean report_prefix_cache;
     /* Whether this is a CHECKFILE or a NORMALFILE. */
     SourceFileType current_file_type;
     /* Whether SETUP_TAGs are ok in extracted games. */
@@ -391,6 +441,18 @@ typedef struct {
     const char *current_input_file;
     /* File of ECO lines. */
     const char *eco_file;
+    /* File caching the table built from eco_file (--ecocache). */
+    const char *eco_cache_file;
+    /* File of the hash values of games from earlier runs (--dupdb). */
+    const char *duplicate_database;
+    /* File in which to build an index of the positions reached
+     * by the games of the input files (--buildposindex).
+     */
+    const char *build_position_index;
+    /* Index used to select the games to be read (--useposindex). */
+    const char *use_position_index;
+    /* Index of where the games of the input files start (--gameindex). */
+    const char *game_index;
     /* Where to write the extracted games. */
     FILE *outputfile;
     /* Output file name. */
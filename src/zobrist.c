@@ -568,61 +568,25 @@ generate_zobrist_hash_from_fen(const char *fen)
     }
 }
 
-/* Generate a Zobrist hash value from the Board passed as argument. */
+/* Return the hash value for coloured_piece on the given square,
+ * numbered from 0 (a1) to 63 (h8).
+ */
 uint64_t
-generate_zobrist_hash_from_board(const Board *board)
+zobrist_piece_key(Piece coloured_piece, int square)
 {
-    uint64_t hash = 0;
+    /* The pieces of FEN_pieces are in Piece order, Black before White. */
+    int piece_id = 2 * (EXTRACT_PIECE(coloured_piece) - PAWN) +
+            (EXTRACT_COLOUR(coloured_piece) == WHITE ? 1 : 0);
 
-    /* The board. */
-    /* Attempt to iterate over the board as fast as possible
-     * as it is the main time consumer for this function.
-     */
-    int board_rank_index = RankConvert(FIRSTRANK);
-    for (int r = 0; r < BOARDSIZE; r++, board_rank_index++) {
-        int board_col_index = ColConvert(FIRSTCOL);
-        for (int c = 0; c < BOARDSIZE; c++, board_col_index++) {
-            int piece_id = -1;
-            switch((int) board->board[board_rank_index][board_col_index]) {
-                case B(PAWN):
-                    piece_id = 0; break;
-                case W(PAWN):
-                    piece_id = 1; break;
-                case B(KNIGHT):
-                    piece_id = 2; break;
-                case W(KNIGHT):
-                    piece_id = 3; break;
-                case B(BISHOP):
-                    piece_id = 4; break;
-                case W(BISHOP):
-                    piece_id = 5; break;
-                case B(ROOK):
-                    piece_id = 6; break;
-                case W(ROOK):
-                    piece_id = 7; break;
-                case B(QUEEN):
-                    piece_id = 8; break;
-                case W(QUEEN):
-                    piece_id = 9; break;
-                case B(KING):
-                    piece_id = 10; break;
-                case W(KING):
-                    piece_id = 11; break;
-                case EMPTY:
-                default:
-                    break;
-            }
-            if (piece_id >= 0) {
-		hash ^= piece_section[64 * piece_id + (8 * r) + c];
-            }
-        }
-    }
+    return piece_section[64 * piece_id + square];
+}
 
-    if(board->to_move == WHITE) {
-	hash ^= white_to_move_element[0];
-    }
+/* Return the hash value for the castling rights on board. */
+uint64_t
+zobrist_castling_key(const Board *board)
+{
+    uint64_t hash = 0;
 
-    /* Castling details. */
     /* Chess960 requirements not yet dealt with. */
     if (board->WKingCastle != '\0') {
 	hash ^= castling_section[0];
@@ -636,6 +600,42 @@ generate_zobrist_hash_from_board(const Board *board)
     if (board->BQueenCastle != '\0') {
 	hash ^= castling_section[3];
     }
+    return hash;
+}
+
+/* Set board->zobrist from the pieces and castling rights of board.
+ * Thereafter, make_move keeps it up to date.
+ */
+void
+set_zobrist_hash(Board *board)
+{
+    uint64_t hash = 0;
+
+    int board_rank_index = RankConvert(FIRSTRANK);
+    for (int r = 0; r < BOARDSIZE; r++, board_rank_index++) {
+        int board_col_index = ColConvert(FIRSTCOL);
+        for (int c = 0; c < BOARDSIZE; c++, board_col_index++) {
+            Piece occupant = board->board[board_rank_index][board_col_index];
+
+            if (occupant != EMPTY && occupant != OFF) {
+		hash ^= zobrist_piece_key(occupant, BOARDSIZE * r + c);
+            }
+        }
+    }
+    board->zobrist = hash ^ zobrist_castling_key(board);
+}
+
+/* Generate a Zobrist hash value from the Board passed as argument.
+ * The pieces and castling rights are already in board->zobrist.
+ */
+uint64_t
+generate_zobrist_hash_from_board(const Board *board)
+{
+    uint64_t hash = board->zobrist;
+
+    if(board->to_move == WHITE) {
+	hash ^= white_to_move_element[0];
+    }
 
     /* En passant. */
     if (board->EnPassant) {
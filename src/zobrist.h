@@ -25,5 +25,8 @@
 uint64_t generate_zobrist_hash_from_board(const Board *board);
 uint64_t generate_zobrist_hash_from_fen(const char *fen);
 uint64_t piece_hash(char piece, int rank, int col);
+uint64_t zobrist_piece_key(Piece coloured_piece, int square);
+uint64_t zobrist_castling_key(const Board *board);
+void set_zobrist_hash(Board *board);
 #endif
 